@@ -23,6 +23,8 @@
 #include "dtable_intern.h"
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <ctype.h>
 #include <math.h>
 
@@ -34,6 +36,12 @@
 
 /* safe storing of doubles */
 #include <safe_double.h>
+
+/* fast conversions of doubles from and to text */
+#include <fast_double.h>
+
+/* vectorized loops for the simple operations */
+#include <kernels.h>
 /* End of internal files */
 
 
@@ -48,7 +56,9 @@
 
 typedef struct {
    long num_cols, num_rows; /* the dimensions */
-   double **ptr; /* the data */
+   double **ptr; /* the rows */
+   double *data; /* the data, one row after the other */
+   bool viewed; /* whether Dvectors were made to read data in place */
 } Dtable;
 
 /* prototypes */
@@ -61,15 +71,51 @@ PRIVATE bool Is_Dtable(VALUE obj) { return is_a_dtable(obj); }
 // i.e., array arr of num_cols W and num_rows H is actually an array of H pointers
 // each pointing to an array of W doubles.
 // access row i and col j as arr[i][j] in c, as arr[i,j] in Ruby.
+// The rows follow each other in a single block of W*H doubles, aligned
+// on DTABLE_ALIGNMENT bytes, so that whole-table operations can go
+// through it linearly (see Dtable_Data).
+
+#define DTABLE_ALIGNMENT 64
+
+/* The garbage collector is told about the size of the entries, so that
+   it runs often enough when large Dtables are created one after the
+   other */
+static void Adjust2dGridUsage(long size) {
+#ifdef HAVE_RB_GC_ADJUST_MEMORY_USAGE
+   rb_gc_adjust_memory_usage(size * (long) sizeof(double));
+#endif
+}
 
-static void Alloc2dGrid(double ***f, int num_cols, int num_rows) {
+static void Free2dGrid(double **f, double *data, long size) {
+   free(f);
+   free(data);
+   if (data) Adjust2dGridUsage(-size);
+}
+
+/* The entries are only set to 0 if clear is true */
+static void Alloc2dGrid(double ***f, double **data, int num_cols, int num_rows,
+                        bool clear) {
    int i;
-   if ((*f = (double **) calloc(num_rows, sizeof(double *)))==NULL)
+   size_t size = (size_t) num_cols * num_rows;
+   if (size / num_rows != (size_t) num_cols || size > SIZE_MAX / sizeof(double))
+      rb_raise(rb_eArgError, "Memory allocation error in \"Alloc2dGrid\"");
+#ifdef HAVE_POSIX_MEMALIGN
+   if (posix_memalign((void **) data, DTABLE_ALIGNMENT, size * sizeof(double)))
+      *data = NULL;
+#else
+   *data = (double *) malloc(size * sizeof(double));
+#endif
+   if (*data == NULL)
+      rb_raise(rb_eArgError, "Memory allocation error in \"Alloc2dGrid\"");
+   if ((*f = (double **) malloc(num_rows * sizeof(double *)))==NULL) {
+      free(*data);
+      *data = NULL;
       rb_raise(rb_eArgError, "Memory allocation error in \"Alloc2dGrid\"");
-   for (i = 0; i < num_rows; i++) {
-      if (((*f)[i] = (double *) calloc(num_cols ,sizeof(double)))==NULL)
-         rb_raise(rb_eArgError, "Memory allocation error in \"Alloc2dGrid\"");
    }
+   if (clear) memset(*data, 0, size * sizeof(double));
+   for (i = 0; i < num_rows; i++)
+      (*f)[i] = *data + (size_t) i * num_cols;
+   Adjust2dGridUsage(size);
 }
 
 static double Max2dGrid(double **f, int num_cols, int num_rows) {
@@ -144,13 +190,22 @@ double **Dtable_Ptr(VALUE dtable, long *num_cols, long *num_rows) {
    return d->ptr;
    }
 
+/* The entries of the Dtable, one row after the other: entry [i,j] is at
+   i * num_cols + j. These are the same doubles as those of Dtable_Ptr. */
+double *Dtable_Data(VALUE dtable, long *num_cols, long *num_rows) {
+   Dtable *d;
+   Data_Get_Struct(dtable, Dtable, d);
+   if(num_cols)
+     *num_cols = d->num_cols;
+   if(num_rows)
+     *num_rows = d->num_rows;
+   return d->data;
+   }
+
 static VALUE cDtable; /* the Dtable class object */
 
 static void dtable_free(Dtable *d) {
-   double **array = d->ptr;
-   int i;
-   for (i = 0; i < d->num_rows; i++) free(array[i]);
-   free(array);
+   Free2dGrid(d->ptr, d->data, d->num_cols * d->num_rows);
    free(d);
 }
 
@@ -159,19 +214,34 @@ static VALUE dtable_alloc(VALUE klass) {
    VALUE ary = Data_Make_Struct(klass, Dtable, NULL, dtable_free, d);
    d->num_cols = d->num_rows = 0;
    d->ptr = NULL;
+   d->data = NULL;
+   d->viewed = false;
    return ary;
 }
 
-static VALUE dtable_init(VALUE ary, int num_cols, int num_rows) {
+/* Gives the dimensions to a Dtable. The entries are set to 0 unless
+   clear is false, for the functions that set them all anyway */
+static VALUE dtable_init2(VALUE ary, int num_cols, int num_rows, bool clear) {
    Dtable *d = Get_Dtable(ary);
    if (num_cols <= 0 || num_rows <= 0)
       rb_raise(rb_eArgError, "bad args: Dtable.new(%d, %d)", num_cols, num_rows);
-   Alloc2dGrid(&d->ptr, num_cols, num_rows);
+   /* the row views read the old entries until they are collected */
+   if (d->viewed)
+      rb_raise(rb_eRuntimeError, "can't reinitialize a Dtable whose rows are viewed");
+   Free2dGrid(d->ptr, d->data, d->num_cols * d->num_rows);
+   d->ptr = NULL;
+   d->data = NULL;
+   d->num_cols = d->num_rows = 0;
+   Alloc2dGrid(&d->ptr, &d->data, num_cols, num_rows, clear);
    d->num_cols = num_cols;
    d->num_rows = num_rows;
    return ary;
 }
 
+static VALUE dtable_init(VALUE ary, int num_cols, int num_rows) {
+   return dtable_init2(ary, num_cols, num_rows, true);
+}
+
 PRIVATE
 /*
  *  call-seq:
@@ -182,16 +252,10 @@ PRIVATE
  */ 
 VALUE dtable_dup(VALUE ary) {
    Dtable *d = Get_Dtable(ary);
-   int i, j, num_cols = d->num_cols, num_rows = d->num_rows;
-   VALUE new = dtable_init(dtable_alloc(cDtable), num_cols, num_rows);
+   int num_cols = d->num_cols, num_rows = d->num_rows;
+   VALUE new = dtable_init2(dtable_alloc(cDtable), num_cols, num_rows, false);
    Dtable *d2 = Get_Dtable(new);
-   double **src, **dest;
-   src = d->ptr; dest = d2->ptr;
-   for (i = 0; i < num_rows; i++) {
-      for (j = 0; j < num_cols; j++) {
-         dest[i][j] = src[i][j];
-      }
-   }
+   MEMCPY(d2->data, d->data, double, (long) num_rows * num_cols);
    return new;
 }
 
@@ -204,17 +268,133 @@ PRIVATE
  */ VALUE dtable_reverse_rows(VALUE ary)
 {
    Dtable *d = Get_Dtable(ary);
-   int i, j, num_cols = d->num_cols, num_rows = d->num_rows, last_row = num_rows - 1;
-   VALUE new = dtable_init(dtable_alloc(cDtable), num_cols, num_rows);
+   int i, num_cols = d->num_cols, num_rows = d->num_rows, last_row = num_rows - 1;
+   VALUE new = dtable_init2(dtable_alloc(cDtable), num_cols, num_rows, false);
    Dtable *d2 = Get_Dtable(new);
-   double **src, **dest;
-   src = d->ptr; dest = d2->ptr;
-   for (i = 0; i < num_rows; i++) {
+   for (i = 0; i < num_rows; i++)
+      MEMCPY(d2->ptr[last_row-i], d->ptr[i], double, num_cols);
+   return new;
+}
+
+/* Transposition and rotations go through the entries by tiles of
+   DTABLE_TILE x DTABLE_TILE, so that both the rows read and the rows
+   written stay in the cache. */
+
+#define DTABLE_TILE 32
+
+/* Copies the entry [i,j] of src, which has num_rows rows of num_cols
+   entries, to dest[j',i'], where dest has num_cols rows of num_rows
+   entries, i' is i, or num_rows - 1 - i if flip_rows, and j' is j,
+   or num_cols - 1 - j if flip_cols */
+static void tiled_transpose(const double *src, double *dest, long num_cols,
+                            long num_rows, bool flip_rows, bool flip_cols) {
+   long i0, j0, i1, j1, i, j, di, dj;
+   for (i0 = 0; i0 < num_rows; i0 += DTABLE_TILE) {
+      i1 = MIN(i0 + DTABLE_TILE, num_rows);
+      for (j0 = 0; j0 < num_cols; j0 += DTABLE_TILE) {
+         j1 = MIN(j0 + DTABLE_TILE, num_cols);
+         for (i = i0; i < i1; i++) {
+            const double *row = src + i * num_cols;
+            di = flip_rows ? num_rows - 1 - i : i;
+            for (j = j0; j < j1; j++) {
+               dj = flip_cols ? num_cols - 1 - j : j;
+               dest[dj * num_rows + di] = row[j];
+            }
+         }
+      }
+   }
+}
+
+/* Transposes a square block of n x n entries in place, swapping the
+   tiles on each side of the diagonal */
+static void tiled_transpose_square(double *a, long n) {
+   long i0, j0, i1, j1, i, j;
+   double tmp;
+   for (i0 = 0; i0 < n; i0 += DTABLE_TILE) {
+      i1 = MIN(i0 + DTABLE_TILE, n);
+      for (j0 = i0; j0 < n; j0 += DTABLE_TILE) {
+         j1 = MIN(j0 + DTABLE_TILE, n);
+         for (i = i0; i < i1; i++) {
+            for (j = (j0 == i0 ? i + 1 : j0); j < j1; j++) {
+               tmp = a[i * n + j];
+               a[i * n + j] = a[j * n + i];
+               a[j * n + i] = tmp;
+            }
+         }
+      }
+   }
+}
+
+/* Transposes num_rows rows of num_cols entries in place by following
+   the cycles of the permutation, with one bit per entry in done (which
+   must be cleared) to remember the entries already moved */
+static void cycle_transpose(double *a, long num_cols, long num_rows,
+                            unsigned char *done) {
+   long n = num_cols * num_rows, start, k, next;
+   double val, tmp;
+   for (start = 1; start < n - 1; start++) {
+      if (done[start >> 3] & (1 << (start & 7))) continue;
+      val = a[start];
+      k = start;
+      do {
+         /* the entry at k = i * num_cols + j goes to j * num_rows + i */
+         next = (k % num_cols) * num_rows + k / num_cols;
+         tmp = a[next];
+         a[next] = val;
+         val = tmp;
+         done[next >> 3] |= 1 << (next & 7);
+         k = next;
+      } while (k != start);
+   }
+}
+
+/* Transposes the entries of d in place, and exchanges its dimensions */
+static void transpose_in_place(Dtable *d) {
+   long num_cols = d->num_cols, num_rows = d->num_rows, i;
+   double **ptr;
+   unsigned char *done;
+   if (num_cols == num_rows) {
+      tiled_transpose_square(d->data, num_cols);
+      return;
+   }
+   /* Everything is allocated first, so that nothing changes on failure */
+   if ((ptr = (double **) malloc(num_cols * sizeof(double *))) == NULL)
+      rb_raise(rb_eArgError, "Memory allocation error in \"transpose!\"");
+   if ((done = (unsigned char *) calloc(num_cols * num_rows / 8 + 1, 1)) == NULL) {
+      free(ptr);
+      rb_raise(rb_eArgError, "Memory allocation error in \"transpose!\"");
+   }
+   cycle_transpose(d->data, num_cols, num_rows, done);
+   free(done);
+   free(d->ptr);
+   d->ptr = ptr;
+   d->num_cols = num_rows;
+   d->num_rows = num_cols;
+   for (i = 0; i < num_cols; i++)
+      d->ptr[i] = d->data + i * num_rows;
+}
+
+static void reverse_rows_in_place(Dtable *d) {
+   long i, j, num_cols = d->num_cols, last_row = d->num_rows - 1;
+   double tmp, *a, *b;
+   for (i = 0; i < last_row - i; i++) {
+      a = d->ptr[i];
+      b = d->ptr[last_row - i];
       for (j = 0; j < num_cols; j++) {
-         dest[last_row-i][j] = src[i][j];
+         tmp = a[j]; a[j] = b[j]; b[j] = tmp;
+      }
+   }
+}
+
+static void reverse_cols_in_place(Dtable *d) {
+   long i, j, last_col = d->num_cols - 1;
+   double tmp, *a;
+   for (i = 0; i < d->num_rows; i++) {
+      a = d->ptr[i];
+      for (j = 0; j < last_col - j; j++) {
+         tmp = a[j]; a[j] = a[last_col - j]; a[last_col - j] = tmp;
       }
    }
-   return new;
 }
 
 PRIVATE
@@ -227,7 +407,7 @@ PRIVATE
 {
    Dtable *d = Get_Dtable(ary);
    int i, j, num_cols = d->num_cols, num_rows = d->num_rows, last_col = num_cols - 1;
-   VALUE new = dtable_init(dtable_alloc(cDtable), num_cols, num_rows);
+   VALUE new = dtable_init2(dtable_alloc(cDtable), num_cols, num_rows, false);
    Dtable *d2 = Get_Dtable(new);
    double **src, **dest;
    src = d->ptr; dest = d2->ptr;
@@ -239,6 +419,29 @@ PRIVATE
    return new;
 }
 
+PRIVATE
+/*
+ *  call-seq:
+ *     dtable.reverse_rows!  -> dtable
+ *  
+ *  Reverses the order of the rows of _dtable_ in place.
+ */ VALUE dtable_reverse_rows_bang(VALUE ary)
+{
+   reverse_rows_in_place(Get_Dtable(ary));
+   return ary;
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     dtable.reverse_cols!  -> dtable
+ *  
+ *  Reverses the order of the columns of _dtable_ in place.
+ */ VALUE dtable_reverse_cols_bang(VALUE ary)
+{
+   reverse_cols_in_place(Get_Dtable(ary));
+   return ary;
+}
 
 PRIVATE
 /*
@@ -249,19 +452,25 @@ PRIVATE
  */ VALUE dtable_rotate_cw90(VALUE ary)
 {
    Dtable *d = Get_Dtable(ary);
-   int i, j, num_cols = d->num_cols, num_rows = d->num_rows, last_row = num_rows - 1;
-   VALUE new = dtable_init(dtable_alloc(cDtable), num_rows, num_cols);
-   Dtable *d2 = Get_Dtable(new);
-   double **src, **dest;
-   src = d->ptr; dest = d2->ptr;
-   for (i = 0; i < num_rows; i++) {
-      for (j = 0; j < num_cols; j++) {
-         dest[j][last_row-i] = src[i][j];
-      }
-   }
+   VALUE new = dtable_init2(dtable_alloc(cDtable), d->num_rows, d->num_cols, false);
+   tiled_transpose(d->data, Get_Dtable(new)->data, d->num_cols, d->num_rows,
+                   true, false);
    return new;
 }
 
+PRIVATE
+/*
+ *  call-seq:
+ *     dtable.rotate_cw90!  -> dtable
+ *  
+ *  Rotates _dtable_ 90 degrees clockwise in place.
+ */ VALUE dtable_rotate_cw90_bang(VALUE ary)
+{
+   Dtable *d = Get_Dtable(ary);
+   transpose_in_place(d);
+   reverse_cols_in_place(d);
+   return ary;
+}
 
 PRIVATE
 /*
@@ -272,19 +481,26 @@ PRIVATE
  */ VALUE dtable_rotate_ccw90(VALUE ary)
 {
    Dtable *d = Get_Dtable(ary);
-   int i, j, num_cols = d->num_cols, num_rows = d->num_rows, last_col = num_cols - 1;
-   VALUE new = dtable_init(dtable_alloc(cDtable), num_rows, num_cols);
-   Dtable *d2 = Get_Dtable(new);
-   double **src, **dest;
-   src = d->ptr; dest = d2->ptr;
-   for (i = 0; i < num_rows; i++) {
-      for (j = 0; j < num_cols; j++) {
-         dest[last_col-j][i] = src[i][j];
-      }
-   }
+   VALUE new = dtable_init2(dtable_alloc(cDtable), d->num_rows, d->num_cols, false);
+   tiled_transpose(d->data, Get_Dtable(new)->data, d->num_cols, d->num_rows,
+                   false, true);
    return new;
 }
 
+PRIVATE
+/*
+ *  call-seq:
+ *     dtable.rotate_ccw90!  -> dtable
+ *  
+ *  Rotates _dtable_ 90 degrees counter-clockwise in place.
+ */ VALUE dtable_rotate_ccw90_bang(VALUE ary)
+{
+   Dtable *d = Get_Dtable(ary);
+   transpose_in_place(d);
+   reverse_rows_in_place(d);
+   return ary;
+}
+
 PRIVATE
 /*
  *  call-seq:
@@ -293,19 +509,26 @@ PRIVATE
  *  Returns a transposed copy of _dtable_ (i.e., exchange rows and columns).
  */ VALUE dtable_transpose(VALUE ary) {
    Dtable *d = Get_Dtable(ary);
-   int i, j, num_cols = d->num_cols, num_rows = d->num_rows;
-   VALUE new = dtable_init(dtable_alloc(cDtable), num_rows, num_cols);
-   Dtable *d2 = Get_Dtable(new);
-   double **src, **dest;
-   src = d->ptr; dest = d2->ptr;
-   for (i = 0; i < num_rows; i++) {
-      for (j = 0; j < num_cols; j++) {
-         dest[j][i] = src[i][j];
-      }
-   }
+   VALUE new = dtable_init2(dtable_alloc(cDtable), d->num_rows, d->num_cols, false);
+   tiled_transpose(d->data, Get_Dtable(new)->data, d->num_cols, d->num_rows,
+                   false, false);
    return new;
 }
 
+PRIVATE
+/*
+ *  call-seq:
+ *     dtable.transpose!  -> dtable
+ *  
+ *  Transposes _dtable_ in place, without allocating a second table:
+ *  square tables are transposed tile by tile, the others by following
+ *  the cycles of the permutation of the entries, which is slower than
+ *  #transpose.
+ */ VALUE dtable_transpose_bang(VALUE ary) {
+   transpose_in_place(Get_Dtable(ary));
+   return ary;
+}
+
 PRIVATE
 /*
  *  call-seq:
@@ -413,6 +636,34 @@ PRIVATE
    return dvec;
 }
 
+PRIVATE
+/*
+ *  call-seq:
+ *     dtable.row_view(int)  -> a_dvec
+ *  
+ *  Returns a Dvector that reads the requested row of _dtable_ in place,
+ *  without copying it: it sees the later changes to the row, and keeps
+ *  _dtable_ alive. The row is only copied the first time the Dvector is
+ *  modified, after which it no longer follows _dtable_.
+ *
+ *     t = Dtable.new(3, 2)
+ *     r = t.row_view(1)
+ *     t[1, 2] = 5
+ *     r                     -> Dvector[ 0, 0, 5 ]
+ *     r[0] = 1
+ *     t[1, 0]               -> 0.0
+ */ VALUE dtable_row_view(VALUE ary, VALUE row_num) {
+   Dtable *d = Get_Dtable(ary);
+   row_num = rb_Integer(row_num);
+   int row = NUM2INT(row_num);
+   if (row < 0 || row >= d->num_rows)
+      rb_raise(rb_eArgError, "Asking for row i = %i from array with only %li rows", row, d->num_rows);
+   VALUE dvec = Dvector_Create();
+   Dvector_Set_View(dvec, ary, d->ptr[row], d->num_cols);
+   d->viewed = true;
+   return dvec;
+}
+
 PRIVATE
 /*
  *  call-seq:
@@ -440,13 +691,17 @@ PRIVATE
  *  call-seq:
  *    dtable.each_row{|row| }
  *
- *  Iterates over all rows and executes the given block
+ *  Iterates over all rows and executes the given block. The rows are
+ *  not copied: the block gets one Dvector, which reads each row in
+ *  place in turn as #row_view does. Use +dup+ to keep a row beyond the
+ *  block.
  */ VALUE dtable_each_row(VALUE ary){
    Dtable *d = Get_Dtable(ary);
    VALUE dvec = Dvector_Create();
-   int i;
+   long i;
+   d->viewed = true;
    for(i=0; i < d->num_rows; i++){
-     Dvector_Data_Replace(dvec, d->num_cols, d->ptr[i]);
+     Dvector_Set_View(dvec, ary, d->ptr[i], d->num_cols);
      rb_yield(dvec);
    }
    return ary;
@@ -488,9 +743,9 @@ PRIVATE
       rb_raise(rb_eArgError, "Asking for column i = %i from array with only %li columns", column, d->num_cols);
    VALUE dvec = Dvector_Create();
    len = d->num_rows;
-   Dvector_Data_Resize(dvec, len);
+   double *col = Dvector_Data_Resize(dvec, len);
    for (i=0; i < len; i++)
-      Dvector_Store_Double(dvec, i, d->ptr[i][column]);
+      col[i] = d->ptr[i][column];
    return dvec;
 }
 
@@ -499,15 +754,18 @@ PRIVATE
  *  call-seq:
  *    dtable.each_column{|col| }
  *
- *  Iterates over all columns and executes the given block
+ *  Iterates over all columns and executes the given block. The block
+ *  gets one Dvector, into which each column is copied in turn.
  */ VALUE dtable_each_column(VALUE ary){
    Dtable *d = Get_Dtable(ary);
    VALUE dvec = Dvector_Create();
-   int i,j;
+   long i,j;
    for(j=0; j < d->num_cols; j++){
-     for(i=0; i < d->num_rows; i++){
-       Dvector_Store_Double(dvec, i, d->ptr[i][j]);
-     }
+     /* the block may have resized the Dvector */
+     double *col = Dvector_Data_Resize(dvec, d->num_rows);
+     double *src = d->data + j;
+     for(i=0; i < d->num_rows; i++, src += d->num_cols)
+       col[i] = *src;
      rb_yield(dvec);
    }
    return ary;
@@ -515,13 +773,10 @@ PRIVATE
 
 static void set_dtable_vals(VALUE ary, double v) {
    Dtable *d = Get_Dtable(ary);
-   int num_cols = d->num_cols, num_rows = d->num_rows, i, j;
-   double **data = d->ptr;
-   for (i = 0; i < num_rows; i++) {
-      for (j = 0; j < num_cols; j++) {
-         data[i][j] = v;
-      }
-   }
+   long len = d->num_cols * d->num_rows, i;
+   double *data = d->data;
+   for (i = 0; i < len; i++)
+      data[i] = v;
 }
 
 PRIVATE
@@ -548,16 +803,11 @@ PRIVATE
    if (is_a_dtable(val)) {
       Dtable *d = Get_Dtable(ary);
       Dtable *d2 = Get_Dtable(val);
-      int num_cols = d->num_cols, num_rows = d->num_rows, i, j;
-      double **data = d->ptr;
-      double **data2 = d2->ptr;
+      int num_cols = d->num_cols, num_rows = d->num_rows;
       if (d2->num_cols != num_cols || d2->num_rows != num_rows)
          rb_raise(rb_eArgError, "Arrays must be same size for Dtable set");
-      for (i = 0; i < num_rows; i++) {
-         for (j = 0; j < num_cols; j++) {
-            data[i][j] = data2[i][j];
-         }
-      }
+      if (d != d2)
+         MEMCPY(d->data, d2->data, double, (long) num_rows * num_cols);
    } else {
       double v = NUM2DBL(val);
       set_dtable_vals(ary, v);
@@ -565,16 +815,89 @@ PRIVATE
    return ary;
 }
 
+static double do_neg(double arg);
+static double do_inv(double arg);
+static double do_safe_sqrt(double x);
+static double do_add(double x, double y);
+static double do_sub(double x, double y);
+static double do_mul(double x, double y);
+static double do_div(double x, double y);
+static double do_mod(double x, double y);
+static double do_trim(double x, double cutoff);
+static double do_safe_inv(double x, double y);
+
+/* The operations that have a vectorized loop in kernels.h use it, and
+   return true */
+static bool kernel_math_op(double *p, long len, double (*op)(double)) {
+   if (op == do_neg) kernel_neg(p, len);
+   else if (op == fabs) kernel_abs(p, len);
+   else if (op == do_inv) kernel_inv(p, len);
+   else if (op == sqrt) kernel_sqrt(p, len);
+   else if (op == do_safe_sqrt) kernel_safe_sqrt(p, len);
+   else if (op == floor) kernel_floor(p, len);
+   else if (op == ceil) kernel_ceil(p, len);
+   else return false;
+   return true;
+}
+
+static bool kernel_math_op1(double *p, long len, double y,
+                            double (*op)(double, double)) {
+   if (op == do_add) kernel_add_scalar(p, len, y);
+   else if (op == do_sub) kernel_sub_scalar(p, len, y);
+   else if (op == do_mul) kernel_mul_scalar(p, len, y);
+   else if (op == do_div) kernel_div_scalar(p, len, y);
+   else if (op == do_mod) kernel_mod_scalar(p, len, y);
+   else if (op == do_trim) kernel_trim(p, len, y);
+   else if (op == do_safe_inv) kernel_safe_inv(p, len, y);
+   else return false;
+   return true;
+}
+
+static bool kernel_math_op2(double *p, const double *q, long len,
+                            double (*op)(double, double)) {
+   if (op == do_add) kernel_add(p, q, len);
+   else if (op == do_sub) kernel_sub(p, q, len);
+   else if (op == do_mul) kernel_mul(p, q, len);
+   else if (op == do_div) kernel_div(p, q, len);
+   else if (op == do_mod) kernel_mod(p, q, len);
+   else return false;
+   return true;
+}
+
+/* The arguments of the element-wise loops, which go through
+   Dvector_Parallel_For over the num_rows * num_cols entries: op for
+   p = op(p), op2 with q for p = op2(p, q), op2 alone for p = op2(p, y) */
+typedef struct {
+   double *p, *q;
+   double y;
+   double (*op)(double);
+   double (*op2)(double, double);
+} math_op_args;
+
+/* Applies the operation to the entries from start to end, which are
+   contiguous */
+static void math_op_task(void *data, long start, long end, int part) {
+   math_op_args *args = (math_op_args *) data;
+   long len = end - start, j;
+   double *p = args->p + start, *q;
+   if (args->op != NULL) {
+      if (!kernel_math_op(p, len, args->op))
+         for (j = 0; j < len; j++) p[j] = (*args->op)(p[j]);
+   }
+   else if (args->q != NULL) {
+      q = args->q + start;
+      if (!kernel_math_op2(p, q, len, args->op2))
+         for (j = 0; j < len; j++) p[j] = (*args->op2)(p[j], q[j]);
+   }
+   else if (!kernel_math_op1(p, len, args->y, args->op2))
+      for (j = 0; j < len; j++) p[j] = (*args->op2)(p[j], args->y);
+}
+
 PRIVATE
 VALUE dtable_apply_math_op_bang(VALUE ary, double (*op)(double)) {
    Dtable *d = Get_Dtable(ary);
-   double **p = d->ptr;
-   int num_cols = d->num_cols, num_rows = d->num_rows, i, j;
-      for (i = 0; i < num_rows; i++) {
-         for (j = 0; j < num_cols; j++) {
-         p[i][j] = (*op)(p[i][j]);
-      }
-   }
+   math_op_args args = { d->data, NULL, 0.0, op, NULL };
+   Dvector_Parallel_For((long) d->num_rows * d->num_cols, math_op_task, &args);
    return ary;
 }
 
@@ -1061,13 +1384,8 @@ PRIVATE
 PRIVATE VALUE dtable_apply_math_op1_bang(VALUE ary, VALUE arg, double (*op)(double, double)) {
    Dtable *d = Get_Dtable(ary);
    arg = rb_Float(arg);
-   double y = NUM2DBL(arg), **p = d->ptr;
-   int num_cols = d->num_cols, num_rows = d->num_rows, i, j;
-      for (i = 0; i < num_rows; i++) {
-         for (j = 0; j < num_cols; j++) {
-         p[i][j] = (*op)(p[i][j], y);
-      }
-   }
+   math_op_args args = { d->data, NULL, NUM2DBL(arg), NULL, op };
+   Dvector_Parallel_For((long) d->num_rows * d->num_cols, math_op_task, &args);
    return ary;
 }
 
@@ -1352,16 +1670,11 @@ PRIVATE VALUE dtable_apply_math_op2_bang(VALUE ary1, VALUE ary2, double (*op)(do
    if (check != Qfalse) { return dtable_apply_math_op1_bang(ary1, ary2, op); }
    Dtable *d1 = Get_Dtable(ary1);
    Dtable *d2 = Get_Dtable(ary2);
-   int num_cols = d1->num_cols, num_rows = d1->num_rows, i, j;
+   int num_cols = d1->num_cols, num_rows = d1->num_rows;
    if (num_cols != d2->num_cols || num_rows != d2->num_rows) 
       rb_raise(rb_eArgError, "Dtable arrays must be same dimension for math operation");
-   double **p1, **p2;
-   p1 = d1->ptr; p2 = d2->ptr;
-   for (i = 0; i < num_rows; i++) {
-      for (j = 0; j < num_cols; j++) {
-         p1[i][j] = (*op)(p1[i][j], p2[i][j]);
-      }
-   }
+   math_op_args args = { d1->data, d2->data, 0.0, NULL, op };
+   Dvector_Parallel_For((long) num_rows * num_cols, math_op_task, &args);
    return ary1;
 }
 
@@ -1583,7 +1896,7 @@ PRIVATE
       }
    }
    
-   // rewrite to use strtod instead of fscanf to deal with numbers from fortran like 0.501-129 for 0.501E-129
+   // fast_strtod reads the numbers from fortran like 0.501-129 for 0.501E-129
    
    for (i = 0; i < num_rows; i++) {
       data = ptr[i];
@@ -1600,13 +1913,7 @@ PRIVATE
             *p++ = c;
          }
          *p = ' ';
-         data[j] = strtod(buff,&pend);
-         if (pend != p) { // need to check to see if have a number like 0.501-129
-            if (pend[0] == '+' || pend[0] == '-') { // insert 'E' and try again
-                pend[5] = ' '; pend[4] = pend[3]; pend[3] = pend[2]; pend[2] = pend[1]; pend[1] = pend[0]; pend[0] = 'E';
-                data[j] = strtod(buff,&pend);
-            }
-         }
+         data[j] = fast_strtod(buff, &pend, FAST_DOUBLE_FORTRAN);
          if (!is_okay_number(data[j])) {
             fclose(file);
             len = (pend-buff < err_len-1)? pend-buff : err_len-1;
@@ -1687,7 +1994,9 @@ VALUE dtable_aset(VALUE ary, VALUE xloc, VALUE yloc, VALUE val) {
    return val;
 }
 
-#define DTABLE_DUMP_VERSION 1
+/* Version 1 stored the dimensions on 4 bytes, version 2 on 8, after a
+   byte giving the byte order of the doubles */
+#define DTABLE_DUMP_VERSION 2
 
 PRIVATE
 /*
@@ -1696,37 +2005,21 @@ PRIVATE
  */
 VALUE dtable_dump(VALUE ary, VALUE limit)
 {
-  int i; /* for STORE_UNSIGNED */
   long rows, cols;
-  long x, y;
-  double ** data = Dtable_Ptr(ary, &cols, &rows);
-  double * col;
+  double * data = Dtable_Data(ary, &cols, &rows);
   long target_len = 1 /* first signature byte */
-    + 8 /* 2 * length */
+    + 1 /* byte order */
+    + 16 /* 2 * length */
     + cols * rows * 8 ;
-  unsigned u_len;
-  VALUE str = rb_str_new2("");
-  rb_str_resize(str,target_len); /* This seems to do the trick */
-  /* \begin{playing with ruby's internals} */
+  VALUE str = rb_str_new(NULL, target_len);
   unsigned char * ptr = (unsigned char *) RSTRING_PTR(str);
   /* signature byte */
   (*ptr++) = DTABLE_DUMP_VERSION;
-  u_len = (unsigned) rows; /* limits to 4 billions rows */
-  STORE_UNSIGNED(u_len, ptr); /* destroys u_len */
-  u_len = (unsigned) cols; /* limits to 4 billions columns */
-  STORE_UNSIGNED(u_len, ptr); /* destroys u_len */
-  for(x = 0; x < rows; x++)
-    {
-      col = data[x];
-      for(y = 0; y < cols; y++)
-	{
-	  store_double(*(col++), ptr);
-	  ptr += 8;
-	}
-    }
-  /*  RSTRING_LEN(str) = target_len;*/
+  (*ptr++) = DOUBLES_LITTLE_ENDIAN_TAG;
+  store_length(rows, ptr);
+  store_length(cols, ptr + 8);
+  store_doubles(data, rows * cols, ptr + 16);
   return str;
-  /* \end{playing with ruby's internals} */
 }
 
 PRIVATE
@@ -1742,109 +2035,297 @@ VALUE dtable_load(VALUE klass, VALUE str)
   unsigned char * dest = buf + RSTRING_LEN(s);
   unsigned i; /* for GET_UNSIGNED */
   unsigned tmp = 0;
-  long rows, cols;
-  long x,y;
-  double ** data;
-  double * col;
+  unsigned long long rows, cols;
   /*  depending on the first byte, the decoding will be different */
   switch(*(buf++)) 
     {
     case 1:
+      if(dest - buf < 8)
+	break;
       GET_UNSIGNED(tmp, buf);
       rows = tmp;
       GET_UNSIGNED(tmp, buf);
       cols = tmp;
       /* create a new Dtable with the right size */
-      ret = dtable_init(dtable_alloc(cDtable), cols, rows);
-      data = Dtable_Ptr(ret, NULL, NULL);
-      for(x = 0; x < rows; x++) 
-	{
-	  col = data[x];
-	  for(y = 0; y< cols; y++)
-	    {
-	      if(buf + 8 > dest)
-		{
-		  rb_raise(rb_eRuntimeError, 
-			   "corrupted data given to Dtable._load");
-		  break;
-		}	
-	      else 
-		{
-		  col[y] = get_double(buf);
-		  buf += 8;
-		}
-	    }
-	}
-      break;
-    default:
-      rb_raise(rb_eRuntimeError, "corrupted data given to Dtable._load");
+      if(cols > INT_MAX || rows > INT_MAX ||
+	 (unsigned long long) (dest - buf) / 8 < rows * cols)
+	break;
+      ret = dtable_init2(dtable_alloc(cDtable), cols, rows, false);
+      get_doubles(Dtable_Data(ret, NULL, NULL), rows * cols, buf);
+      return ret;
+    case 2:
+      if(dest - buf < 17 || *buf != DOUBLES_LITTLE_ENDIAN_TAG)
+	break;
+      rows = get_length(buf + 1);
+      cols = get_length(buf + 9);
+      buf += 17;
+      /* the dimensions of a Dtable are ints */
+      if(cols > INT_MAX || rows > INT_MAX ||
+	 (dest - buf) % 8 || (unsigned long long) (dest - buf) / 8 != rows * cols)
+	break;
+      ret = dtable_init2(dtable_alloc(cDtable), cols, rows, false);
+      get_doubles(Dtable_Data(ret, NULL, NULL), rows * cols, buf);
+      return ret;
     }
+  rb_raise(rb_eRuntimeError, "corrupted data given to Dtable._load");
+  return ret;
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     dtable.to_binary   ->  string
+ *
+ *  Returns the entries of _dtable_, row after row, as 8-byte
+ *  little-endian doubles, the format of the Dtables of
+ *  Dvector.write_binary.
+ */
+VALUE dtable_to_binary(VALUE ary)
+{
+  long rows, cols;
+  double * data = Dtable_Data(ary, &cols, &rows);
+  VALUE str = rb_str_new(NULL, rows * cols * 8);
+  store_doubles(data, rows * cols, (unsigned char *) RSTRING_PTR(str));
+  return str;
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     Dtable.from_binary(string, num_cols, num_rows)   ->  a_dtable
+ *
+ *  The reverse of Dtable#to_binary.
+ */
+VALUE dtable_from_binary(VALUE klass, VALUE str, VALUE num_cols, 
+			 VALUE num_rows)
+{
+  long rows = NUM2LONG(num_rows), cols = NUM2LONG(num_cols);
+  VALUE ret;
+  StringValue(str);
+  if(RSTRING_LEN(str) != rows * cols * 8)
+    rb_raise(rb_eArgError, "a %ldx%ld Dtable takes %ld bytes, not %ld", 
+	     cols, rows, rows * cols * 8, (long) RSTRING_LEN(str));
+  ret = dtable_init2(dtable_alloc(klass), cols, rows, false);
+  get_doubles(Dtable_Data(ret, NULL, NULL), rows * cols, 
+	      (const unsigned char *) RSTRING_PTR(str));
   return ret;
 }
 
-/* The following function has been written by Benjamin ter Kuile <bterkuile@gmail.com> */
+/*
+  Resampling for Dtable#interpolate. Along each axis, every point of
+  the result is a weighted sum of taps points of the source (1 for the
+  nearest neighbour, 2 for linear, 4 for cubic interpolation), whose
+  indices and weights are computed once. The entries of the result are
+  then split between the threads.
+*/
+
+enum interpolation_mode {
+   INTERPOLATE_NEAREST = 1,     /* the values are the number of taps */
+   INTERPOLATE_LINEAR = 2,
+   INTERPOLATE_CUBIC = 4
+};
+
+/* Fills index and weight with the taps for the n points start + k * step
+   of an axis whose len source points are src, sorted in increasing
+   order */
+static void interpolation_weights(const double *src, long len, double start,
+                                  double step, long n, int taps,
+                                  long *index, double *weight) {
+   long k, j = 1, l;
+   for (k = 0; k < n; k++, index += taps, weight += taps) {
+      double x = start + k * step, h, t, t2, t3, h00, h10, h01, h11;
+      for (l = 0; l < taps; l++) {
+         index[l] = 0;
+         weight[l] = 0.0;
+      }
+      if (len < 2) {
+         weight[0] = 1.0;
+         continue;
+      }
+      /* The source interval is [src[j-1], src[j]] */
+      while (j < len - 1 && src[j] < x) j++;
+      index[0] = j - 1;
+      h = src[j] - src[j - 1];
+      t = (x - src[j - 1]) / h;
+      switch (taps) {
+      case INTERPOLATE_NEAREST:
+         if (t > 0.5) index[0] = j;
+         weight[0] = 1.0;
+         break;
+      case INTERPOLATE_LINEAR:
+         index[1] = j;
+         weight[0] = 1.0 - t;
+         weight[1] = t;
+         break;
+      case INTERPOLATE_CUBIC:
+         /* A cubic Hermite spline whose slopes at src[j-1] and src[j]
+            are those of the neighbouring points (Catmull-Rom), or of
+            the interval itself at the ends */
+         t2 = t * t;
+         t3 = t2 * t;
+         h00 = 2 * t3 - 3 * t2 + 1;
+         h10 = t3 - 2 * t2 + t;
+         h01 = -2 * t3 + 3 * t2;
+         h11 = t3 - t2;
+         index[0] = index[1] = index[3] = j - 1;
+         index[2] = j;
+         weight[1] = h00;
+         weight[2] = h01;
+         if (j >= 2) {
+            double f = h10 * h / (src[j] - src[j - 2]);
+            index[0] = j - 2;
+            weight[0] = -f;
+            weight[2] += f;
+         }
+         else {
+            weight[1] -= h10;
+            weight[2] += h10;
+         }
+         if (j < len - 1) {
+            double f = h11 * h / (src[j + 1] - src[j - 1]);
+            index[3] = j + 1;
+            weight[3] = f;
+            weight[1] -= f;
+         }
+         else {
+            weight[1] -= h11;
+            weight[2] += h11;
+         }
+         break;
+      }
+   }
+}
+
+typedef struct {
+   double **src;
+   double *dest;
+   long nx;
+   int taps;
+   const long *x_index, *y_index;
+   const double *x_weight, *y_weight;
+} interpolate_args;
+
+/* Computes the entries from start to end of the result, one piece of
+   row at a time */
+static void interpolate_task(void *data, long start, long end, int part) {
+   interpolate_args *args = (interpolate_args *) data;
+   long nx = args->nx, k = start, i, j, last;
+   int taps = args->taps, p, q;
+   while (k < end) {
+      i = k / nx;
+      j = k % nx;
+      last = MIN(nx, j + end - k);
+      const long *yi = args->y_index + i * taps;
+      const double *yw = args->y_weight + i * taps;
+      double *out = args->dest + i * nx;
+      if (taps == INTERPOLATE_NEAREST) {
+         const double *row = args->src[yi[0]];
+         for (; j < last; j++)
+            out[j] = row[args->x_index[j]];
+      }
+      else if (taps == INTERPOLATE_LINEAR) {
+         const double *r0 = args->src[yi[0]], *r1 = args->src[yi[1]];
+         for (; j < last; j++) {
+            const long *xi = args->x_index + 2 * j;
+            const double *xw = args->x_weight + 2 * j;
+            out[j] = yw[0] * (xw[0] * r0[xi[0]] + xw[1] * r0[xi[1]]) +
+               yw[1] * (xw[0] * r1[xi[0]] + xw[1] * r1[xi[1]]);
+         }
+      }
+      else {
+         for (; j < last; j++) {
+            const long *xi = args->x_index + j * taps;
+            const double *xw = args->x_weight + j * taps;
+            double v = 0.0;
+            for (p = 0; p < taps; p++) {
+               const double *row = args->src[yi[p]];
+               double r = 0.0;
+               for (q = 0; q < taps; q++)
+                  r += xw[q] * row[xi[q]];
+               v += yw[p] * r;
+            }
+            out[j] = v;
+         }
+      }
+      k = i * nx + last;
+   }
+}
+
+/* The interpolation function was first written by Benjamin ter Kuile <bterkuile@gmail.com> */
 
 PRIVATE
 /*
  *  call-seq:
  *     dtable.interpolate(Xs, Ys, nx, ny, x_start, x_end, y_start, y_end)  -> a_dtable
+ *     dtable.interpolate(Xs, Ys, nx, ny, x_start, x_end, y_start, y_end, mode)  -> a_dtable
  *  
  *  Returns a copy of _dtable_ with the values interpolated given the proper X and Y axis to create a uniform spaced result in the X- and Y 
  *  direction consisting of nx- and ny values for each direction.
- */ VALUE dtable_interpolate(VALUE ary, VALUE x_vec, VALUE y_vec, VALUE nx_val, VALUE ny_val, VALUE xstart_val, VALUE xend_val, VALUE ystart_val, VALUE yend_val)
+ *  _Xs_ and _Ys_ must be sorted in increasing order, but they need not
+ *  be evenly spaced.
+ *
+ *  _mode_ is one of "linear" (bilinear interpolation, the default),
+ *  "cubic" (bicubic Catmull-Rom splines, adapted to uneven spacing) or
+ *  "nearest" (the nearest neighbour). With Dobjects.num_threads, the
+ *  entries of the result are computed by several threads.
+ */ VALUE dtable_interpolate(int argc, VALUE *argv, VALUE ary)
 {
    Dtable *d = Get_Dtable(ary);
-	int nx = NUM2DBL(rb_Integer(nx_val));
-	int ny = NUM2DBL(rb_Integer(ny_val));
-	int i, j, num_cols = d->num_cols, num_rows = d->num_rows/*, last_row = num_rows - 1*/;
+   int taps = INTERPOLATE_LINEAR;
+   if (argc != 8 && argc != 9)
+      rb_raise(rb_eArgError, "wrong number of arguments (%d for 8 or 9)", argc);
+   if (argc == 9 && RTEST(argv[8])) {
+      VALUE mode = rb_funcall(argv[8], rb_intern("to_s"), 0);
+      const char *m = StringValueCStr(mode);
+      if (!strcmp(m, "nearest")) taps = INTERPOLATE_NEAREST;
+      else if (!strcmp(m, "linear") || !strcmp(m, "bilinear"))
+         taps = INTERPOLATE_LINEAR;
+      else if (!strcmp(m, "cubic") || !strcmp(m, "bicubic"))
+         taps = INTERPOLATE_CUBIC;
+      else
+         rb_raise(rb_eArgError, "unknown interpolation mode: %s", m);
+   }
+	int nx = NUM2INT(rb_Integer(argv[2]));
+	int ny = NUM2INT(rb_Integer(argv[3]));
+	int num_cols = d->num_cols, num_rows = d->num_rows;
 	
    long xsrc_len, ysrc_len;
-   double *xsrc = Dvector_Data_for_Read(x_vec, &xsrc_len);
-   double *ysrc = Dvector_Data_for_Read(y_vec, &ysrc_len);
+   double *xsrc = Dvector_Data_for_Read(argv[0], &xsrc_len);
+   double *ysrc = Dvector_Data_for_Read(argv[1], &ysrc_len);
 	if(xsrc_len != num_cols) rb_raise(rb_eArgError, "Number of x values (%ld) do not match the number of columns (%d)", xsrc_len, num_cols);
 	if(ysrc_len != num_rows) rb_raise(rb_eArgError, "Number of y values (%ld) do not match the number of rows (%d)", ysrc_len, num_rows);
-   VALUE new = dtable_init(dtable_alloc(cDtable), nx, ny);
-   Dtable *d2 = Get_Dtable(new);
-   double **src, **dest;
-	xstart_val = rb_Float(xstart_val);
-	double xstart = NUM2DBL(rb_Float(xstart_val));
+	double xstart = NUM2DBL(rb_Float(argv[4]));
 	if(xstart < xsrc[0]) rb_raise(rb_eArgError, "The start x value %g is smaller than the bound (%g)", xstart, xsrc[0]);
-	double xend = NUM2DBL(rb_Float(xend_val));
+	double xend = NUM2DBL(rb_Float(argv[5]));
 	if(xend > xsrc[xsrc_len-1]) rb_raise(rb_eArgError, "The end x value %g is bigger than the bound (%g)", xend, xsrc[xsrc_len-1]);
-	double ystart = NUM2DBL(rb_Float(ystart_val));
+	double ystart = NUM2DBL(rb_Float(argv[6]));
 	if(ystart < ysrc[0]) rb_raise(rb_eArgError, "The start y value %g is smaller than the bound (%g)", ystart, ysrc[0]);
-	double yend = NUM2DBL(rb_Float(yend_val));
+	double yend = NUM2DBL(rb_Float(argv[7]));
 	if(yend > ysrc[ysrc_len-1]) rb_raise(rb_eArgError, "The end y value %g is bigger than the bound (%g)", yend, ysrc[ysrc_len-1]);
-	double dx = (xend-xstart)/(nx-1);
-	double dy = (yend-ystart)/(ny-1);
-	double xcurrent = xstart;
-	double ycurrent = ystart;
-	double intvalue;
-	int isrc = 1;
-	int jsrc = 1;
-   src = d->ptr; dest = d2->ptr;
-   for (i = 1; i < ny+1; i++) {
-		while(ysrc[isrc] < ycurrent && ycurrent < ysrc[ysrc_len-1]){
-			isrc++;
-		}
-      for (j = 1; j < nx+1; j++) {
-			while(xsrc[jsrc] < xcurrent && xcurrent < xsrc[xsrc_len-1]){
-				jsrc++;
-			}
-			intvalue = (
-				( src[isrc-1][jsrc-1]*(ysrc[isrc]-ycurrent)*(xsrc[jsrc]-xcurrent)) +
-				( src[isrc][jsrc - 1] * (ycurrent - ysrc[isrc - 1]) * (xsrc[jsrc] - xcurrent) ) +
-				( src[isrc - 1][jsrc] * (ysrc[isrc] - ycurrent) * (xcurrent - xsrc[jsrc - 1]) ) +
-				( src[isrc][jsrc] * (ycurrent - ysrc[isrc - 1]) * (xcurrent - xsrc[jsrc - 1]) )
-			);
-			intvalue = intvalue / ( (ysrc[isrc] - ysrc[isrc - 1]) * (xsrc[jsrc] - xsrc[jsrc - 1]) );
-         dest[i-1][j-1] = intvalue;
-			xcurrent += dx;
-      }
-		xcurrent = xstart;
-		jsrc = 1;
-		ycurrent += dy;
-   }
+   VALUE new = dtable_init2(dtable_alloc(cDtable), nx, ny, false);
+	double dx = nx > 1 ? (xend-xstart)/(nx-1) : 0.0;
+	double dy = ny > 1 ? (yend-ystart)/(ny-1) : 0.0;
+
+   interpolate_args args;
+   long *x_index = ALLOC_N(long, (long) nx * taps);
+   long *y_index = ALLOC_N(long, (long) ny * taps);
+   double *x_weight = ALLOC_N(double, (long) nx * taps);
+   double *y_weight = ALLOC_N(double, (long) ny * taps);
+   interpolation_weights(xsrc, xsrc_len, xstart, dx, nx, taps, x_index, x_weight);
+   interpolation_weights(ysrc, ysrc_len, ystart, dy, ny, taps, y_index, y_weight);
+   args.src = d->ptr;
+   args.dest = Get_Dtable(new)->data;
+   args.nx = nx;
+   args.taps = taps;
+   args.x_index = x_index;
+   args.y_index = y_index;
+   args.x_weight = x_weight;
+   args.y_weight = y_weight;
+   Dvector_Parallel_For((long) nx * ny, interpolate_task, &args);
+   free(x_index);
+   free(y_index);
+   free(x_weight);
+   free(y_weight);
    return new;
 }
 
@@ -1906,6 +2387,7 @@ PUBLIC void Init_Dtable() {
    rb_define_method(cDtable, "[]=", dtable_aset, 3);
 
    rb_define_method(cDtable, "row", dtable_row, 1);
+   rb_define_method(cDtable, "row_view", dtable_row_view, 1);
    rb_define_method(cDtable, "column", dtable_column, 1);
    rb_define_method(cDtable, "set_row", dtable_set_row, 2);
    rb_define_method(cDtable, "set_column", dtable_set_column, 2);
@@ -1923,6 +2405,11 @@ PUBLIC void Init_Dtable() {
    rb_define_method(cDtable, "reverse_cols", dtable_reverse_cols, 0);
    rb_define_method(cDtable, "rotate_cw90", dtable_rotate_cw90, 0);
    rb_define_method(cDtable, "rotate_ccw90", dtable_rotate_ccw90, 0);
+   rb_define_method(cDtable, "transpose!", dtable_transpose_bang, 0);
+   rb_define_method(cDtable, "reverse_rows!", dtable_reverse_rows_bang, 0);
+   rb_define_method(cDtable, "reverse_cols!", dtable_reverse_cols_bang, 0);
+   rb_define_method(cDtable, "rotate_cw90!", dtable_rotate_cw90_bang, 0);
+   rb_define_method(cDtable, "rotate_ccw90!", dtable_rotate_ccw90_bang, 0);
    
    /* math operations */
    rb_define_method(cDtable, "add", dtable_add, 1);
@@ -2030,7 +2517,7 @@ PUBLIC void Init_Dtable() {
    rb_define_method(cDtable, "safe_asin!", dtable_safe_asin_bang, 0);
    rb_define_method(cDtable, "safe_acos!", dtable_safe_acos_bang, 0);
 
-   rb_define_method(cDtable, "interpolate", dtable_interpolate, 8);
+   rb_define_method(cDtable, "interpolate", dtable_interpolate, -1);
    rb_define_method(cDtable, "sum", dtable_sum, 0);
    rb_define_method(cDtable, "each_row", dtable_each_row, 0);
    rb_define_method(cDtable, "each_column", dtable_each_column, 0);
@@ -2038,6 +2525,8 @@ PUBLIC void Init_Dtable() {
    /* Marshal : */
    rb_define_method(cDtable, "_dump", dtable_dump, 1);
    rb_define_singleton_method(cDtable, "_load", dtable_load, 1);
+   rb_define_method(cDtable, "to_binary", dtable_to_binary, 0);
+   rb_define_singleton_method(cDtable, "from_binary", dtable_from_binary, 3);
    /* modified by Vincent Fourmond, for splitting out the libraries */
    rb_require("Dobjects/Dtable_extras.rb");
    /* end of modification */
@@ -2047,14 +2536,17 @@ PUBLIC void Init_Dtable() {
    */
    RB_EXPORT_SYMBOL(cDtable, Read_Dtable);
    RB_EXPORT_SYMBOL(cDtable, Dtable_Ptr);
+   RB_EXPORT_SYMBOL(cDtable, Dtable_Data);
 
    /* now we import the symbols from Dvector */
    VALUE cDvector = rb_const_get(mDobjects, rb_intern("Dvector"));
    RB_IMPORT_SYMBOL(cDvector, Dvector_Create);
    RB_IMPORT_SYMBOL(cDvector, Dvector_Data_Resize);
    RB_IMPORT_SYMBOL(cDvector, Dvector_Data_Replace);
+   RB_IMPORT_SYMBOL(cDvector, Dvector_Set_View);
    RB_IMPORT_SYMBOL(cDvector, Dvector_Data_for_Read);
    RB_IMPORT_SYMBOL(cDvector, Dvector_Store_Double);
+   RB_IMPORT_SYMBOL(cDvector, Dvector_Parallel_For);
 
 }
 
@@ -2064,7 +2556,9 @@ PUBLIC void Init_Dtable() {
 IMPLEMENT_SYMBOL(Dvector_Create);
 IMPLEMENT_SYMBOL(Dvector_Data_Resize);
 IMPLEMENT_SYMBOL(Dvector_Data_Replace);
+IMPLEMENT_SYMBOL(Dvector_Set_View);
 IMPLEMENT_SYMBOL(Dvector_Data_for_Read);
 IMPLEMENT_SYMBOL(Dvector_Store_Double);
+IMPLEMENT_SYMBOL(Dvector_Parallel_For);
 
 
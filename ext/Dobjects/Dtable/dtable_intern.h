@@ -32,6 +32,7 @@
 PUBLIC void Init_Dtable();
 PRIVATE VALUE Read_Dtable(VALUE dest, char *filename, int skip_lines);
 PRIVATE double **Dtable_Ptr(VALUE dtable, long *num_cols, long *num_rows);
+PRIVATE double *Dtable_Data(VALUE dtable, long *num_cols, long *num_rows);
 
 PRIVATE bool Is_Dtable(VALUE obj);
 
@@ -46,12 +47,18 @@ PRIVATE VALUE dtable_reverse_rows(VALUE ary);
 PRIVATE VALUE dtable_reverse_cols(VALUE ary);
 PRIVATE VALUE dtable_rotate_cw90(VALUE ary);
 PRIVATE VALUE dtable_rotate_ccw90(VALUE ary);
+PRIVATE VALUE dtable_transpose_bang(VALUE ary);
+PRIVATE VALUE dtable_reverse_rows_bang(VALUE ary);
+PRIVATE VALUE dtable_reverse_cols_bang(VALUE ary);
+PRIVATE VALUE dtable_rotate_cw90_bang(VALUE ary);
+PRIVATE VALUE dtable_rotate_ccw90_bang(VALUE ary);
 PRIVATE VALUE dtable_num_cols(VALUE ary);
 PRIVATE VALUE dtable_num_rows(VALUE ary);
 PRIVATE VALUE dtable_min(VALUE ary);
 PRIVATE VALUE dtable_max(VALUE ary);
 PRIVATE VALUE dtable_minmax(VALUE ary);
 PRIVATE VALUE dtable_row(VALUE ary, VALUE row_num);
+PRIVATE VALUE dtable_row_view(VALUE ary, VALUE row_num);
 PRIVATE VALUE dtable_column(VALUE ary, VALUE column_num);
 PRIVATE VALUE dtable_set_row(VALUE ary, VALUE row_num, VALUE dvec);
 PRIVATE VALUE dtable_set_column(VALUE ary, VALUE col_num, VALUE dvec);
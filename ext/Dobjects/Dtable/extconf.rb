@@ -4,4 +4,15 @@ require 'mkmf'
 # We add include directories
 $INCFLAGS += " -I../../includes -I../Dvector/include"
 
+# Lets the compiler vectorize the sqrt loops of kernels.h; nothing here
+# looks at errno after a math function
+if try_compile("int main() { return 0; }", "-fno-math-errno")
+  $CFLAGS += " -fno-math-errno"
+end
+
+# The entries of the Dtables are aligned for the vectorized loops, and
+# their size is reported to the garbage collector
+have_func("posix_memalign", "stdlib.h")
+have_func("rb_gc_adjust_memory_usage", "ruby.h")
+
 create_makefile 'Dobjects/Dtable'
@@ -31,5 +31,8 @@ DECLARE_SYMBOL(VALUE, Read_Dtable,
 	       (VALUE dest, char *filename, int skip_lines));
 DECLARE_SYMBOL(double **, Dtable_Ptr, 
 	       (VALUE dtable, long *num_cols, long *num_rows));
+/* The same entries as a single block, one row after the other */
+DECLARE_SYMBOL(double *, Dtable_Data, 
+	       (VALUE dtable, long *num_cols, long *num_rows));
 
 #endif
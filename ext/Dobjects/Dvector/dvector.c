@@ -40,8 +40,37 @@
 /* safe storing of doubles */
 #include <safe_double.h>
 
+/* fast conversions of doubles from and to text */
+#include <fast_double.h>
+
+/* vectorized loops for the simple operations */
+#include <kernels.h>
+
 /* End of internal files */
 
+/* The parallel loops need both POSIX threads and a way to release the
+   GVL; without them, everything runs in the calling thread */
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_RUBY_THREAD_H)
+#define DVECTOR_THREADS
+#include <pthread.h>
+#include <ruby/thread.h>
+#endif
+
+/* For Dvector.mmap */
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* fast_fancy_read reads the parts of large files in parallel */
+#ifdef HAVE_PREAD
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#endif
+
 #define is_a_dvector(d) ( TYPE(d) == T_DATA && RDATA(d)->dfree == (RUBY_DATA_FUNC)dvector_free )
 
 #ifndef MAX
@@ -64,6 +93,11 @@ typedef struct {
    int dirty; 	/* set to 1 if data has been modified since the last time
 		   it was cleared
 		*/
+   void *map;     /* if not NULL, the data lives in this file mapping
+                     (see Dvector.mmap), which only a frozen base Dvector
+                     holds */
+   size_t map_len;
+   int map_writable; /* the Dvectors sharing the mapping write to the file */
 } Dvector;
 
 static VALUE dvector_make_shared(VALUE ary);
@@ -78,6 +112,231 @@ static void dvector_splice(VALUE ary, long beg, long len, VALUE rpl);
 static void dvector_mark(Dvector *d);
 static void dvector_free(Dvector *d);
 
+/* Parallel loops
+
+   Dvector_Parallel_For splits the loops over large vectors in
+   contiguous parts. The calling thread releases the GVL and takes its
+   share of the parts, the others going to a pool of worker threads
+   that are started the first time they are needed and then wait for
+   the next loop. The parts only depend on the length and on the
+   number of threads, and element-wise operations give the same results
+   whatever the split. */
+
+#define DVECTOR_MAX_THREADS 256
+
+static int dvector_num_threads = 1;
+static long dvector_parallel_threshold = 100000;
+
+typedef void (*dvector_task)(void *data, long start, long end, int part);
+
+/* Start of the given part; the boundaries fall on multiples of 8
+   elements, so that the parts don't share cache lines */
+static long parallel_part_start(long len, int num_parts, int part)
+{
+   if (part >= num_parts) return len;
+   return (len / num_parts * part) & ~7L;
+}
+
+#ifdef DVECTOR_THREADS
+
+static struct {
+   pthread_mutex_t busy;  /* held by the thread running a loop */
+   pthread_mutex_t lock;  /* protects the rest */
+   pthread_cond_t work;   /* there are parts left to start */
+   pthread_cond_t done;   /* all the parts are finished */
+   int num_workers;
+   bool at_fork;          /* the fork handler is registered */
+   dvector_task task;
+   void *data;
+   long len;
+   int num_parts;
+   int next_part;         /* the first part that nobody took yet */
+   int pending;           /* the parts not finished yet */
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+           PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+/* Runs the parts nobody took yet; pool.lock must be held */
+static void parallel_run_parts(void)
+{
+   while (pool.next_part < pool.num_parts) {
+      int part = pool.next_part++;
+      dvector_task task = pool.task;
+      void *data = pool.data;
+      long start = parallel_part_start(pool.len, pool.num_parts, part),
+         end = parallel_part_start(pool.len, pool.num_parts, part + 1);
+      pthread_mutex_unlock(&pool.lock);
+      task(data, start, end, part);
+      pthread_mutex_lock(&pool.lock);
+      if (--pool.pending == 0) pthread_cond_signal(&pool.done);
+   }
+}
+
+static void *parallel_worker(void *arg)
+{
+   pthread_mutex_lock(&pool.lock);
+   while (1) {
+      while (pool.next_part >= pool.num_parts)
+         pthread_cond_wait(&pool.work, &pool.lock);
+      parallel_run_parts();
+   }
+   return NULL;
+}
+
+/* Runs in the calling thread, without the GVL */
+static void *parallel_wait(void *arg)
+{
+   pthread_mutex_lock(&pool.lock);
+   parallel_run_parts();
+   while (pool.pending > 0)
+      pthread_cond_wait(&pool.done, &pool.lock);
+   pthread_mutex_unlock(&pool.lock);
+   return NULL;
+}
+
+/* The workers don't survive a fork */
+static void parallel_after_fork(void)
+{
+   pthread_mutex_init(&pool.busy, NULL);
+   pthread_mutex_init(&pool.lock, NULL);
+   pthread_cond_init(&pool.work, NULL);
+   pthread_cond_init(&pool.done, NULL);
+   pool.num_workers = 0;
+   pool.num_parts = pool.next_part = pool.pending = 0;
+}
+
+#endif
+
+PRIVATE int Dvector_Parallel_For(long len, dvector_task task, void *data)
+{
+   int num_parts = (len >= dvector_parallel_threshold) ? 
+      dvector_num_threads : 1, part;
+#ifdef DVECTOR_THREADS
+   if (num_parts > 1 && pthread_mutex_trylock(&pool.busy) == 0) {
+      pthread_mutex_lock(&pool.lock);
+      if (!pool.at_fork)
+         pool.at_fork = (pthread_atfork(NULL, NULL, parallel_after_fork) == 0);
+      while (pool.num_workers < num_parts - 1) {
+         pthread_t thread;
+         if (pthread_create(&thread, NULL, parallel_worker, NULL) != 0)
+            break; /* the parts are shared by the threads we have */
+         pthread_detach(thread);
+         pool.num_workers++;
+      }
+      pool.task = task;
+      pool.data = data;
+      pool.len = len;
+      pool.num_parts = pool.pending = num_parts;
+      pool.next_part = 0;
+      pthread_cond_broadcast(&pool.work);
+      pthread_mutex_unlock(&pool.lock);
+      rb_thread_call_without_gvl(parallel_wait, NULL, NULL, NULL);
+      pthread_mutex_unlock(&pool.busy);
+      return num_parts;
+   }
+#endif
+   /* Without threads, or when another Ruby thread is already running
+      a parallel loop, the same parts run one after the other, so that
+      the results don't depend on that */
+   for (part = 0; part < num_parts; part++)
+      task(data, parallel_part_start(len, num_parts, part),
+           parallel_part_start(len, num_parts, part + 1), part);
+   return num_parts;
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     Dobjects.num_threads   ->  int
+ *
+ *  The number of threads used for the operations on large Dvectors
+ *  and Dtables (1 by default). See Dobjects.num_threads=.
+ */
+VALUE dobjects_num_threads(VALUE self) {
+   return INT2FIX(dvector_num_threads);
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     Dobjects.num_threads = int
+ *
+ *  Sets the number of threads used for the element-wise operations
+ *  (<tt>log10!</tt>, <tt>+</tt>, <tt>mul!</tt>...) and for +sum+, +dot+,
+ *  +min+, +max+, +bounds+, Dvector.min_of_many and
+ *  Dvector.max_of_many, on Dvectors and Dtables with at least
+ *  Dobjects.parallel_threshold elements. The Ruby GVL is released while
+ *  they run, so that other Ruby threads carry on; they should not
+ *  modify the vectors in use in the meantime.
+ *
+ *  Element-wise operations give exactly the same results whatever the
+ *  number of threads. +sum+ and +dot+ add up the partial sums of each
+ *  thread, which can change the last bits of the result (but it only
+ *  depends on the number of threads).
+ *
+ *     Dobjects.num_threads = 8
+ *     v = Dvector.new(200_000_000) { |i| i + 1.0 }
+ *     v.log10!                       # on 8 threads
+ */
+VALUE dobjects_set_num_threads(VALUE self, VALUE num) {
+   int n = NUM2INT(num);
+   if (n < 1 || n > DVECTOR_MAX_THREADS)
+      rb_raise(rb_eArgError, "the number of threads must be between 1 and %d",
+               DVECTOR_MAX_THREADS);
+   dvector_num_threads = n;
+   return num;
+}
+
+static VALUE dobjects_restore_num_threads(VALUE num) {
+   dvector_num_threads = FIX2INT(num);
+   return Qnil;
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     Dobjects.with_num_threads(int) { ... }   ->  obj
+ *
+ *  Runs the block with Dobjects.num_threads set to _int_, and returns
+ *  its value. It is the way to use a different number of threads for a
+ *  given call:
+ *
+ *     Dobjects.with_num_threads(1) { v.sum }
+ */
+VALUE dobjects_with_num_threads(VALUE self, VALUE num) {
+   VALUE old = INT2FIX(dvector_num_threads);
+   dobjects_set_num_threads(self, num);
+   return rb_ensure(rb_yield, Qnil, dobjects_restore_num_threads, old);
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     Dobjects.parallel_threshold   ->  int
+ *
+ *  The number of elements from which the operations run on
+ *  several threads (100000 by default).
+ */
+VALUE dobjects_parallel_threshold(VALUE self) {
+   return LONG2NUM(dvector_parallel_threshold);
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     Dobjects.parallel_threshold = int
+ *
+ *  Sets the number of elements from which the operations run on
+ *  several threads (see Dobjects.num_threads=). Below, starting the
+ *  threads costs more than it saves.
+ */
+VALUE dobjects_set_parallel_threshold(VALUE self, VALUE num) {
+   long n = NUM2LONG(num);
+   if (n < 1)
+      rb_raise(rb_eArgError, "the threshold must be positive");
+   dvector_parallel_threshold = n;
+   return num;
+}
+
 #define DVEC_DEFAULT_SIZE 16
 
 PRIVATE bool Is_Dvector(VALUE obj) { return is_a_dvector(obj); }
@@ -107,11 +366,30 @@ static inline void dvector_memfill(double *mem, long size, double val) {
 
 static VALUE cDvector; /* the Dvector class object */
 
+/* Changes the capacity of the buffer of a Dvector that went through
+   dvector_modify. The only buffers still shared at this point are the
+   writable file mappings, which are then copied. */
+static void dvector_realloc(Dvector *d, long capa) {
+   if (d->shared != Qnil) {
+      double *ptr = ALLOC_N(double, capa);
+      MEMCPY(ptr, d->ptr, double, MIN(d->len, capa));
+      d->ptr = ptr;
+      d->shared = Qnil;
+   }
+   else
+      REALLOC_N(d->ptr, double, capa);
+   d->capa = capa;
+}
+
 static void dvector_mark(Dvector *d) {
    if (d->shared != Qnil) rb_gc_mark(d->shared);
 }
 
 static void dvector_free(Dvector *d) {
+#ifdef HAVE_SYS_MMAN_H
+   if (d->map != NULL) munmap(d->map, d->map_len);
+   else
+#endif
    if (d->ptr != NULL && d->shared == Qnil) free(d->ptr);
    free(d);
 }
@@ -123,6 +401,9 @@ static VALUE dvector_alloc(VALUE klass) {
    d->ptr = NULL;
    d->capa = 0;
    d->shared = Qnil;
+   d->map = NULL;
+   d->map_len = 0;
+   d->map_writable = 0;
    return ary;
 }
 
@@ -168,8 +449,7 @@ void Dvector_Store_Double(VALUE ary, long idx, double val) {
          new_capa = DVEC_DEFAULT_SIZE;
       }
       new_capa += idx;
-      REALLOC_N(d->ptr, double, new_capa);
-      d->capa = new_capa;
+      dvector_realloc(d, new_capa);
    }
    if (idx > d->len) {
       dvector_mem_clear(d->ptr + d->len, idx - d->len + 1);
@@ -208,6 +488,32 @@ static inline void dvector_modify_check(VALUE ary) {
       rb_raise(rb_eSecurityError, "Insecure: can't modify dvector");
 }
 
+/* Whether a Dvector sharing the buffer of shared modifies it in place:
+   only the writable file mappings are. The other buffers, among which
+   the views on the entries of other objects (see Dvector_Set_View), are
+   copied on the first write. */
+static inline bool dvector_writes_through(VALUE shared) {
+   return is_a_dvector(shared) && Get_Dvector(shared)->map_writable;
+}
+
+/* A Dvector only writes to a mapping while it covers the same entries
+   of the file: once it got shorter (len < capa), it is copied as well,
+   so that growing again can't write beyond it */
+static inline bool dvector_is_mapped(Dvector *d) {
+   return d->shared != Qnil && d->len == d->capa && 
+      dvector_writes_through(d->shared);
+}
+
+/* dvector_modify for the functions that can change the length of the
+   Dvector: a writable mapping is copied to memory first, so that the
+   file keeps its entries */
+static Dvector *dvector_modify_length(VALUE ary) {
+   Dvector *d = dvector_modify(ary);
+   /* after dvector_modify, only writable mappings are still shared */
+   if (d->shared != Qnil) dvector_realloc(d, d->capa);
+   return d;
+}
+
 static Dvector *dvector_modify(VALUE ary) {
    double *ptr;
    Dvector *d;
@@ -215,7 +521,7 @@ static Dvector *dvector_modify(VALUE ary) {
    d = Get_Dvector(ary);
    /* we set the dirty bit */
    d->dirty = 1;
-   if (d->shared != Qnil) {
+   if (d->shared != Qnil && !dvector_is_mapped(d)) {
       ptr = ALLOC_N(double, d->len);
       d->shared = Qnil;
       d->capa = d->len;
@@ -412,8 +718,7 @@ PRIVATE
       rb_raise(rb_eArgError, "array size too big");
    }
    if (len > d->capa) {
-      REALLOC_N(d->ptr, double, len);
-      d->capa = len;
+      dvector_realloc(d, len);
    }
    if (rb_block_given_p()) {
       long i;
@@ -487,7 +792,7 @@ PRIVATE
  *     a.pop   -> 3
  *     a       -> Dvector[ 1, 2 ]
  */ VALUE dvector_pop(VALUE ary) {
-   Dvector *d = dvector_modify(ary);
+   Dvector *d = dvector_modify_length(ary);
    if (d->len == 0) return Qnil;
    if (d->shared == Qnil && d->len * 2 < d->capa && d->capa > DVEC_DEFAULT_SIZE) {
       d->capa = d->len * 2;
@@ -523,12 +828,13 @@ PRIVATE
  *     args         -> Dvector[ 2, 3 ]
  */ VALUE dvector_shift(VALUE ary) {
    double top;
-   Dvector *d = dvector_modify(ary);
+   Dvector *d = dvector_modify_length(ary);
    if (d->len == 0) return Qnil;
    top = d->ptr[0];
    dvector_make_shared(ary);
    d->ptr++;		/* shift ptr */
    d->len--;
+   d->capa--;
    return rb_float_new(top);
 }
 
@@ -589,7 +895,7 @@ PRIVATE VALUE dvector_subseq(VALUE ary, long beg, long len) {
    ary2 = dvector_alloc(klass);
    d2 = Get_Dvector(ary2);
    d2->ptr = ptr + beg;
-   d2->len = len;
+   d2->len = d2->capa = len;
    d2->shared = shared;
    return ary2;
 }
@@ -761,7 +1067,7 @@ PRIVATE
  *     b.uniq!              ->   nil
  */ VALUE dvector_uniq_bang(VALUE ary) {
    double v;
-   Dvector *d = dvector_modify(ary);
+   Dvector *d = dvector_modify_length(ary);
    long i, j, k;
    int uniq;
    for (i=j=0; i < d->len; i++) {
@@ -895,7 +1201,7 @@ PRIVATE
 
 static void dvector_splice(VALUE ary, long beg, long len, VALUE rpl) {
    long rlen;
-   Dvector *d = dvector_modify(ary), *r = NULL;
+   Dvector *d = dvector_modify_length(ary), *r = NULL;
    if (len < 0) rb_raise(rb_eIndexError, "negative length (%ld)", len);
    if (beg < 0) {
       beg += d->len;
@@ -920,8 +1226,7 @@ static void dvector_splice(VALUE ary, long beg, long len, VALUE rpl) {
    if (beg >= d->len) {
       len = beg + rlen;
       if (len >= d->capa) {
-         REALLOC_N(d->ptr, double, len);
-         d->capa = len;
+         dvector_realloc(d, len);
       }
       dvector_mem_clear(d->ptr + d->len, beg - d->len);
       if (rlen > 0) {
@@ -936,8 +1241,7 @@ static void dvector_splice(VALUE ary, long beg, long len, VALUE rpl) {
       }
       alen = d->len + rlen - len;
       if (alen >= d->capa) {
-         REALLOC_N(d->ptr, double, alen);
-         d->capa = alen;
+         dvector_realloc(d, alen);
       }
       if (len != rlen) {
          MEMMOVE(d->ptr + beg + rlen, d->ptr + beg + len, double, d->len - (beg + len));
@@ -1028,11 +1332,10 @@ PRIVATE
  *     a = Dvector[ 1, 2, 3, 4, 5 ]
  *     a.clear    -> Dvector[]
  */ VALUE dvector_clear(VALUE ary) {
-   Dvector *d = dvector_modify(ary);
+   Dvector *d = dvector_modify_length(ary);
    d->len = 0;
    if (DVEC_DEFAULT_SIZE * 2 < d->capa) {
-      REALLOC_N(d->ptr, double, DVEC_DEFAULT_SIZE * 2);
-      d->capa = DVEC_DEFAULT_SIZE * 2;
+      dvector_realloc(d, DVEC_DEFAULT_SIZE * 2);
    }
    return ary;
 }
@@ -2061,7 +2364,7 @@ VALUE dvector_delete(VALUE ary, VALUE item) {
    double val, e;
    item = rb_Float(item);
    val = NUM2DBL(item);
-   d = dvector_modify(ary);
+   d = dvector_modify_length(ary);
    len = d->len;
    for (i1 = i2 = 0; i1 < d->len; i1++) {
       e = d->ptr[i1];
@@ -2080,8 +2383,7 @@ VALUE dvector_delete(VALUE ary, VALUE item) {
    if (len > i2) {
       d->len = i2;
       if (i2 * 2 < d->capa && d->capa > DVEC_DEFAULT_SIZE) {
-         REALLOC_N(d->ptr, double, i2 * 2);
-         d->capa = i2 * 2;
+         dvector_realloc(d, i2 * 2);
       }
    }
    return item;
@@ -2098,7 +2400,7 @@ VALUE dvector_delete_at(VALUE ary, long pos) {
       pos += len;
       if (pos < 0) return Qnil;
    }
-   dvector_modify(ary);
+   dvector_modify_length(ary);
    del = d->ptr[pos];
    for (i = pos + 1; i < len; i++, pos++) {
       d->ptr[pos] = d->ptr[i];
@@ -2154,7 +2456,7 @@ PRIVATE
  */ 
 VALUE dvector_prune_bang(VALUE ary, VALUE lst) {
    Dvector *d;
-   d = dvector_modify(ary);
+   d = dvector_modify_length(ary);
    int i, lst_len, ary_len, pos, j;
    VALUE *lst_ptr;
    lst = rb_Array(lst);
@@ -2200,7 +2502,7 @@ VALUE dvector_slice_bang(int argc, VALUE *argv, VALUE ary) {
    VALUE arg1, arg2;
    long pos, len;
    Dvector *d;
-   d = dvector_modify(ary);
+   d = dvector_modify_length(ary);
    if (rb_scan_args(argc, argv, "11", &arg1, &arg2) == 2) {
       pos = NUM2LONG(arg1);
       len = NUM2LONG(arg2);
@@ -2231,7 +2533,7 @@ PRIVATE
 VALUE dvector_reject_bang(VALUE ary) {
    long i1, i2;
    Dvector *d;
-   d = dvector_modify(ary);
+   d = dvector_modify_length(ary);
    for (i1 = i2 = 0; i1 < d->len; i1++) {
       double val = d->ptr[i1];
       VALUE v = rb_float_new(val);
@@ -2285,15 +2587,14 @@ static double *dvector_replace_dbls(VALUE ary, long len, double *data) {
    Dvector *d;
    long i;
    if (len < 0) len = 0;
-   d = dvector_modify(ary);
+   d = dvector_modify_length(ary);
    if (len > d->capa) {
       long new_capa = d->capa / 2;
       if (new_capa < DVEC_DEFAULT_SIZE) {
          new_capa = DVEC_DEFAULT_SIZE;
       }
       new_capa += len;
-      REALLOC_N(d->ptr, double, new_capa);
-      d->capa = new_capa;
+      dvector_realloc(d, new_capa);
    }
    d->len = len;
    for (i = 0; i < len; i++) d->ptr[i] = data[i];
@@ -2320,11 +2621,20 @@ VALUE dvector_replace(VALUE dest, VALUE orig) {
    if (dest == orig) return dest;
    org = Get_Dvector(orig);
    d = Get_Dvector(dest);
-   if (d->ptr) free(d->ptr); // we know it isn't shared because we did dvector_modify above
+   // after dvector_modify, it can only be shared with a writable mapping
+   if (d->ptr && d->shared == Qnil) free(d->ptr);
+   if (org->shared != Qnil && dvector_writes_through(org->shared)) {
+      /* a copy must not write to the file */
+      d->capa = org->len > 0 ? org->len : DVEC_DEFAULT_SIZE;
+      d->ptr = ALLOC_N(double, d->capa);
+      MEMCPY(d->ptr, org->ptr, double, org->len);
+      d->len = org->len;
+      d->shared = Qnil;
+      return dest;
+   }
    shared = dvector_make_shared(orig);
-   org = Get_Dvector(shared);
    d->ptr = org->ptr;
-   d->len = org->len;
+   d->len = d->capa = org->len;
    d->shared = shared;
    return dest;
 }
@@ -2391,8 +2701,7 @@ VALUE dvector_fill(int argc, VALUE *argv, VALUE ary) {
    end = beg + len;
    if (end > d->len) {
       if (end >= d->capa) {
-         REALLOC_N(d->ptr, double, end);
-         d->capa = end;
+         dvector_realloc(d, end);
       }
       if (beg > d->len) {
          dvector_mem_clear(d->ptr + d->len, end - d->len);
@@ -2418,15 +2727,14 @@ VALUE dvector_fill(int argc, VALUE *argv, VALUE ary) {
 }
 
 static VALUE c_Resize(VALUE ary, long new_len) {
-   Dvector *d = dvector_modify(ary);
+   Dvector *d = dvector_modify_length(ary);
    if (new_len > d->capa) {
       Dvector_Store_Double(ary, new_len-1, 0.0);
    } else {
       d->len = new_len;
       if (new_len < DVEC_DEFAULT_SIZE) new_len = DVEC_DEFAULT_SIZE;
       if (new_len * 2 < d->capa) {
-         REALLOC_N(d->ptr, double, new_len * 2);
-         d->capa = new_len * 2;
+         dvector_realloc(d, new_len * 2);
       }
    }
    return ary;
@@ -2612,15 +2920,39 @@ VALUE dvector_where_last_max(VALUE ary) {
    return INT2FIX(bst_i);   
 }
 
-static double c_dvector_max(Dvector *d)
+/* The results of each part of min, max and bounds */
+typedef struct {
+   const double *p;
+   double min[DVECTOR_MAX_THREADS], max[DVECTOR_MAX_THREADS];
+   bool found[DVECTOR_MAX_THREADS];
+} extrema_args;
+
+/* Like the plain loop, the first part keeps a NaN in first position;
+   the other parts can only find a larger value */
+static void max_task(void *data, long start, long end, int part)
 {
-   double bst, *p = d->ptr;
-   long len = d->len, i;
-   if (len <= 0) return 0.0;
-   bst = p[0];
-   for (i=1; i<len; i++) {
+   extrema_args *args = (extrema_args *) data;
+   const double *p = args->p;
+   double bst = (part == 0) ? p[0] : -INFINITY;
+   long i;
+   for (i=start; i<end; i++) {
       if (p[i] > bst) bst = p[i];
    }
+   args->max[part] = bst;
+}
+
+static double c_dvector_max(Dvector *d)
+{
+   extrema_args args;
+   double bst;
+   int num_parts, i;
+   if (d->len <= 0) return 0.0;
+   args.p = d->ptr;
+   num_parts = Dvector_Parallel_For(d->len, max_task, &args);
+   bst = args.max[0];
+   for (i=1; i<num_parts; i++) {
+      if (args.max[i] > bst) bst = args.max[i];
+   }
    return bst;   
 }
 
@@ -2640,16 +2972,15 @@ PRIVATE
  *     a.max(b)            -> 8
  */ 
 VALUE dvector_max(int argc, VALUE *argv, VALUE self) {
-   VALUE ary, index;
+   VALUE ary;
    int i, got_one = false;
    double mx=0, tmp;
    Dvector *d;
    for (i = 0; i <= argc; i++) {
       ary = (i < argc)? argv[i] : self;
-      index = dvector_where_max(ary);
-      if (index == Qnil) continue;
       d = Get_Dvector(ary);
-      tmp = d->ptr[NUM2INT(index)];
+      if (d->len <= 0) continue;
+      tmp = c_dvector_max(d);
       if (!got_one || tmp > mx) { mx = tmp; got_one = true; }
    }
    if (!got_one) return Qnil;
@@ -2682,15 +3013,30 @@ VALUE dvector_where_min(VALUE ary) {
    return INT2FIX(bst_i);   
 }
 
-static double c_dvector_min(Dvector *d)
+static void min_task(void *data, long start, long end, int part)
 {
-   double bst, *p = d->ptr;
-   long len = d->len, i;
-   if (len <= 0) return 0.0;
-   bst = p[0];
-   for (i=1; i<len; i++) {
+   extrema_args *args = (extrema_args *) data;
+   const double *p = args->p;
+   double bst = (part == 0) ? p[0] : INFINITY;
+   long i;
+   for (i=start; i<end; i++) {
       if (p[i] < bst) bst = p[i];
    }
+   args->min[part] = bst;
+}
+
+static double c_dvector_min(Dvector *d)
+{
+   extrema_args args;
+   double bst;
+   int num_parts, i;
+   if (d->len <= 0) return 0.0;
+   args.p = d->ptr;
+   num_parts = Dvector_Parallel_For(d->len, min_task, &args);
+   bst = args.min[0];
+   for (i=1; i<num_parts; i++) {
+      if (args.min[i] < bst) bst = args.min[i];
+   }
    return bst;   
 }
 
@@ -2710,16 +3056,15 @@ PRIVATE
  *     a.min(b)            -> 0
  */ 
 VALUE dvector_min(int argc, VALUE *argv, VALUE self) {
-   VALUE ary, index;
+   VALUE ary;
    int i, got_one = false;
    double mn=0, tmp;
    Dvector *d;
    for (i = 0; i <= argc; i++) {
       ary = (i < argc)? argv[i] : self;
-      index = dvector_where_min(ary);
-      if (index == Qnil) continue;
       d = Get_Dvector(ary);
-      tmp = d->ptr[NUM2INT(index)];
+      if (d->len <= 0) continue;
+      tmp = c_dvector_min(d);
       if (!got_one || tmp < mn) { mn = tmp; got_one = true; }
    }
    if (!got_one) return Qnil;
@@ -3117,6 +3462,26 @@ VALUE dvector_where_last_ge(VALUE ary, VALUE item) {
    return Qnil;   
 }
 
+/* The partial sums of sum and dot; when there are several parts, they
+   are added in order */
+typedef struct {
+   const double *p, *q;
+   double sum[DVECTOR_MAX_THREADS];
+} sum_args;
+
+static void sum_task(void *data, long start, long end, int part)
+{
+   sum_args *args = (sum_args *) data;
+   const double *p = args->p, *q = args->q;
+   double sum = 0.0;
+   long i;
+   if (q == NULL)
+      for (i=start; i<end; i++) sum += p[i];
+   else
+      for (i=start; i<end; i++) sum += p[i] * q[i];
+   args->sum[part] = sum;
+}
+
 PRIVATE
 /*
  *  call-seq:
@@ -3131,9 +3496,14 @@ PRIVATE
  */ 
 VALUE dvector_sum(VALUE ary) {
    Dvector *d = Get_Dvector(ary);
-   double *p = d->ptr, sum = 0.0;
-   long len = d->len, i;
-   for (i=0; i<len; i++) sum += p[i];
+   sum_args args;
+   double sum;
+   int num_parts, i;
+   args.p = d->ptr;
+   args.q = NULL;
+   num_parts = Dvector_Parallel_For(d->len, sum_task, &args);
+   sum = args.sum[0];
+   for (i=1; i<num_parts; i++) sum += args.sum[i];
    return rb_float_new(sum);
 }
 
@@ -3152,12 +3522,17 @@ PRIVATE
  */ 
 VALUE dvector_dot(VALUE ary1, VALUE ary2) {
    Dvector *d1 = Get_Dvector(ary1), *d2 = Get_Dvector(ary2);
-   double *p1 = d1->ptr, *p2 = d2->ptr, sum = 0.0;
-   long len = d1->len, i;
-   if (len != d2->len) {
+   sum_args args;
+   double sum;
+   int num_parts, i;
+   if (d1->len != d2->len) {
       rb_raise(rb_eArgError, "vectors with different lengths (%ld vs %ld) for dot", d1->len, d2->len);
    }
-   for (i=0; i<len; i++) sum += p1[i] * p2[i];
+   args.p = d1->ptr;
+   args.q = d2->ptr;
+   num_parts = Dvector_Parallel_For(d1->len, sum_task, &args);
+   sum = args.sum[0];
+   for (i=1; i<num_parts; i++) sum += args.sum[i];
    return rb_float_new(sum);
 }
 
@@ -3178,12 +3553,97 @@ VALUE dvector_vector_length(VALUE ary) {
    for (i=0; i<len; i++) sum += p[i] * p[i];
    return rb_float_new(sqrt(sum));
 }
+static double do_neg(double arg);
+static double do_inv(double arg);
+static double do_safe_sqrt(double x);
+static double do_add(double x, double y);
+static double do_sub(double x, double y);
+static double do_mul(double x, double y);
+static double do_div(double x, double y);
+static double do_mod(double x, double y);
+static double do_trim(double x, double cutoff);
+static double do_safe_inv(double x, double y);
+
+/* The operations that have a vectorized loop in kernels.h use it, and
+   return true */
+static bool kernel_math_op(double *p, long len, double (*op)(double)) {
+   if (op == do_neg) kernel_neg(p, len);
+   else if (op == fabs) kernel_abs(p, len);
+   else if (op == do_inv) kernel_inv(p, len);
+   else if (op == sqrt) kernel_sqrt(p, len);
+   else if (op == do_safe_sqrt) kernel_safe_sqrt(p, len);
+   else if (op == floor) kernel_floor(p, len);
+   else if (op == ceil) kernel_ceil(p, len);
+   else return false;
+   return true;
+}
+
+static bool kernel_math_op1(double *p, long len, double y,
+                            double (*op)(double, double)) {
+   if (op == do_add) kernel_add_scalar(p, len, y);
+   else if (op == do_sub) kernel_sub_scalar(p, len, y);
+   else if (op == do_mul) kernel_mul_scalar(p, len, y);
+   else if (op == do_div) kernel_div_scalar(p, len, y);
+   else if (op == do_mod) kernel_mod_scalar(p, len, y);
+   else if (op == do_trim) kernel_trim(p, len, y);
+   else if (op == do_safe_inv) kernel_safe_inv(p, len, y);
+   else return false;
+   return true;
+}
+
+static bool kernel_math_op2(double *p, const double *q, long len,
+                            double (*op)(double, double)) {
+   if (op == do_add) kernel_add(p, q, len);
+   else if (op == do_sub) kernel_sub(p, q, len);
+   else if (op == do_mul) kernel_mul(p, q, len);
+   else if (op == do_div) kernel_div(p, q, len);
+   else if (op == do_mod) kernel_mod(p, q, len);
+   else return false;
+   return true;
+}
+
+/* The arguments of the element-wise loops, which go through
+   Dvector_Parallel_For */
+typedef struct {
+   double *p;
+   const double *q;
+   double y;
+   double (*op)(double);
+   double (*op2)(double, double);
+} math_op_args;
+
+static void math_op_task(void *data, long start, long end, int part) {
+   math_op_args *args = (math_op_args *) data;
+   double *p = args->p + start;
+   long len = end - start, i;
+   if (kernel_math_op(p, len, args->op)) return;
+   for (i=0; i<len; i++) p[i] = (*args->op)(p[i]);
+}
+
+static void math_op1_task(void *data, long start, long end, int part) {
+   math_op_args *args = (math_op_args *) data;
+   double *p = args->p + start, y = args->y;
+   long len = end - start, i;
+   if (kernel_math_op1(p, len, y, args->op2)) return;
+   for (i=0; i<len; i++) p[i] = (*args->op2)(p[i], y);
+}
+
+static void math_op2_task(void *data, long start, long end, int part) {
+   math_op_args *args = (math_op_args *) data;
+   double *p = args->p + start;
+   const double *q = args->q + start;
+   long len = end - start, i;
+   if (kernel_math_op2(p, q, len, args->op2)) return;
+   for (i=0; i<len; i++) p[i] = (*args->op2)(p[i], q[i]);
+}
+
 PRIVATE 
 VALUE dvector_apply_math_op_bang(VALUE ary, double (*op)(double)) {
    Dvector *d= dvector_modify(ary);
-   double *p = d->ptr;
-   long len = d->len, i;
-   for (i=0; i<len; i++) p[i] = (*op)(p[i]);
+   math_op_args args;
+   args.p = d->ptr;
+   args.op = op;
+   Dvector_Parallel_For(d->len, math_op_task, &args);
    return ary;
 }
 PRIVATE 
@@ -3877,9 +4337,11 @@ VALUE dvector_sqrt_bang(VALUE ary) {
 static VALUE dvector_apply_math_op1_bang(VALUE ary, VALUE arg, double (*op)(double, double)) {
    Dvector *d = dvector_modify(ary);
    arg = rb_Float(arg);
-   double y = NUM2DBL(arg), *p = d->ptr;
-   long len = d->len, i;
-   for (i=0; i<len; i++) p[i] = (*op)(p[i], y);
+   math_op_args args;
+   args.p = d->ptr;
+   args.y = NUM2DBL(arg);
+   args.op2 = op;
+   Dvector_Parallel_For(d->len, math_op1_task, &args);
    return ary;
 }
 
@@ -4220,12 +4682,14 @@ VALUE dvector_apply_math_op2_bang(VALUE ary1, VALUE ary2, double (*op)(double, d
    VALUE check = rb_obj_is_kind_of(ary2, rb_cNumeric);
    if (check != Qfalse) { return dvector_apply_math_op1_bang(ary1, ary2, op); }
    Dvector *d1 = dvector_modify(ary1), *d2 = Get_Dvector(ary2);
-   double *p1 = d1->ptr, *p2 = d2->ptr;
-   long len = d1->len, i;
-   if (len != d2->len) {
+   math_op_args args;
+   if (d1->len != d2->len) {
       rb_raise(rb_eArgError, "vectors with different lengths (%ld vs %ld) math operation", d1->len, d2->len);
    }
-   for (i=0; i<len; i++) p1[i] = (*op)(p1[i], p2[i]);
+   args.p = d1->ptr;
+   args.q = d2->ptr;
+   args.op2 = op;
+   Dvector_Parallel_For(d1->len, math_op2_task, &args);
    return ary1;
 }
 PRIVATE 
@@ -4584,7 +5048,7 @@ VALUE Read_Dvectors(char *filename, VALUE destinations, int first_row_of_file, i
    double v;
    int last_row_of_file;
    int buff_len = 100;
-   char *buff, *num_str, *pend, c, *cptr;
+   char *buff, *num_str, *pend;
    int num_cols = 0, i, row, col, buff_loc, skip = first_row_of_file - 1;
    last_row_of_file = (number_of_rows == -1)? -1 : first_row_of_file + number_of_rows - 1;
    if ((last_row_of_file != -1 && last_row_of_file < first_row_of_file) || filename == NULL) return false;
@@ -4602,7 +5066,7 @@ VALUE Read_Dvectors(char *filename, VALUE destinations, int first_row_of_file, i
       for (i = 0; i < num_cols; i++) { /* second pass to clear destination dvectors */
          col_obj = cols_ptr[i];
          if (col_obj == Qnil) continue;
-         d = dvector_modify(col_obj);
+         d = dvector_modify_length(col_obj);
          d->len = 0;
       }
    }
@@ -4661,22 +5125,15 @@ VALUE Read_Dvectors(char *filename, VALUE destinations, int first_row_of_file, i
          Data_Get_Struct(col_obj, Dvector, d);
          
          buff[buff_loc] = ' ';
-         // rewrite to use strtod instead of fscanf to deal with numbers from fortran like 0.501-129 for 0.501E-129
-         v = strtod(num_str,&pend);
-         
-         if (pend != buff+buff_loc) {
+         // fast_strtod reads the numbers from fortran like 0.501-129 for 0.501E-129
+         v = fast_strtod(num_str, &pend, FAST_DOUBLE_FORTRAN);
          if (pend != buff+buff_loc) {
-            if ((buff+buff_loc - pend >= 4) && (pend[0] == '+' || pend[0] == '-')) { // insert 'E' and try again
-                cptr = pend+5; c = *cptr; pend[5] = ' '; pend[4] = pend[3]; pend[3] = pend[2]; 
-                pend[2] = pend[1]; pend[1] = pend[0]; pend[0] = 'E';
-                v = strtod(num_str,&pend); *cptr = c; buff_loc = pend - buff;
-            } else {
-                fclose(file);
-                free(buff);
-                pend[0] = 0;
-                rb_raise(rb_eArgError, "ERROR: unreadable value in file %s in line %i: %s", filename, i , buff+buff_loc);
-            }
-         }
+            VALUE str;
+            buff[buff_loc] = 0;
+            str = rb_str_new2(num_str);
+            fclose(file);
+            free(buff);
+            rb_raise(rb_eArgError, "ERROR: unreadable value in file %s in line %i: %s", filename, i , RSTRING_PTR(str));
          }
          
          if (!is_okay_number(v)) {
@@ -4733,7 +5190,7 @@ VALUE Read_Rows_of_Dvectors(char *filename, VALUE destinations, int first_row_of
    Dvector *d;
    double v, *row_data;
    int buff_len = 1000;
-   char *buff, *num_str, *pend, c, *cptr;
+   char *buff, *num_str, *pend;
    int num_rows = 0, i, row, col, buff_loc, skip = first_row_of_file - 1;
    rows_obj = rb_Array(destinations);
    num_rows = RARRAY_LEN(rows_obj);
@@ -4748,7 +5205,7 @@ VALUE Read_Rows_of_Dvectors(char *filename, VALUE destinations, int first_row_of
    for (i = 0; i < num_rows; i++) { /* second pass to clear destination dvectors */
       row_obj = rows_ptr[i];
       if (row_obj == Qnil) continue;
-      d = dvector_modify(row_obj);
+      d = dvector_modify_length(row_obj);
       d->len = 0;
    }
    if ((file=fopen(filename,"r")) == NULL) {
@@ -4785,20 +5242,17 @@ VALUE Read_Rows_of_Dvectors(char *filename, VALUE destinations, int first_row_of
          while (isgraph(buff[buff_loc])) buff_loc++; /* include non-blanks */
 
          buff[buff_loc] = ' ';
-         // use strtod instead of fscanf to deal with numbers from fortran like 0.501-129 for 0.501E-129
-         v = strtod(num_str,&pend);
+         // fast_strtod reads the numbers from fortran like 0.501-129 for 0.501E-129
+         v = fast_strtod(num_str, &pend, FAST_DOUBLE_FORTRAN);
          if (pend != buff+buff_loc) {
-            if ((buff+buff_loc - pend >= 4) && (pend[0] == '+' || pend[0] == '-')) { // insert 'E' and try again
-                cptr = pend+5; c = *cptr; pend[5] = ' '; pend[4] = pend[3]; pend[3] = pend[2]; 
-                pend[2] = pend[1]; pend[1] = pend[0]; pend[0] = 'E';
-                v = strtod(num_str,&pend); *cptr = c; buff_loc = pend - buff;
-            } else {
-                fclose(file);
-                pend[0] = 0;
-                rb_raise(rb_eArgError, "ERROR: unreadable value in file %s in line %i: %s", filename, i , buff+buff_loc);
-            }
+            VALUE str;
+            buff[buff_loc] = 0;
+            str = rb_str_new2(num_str);
+            fclose(file);
+            free(buff);
+            rb_raise(rb_eArgError, "ERROR: unreadable value in file %s in line %i: %s", filename, i , RSTRING_PTR(str));
          }
-
+         
          if (!is_okay_number(v)) {
             fclose(file);
             free(buff);
@@ -4812,8 +5266,7 @@ VALUE Read_Rows_of_Dvectors(char *filename, VALUE destinations, int first_row_of
          }
       }
       if (col+10 < d->capa) {
-         REALLOC_N(d->ptr, double, col);
-         d->capa = col;
+         dvector_realloc(d, col);
       }
    }
    fclose(file);
@@ -4848,7 +5301,7 @@ PRIVATE
 VALUE Read_Row(char *filename, int row, VALUE row_ary) {
    FILE *file = NULL;
    int buff_len = 1000;
-   char *buff, *num_str, *pend, c, *cptr;
+   char *buff, *num_str, *pend;
    int i, col, buff_loc;
    double v;
    if (row <= 0) {
@@ -4886,21 +5339,15 @@ VALUE Read_Row(char *filename, int row, VALUE row_ary) {
       if (buff[buff_loc] == '\0') break;
 
       buff[buff_loc] = ' ';
-      // rewrite to use strtod instead of fscanf to deal with numbers from fortran like 0.501-129 for 0.501E-129
-      v = strtod(num_str,&pend);
+      // fast_strtod reads the numbers from fortran like 0.501-129 for 0.501E-129
+      v = fast_strtod(num_str, &pend, FAST_DOUBLE_FORTRAN);
       if (pend != buff+buff_loc) {
-         if (pend != buff+buff_loc) {
-            if ((buff+buff_loc - pend >= 4) && (pend[0] == '+' || pend[0] == '-')) { // insert 'E' and try again
-                cptr = pend+5; c = *cptr; pend[5] = ' '; pend[4] = pend[3]; pend[3] = pend[2]; 
-                pend[2] = pend[1]; pend[1] = pend[0]; pend[0] = 'E';
-                v = strtod(num_str,&pend); *cptr = c; buff_loc = pend - buff;
-            } else {
-                fclose(file);
-                free(buff);
-                pend[0] = 0;
-                rb_raise(rb_eArgError, "ERROR: unreadable value in file %s in line %i: %s", filename, i , buff+buff_loc);
-            }
-         }
+         VALUE str;
+         buff[buff_loc] = 0;
+         str = rb_str_new2(num_str);
+         fclose(file);
+         free(buff);
+         rb_raise(rb_eArgError, "ERROR: unreadable value in file %s in line %i: %s", filename, i , RSTRING_PTR(str));
       }
 
       if (!is_okay_number(v)) {
@@ -4998,6 +5445,22 @@ double *Dvector_Data_Replace(VALUE dvector, long len, double *data) { /* copies
    return dvector_replace_dbls(dvector, len, data); }
 PRIVATE    
 VALUE Dvector_Create(void) { return dvector_new(); }
+
+/* Turns dvector into a view on the len doubles at ptr, which belong to
+   owner: dvector keeps owner alive, reads the doubles in place and
+   copies them on its first modification. The owner must not free them
+   while it is alive. A Dvector can be pointed at other doubles any
+   number of times, which costs no allocation. */
+PRIVATE void Dvector_Set_View(VALUE dvector, VALUE owner, double *ptr, long len) {
+   if (!is_a_dvector(dvector)) rb_raise(rb_eArgError, "arg must be a Dvector");
+   dvector_modify_check(dvector);
+   Dvector *d = Get_Dvector(dvector);
+   if (d->ptr != NULL && d->shared == Qnil) free(d->ptr);
+   d->ptr = ptr;
+   d->len = d->capa = len;
+   d->shared = owner;
+   d->dirty = 1;
+}
 /*
 PRIVATE int Find_First_Both_Greater(VALUE Xs, VALUE Ys, double x, double y) {
       int i;
@@ -5382,6 +5845,115 @@ VALUE dvector_linear_interpolate(int argc, VALUE *argv, VALUE klass) {
    return rb_float_new(y);
 }
 
+/* Returns the given option of Dvector.mmap, given either as a symbol or
+   a string */
+static VALUE mmap_option(VALUE options, const char *name) {
+   VALUE val;
+   if (options == Qnil) return Qnil;
+   val = rb_hash_aref(options, ID2SYM(rb_intern(name)));
+   if (val == Qnil) val = rb_hash_aref(options, rb_str_new2(name));
+   return val;
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     Dvector.mmap(path)                      ->  a_dvector
+ *     Dvector.mmap(path, offset: bytes, length: n, writable: false)  ->  a_dvector
+ *
+ *  Returns a Dvector whose entries are read directly from the file
+ *  _path_ mapped in memory, without copying them: the pages are only
+ *  read when used, and several processes mapping the same file share
+ *  them. The file holds raw doubles in the native byte order
+ *  (little-endian on x86), starting _offset_ bytes (0 by default, a
+ *  multiple of 8) into the file; _length_ is the number of entries, by
+ *  default all the ones up to the end of the file.
+ *
+ *  The file is opened read-only unless _writable_ is true. The
+ *  Dvector can be modified in both cases, but a read-only mapping
+ *  is copied to memory first. With _writable_, the changes go to the
+ *  file, as long as the length stays the same: changing the length
+ *  copies the entries to memory. The copies made by +dup+, +replace+
+ *  or Dvector.new don't write to the file.
+ *
+ *     v = Dvector.mmap("run.dat", offset: 4096, length: 1_000_000)
+ *     v.max          # reads the file
+ *     v.mul!(2)      # v now lives in memory, run.dat is unchanged
+ */
+VALUE dvector_mmap(int argc, VALUE *argv, VALUE klass) {
+#ifdef HAVE_SYS_MMAN_H
+   VALUE path, options = Qnil, val, base, ary;
+   long offset = 0, length, page;
+   int writable, fd;
+   struct stat st;
+   void *map;
+   size_t map_len;
+   Dvector *b, *d;
+   if (argc < 1 || argc > 2)
+      rb_raise(rb_eArgError, "wrong # of arguments(%d) for mmap", argc);
+   path = rb_String(argv[0]);
+   if (argc == 2 && argv[1] != Qnil) options = rb_convert_type(argv[1], T_HASH, "Hash", "to_hash");
+   val = mmap_option(options, "offset");
+   if (val != Qnil) offset = NUM2LONG(val);
+   if (offset < 0 || offset % sizeof(double) != 0)
+      rb_raise(rb_eArgError, "the offset (%ld) must be a positive multiple of %d", 
+               offset, (int) sizeof(double));
+   writable = RTEST(mmap_option(options, "writable"));
+
+   fd = open(StringValueCStr(path), writable ? O_RDWR : O_RDONLY);
+   if (fd < 0) rb_sys_fail(StringValueCStr(path));
+   if (fstat(fd, &st) < 0) {
+      close(fd);
+      rb_sys_fail(StringValueCStr(path));
+   }
+   if (offset > st.st_size) {
+      close(fd);
+      rb_raise(rb_eArgError, "the offset (%ld) is past the end of %s", 
+               offset, StringValueCStr(path));
+   }
+   val = mmap_option(options, "length");
+   length = (val == Qnil) ? (long) ((st.st_size - offset) / sizeof(double)) :
+      NUM2LONG(val);
+   /* a mapping that goes past the end of the file crashes when read */
+   if (length < 0 || length > (long) ((st.st_size - offset) / sizeof(double))) {
+      close(fd);
+      rb_raise(rb_eArgError, "%s does not hold %ld doubles at offset %ld", 
+               StringValueCStr(path), length, offset);
+   }
+   ary = dvector_alloc(klass);
+   if (length == 0) {
+      close(fd);
+      return ary;
+   }
+   /* the mapping starts on a page boundary */
+   page = sysconf(_SC_PAGESIZE);
+   map_len = offset % page + length * sizeof(double);
+   map = mmap(NULL, map_len, writable ? PROT_READ | PROT_WRITE : PROT_READ, 
+              writable ? MAP_SHARED : MAP_PRIVATE, fd, offset - offset % page);
+   close(fd);
+   if (map == MAP_FAILED) rb_sys_fail(StringValueCStr(path));
+
+   /* The mapping belongs to a frozen base Dvector, which unmaps it when
+      collected; the one returned shares it like a subsequence would */
+   base = dvector_alloc(cDvector);
+   b = Get_Dvector(base);
+   b->map = map;
+   b->map_len = map_len;
+   b->map_writable = writable;
+   b->ptr = (double *) ((char *) map + offset % page);
+   b->len = b->capa = length;
+   OBJ_FREEZE(base);
+   d = Get_Dvector(ary);
+   d->ptr = b->ptr;
+   d->len = d->capa = length;
+   d->shared = base;
+   return ary;
+#else
+   rb_raise(rb_eNotImpError, "Dvector.mmap is not available on this platform");
+   return Qnil;
+#endif
+}
+
 PRIVATE
 /*
  *  call-seq:
@@ -5449,7 +6021,9 @@ VALUE dvector_max_of_many(VALUE klass, VALUE ary) {
    return rb_float_new(m);
 }
 
-#define DVECTOR_DUMP_VERSION 1
+/* Version 1 stored the length on 4 bytes, version 2 on 8, after a byte
+   giving the byte order of the doubles, which follow as one block */
+#define DVECTOR_DUMP_VERSION 2
 
 PRIVATE
 /*
@@ -5458,32 +6032,20 @@ PRIVATE
  */
 VALUE dvector_dump(VALUE ary, VALUE limit)
 {
-  int i; /* for STORE_UNSIGNED */
   long len;
   double * data = Dvector_Data_for_Read(ary, &len);
   long target_len = 1 /* first signature byte */
-    + 4 /* length */
+    + 1 /* byte order */
+    + 8 /* length */
     + len * 8 ;
-  unsigned u_len = (unsigned) len; /* this is bad, I know, but it
-				      won't hurt before it is common
-				      that computers have 32 GB of RAM...
-				   */
-
-  VALUE str = rb_str_new2("");
-  rb_str_resize(str,target_len); /* This seems to do the trick */
-  /* \begin{playing with ruby's internals} */
+  VALUE str = rb_str_new(NULL, target_len);
   unsigned char * ptr = (unsigned char *) RSTRING_PTR(str);
   /* signature byte */
   (*ptr++) = DVECTOR_DUMP_VERSION;
-  STORE_UNSIGNED(u_len, ptr); /* destroys u_len */
-  while(len-- > 0)
-    {
-      store_double(*(data++), ptr);
-      ptr += 8;
-    }
-  /*   RSTRING_LEN(str) = target_len; */
+  (*ptr++) = DOUBLES_LITTLE_ENDIAN_TAG;
+  store_length(len, ptr);
+  store_doubles(data, len, ptr + 8);
   return str;
-  /* \end{playing with ruby's internals} */
 }
 
 PRIVATE
@@ -5499,36 +6061,96 @@ VALUE dvector_load(VALUE klass, VALUE str)
   unsigned char * dest = buf + RSTRING_LEN(s);
   unsigned i; /* for GET_UNSIGNED */
   unsigned tmp = 0;
-  double * data;
+  unsigned long long len;
   /*  depending on the first byte, the decoding will be different */
   switch(*(buf++)) 
     {
     case 1:
+      if(dest - buf < 4)
+	break;
       GET_UNSIGNED(tmp, buf);
+      if((dest - buf) / 8 < tmp)
+	break;
       /* create a new Dvector with the right size */
-      ret = rb_funcall(cDvector, rb_intern("new"), 1, UINT2NUM(tmp));
-      data = Dvector_Data_for_Write(ret, NULL);
-      for(i = 0; i< tmp; i++)
-	{
-	  if(buf + 8 > dest)
-	    {
-	      rb_raise(rb_eRuntimeError, 
-		       "corrupted data given to Dvector._load");
-	      break;
-	    }	
-	  else 
-	    {
-	      data[i] = get_double(buf);
-	      buf += 8;
-	    }
-	}
-      break;
-    default:
-      rb_raise(rb_eRuntimeError, "corrupted data given to Dvector._load");
+      ret = make_new_dvector(cDvector, tmp, tmp);
+      get_doubles(Get_Dvector(ret)->ptr, tmp, buf);
+      return ret;
+    case 2:
+      if(dest - buf < 9 || *buf != DOUBLES_LITTLE_ENDIAN_TAG)
+	break;
+      len = get_length(buf + 1);
+      buf += 9;
+      if((unsigned long long) (dest - buf) != len * 8 || 
+	 len > (unsigned long long) LONG_MAX / 8)
+	break;
+      ret = make_new_dvector(cDvector, len, len);
+      get_doubles(Get_Dvector(ret)->ptr, len, buf);
+      return ret;
     }
+  rb_raise(rb_eRuntimeError, "corrupted data given to Dvector._load");
+  return ret;
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     dvector.to_binary   ->  string
+ *
+ *  Returns the entries of _dvector_ as 8-byte little-endian doubles,
+ *  the format of the columns of Dvector.write_binary.
+ */
+VALUE dvector_to_binary(VALUE ary)
+{
+  long len;
+  double * data = Dvector_Data_for_Read(ary, &len);
+  VALUE str = rb_str_new(NULL, len * 8);
+  store_doubles(data, len, (unsigned char *) RSTRING_PTR(str));
+  return str;
+}
+
+PRIVATE
+/*
+ *  call-seq:
+ *     Dvector.from_binary(string)   ->  a_dvector
+ *
+ *  The reverse of Dvector#to_binary.
+ */
+VALUE dvector_from_binary(VALUE klass, VALUE str)
+{
+  long len;
+  VALUE ret;
+  StringValue(str);
+  if(RSTRING_LEN(str) % 8)
+    rb_raise(rb_eArgError, "the length of the string (%ld) is not "
+	     "a multiple of 8", (long) RSTRING_LEN(str));
+  len = RSTRING_LEN(str) / 8;
+  ret = make_new_dvector(klass, len, len);
+  get_doubles(Get_Dvector(ret)->ptr, len, 
+	      (const unsigned char *) RSTRING_PTR(str));
   return ret;
 }
 
+static void bounds_task(void *data, long start, long end, int part)
+{
+  extrema_args *args = (extrema_args *) data;
+  const double *p = args->p;
+  double min = INFINITY, max = -INFINITY;
+  bool found = false;
+  long i;
+  for(i = start; i < end; i++)
+    if(! isnan(p[i]))
+      {
+	found = true;
+	if(p[i] < min)
+	  min = p[i];
+	if(p[i] > max)
+	  max = p[i];
+      }
+  args->min[part] = min;
+  args->max[part] = max;
+  args->found[part] = found;
+}
+
 /* Returns the boundaries of a Dvector, that is [min, max]. It ignores
    NaN and will complain if the Dvector contains only NaN.
    
@@ -5538,28 +6160,26 @@ VALUE dvector_load(VALUE klass, VALUE str)
 */
 static VALUE dvector_bounds(VALUE self)
 {
-  double min, max;
+  double min = 0.0, max = 0.0;
   VALUE ret;
   long len;
-  double * data = Dvector_Data_for_Read(self, &len);
-  /* skip all NaNs at the beginning */
-  while(len-- > 0)
-    if(!isnan(*data++))
-       break;
-  if(len>=0)
+  extrema_args args;
+  int num_parts, i;
+  bool found = false;
+  args.p = Dvector_Data_for_Read(self, &len);
+  num_parts = Dvector_Parallel_For(len, bounds_task, &args);
+  for(i = 0; i < num_parts; i++)
+    {
+      if(! args.found[i])
+	continue;
+      if(! found || args.min[i] < min)
+	min = args.min[i];
+      if(! found || args.max[i] > max)
+	max = args.max[i];
+      found = true;
+    }
+  if(found)
     {
-      min = max = *(data-1);
-      while(len-- > 0)
-	{
-	  if(! isnan(*data))
-	    {
-	      if(*data < min)
-		min = *data;
-	      if(*data > max)
-		max = *data;
-	    }
-	  data++;
-	}
       ret = rb_ary_new2(2);
       rb_ary_store(ret, 0, rb_float_new(min));
       rb_ary_store(ret, 1, rb_float_new(max));
@@ -5633,20 +6253,692 @@ static VALUE marked_array()
 }
 
 /*
-  :call-seq:
-  Dvector.fast_fancy_read(stream, options) => Array_of_Dvectors
-  
-  Reads data from an IO stream (or anything that supports a gets method)
-  and separate it into columns of data
-  according to the _options_, a hash holding the following elements
-  (compulsory, but you can use FANCY_READ_DEFAULTS):
-  * 'sep': a regular expression that separate the entries
-  * 'comments': any line matching this will be skipped
-  * 'skip_first': skips that many lines before reading anything
-  * 'index_col': if true, the first column returned contains the
-    number of the line read
-  * 'remove_space': whether to remove spaces at the beginning of a line.
-  * 'comment_out': this should be an array into which the comments
+  The C tokenizer of fast_fancy_read.
+
+  In the common cases -- separators made of white space (the /\s+/ of
+  fancy_read) or of a single character, comments starting with a single
+  character, possibly after white space, and no text columns -- the
+  stream is read in large blocks, which are split into lines and fields
+  in C, and the fields are converted in place with fast_strtod. The
+  results are exactly those of the general path, which matches each
+  line and each field with the regular expressions.
+*/
+
+#define FANCY_BLOCK (1 << 20)
+
+typedef struct {
+  int whitespace_sep;           /* fields are separated by runs of
+                                   white space... */
+  char sep;                     /* ... or by this character */
+  int comment;                  /* comment lines start with this
+                                   character, or -1 for none */
+  int comment_space;            /* ... possibly after white space */
+  int remove_space;
+  VALUE comment_out;
+} fancy_format;
+
+/* The numeric columns being read. The parts of a file may be read by
+   several threads without the GVL (see fancy_read_parallel), so the
+   memory is handled with malloc and realloc, and allocation failures
+   are only reported at the end. */
+typedef struct {
+  int nb;                       /* The number of vectors currently created */
+  int size;                     /* The number of slots available */
+  double ** vectors;
+  long index;                   /* The current line in the vectors */
+  long allocated;               /* The size available in the vectors */
+  long max_rows;                /* If not 0, the number of lines after
+                                   which parsing stops */
+  double def;
+  int failed;                   /* A memory allocation failed */
+  int error;                    /* The errno of a failed read */
+  int keep_comments;            /* Whether the comment lines are kept
+                                   in comments rather than pushed to
+                                   comment_out */
+  char * comments;
+  long comments_len;
+  long comments_size;
+} fancy_columns;
+
+/* Returns the length of the source of a regular expression matching
+   the single character *c at the beginning of src (such as "#", "\#"
+   or "\t"), or 0 */
+static int fancy_simple_char(const char * src, long len, char * c)
+{
+  if(len >= 1 && ! strchr(".^$|?*+()[]{}\\\n", src[0])) {
+    *c = src[0];
+    return 1;
+  }
+  if(len >= 2 && src[0] == '\\') {
+    if(src[1] == 't') {
+      *c = '\t';
+      return 2;
+    }
+    if(ispunct(src[1]) || src[1] == ' ') {
+      *c = src[1];
+      return 2;
+    }
+  }
+  return 0;
+}
+
+/* Fills the format if sep and comments are simple enough for the C
+   tokenizer, and returns true in that case */
+static int fancy_format_init(fancy_format * f, VALUE sep, VALUE comments)
+{
+  const char * src;
+  long len;
+  int n;
+  if(TYPE(sep) != T_REGEXP || 
+     rb_funcall(sep, rb_intern("options"), 0) != INT2FIX(0))
+    return 0;
+  src = RSTRING_PTR(rb_funcall(sep, rb_intern("source"), 0));
+  len = strlen(src);
+  f->whitespace_sep = (len == 3 && ! strcmp(src, "\\s+"));
+  if(! f->whitespace_sep && fancy_simple_char(src, len, &f->sep) != len)
+    return 0;
+
+  f->comment = -1;
+  f->comment_space = 0;
+  if(RTEST(comments)) {
+    char c;
+    if(TYPE(comments) != T_REGEXP || 
+       rb_funcall(comments, rb_intern("options"), 0) != INT2FIX(0))
+      return 0;
+    src = RSTRING_PTR(rb_funcall(comments, rb_intern("source"), 0));
+    len = strlen(src);
+    if(len < 2 || src[0] != '^')
+      return 0;
+    src++; len--;
+    if(len > 3 && ! strncmp(src, "\\s*", 3)) {
+      f->comment_space = 1;
+      src += 3; len -= 3;
+    }
+    n = fancy_simple_char(src, len, &c);
+    if(n == 0 || n != len)
+      return 0;
+    f->comment = (unsigned char) c;
+  }
+  return 1;
+}
+
+/* Fills the format from the options of fast_fancy_read, and returns
+   true if stream can be read by the C tokenizer with them */
+static int fancy_format_from_options(fancy_format * f, VALUE stream, 
+                                     VALUE options)
+{
+  VALUE lc = rb_hash_aref(options, rb_str_new2("last_col"));
+  VALUE text_columns = rb_hash_aref(options, rb_str_new2("text_columns"));
+  /* No text columns */
+  if((RTEST(lc) && FIX2LONG(lc) >= 0) || 
+     (RTEST(text_columns) && 
+      RTEST(rb_funcall(text_columns, rb_intern("max"), 0))))
+    return 0;
+  if(! rb_respond_to(stream, rb_intern("read")) ||
+     ! fancy_format_init(f, rb_hash_aref(options, rb_str_new2("sep")),
+                         rb_hash_aref(options, rb_str_new2("comments"))))
+    return 0;
+  f->remove_space = RTEST(rb_hash_aref(options, 
+                                       rb_str_new2("remove_space")));
+  f->comment_out = rb_hash_aref(options, rb_str_new2("comment_out"));
+  return 1;
+}
+
+static void fancy_columns_init(fancy_columns * c, double def, 
+                               long initial_size)
+{
+  memset(c, 0, sizeof(fancy_columns));
+  c->allocated = initial_size > 0 ? initial_size : 1;
+  c->def = def;
+}
+
+static void fancy_columns_store(fancy_columns * c, int col, double val)
+{
+  if(c->failed)
+    return;
+  if(col >= c->nb) {
+    /* We need to create a new vector; col is always nb here */
+    long i;
+    double * vals;
+    if(col >= c->size) { /* Increase the available size */
+      double ** vectors = realloc(c->vectors, (col + 5) * sizeof(double *));
+      if(! vectors) {
+        c->failed = 1;
+        return;
+      }
+      c->vectors = vectors;
+      c->size = col + 5;
+    }
+    vals = malloc(c->allocated * sizeof(double));
+    if(! vals) {
+      c->failed = 1;
+      return;
+    }
+    /* Filling it with the default value */
+    for(i = 0; i < c->index; i++)
+      vals[i] = c->def;
+    c->vectors[c->nb++] = vals;
+  }
+  c->vectors[col][c->index] = val;
+}
+
+/* Finishes the current line, which had col columns */
+static void fancy_columns_end_line(fancy_columns * c, int col)
+{
+  if(c->failed)
+    return;
+  for(; col < c->nb; col++)
+    c->vectors[col][c->index] = c->def;
+  c->index++;
+  /* Now, we reallocate memory if necessary */
+  if(c->index >= c->allocated) {
+    long allocated = c->allocated * 2; /* We double the size */
+    for(col = 0; col < c->nb; col++) {
+      double * vals = realloc(c->vectors[col], allocated * sizeof(double));
+      if(! vals) {
+        c->failed = 1;
+        return;
+      }
+      c->vectors[col] = vals;
+    }
+    c->allocated = allocated;
+  }
+}
+
+static void fancy_columns_comment(fancy_columns * c, const char * line, 
+                                  long len)
+{
+  if(c->failed)
+    return;
+  if(c->comments_len + len > c->comments_size) {
+    long size = 2 * (c->comments_len + len);
+    char * comments = realloc(c->comments, size);
+    if(! comments) {
+      c->failed = 1;
+      return;
+    }
+    c->comments = comments;
+    c->comments_size = size;
+  }
+  memcpy(c->comments + c->comments_len, line, len);
+  c->comments_len += len;
+}
+
+static void fancy_columns_free(fancy_columns * c)
+{
+  int i;
+  for(i = 0; i < c->nb; i++)
+    free(c->vectors[i]);
+  free(c->vectors);
+  free(c->comments);
+  c->nb = 0;
+  c->vectors = NULL;
+  c->comments = NULL;
+}
+
+/* Splits and converts one line, from line to nl, which is the position
+   of its newline (or its end if it doesn't have one). The byte at nl
+   must be writable. */
+static void fancy_parse_line(const fancy_format * f, fancy_columns * c,
+                             char * line, char * nl, int has_nl)
+{
+  char * p = line, * q, * end = nl, save, * b;
+  int col = 0;
+  double val;
+
+  /* We check for a blank line using isspace: */
+  while(p < nl && isspace(*p))
+    p++;
+  if(p == nl)
+    return;                     /* We found a blank line  */
+  if(f->remove_space)
+    line = p;
+
+  /* ... or a comment line */
+  if(f->comment >= 0) {
+    p = line;
+    if(f->comment_space)
+      while(p < nl && isspace(*p))
+        p++;
+    if(p < nl && *p == f->comment) {
+      if(! RTEST(f->comment_out))
+        return;
+      if(c->keep_comments)
+        fancy_columns_comment(c, line, nl + (has_nl ? 1 : 0) - line);
+      else
+        rb_ary_push(f->comment_out, 
+                    rb_str_new(line, nl + (has_nl ? 1 : 0) - line));
+      return;
+    }
+  }
+
+  /* Then, we remove the newline (chomp!): */
+  if(end > line && end[-1] == '\r')
+    end--;
+
+  p = line;
+  while(1) {
+    if(f->whitespace_sep) {
+      q = p;
+      while(q < end && ! isspace(*q))
+        q++;
+    }
+    else {
+      q = memchr(p, f->sep, end - p);
+      if(! q)
+        q = end;
+    }
+    save = *q;
+    *q = 0;
+    val = fast_strtod(p, &b, 0);
+    if(b == p) 
+      val = c->def;
+    *q = save;
+    fancy_columns_store(c, col++, val);
+    if(q >= end)
+      break;
+    if(f->whitespace_sep)
+      while(q < end && isspace(*q))
+        q++;
+    else
+      q++;
+    p = q;
+  }
+  fancy_columns_end_line(c, col);
+}
+
+/* Parses the complete lines between buf and end that start before
+   limit (or until the columns have max_rows lines), and returns the
+   position of the first line not parsed. When last is true, the end of
+   the buffer ends the last line. */
+static char * fancy_parse_lines(const fancy_format * f, fancy_columns * c,
+                                char * buf, char * end, char * limit,
+                                long * line_number, long skip_first, 
+                                int last)
+{
+  char * nl;
+  while(buf < limit && ! (c->max_rows && c->index >= c->max_rows)) {
+    nl = memchr(buf, '\n', end - buf);
+    if(! nl) {
+      if(! last)
+        break;
+      nl = end;
+    }
+    (*line_number)++;
+    /* Whether we should skip the line... */
+    if(skip_first < *line_number)
+      fancy_parse_line(f, c, buf, nl, nl < end);
+    buf = nl + 1;
+  }
+  return buf < end ? buf : end;
+}
+
+typedef struct {
+  VALUE stream;
+  const fancy_format * format;
+  fancy_columns * columns;
+  long skip_first;
+  char * buf;
+  long rows;                    /* If not 0, the size of the chunks */
+  VALUE vectors;                /* The Dvectors of the chunks... */
+  VALUE ary;                    /* ... and the Array yielded */
+} fancy_read_state;
+
+/* Copies the lines read so far into the Dvectors of the chunks, yields
+   them and starts a new chunk */
+static void fancy_yield_chunk(fancy_read_state * s)
+{
+  fancy_columns * c = s->columns;
+  int i;
+  if(c->failed)
+    rb_memerror();
+  for(i = RARRAY_LEN(s->vectors); i < c->nb; i++)
+    rb_ary_push(s->vectors, dvector_new2(0, s->rows));
+  for(i = 0; i < c->nb; i++)
+    dvector_replace_dbls(rb_ary_entry(s->vectors, i), c->index, 
+                         c->vectors[i]);
+  c->index = 0;
+  /* The block may have modified the Array */
+  rb_ary_replace(s->ary, s->vectors);
+  rb_yield(s->ary);
+}
+
+/* Parses the lines in the first len bytes of the buffer, yielding the
+   chunks as they are full, and returns the position of the first line
+   not parsed */
+static char * fancy_read_lines(fancy_read_state * s, long len, 
+                               long * line_number, int last)
+{
+  char * p = s->buf, * end = s->buf + len;
+  while(1) {
+    p = fancy_parse_lines(s->format, s->columns, p, end, end, line_number,
+                          s->skip_first, last);
+    if(! s->rows || s->columns->index < s->rows)
+      return p;
+    fancy_yield_chunk(s);
+  }
+}
+
+static VALUE fancy_read_blocks(VALUE arg)
+{
+  fancy_read_state * s = (fancy_read_state *) arg;
+  fancy_columns * c = s->columns;
+  ID read_id = rb_intern("read");
+  VALUE block_size = INT2FIX(FANCY_BLOCK);
+  long len = 0, capa = FANCY_BLOCK, line_number = 0, n;
+  char * rest;
+  VALUE block, ary;
+  int i;
+  s->buf = ALLOC_N(char, capa + 1);
+  while(RTEST(block = rb_funcall(s->stream, read_id, 1, block_size))) {
+    StringValue(block);
+    n = RSTRING_LEN(block);
+    if(n == 0)
+      break;
+    if(len + n > capa) {
+      capa = 2 * (len + n);
+      REALLOC_N(s->buf, char, capa + 1);
+    }
+    MEMCPY(s->buf + len, RSTRING_PTR(block), char, n);
+    len += n;
+    rest = fancy_read_lines(s, len, &line_number, 0);
+    len -= rest - s->buf;
+    memmove(s->buf, rest, len);
+  }
+  /* The last line, without a newline */
+  fancy_read_lines(s, len, &line_number, 1);
+  if(c->failed)
+    rb_memerror();
+  if(s->rows) {
+    if(c->index > 0)
+      fancy_yield_chunk(s);
+    return Qnil;
+  }
+
+  ary = rb_ary_new2(c->nb);
+  for(i = 0; i < c->nb; i++)
+    rb_ary_store(ary, i, make_dvector_from_data(cDvector, c->index, 
+                                                c->vectors[i]));
+  return ary;
+}
+
+static VALUE fancy_read_cleanup(VALUE arg)
+{
+  fancy_read_state * s = (fancy_read_state *) arg;
+  free(s->buf);
+  fancy_columns_free(s->columns);
+  return Qnil;
+}
+
+/* Reads the whole stream with the C tokenizer */
+static VALUE fancy_read_simple(VALUE stream, const fancy_format * f, 
+                               double def, long skip_first, 
+                               long initial_size)
+{
+  fancy_columns c;
+  fancy_read_state s;
+  fancy_columns_init(&c, def, initial_size);
+  s.stream = stream;
+  s.format = f;
+  s.columns = &c;
+  s.skip_first = skip_first;
+  s.buf = NULL;
+  s.rows = 0;
+  /* We make sure nothing leaks if the stream raises an exception */
+  return rb_ensure(fancy_read_blocks, (VALUE) &s, 
+                   fancy_read_cleanup, (VALUE) &s);
+}
+
+/* Reads the whole stream with the C tokenizer, yielding the columns by
+   chunks of rows lines. The columns never grow beyond that. */
+static void fancy_read_chunks(VALUE stream, const fancy_format * f, 
+                              double def, long skip_first, long rows)
+{
+  fancy_columns c;
+  fancy_read_state s;
+  fancy_columns_init(&c, def, rows + 1);
+  c.max_rows = rows;
+  s.stream = stream;
+  s.format = f;
+  s.columns = &c;
+  s.skip_first = skip_first;
+  s.buf = NULL;
+  s.rows = rows;
+  s.vectors = rb_ary_new();
+  s.ary = rb_ary_new();
+  /* This also frees everything when the block breaks out */
+  rb_ensure(fancy_read_blocks, (VALUE) &s, fancy_read_cleanup, (VALUE) &s);
+}
+
+#ifdef HAVE_PREAD
+
+/*
+  Reading a file with several threads: the bytes between the current
+  position and the end of the file are split into parts (by
+  Dvector_Parallel_For), and each thread reads the lines that start
+  in its part into its own columns, with pread. The columns are then
+  put back together in order.
+*/
+
+typedef struct {
+  const fancy_format * format;
+  fancy_columns * columns;      /* one per part */
+  int nb_parts;
+  int fd;
+  off_t offset;                 /* where the parts start */
+  off_t size;                   /* the size of the file */
+} fancy_parallel_state;
+
+static long fancy_pread(int fd, char * buf, long len, off_t pos)
+{
+  ssize_t n;
+  do
+    n = pread(fd, buf, len, pos);
+  while(n < 0 && errno == EINTR);
+  return n;
+}
+
+static void fancy_parse_part(void * data, long start, long end, int part)
+{
+  fancy_parallel_state * s = (fancy_parallel_state *) data;
+  fancy_columns * c = s->columns + part;
+  off_t pos = s->offset + start, stop = s->offset + end;
+  long len = 0, capa = FANCY_BLOCK, line_number = 0, n;
+  int skip = 0, eof = 0;
+  char * buf, * p, * rest;
+
+  if(start >= end)
+    return;
+  /* The lines that start in the previous part are not ours: we look
+     for the end of the line before the part */
+  if(start > 0) {
+    pos--;
+    skip = 1;
+  }
+  if(! (buf = malloc(capa + 1))) {
+    c->failed = 1;
+    return;
+  }
+  while(! eof) {
+    if(len == capa) {           /* A line longer than the buffer */
+      char * b = realloc(buf, 2 * capa + 1);
+      if(! b) {
+        c->failed = 1;
+        break;
+      }
+      buf = b;
+      capa *= 2;
+    }
+    n = fancy_pread(s->fd, buf + len, capa - len, pos + len);
+    if(n < 0) {
+      c->error = errno;
+      break;
+    }
+    eof = (n == 0);
+    len += n;
+    p = buf;
+    if(skip) {
+      if(! (p = memchr(buf, '\n', len))) {
+        pos += len;
+        len = 0;
+        if(pos >= stop)
+          break;                /* No line starts in this part */
+        continue;
+      }
+      p++;
+      skip = 0;
+    }
+    rest = fancy_parse_lines(s->format, c, p, buf + len, 
+                             buf + (stop - pos < len ? stop - pos : len),
+                             &line_number, 0, eof);
+    if(pos + (rest - buf) >= stop)
+      break;
+    len -= rest - buf;
+    pos += rest - buf;
+    memmove(buf, rest, len);
+  }
+  free(buf);
+}
+
+/* Returns the position after the first skip_first lines from pos */
+static off_t fancy_skip_lines(int fd, off_t pos, off_t size, long skip_first)
+{
+  char * buf = ALLOC_N(char, FANCY_BLOCK), * p, * nl;
+  long n;
+  while(skip_first > 0 && pos < size) {
+    n = fancy_pread(fd, buf, FANCY_BLOCK, pos);
+    if(n <= 0) {
+      free(buf);
+      if(n < 0)
+        rb_sys_fail("pread");
+      return size;
+    }
+    p = buf;
+    while(skip_first > 0 && (nl = memchr(p, '\n', buf + n - p))) {
+      skip_first--;
+      p = nl + 1;
+    }
+    pos += (skip_first > 0 ? n : p - buf);
+  }
+  free(buf);
+  return skip_first > 0 ? size : pos;
+}
+
+static VALUE fancy_read_parts(VALUE arg)
+{
+  fancy_parallel_state * s = (fancy_parallel_state *) arg;
+  const fancy_format * f = s->format;
+  long rows = 0, row, k;
+  int nb = 0, nb_parts, i, j;
+  VALUE ary;
+
+  nb_parts = Dvector_Parallel_For(s->size - s->offset, fancy_parse_part, s);
+  for(i = 0; i < nb_parts; i++) {
+    if(s->columns[i].failed)
+      rb_memerror();
+    if(s->columns[i].error) {
+      errno = s->columns[i].error;
+      rb_sys_fail("pread");
+    }
+    rows += s->columns[i].index;
+    if(s->columns[i].nb > nb)
+      nb = s->columns[i].nb;
+  }
+
+  /* The columns that start late or end early in a part are padded
+     with the default value, as when the file is read in one go */
+  ary = rb_ary_new2(nb);
+  for(j = 0; j < nb; j++) {
+    VALUE vect = dvector_new2(rows, rows);
+    Dvector * d = Get_Dvector(vect);
+    row = 0;
+    for(i = 0; i < nb_parts; i++) {
+      fancy_columns * c = s->columns + i;
+      if(j < c->nb)
+        MEMCPY(d->ptr + row, c->vectors[j], double, c->index);
+      else
+        for(k = 0; k < c->index; k++)
+          d->ptr[row + k] = c->def;
+      row += c->index;
+    }
+    rb_ary_store(ary, j, vect);
+  }
+
+  /* Then the comments, one line at a time */
+  if(RTEST(f->comment_out))
+    for(i = 0; i < nb_parts; i++) {
+      fancy_columns * c = s->columns + i;
+      char * p = c->comments, * end = p + c->comments_len, * nl;
+      while(p < end) {
+        nl = memchr(p, '\n', end - p);
+        nl = nl ? nl + 1 : end;
+        rb_ary_push(f->comment_out, rb_str_new(p, nl - p));
+        p = nl;
+      }
+    }
+  return ary;
+}
+
+static VALUE fancy_read_parts_cleanup(VALUE arg)
+{
+  fancy_parallel_state * s = (fancy_parallel_state *) arg;
+  int i;
+  for(i = 0; i < s->nb_parts; i++)
+    fancy_columns_free(s->columns + i);
+  free(s->columns);
+  return Qnil;
+}
+
+/* Reads the rest of a File with several threads, or returns Qundef if
+   it is not a regular file */
+static VALUE fancy_read_parallel(VALUE stream, const fancy_format * f, 
+                                 double def, long skip_first, 
+                                 long initial_size)
+{
+  fancy_parallel_state s;
+  struct stat st;
+  VALUE ary;
+  int i;
+
+  s.fd = NUM2INT(rb_funcall(stream, rb_intern("fileno"), 0));
+  if(fstat(s.fd, &st) || ! S_ISREG(st.st_mode))
+    return Qundef;
+  /* The position of the IO takes its buffer into account */
+  s.offset = NUM2OFFT(rb_funcall(stream, rb_intern("pos"), 0));
+  s.size = st.st_size;
+  s.offset = fancy_skip_lines(s.fd, s.offset, s.size, skip_first);
+
+  s.format = f;
+  s.nb_parts = dvector_num_threads;
+  s.columns = ALLOC_N(fancy_columns, s.nb_parts);
+  for(i = 0; i < s.nb_parts; i++) {
+    fancy_columns_init(s.columns + i, def, initial_size);
+    s.columns[i].keep_comments = 1;
+  }
+  ary = rb_ensure(fancy_read_parts, (VALUE) &s, 
+                  fancy_read_parts_cleanup, (VALUE) &s);
+  /* We leave the stream at its end, as when it is read in one go */
+  rb_funcall(stream, rb_intern("seek"), 1, OFFT2NUM(s.size));
+  return ary;
+}
+
+#endif
+
+/*
+  :call-seq:
+  Dvector.fast_fancy_read(stream, options) => Array_of_Dvectors
+  
+  Reads data from an IO stream (or anything that supports a gets method)
+  and separate it into columns of data
+  according to the _options_, a hash holding the following elements
+  (compulsory, but you can use FANCY_READ_DEFAULTS):
+  * 'sep': a regular expression that separate the entries
+  * 'comments': any line matching this will be skipped
+  * 'skip_first': skips that many lines before reading anything
+  * 'index_col': if true, the first column returned contains the
+    number of the line read
+  * 'remove_space': whether to remove spaces at the beginning of a line.
+  * 'comment_out': this should be an array into which the comments
      will be dumped one by one.
   * 'default':  what to put when nothing was found but a number must be used
   * 'last_col': when this is specified, it represents the last column which
@@ -5662,6 +6954,16 @@ static VALUE marked_array()
   * 'initial_size': the initial size of the memory buffers: if there
     are not more lines than that, no additional memory allocation/copy
     occurs.
+
+  When there are no text columns, when 'sep' is /\s+/ or matches a
+  single character (such as /,/ or /\t/) and when 'comments' is of the
+  form /^#/ or /^\s*#/, streams that have a read method are read by
+  large blocks and split into lines and fields in C, which is much
+  faster and gives the same results.
+
+  * 'parallel': in these cases, if _stream_ is a File, its lines are
+    read by Dobjects.num_threads threads, each taking care of a part of
+    the file, with the same results.
 */
 static VALUE dvector_fast_fancy_read(VALUE self, VALUE stream, VALUE options)
 {
@@ -5702,6 +7004,26 @@ static VALUE dvector_fast_fancy_read(VALUE self, VALUE stream, VALUE options)
   }
 
 
+  /* Without text columns, the simple cases are handled in C */
+  {
+    fancy_format format;
+    if(fancy_format_from_options(&format, stream, options)) {
+      long initial_size = FIX2LONG(rb_hash_aref(options, 
+                                              rb_str_new2("initial_size")));
+#ifdef HAVE_PREAD
+      if(RTEST(rb_hash_aref(options, rb_str_new2("parallel"))) &&
+         rb_obj_is_kind_of(stream, rb_cFile)) {
+        VALUE ary = fancy_read_parallel(stream, &format, def, skip_first, 
+                                        initial_size);
+        if(ary != Qundef)
+          return ary;
+      }
+#endif
+      return fancy_read_simple(stream, &format, def, skip_first, 
+                               initial_size);
+    }
+  }
+
   /* array of Ruby arrays containing the text objects of interest */
   VALUE * text_cols = NULL;
 
@@ -5825,7 +7147,7 @@ static VALUE dvector_fast_fancy_read(VALUE self, VALUE stream, VALUE options)
       }
       else {
         a = StringValueCStr(pre);
-        double c = strtod(a, &b);
+        double c = fast_strtod(a, &b, 0);
         if(b == a) 
           c = def;
         if(col >= nb_vectors) {
@@ -5888,6 +7210,553 @@ static VALUE dvector_fast_fancy_read(VALUE self, VALUE stream, VALUE options)
   return ary;
 }
 
+/*
+  :call-seq:
+  Dvector.fast_each_chunk(stream, rows, options) {|columns| ... } => true or false
+
+  Reads _stream_ as fast_fancy_read with the same _options_, but
+  yields the columns by chunks of _rows_ lines (the last one may be
+  shorter) instead of returning them. The same Array and the same
+  Dvectors are yielded for all the chunks, so the memory used doesn't
+  depend on the size of the stream. Columns that only appear after the
+  first chunks are added at the end of the Array.
+
+  Returns false without reading anything if _options_ can't be handled
+  by the C tokenizer (see fast_fancy_read). This is the fast part of
+  Dvector.each_chunk.
+*/
+static VALUE dvector_fast_each_chunk(VALUE self, VALUE stream, VALUE rows, 
+                                     VALUE options)
+{
+  fancy_format format;
+  long nb_rows = NUM2LONG(rows);
+  if(nb_rows <= 0)
+    rb_raise(rb_eArgError, "the number of rows must be positive");
+  rb_need_block();
+  if(! fancy_format_from_options(&format, stream, options))
+    return Qfalse;
+  fancy_read_chunks(stream, &format, 
+                    rb_num2dbl(rb_hash_aref(options, rb_str_new2("default"))),
+                    FIX2LONG(rb_hash_aref(options, 
+                                          rb_str_new2("skip_first"))),
+                    nb_rows);
+  return Qtrue;
+}
+
+/*
+  :call-seq:
+  Dvector.fast_write(io, columns, sep) => io
+
+  Writes the Dvectors of _columns_ to _io_ (anything with a write
+  method) as columns of text separated by _sep_, one row per line, with
+  the shortest representation of each number that reads back exactly
+  (the same as Float#to_s). Shorter columns are padded with empty
+  fields. This is the fast part of Dvector.write.
+*/
+static VALUE dvector_fast_write(VALUE klass, VALUE io, VALUE columns, 
+                                VALUE sep)
+{
+  ID write_id = rb_intern("write");
+  long nb, j, rows = 0, row, row_size, capa, len = 0;
+  VALUE buf;
+  char * p;
+
+  columns = rb_Array(columns);
+  nb = RARRAY_LEN(columns);
+  columns = rb_ary_dup(columns);
+  for(j = 0; j < nb; j++) {
+    VALUE col = dvector_to_dvector(rb_ary_entry(columns, j));
+    long l = Get_Dvector(col)->len;
+    rb_ary_store(columns, j, col);
+    if(l > rows)
+      rows = l;
+  }
+  StringValue(sep);
+  /* The largest possible row */
+  row_size = nb * (32 + RSTRING_LEN(sep)) + 1;
+  capa = row_size > FANCY_BLOCK ? row_size : FANCY_BLOCK;
+
+  buf = rb_str_new(NULL, capa);
+  p = RSTRING_PTR(buf);
+  for(row = 0; row < rows; row++) {
+    for(j = 0; j < nb; j++) {
+      Dvector * d = Get_Dvector(rb_ary_entry(columns, j));
+      if(j > 0) {
+        memcpy(p + len, RSTRING_PTR(sep), RSTRING_LEN(sep));
+        len += RSTRING_LEN(sep);
+      }
+      if(row < d->len)
+        len += fast_dtoa(d->ptr[row], p + len);
+    }
+    p[len++] = '\n';
+    if(len + row_size > capa || row == rows - 1) {
+      rb_str_set_len(buf, len);
+      rb_funcall(io, write_id, 1, buf);
+      /* Anything could have happened during the call to write, so we
+         make sure the next row still fits */
+      StringValue(sep);
+      row_size = nb * (32 + RSTRING_LEN(sep)) + 1;
+      if(row_size > capa)
+        capa = row_size;
+      buf = rb_str_new(NULL, capa);
+      p = RSTRING_PTR(buf);
+      len = 0;
+    }
+  }
+  return io;
+}
+
+/*
+  Compiled formulas for Dvector.compute_formula.
+
+  The formula is parsed by recursive descent into a small bytecode for
+  a stack machine, which is then run over blocks of FORMULA_BLOCK
+  elements of the input Dvectors: each instruction works on a whole
+  block at a time, so the dispatch cost is paid once per block rather
+  than once per element.
+
+  Only the subset of Ruby that can be evaluated exactly the same way in
+  C is understood: floating point numbers, column[n], + - * / % ** and
+  parentheses, the functions of Math and those that MathEvaluator adds,
+  and the constants PI and E.
+  Anything else (including integer divisions, which don't give the same
+  result in C) makes the compilation fail, and compute_formula falls
+  back on the Ruby evaluation.
+*/
+
+#define FORMULA_BLOCK 256
+#define FORMULA_MAX_STACK 64
+
+enum formula_opcode {
+  FORMULA_CONST, FORMULA_COLUMN,
+  FORMULA_ADD, FORMULA_SUB, FORMULA_MUL, FORMULA_DIV, FORMULA_MOD,
+  FORMULA_FLOOR_MOD, FORMULA_POW, FORMULA_NEG, FORMULA_FUNC1, FORMULA_FUNC2
+};
+
+typedef struct {
+  enum formula_opcode op;
+  long arg;               /* the column for FORMULA_COLUMN */
+  double value;           /* the value for FORMULA_CONST */
+  double (*func1)(double);
+  double (*func2)(double, double);
+} formula_instruction;
+
+typedef struct {
+  const char *pos;        /* the parser's position in the formula */
+  formula_instruction *code;
+  long len, capa;
+  int depth, max_depth;   /* of the evaluation stack */
+  int nesting;            /* of the parsing functions */
+  long nb_columns;        /* the number of elements of the array */
+  double **columns;       /* NULL for the elements that aren't Dvectors */
+  int failed;
+} formula_compiler;
+
+static double formula_log_base(double x, double base) {
+  return log(x)/log(base);
+}
+static double formula_mod(double x, double y) {
+  /* Ruby's modulo takes the sign of y */
+  double r = fmod(x, y);
+  if(r != 0 && ((r < 0) != (y < 0)))
+    r += y;
+  return r;
+}
+/* Dvector#modulo, which differs from the above when x/y is large */
+static double formula_floor_mod(double x, double y) {
+  return x - y * floor(x/y);
+}
+
+static const struct {
+  const char *name;
+  double (*func1)(double);
+  double (*func2)(double, double);
+} formula_functions[] = {
+  { "sin", sin, NULL }, { "cos", cos, NULL }, { "tan", tan, NULL },
+  { "asin", asin, NULL }, { "acos", acos, NULL }, { "atan", atan, NULL },
+  { "sinh", sinh, NULL }, { "cosh", cosh, NULL }, { "tanh", tanh, NULL },
+  { "asinh", asinh, NULL }, { "acosh", acosh, NULL },
+  { "atanh", atanh, NULL }, { "exp", exp, NULL }, { "log", log, formula_log_base },
+  { "log10", log10, NULL }, { "log2", log2, NULL }, { "sqrt", sqrt, NULL },
+  { "cbrt", cbrt, NULL }, { "erf", erf, NULL }, { "erfc", erfc, NULL },
+  { "atan2", NULL, atan2 }, { "hypot", NULL, hypot },
+  { "fabs", fabs, NULL }, { "floor_mod", NULL, formula_floor_mod },
+  { NULL, NULL, NULL }
+};
+
+static void formula_emit(formula_compiler *c, enum formula_opcode op,
+                         int stack_change)
+{
+  if(c->len >= c->capa) {
+    c->capa = c->capa * 2 + 16;
+    REALLOC_N(c->code, formula_instruction, c->capa);
+  }
+  MEMZERO(c->code + c->len, formula_instruction, 1);
+  c->code[c->len++].op = op;
+  c->depth += stack_change;
+  if(c->depth > c->max_depth)
+    c->max_depth = c->depth;
+  if(c->max_depth > FORMULA_MAX_STACK)
+    c->failed = 1;
+}
+
+static void formula_skip_spaces(formula_compiler *c)
+{
+  while(*c->pos == ' ' || *c->pos == '\t')
+    c->pos++;
+}
+
+/* Each parsing function returns 1 when the value is an Integer for
+   Ruby */
+static int formula_parse_sum(formula_compiler *c);
+static int formula_parse_unary(formula_compiler *c);
+
+static int formula_parse_primary(formula_compiler *c)
+{
+  const char *start;
+  formula_skip_spaces(c);
+  start = c->pos;
+  if(*c->pos == '(') {
+    int is_int;
+    c->pos++;
+    is_int = formula_parse_sum(c);
+    formula_skip_spaces(c);
+    if(*c->pos != ')')
+      c->failed = 1;
+    else
+      c->pos++;
+    return is_int;
+  }
+  if(isdigit(*c->pos)) {
+    int is_int = 1;
+    char buffer[64], *end;
+    long len = 0;
+    /* Ruby numbers, with their underscores */
+    while(isdigit(*c->pos) || (*c->pos == '_' && isdigit(c->pos[1]))) {
+      if(*c->pos != '_' && len < 62)
+        buffer[len++] = *c->pos;
+      c->pos++;
+    }
+    if(*c->pos == '.' && isdigit(c->pos[1])) {
+      is_int = 0;
+      buffer[len++] = *c->pos++;
+      while(isdigit(*c->pos) && len < 62)
+        buffer[len++] = *c->pos++;
+    }
+    if((*c->pos == 'e' || *c->pos == 'E') &&
+       (isdigit(c->pos[1]) || ((c->pos[1] == '-' || c->pos[1] == '+')
+                               && isdigit(c->pos[2])))) {
+      is_int = 0;
+      buffer[len++] = *c->pos++;
+      buffer[len++] = *c->pos++;
+      while(isdigit(*c->pos) && len < 62)
+        buffer[len++] = *c->pos++;
+    }
+    buffer[len] = 0;
+    if(isalnum(*c->pos) || *c->pos == '_' || *c->pos == '.' || len >= 62) {
+      c->failed = 1;
+      return 0;
+    }
+    formula_emit(c, FORMULA_CONST, 1);
+    c->code[c->len - 1].value = strtod(buffer, &end);
+    return is_int;
+  }
+  if(isalpha(*c->pos)) {
+    long len, i;
+    while(isalnum(*c->pos) || *c->pos == '_')
+      c->pos++;
+    len = c->pos - start;
+    if(len == 6 && ! strncmp(start, "column", 6)) {
+      long col = 0;
+      formula_skip_spaces(c);
+      if(*c->pos != '[') {
+        c->failed = 1;
+        return 0;
+      }
+      c->pos++;
+      formula_skip_spaces(c);
+      if(! isdigit(*c->pos)) {
+        c->failed = 1;
+        return 0;
+      }
+      while(isdigit(*c->pos) && col < c->nb_columns)
+        col = col * 10 + (*c->pos++ - '0');
+      formula_skip_spaces(c);
+      if(*c->pos != ']' || col >= c->nb_columns || ! c->columns[col]) {
+        c->failed = 1;
+        return 0;
+      }
+      c->pos++;
+      formula_emit(c, FORMULA_COLUMN, 1);
+      c->code[c->len - 1].arg = col;
+      return 0;
+    }
+    if((len == 2 && ! strncmp(start, "PI", 2)) ||
+       (len == 1 && *start == 'E')) {
+      formula_emit(c, FORMULA_CONST, 1);
+      c->code[c->len - 1].value = (len == 2 ? M_PI : M_E);
+      return 0;
+    }
+    for(i = 0; formula_functions[i].name; i++) {
+      int nb_args = 0;
+      if(strlen(formula_functions[i].name) != (size_t) len ||
+         strncmp(start, formula_functions[i].name, len))
+        continue;
+      /* Ruby only takes a parenthesis right after the name as the
+         argument list */
+      if(*c->pos != '(')
+        break;
+      c->pos++;
+      while(1) {
+        formula_parse_sum(c);
+        nb_args++;
+        formula_skip_spaces(c);
+        if(*c->pos != ',' || nb_args >= 2)
+          break;
+        c->pos++;
+      }
+      if(*c->pos != ')')
+        break;
+      c->pos++;
+      if(nb_args == 1 && formula_functions[i].func1) {
+        formula_emit(c, FORMULA_FUNC1, 0);
+        c->code[c->len - 1].func1 = formula_functions[i].func1;
+      }
+      else if(nb_args == 2 && 
+              formula_functions[i].func2 == formula_floor_mod)
+        formula_emit(c, FORMULA_FLOOR_MOD, -1);
+      else if(nb_args == 2 && formula_functions[i].func2) {
+        formula_emit(c, FORMULA_FUNC2, -1);
+        c->code[c->len - 1].func2 = formula_functions[i].func2;
+      }
+      else
+        break;
+      return 0;
+    }
+  }
+  c->failed = 1;
+  return 0;
+}
+
+/* ** is right-associative, and binds tighter than the unary minus */
+static int formula_parse_power(formula_compiler *c)
+{
+  int is_int = formula_parse_primary(c);
+  formula_skip_spaces(c);
+  if(c->pos[0] == '*' && c->pos[1] == '*') {
+    c->pos += 2;
+    int exp_is_int = formula_parse_unary(c);
+    if(is_int && exp_is_int)
+      c->failed = 1;      /* Integer or Rational */
+    formula_emit(c, FORMULA_POW, -1);
+    return 0;
+  }
+  return is_int;
+}
+
+static int formula_parse_unary(formula_compiler *c)
+{
+  int is_int;
+  /* All the recursions go through here */
+  if(c->failed || ++c->nesting > 200) {
+    c->failed = 1;
+    return 0;
+  }
+  formula_skip_spaces(c);
+  if(*c->pos == '-') {
+    c->pos++;
+    is_int = formula_parse_unary(c);
+    formula_emit(c, FORMULA_NEG, 0);
+  }
+  else if(*c->pos == '+') {
+    c->pos++;
+    is_int = formula_parse_unary(c);
+  }
+  else
+    is_int = formula_parse_power(c);
+  c->nesting--;
+  return is_int;
+}
+
+static int formula_parse_product(formula_compiler *c)
+{
+  int is_int = formula_parse_unary(c);
+  while(! c->failed) {
+    enum formula_opcode op;
+    int rhs_is_int;
+    formula_skip_spaces(c);
+    if(*c->pos == '*' && c->pos[1] != '*')
+      op = FORMULA_MUL;
+    else if(*c->pos == '/')
+      op = FORMULA_DIV;
+    else if(*c->pos == '%')
+      op = FORMULA_MOD;
+    else
+      break;
+    c->pos++;
+    rhs_is_int = formula_parse_unary(c);
+    /* Integer divisions don't work the same in C */
+    if(is_int && rhs_is_int && op != FORMULA_MUL)
+      c->failed = 1;
+    is_int = is_int && rhs_is_int;
+    formula_emit(c, op, -1);
+  }
+  return is_int;
+}
+
+static int formula_parse_sum(formula_compiler *c)
+{
+  int is_int = formula_parse_product(c);
+  while(! c->failed) {
+    enum formula_opcode op;
+    formula_skip_spaces(c);
+    if(*c->pos == '+')
+      op = FORMULA_ADD;
+    else if(*c->pos == '-')
+      op = FORMULA_SUB;
+    else
+      break;
+    c->pos++;
+    is_int = formula_parse_product(c) && is_int;
+    formula_emit(c, op, -1);
+  }
+  return is_int;
+}
+
+/* Runs the code over the elements from start to start + len */
+static void formula_run_block(formula_compiler *c, double *stack,
+                              long start, long len, double *target)
+{
+  long pc, i;
+  double *top = NULL;     /* the block at the top of the stack */
+  for(pc = 0; pc < c->len; pc++) {
+    formula_instruction *ins = c->code + pc;
+    double *src, *dest;
+    switch(ins->op) {
+    case FORMULA_CONST:
+      top = top ? top + FORMULA_BLOCK : stack;
+      for(i = 0; i < len; i++)
+        top[i] = ins->value;
+      break;
+    case FORMULA_COLUMN:
+      top = top ? top + FORMULA_BLOCK : stack;
+      MEMCPY(top, c->columns[ins->arg] + start, double, len);
+      break;
+    case FORMULA_NEG:
+      for(i = 0; i < len; i++)
+        top[i] = -top[i];
+      break;
+    case FORMULA_FUNC1:
+      for(i = 0; i < len; i++)
+        top[i] = ins->func1(top[i]);
+      break;
+    default:
+      src = top;
+      top -= FORMULA_BLOCK;
+      dest = top;
+      switch(ins->op) {
+      case FORMULA_ADD:
+        for(i = 0; i < len; i++)
+          dest[i] += src[i];
+        break;
+      case FORMULA_SUB:
+        for(i = 0; i < len; i++)
+          dest[i] -= src[i];
+        break;
+      case FORMULA_MUL:
+        for(i = 0; i < len; i++)
+          dest[i] *= src[i];
+        break;
+      case FORMULA_DIV:
+        for(i = 0; i < len; i++)
+          dest[i] /= src[i];
+        break;
+      case FORMULA_MOD:
+        for(i = 0; i < len; i++)
+          dest[i] = formula_mod(dest[i], src[i]);
+        break;
+      case FORMULA_FLOOR_MOD:
+        for(i = 0; i < len; i++)
+          dest[i] = dest[i] - src[i] * floor(dest[i]/src[i]);
+        break;
+      case FORMULA_POW:
+        for(i = 0; i < len; i++)
+          dest[i] = pow(dest[i], src[i]);
+        break;
+      case FORMULA_FUNC2:
+        for(i = 0; i < len; i++)
+          dest[i] = ins->func2(dest[i], src[i]);
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  MEMCPY(target + start, stack, double, len);
+}
+
+/*
+  :call-seq:
+  Dvector.fast_compute_formula(formula, array) => a_dvector or nil
+
+  Does the job of Dvector.compute_formula, but compiles the _formula_
+  rather than having Ruby evaluate it for each element. It only
+  understands numbers, <tt>column[n]</tt>, the arithmetic operators,
+  parentheses, the functions of Math, +fabs+ and +floor_mod+ (see
+  MathEvaluator) and the constants +PI+ and +E+; for anything else, it
+  returns +nil+.
+*/
+static VALUE dvector_fast_compute_formula(VALUE klass, VALUE formula,
+                                          VALUE array)
+{
+  formula_compiler c;
+  long i, len = -1;
+  double *stack, *target;
+  VALUE ret;
+
+  formula = rb_str_to_str(formula);
+  array = rb_Array(array);
+  MEMZERO(&c, formula_compiler, 1);
+  c.nb_columns = RARRAY_LEN(array);
+  c.columns = ALLOC_N(double *, c.nb_columns + 1);
+  for(i = 0; i < c.nb_columns; i++) {
+    VALUE elem = rb_ary_entry(array, i);
+    long l;
+    c.columns[i] = NULL;
+    if(! is_a_dvector(elem))
+      continue;
+    c.columns[i] = Dvector_Data_for_Read(elem, &l);
+    if(len >= 0 && l != len) {
+      xfree(c.columns);
+      rb_raise(rb_eArgError, "Dvectors should have all the same length !");
+    }
+    len = l;
+  }
+  if(len < 0) {
+    xfree(c.columns);
+    rb_raise(rb_eArgError, "No Dvector found");
+  }
+
+  c.pos = StringValueCStr(formula);
+  formula_parse_sum(&c);
+  formula_skip_spaces(&c);
+  if(c.failed || *c.pos || c.max_depth == 0) {
+    xfree(c.code);
+    xfree(c.columns);
+    return Qnil;
+  }
+
+  ret = Dvector_Create();
+  target = Dvector_Data_Resize(ret, len);
+  stack = ALLOC_N(double, FORMULA_BLOCK * c.max_depth);
+  for(i = 0; i < len; i += FORMULA_BLOCK)
+    formula_run_block(&c, stack, i, MIN(FORMULA_BLOCK, len - i), target);
+  xfree(stack);
+  xfree(c.code);
+  xfree(c.columns);
+  return ret;
+}
+
 /*
   Returns a list of local extrema of the vector, organized thus:
   
@@ -6211,6 +8080,9 @@ static VALUE dvector_fft_mul(VALUE self, VALUE m)
  *          log_xhe0.replace(xhe).sub!(xhe1).sub!(xhe2).log10!
  * This copies <i>xhe</i> to <i>log_xhe0</i>, subtracts <i>xhe1</i> and <i>xhe2</i> from <i>log_xhe0</i> in place,
  * and then takes the +log+, also in place.  It's not pretty, but it is efficient -- use if needed.
+ * Or you can have it both ways, with a lazy expression (see LazyDvector) that is computed in a single pass
+ * over the vectors when the result is asked for:
+ *          log_xhe0 = (xhe.lazy - xhe1 - xhe2).log10.to_dvector
  *
  * Please report problems with the Dvector extension to the <tt>tioga-users</tt> at <tt>rubyforge.org</tt> mailing list.
  * [Note: for N-dimensional arrays or arrays of complex numbers or integers as well as doubles,
@@ -6228,6 +8100,16 @@ void Init_Dvector() {
      we use the Dvector module. I don't know if it is a good idea...
   */
    VALUE mDobjects = rb_define_module("Dobjects");
+   rb_define_singleton_method(mDobjects, "num_threads", 
+                              dobjects_num_threads, 0);
+   rb_define_singleton_method(mDobjects, "num_threads=", 
+                              dobjects_set_num_threads, 1);
+   rb_define_singleton_method(mDobjects, "with_num_threads", 
+                              dobjects_with_num_threads, 1);
+   rb_define_singleton_method(mDobjects, "parallel_threshold", 
+                              dobjects_parallel_threshold, 0);
+   rb_define_singleton_method(mDobjects, "parallel_threshold=", 
+                              dobjects_set_parallel_threshold, 1);
    cDvector = rb_define_class_under(mDobjects, "Dvector", rb_cObject);
    rb_include_module(cDvector, rb_mEnumerable);
    
@@ -6244,6 +8126,7 @@ void Init_Dvector() {
    rb_define_singleton_method(cDvector, "pm_cubic_interpolate", dvector_pm_cubic_interpolate, -1);
 
    rb_define_singleton_method(cDvector, "linear_interpolate", dvector_linear_interpolate, -1);
+   rb_define_singleton_method(cDvector, "mmap", dvector_mmap, -1);
    rb_define_singleton_method(cDvector, "min_of_many", dvector_min_of_many, 1);
    rb_define_singleton_method(cDvector, "max_of_many", dvector_max_of_many, 1);
 
@@ -6492,6 +8375,8 @@ void Init_Dvector() {
 
    /* dvector marshalling */
    rb_define_method(cDvector, "_dump", dvector_dump, 1);
+   rb_define_method(cDvector, "to_binary", dvector_to_binary, 0);
+   rb_define_singleton_method(cDvector, "from_binary", dvector_from_binary, 1);
    rb_define_singleton_method(cDvector, "_load", dvector_load, 1);
 
    /* simple convolution */
@@ -6500,6 +8385,14 @@ void Init_Dvector() {
    /* Fast fancy read: */
    rb_define_singleton_method(cDvector, "fast_fancy_read", 
 			      dvector_fast_fancy_read, 2);
+   rb_define_singleton_method(cDvector, "fast_each_chunk", 
+                              dvector_fast_each_chunk, 3);
+   rb_define_singleton_method(cDvector, "fast_write", 
+                              dvector_fast_write, 3);
+
+   /* Compiled formulas */
+   rb_define_singleton_method(cDvector, "fast_compute_formula", 
+			      dvector_fast_compute_formula, 2);
 
 
    /* Local extrema */
@@ -6539,8 +8432,10 @@ void Init_Dvector() {
    RB_EXPORT_SYMBOL(cDvector, Dvector_Data_Resize);
    RB_EXPORT_SYMBOL(cDvector, Dvector_Data_Replace);
    RB_EXPORT_SYMBOL(cDvector, Dvector_Create);
+   RB_EXPORT_SYMBOL(cDvector, Dvector_Set_View);
    RB_EXPORT_SYMBOL(cDvector, Dvector_Store_Double);
    RB_EXPORT_SYMBOL(cDvector, Dvector_Push_Double);
+   RB_EXPORT_SYMBOL(cDvector, Dvector_Parallel_For);
    RB_EXPORT_SYMBOL(cDvector, c_dvector_spline_interpolate);
    RB_EXPORT_SYMBOL(cDvector, c_dvector_linear_interpolate);
    RB_EXPORT_SYMBOL(cDvector, c_dvector_create_spline_interpolant);
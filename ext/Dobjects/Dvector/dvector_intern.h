@@ -37,8 +37,13 @@ PRIVATE double *Dvector_Data_for_Write(VALUE dvector, long *len_ptr);
 PRIVATE double *Dvector_Data_Resize(VALUE dvector, long new_len);
 PRIVATE double *Dvector_Data_Replace(VALUE dvector, long len, double *data); /* copies the data into the dvector */
 PRIVATE VALUE Dvector_Create(void);
+PRIVATE void Dvector_Set_View(VALUE dvector, VALUE owner, double *ptr, long len);
 PRIVATE void Dvector_Push_Double(VALUE ary, double val);
 PRIVATE void Dvector_Store_Double(VALUE ary, long idx, double val);
+PRIVATE int Dvector_Parallel_For(long len, 
+                                 void (*task)(void *data, long start, 
+                                              long end, int part),
+                                 void *data);
 
 PRIVATE VALUE Read_Dvectors(char *filename, VALUE destinations, int first_row_of_file, int number_of_rows);
 PRIVATE VALUE Read_Row(char *filename, int row, VALUE row_ary);
@@ -15,8 +15,27 @@ unless have_header("ieee754.h")
 end
 
 
+# Large vectors are processed by several threads, with the GVL released
+if have_header("pthread.h") and have_header("ruby/thread.h")
+  have_library("pthread", "pthread_create")
+else
+  puts "No threads: the operations on large vectors will run in one thread"
+end
+
+# Dvector.mmap
+have_header("sys/mman.h")
+
+# Parallel fancy_read of files
+have_func("pread", "unistd.h")
+
 # We add include directories
 $INCFLAGS += " -I../../includes"
 
+# Lets the compiler vectorize the sqrt loops of kernels.h; nothing here
+# looks at errno after a math function
+if try_compile("int main() { return 0; }", "-fno-math-errno")
+  $CFLAGS += " -fno-math-errno"
+end
+
 
 create_makefile 'Dobjects/Dvector'
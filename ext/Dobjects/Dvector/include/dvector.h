@@ -49,10 +49,23 @@ DECLARE_SYMBOL(double *, Dvector_Data_Replace,
 	       (VALUE dvector, long len, double *data)); 
 /* copies the data into the dvector */
 DECLARE_SYMBOL(VALUE, Dvector_Create, (void));
+/* makes the dvector read the len doubles at ptr, which belong to owner,
+   until it is first modified; owner is kept alive */
+DECLARE_SYMBOL(void, Dvector_Set_View, 
+	       (VALUE dvector, VALUE owner, double *ptr, long len));
 DECLARE_SYMBOL(void, Dvector_Store_Double, (VALUE ary, long idx, double val));
 /* pushes one element onto the vector */
 DECLARE_SYMBOL(void, Dvector_Push_Double, (VALUE ary, double val));
 
+/* runs task over [0, len), split in parts that run in parallel when
+   len is large enough and Dobjects.num_threads > 1, without the Ruby
+   GVL: task must not call anything from Ruby. It returns the number of
+   parts, which are numbered from 0 */
+DECLARE_SYMBOL(int, Dvector_Parallel_For, 
+	       (long len, 
+		void (*task)(void *data, long start, long end, int part),
+		void *data));
+
 
 /* functions for interpolation */
 DECLARE_SYMBOL(void, c_dvector_create_spline_interpolant,
@@ -92,16 +92,30 @@ PRIVATE
 /* 
  *  call-seq:
  *     Flate.expand(str)  ->  string
+ *     Flate.expand(str, size)  ->  string
  *
  *  Returns a decompressed verion of _str_ in a new string.
  *  Assumes that _str_ was compressed using <code>Flate.compress</code>.
+ *  When the _size_ of the result is known, it is allocated right away;
+ *  otherwise, the result can't be larger than about 10MB.
  *  
  */
  
-VALUE do_expand(VALUE klass, VALUE str) {
+VALUE do_expand(int argc, VALUE *argv, VALUE klass) {
+   VALUE str, size;
+   rb_scan_args(argc, argv, "11", &str, &size);
    str = rb_String(str);
    unsigned char *ptr = (unsigned char *)RSTRING_PTR(str);
    long len = RSTRING_LEN(str);
+   if (size != Qnil) {
+      unsigned long new_len = NUM2ULONG(size);
+      VALUE new_str = rb_str_new(NULL, new_len);
+      if (uncompress((unsigned char *)RSTRING_PTR(new_str), &new_len, 
+                     ptr, len) != Z_OK)
+         rb_raise(rb_eArgError, "Error in Flate.expand");
+      rb_str_set_len(new_str, new_len);
+      return new_str;
+   }
    unsigned long new_len = len * 4 + 100;
    unsigned char *new_ptr = ALLOC_N(unsigned char, new_len);
    if (flate_expand(&new_ptr, &new_len, ptr, len) != Z_OK) {
@@ -132,7 +146,79 @@ PRIVATE int flate_expand(unsigned char **new_ptr_ptr, unsigned long *new_len_ptr
    *new_ptr_ptr = new_ptr;
    return result;
 }
- 
+
+
+/* Streaming compression */
+
+#define FLATE_STREAM_CHUNK 16384
+
+struct flate_stream {
+   z_stream zs;
+   FILE *out;
+   unsigned long total_out;
+   unsigned char buffer[FLATE_STREAM_CHUNK];
+};
+
+/* Runs deflate with the given flush mode until it has consumed all the
+   pending input, writing the output to s->out a chunk at a time. */
+PRIVATE int flate_stream_deflate(flate_stream *s, int flush)
+{
+   int result;
+   unsigned long len;
+   do {
+      s->zs.next_out = s->buffer;
+      s->zs.avail_out = FLATE_STREAM_CHUNK;
+      result = deflate(&s->zs, flush);
+      if (result == Z_STREAM_ERROR) return result;
+      len = FLATE_STREAM_CHUNK - s->zs.avail_out;
+      if (len > 0 && fwrite(s->buffer, 1, len, s->out) < len) return Z_ERRNO;
+      s->total_out += len;
+   } while (s->zs.avail_out == 0);
+   return (flush == Z_FINISH && result != Z_STREAM_END) ? Z_BUF_ERROR : Z_OK;
+}
+
+PRIVATE flate_stream * flate_stream_open(FILE *out)
+{
+   flate_stream *s = ALLOC(flate_stream);
+   s->zs.zalloc = Z_NULL;
+   s->zs.zfree = Z_NULL;
+   s->zs.opaque = Z_NULL;
+   if (deflateInit(&s->zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+      free(s);
+      return NULL;
+   }
+   s->out = out;
+   s->total_out = 0;
+   return s;
+}
+
+PRIVATE int flate_stream_write(flate_stream *s, unsigned char *ptr, long len)
+{
+   int result = Z_OK;
+   while (len > 0 && result == Z_OK) {
+      /* avail_in is only an uInt */
+      uInt n = (len > 0x40000000L) ? 0x40000000U : (uInt) len;
+      s->zs.next_in = ptr;
+      s->zs.avail_in = n;
+      result = flate_stream_deflate(s, Z_NO_FLUSH);
+      ptr += n;
+      len -= n;
+   }
+   return result;
+}
+
+PRIVATE int flate_stream_close(flate_stream *s, unsigned long *new_len_ptr)
+{
+   int result;
+   s->zs.next_in = Z_NULL;
+   s->zs.avail_in = 0;
+   result = flate_stream_deflate(s, Z_FINISH);
+   deflateEnd(&s->zs);
+   *new_len_ptr = s->total_out;
+   free(s);
+   return result;
+}
+
 /* 
  * Document-module: Flate
  *
@@ -154,10 +240,13 @@ PUBLIC void Init_Flate() {
      VALUE mFlate = rb_define_module_under(mTioga, "Flate"); */
    VALUE mFlate = rb_define_module("Flate");
    rb_define_singleton_method(mFlate, "compress", do_compress, 1);
-   rb_define_singleton_method(mFlate, "expand", do_expand, 1);
+   rb_define_singleton_method(mFlate, "expand", do_expand, -1);
 
    /* exporting the symbols that might be needed by other modules */
    RB_EXPORT_SYMBOL(mFlate, flate_expand);
    RB_EXPORT_SYMBOL(mFlate, flate_compress);
+   RB_EXPORT_SYMBOL(mFlate, flate_stream_open);
+   RB_EXPORT_SYMBOL(mFlate, flate_stream_write);
+   RB_EXPORT_SYMBOL(mFlate, flate_stream_close);
 }
 
@@ -26,6 +26,7 @@
 #include <namespace.h>
 
 #include "ruby.h"
+#include <stdio.h>
 
 /* and once again, the dirty trick */
 
@@ -42,6 +43,19 @@ PRIVATE int flate_expand(unsigned char **new_ptr_ptr, unsigned long *new_len_ptr
 // So you MUST allocate a buffer rather than using a static one.
 // And you MUST be prepared for the buffer to change location and size.
 
+/* Streaming compression: the compressed data is written to the given
+   FILE as it is produced, so memory use is bounded by the deflate
+   window rather than by the amount of data. */
+typedef struct flate_stream flate_stream;
+
+PRIVATE flate_stream * flate_stream_open(FILE *out);
+// returns a new compression stream writing to out, or NULL on failure.
+PRIVATE int flate_stream_write(flate_stream *s, unsigned char *ptr, long len);
+// compresses len bytes from ptr, writing whatever output is ready.
+PRIVATE int flate_stream_close(flate_stream *s, unsigned long *new_len_ptr);
+// flushes the remaining data, stores the total number of compressed bytes
+// written in *new_len_ptr and frees s (even in case of error).
+
 // Here are the return codes for the compression/expansion functions. Negative
 // values are errors, positive values are used for special but normal events.
 
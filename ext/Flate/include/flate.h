@@ -27,6 +27,7 @@
 #define __flate_H__
 
 #include <symbols.h>
+#include <stdio.h>
 
 DECLARE_SYMBOL(int, flate_compress, 
 	       (unsigned char *new_ptr, unsigned long *new_len_ptr, 
@@ -45,6 +46,22 @@ DECLARE_SYMBOL(int, flate_expand,
 // So you MUST allocate a buffer rather than using a static one.
 // And you MUST be prepared for the buffer to change location and size.
 
+typedef struct flate_stream flate_stream; // opaque
+
+DECLARE_SYMBOL(flate_stream *, flate_stream_open, (FILE *out));
+// returns a new compression stream whose output goes directly to out,
+// or NULL if it could not be created.
+DECLARE_SYMBOL(int, flate_stream_write, 
+	       (flate_stream *s, unsigned char *ptr, long len));
+// compresses len bytes from ptr. Compressed data is written to the
+// output file as soon as it is available, so the memory used is bounded
+// by the size of the deflate window, not by the total amount of data.
+DECLARE_SYMBOL(int, flate_stream_close, 
+	       (flate_stream *s, unsigned long *new_len_ptr));
+// finishes the compressed stream, stores the total number of bytes
+// written to the output file in *new_len_ptr, and frees s.
+// s must not be used afterwards, even if an error is returned.
+
 // Here are the return codes for the compression/expansion functions. Negative
 // values are errors, positive values are used for special but normal events.
 
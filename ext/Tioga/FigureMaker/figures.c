@@ -257,6 +257,12 @@ FM *Get_FM(OBJ_PTR fmkr, int *ierr) {
 /* Warning on non-ok numbers */
    BOOL_ATTR(croak_on_nonok_numbers)
 
+/* Point culling in paths */
+   INT_ATTR(cull_points_threshold)
+
+/* Markers as Form XObjects */
+   INT_ATTR(marker_xobject_threshold)
+
 bool Get_initialized() {
    OBJ_PTR v = rb_cv_get(cFM, "@@initialized");
    return v != OBJ_FALSE && v != OBJ_NIL;
@@ -318,6 +324,8 @@ void Init_FigureMaker(void) {
    rb_define_method(cFM, "private_make", FM_private_make, 2);
    rb_define_method(cFM, "get_save_filename", FM_get_save_filename, 1);
    rb_define_method(cFM, "private_make_portfolio", FM_private_make_portfolio, 3);
+   rb_define_method(cFM, "private_begin_pdf_document", FM_private_begin_pdf_document, 1);
+   rb_define_method(cFM, "private_end_pdf_document", FM_private_end_pdf_document, 2);
    rb_define_method(cFM, "private_init_fm_data", FM_private_init_fm_data, 1);
 
 /* page attribute accessors */
@@ -380,6 +388,10 @@ void Init_FigureMaker(void) {
    attr_accessors(fill_opacity)
 /* croak on non ok */
    attr_accessors(croak_on_nonok_numbers)
+/* point culling */
+   attr_accessors(cull_points_threshold)
+/* marker stamping */
+   attr_accessors(marker_xobject_threshold)
 
 /* methods */
    rb_define_method(cFM, "pdf_gsave", FM_pdf_gsave, 0);
@@ -456,6 +468,7 @@ void Init_FigureMaker(void) {
    rb_define_method(cFM, "close_path", FM_close_path, 0);
    rb_define_method(cFM, "append_points_to_path", FM_append_points_to_path, 2);
    rb_define_method(cFM, "private_append_points_with_gaps_to_path", FM_private_append_points_with_gaps_to_path, 4);
+   rb_define_method(cFM, "private_append_decimated_points_to_path", FM_private_append_decimated_points_to_path, 4);
    rb_define_method(cFM, "append_arc_to_path", FM_append_arc_to_path, 8);
    rb_define_method(cFM, "append_rect_to_path", FM_append_rect_to_path, 4);
    rb_define_method(cFM, "append_rounded_rect_to_path", FM_append_rounded_rect_to_path, 6);
@@ -692,6 +705,9 @@ void Init_FigureMaker(void) {
    /* imports from Flate */
    RB_IMPORT_SYMBOL(mFlate, flate_compress);
    RB_IMPORT_SYMBOL(mFlate, flate_expand);
+   RB_IMPORT_SYMBOL(mFlate, flate_stream_open);
+   RB_IMPORT_SYMBOL(mFlate, flate_stream_write);
+   RB_IMPORT_SYMBOL(mFlate, flate_stream_close);
 
    /* imports from Dtable */
    OBJ_PTR cDtable = rb_define_class_under(mDobjects, "Dtable", rb_cObject);
@@ -715,6 +731,9 @@ IMPLEMENT_SYMBOL(c_dvector_create_spline_interpolant);
 
 IMPLEMENT_SYMBOL(flate_compress);
 IMPLEMENT_SYMBOL(flate_expand);
+IMPLEMENT_SYMBOL(flate_stream_open);
+IMPLEMENT_SYMBOL(flate_stream_write);
+IMPLEMENT_SYMBOL(flate_stream_close);
 
 IMPLEMENT_SYMBOL(Dtable_Ptr);
 IMPLEMENT_SYMBOL(Read_Dtable);
@@ -324,14 +324,22 @@ typedef struct {
     /* Whether to complain about out non ok numbers in paths */
     int croak_on_nonok_numbers;
 
+    /* Vectors of at least that many points get their redundant points
+       left out of paths (negative to never do it) */
+    int cull_points_threshold;
+
+    /* show_marker calls with at least that many points draw the marker
+       once, as a Form XObject, and stamp it at each point (negative to
+       never do it) */
+    int marker_xobject_threshold;
+
 /* PRIVATE -- not to be included in the user interface */
     double clip_left, clip_right, clip_top, clip_bottom; // in output coords
+    struct pdf_document *pdf; // the files being written; see pdfs.h
 } FM;
 
 typedef FM Figure_Maker;
 
-extern double bbox_llx, bbox_lly, bbox_urx, bbox_ury;
-
 extern char *data_dir;
 
 
@@ -415,6 +423,10 @@ extern void c_set_device_pagesize(OBJ_PTR fmkr, FM *p, double width, double heig
 extern OBJ_PTR c_get_save_filename(OBJ_PTR fmkr, FM *p, OBJ_PTR name, int *ierr);
 extern void c_private_make(OBJ_PTR fmkr, FM *p, OBJ_PTR name, OBJ_PTR cmd, int *ierr);
 extern OBJ_PTR c_private_make_portfolio(OBJ_PTR fmkr, FM *p, OBJ_PTR name, OBJ_PTR fignums, OBJ_PTR fignames, int *ierr);
+extern void c_private_begin_pdf_document(OBJ_PTR fmkr, FM *p, OBJ_PTR name,
+                                        int *ierr);
+extern void c_private_end_pdf_document(OBJ_PTR fmkr, FM *p, OBJ_PTR name,
+                                      OBJ_PTR fignames, int *ierr);
 
 /* The ID of the measures_info instance variable */
 extern ID_PTR measures_info_ID;
@@ -442,14 +454,14 @@ extern OBJ_PTR c_private_make_spline_interpolated_points(OBJ_PTR fmkr, FM *p,
 
 /*======================================================================*/
 // pdfcolor.c
-extern void Free_Functions(void);
-extern void Write_Functions(int *ierr);
-extern void Free_Stroke_Opacities(void);
-extern void Free_Fill_Opacities(void);
-extern void Write_Stroke_Opacity_Objects(void);
-extern void Write_Fill_Opacity_Objects(void);
-extern void Free_Shadings(void);
-extern void Write_Shadings(void);
+extern void Free_Functions(struct pdf_document *doc);
+extern void Write_Functions(FM *p, int *ierr);
+extern void Free_Stroke_Opacities(struct pdf_document *doc);
+extern void Free_Fill_Opacities(struct pdf_document *doc);
+extern void Write_Stroke_Opacity_Objects(FM *p);
+extern void Write_Fill_Opacity_Objects(FM *p);
+extern void Free_Shadings(struct pdf_document *doc);
+extern void Write_Shadings(FM *p);
 
 extern void c_stroke_opacity_set(OBJ_PTR fmkr, FM *p, double stroke_opacity, int *ierr);
 extern void c_fill_opacity_set(OBJ_PTR fmkr, FM *p, double fill_opacity, int *ierr);
@@ -546,13 +558,15 @@ extern void c_private_set_bounds(OBJ_PTR fmkr, FM *p,
 
 /*======================================================================*/
 // pdffile.c
-extern void Init_pdf(int *ierr);
 extern void Open_pdf(OBJ_PTR fmkr, FM *p, char *filename, bool quiet_mode, int *ierr);
 extern void Start_Axis_Standard_State(OBJ_PTR fmkr, FM *p, double r, double g, double b, double line_width, int *ierr);
-extern void End_Axis_Standard_State(void);
-extern void Write_gsave(void);
-extern void Write_grestore(void);
+extern void End_Axis_Standard_State(FM *p);
+extern void Write_gsave(FM *p);
+extern void Write_grestore(FM *p);
 extern void Close_pdf(OBJ_PTR fmkr, FM *p, bool quiet_mode, int *ierr);
+extern void Open_pdf_document(OBJ_PTR fmkr, FM *p, char *filename,
+                              int *ierr);
+extern void Close_pdf_document(OBJ_PTR fmkr, FM *p, int *ierr);
 extern void Rename_pdf(char *oldname, char *newname);
 
 extern void c_pdf_gsave(OBJ_PTR fmkr, FM *p, int *ierr);
@@ -640,6 +654,8 @@ extern void c_append_circle_to_path(OBJ_PTR fmkr, FM *p, double x, double y, dou
 extern void c_append_points_to_path(OBJ_PTR fmkr, FM *p, OBJ_PTR x_vec, OBJ_PTR y_vec, int *ierr);
 extern void c_private_append_points_with_gaps_to_path(OBJ_PTR fmkr, FM *p,
    OBJ_PTR x_vec, OBJ_PTR y_vec, OBJ_PTR gaps, bool do_close, int *ierr);
+extern void c_private_append_decimated_points_to_path(OBJ_PTR fmkr, FM *p,
+   OBJ_PTR x_vec, OBJ_PTR y_vec, OBJ_PTR gaps, bool do_close, int *ierr);
 extern void c_stroke(OBJ_PTR fmkr, FM *p, int *ierr);
 extern void c_close_and_stroke(OBJ_PTR fmkr, FM *p, int *ierr);
 extern void c_fill(OBJ_PTR fmkr, FM *p, int *ierr);
@@ -684,11 +700,11 @@ extern void c_clip_to_frame(OBJ_PTR fmkr, FM *p, int *ierr);
 /*======================================================================*/
 // pdftext.c
 extern void Init_Font_Dictionary(void);
-extern bool Used_Any_Fonts(void);
-extern void Clear_Fonts_In_Use_Flags(void);
-extern void Write_Font_Dictionaries(void);
-extern void Write_Font_Descriptors(void);
-extern void Write_Font_Widths(void);
+extern bool Used_Any_Fonts(FM *p);
+extern void Free_Fonts_In_Use(struct pdf_document *doc);
+extern void Write_Font_Dictionaries(FM *p);
+extern void Write_Font_Descriptors(FM *p);
+extern void Write_Font_Widths(FM *p);
 
 extern OBJ_PTR c_register_font(OBJ_PTR fmkr, FM *p, char *font_name, int *ierr);
 extern OBJ_PTR c_marker_string_info(OBJ_PTR fmkr, FM *p, int fnt, unsigned char *text, double scale, int *ierr);
@@ -699,6 +715,8 @@ extern void c_private_show_marker(OBJ_PTR fmkr, FM *p, OBJ_PTR args, int *ierr);
 extern void Open_tex(OBJ_PTR fmkr, char *filename, bool quiet_mode, int *ierr);
 extern void Close_tex(OBJ_PTR fmkr, bool quiet_mode, int *ierr);
 extern void Create_wrapper(OBJ_PTR fmkr, char *filename, bool quiet_mode, int *ierr);
+extern void Create_document_wrapper(OBJ_PTR fmkr, char *filename,
+                                    OBJ_PTR fignames, int *ierr);
 extern void Init_tex(int *ierr);
 extern void Rename_tex(char *oldname, char *newname, int *ierr);
 extern void private_make_portfolio(char *filename, OBJ_PTR fignums, OBJ_PTR fignames, int *ierr);
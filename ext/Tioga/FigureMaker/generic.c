@@ -53,6 +53,29 @@ OBJ_PTR Integer_New(long val) { return INT2FIX(val); }
 
 OBJ_PTR Float_New(double val) { return rb_float_new(val); }
 
+OBJ_PTR Pointer_New(void *ptr, void (*free_fn)(void *)) {
+   return Data_Wrap_Struct(rb_cObject, NULL, free_fn, ptr); }
+
+typedef struct {
+   void (*fn)(void *);
+   void (*cleanup)(void *);
+   void *data;
+} Ensured_Call;
+
+static VALUE ensured_call_fn(VALUE arg) {
+   Ensured_Call *c = (Ensured_Call *)arg;
+   c->fn(c->data);
+   return Qnil; }
+
+static VALUE ensured_call_cleanup(VALUE arg) {
+   Ensured_Call *c = (Ensured_Call *)arg;
+   c->cleanup(c->data);
+   return Qnil; }
+
+void Call_Ensuring(void (*fn)(void *), void (*cleanup)(void *), void *data) {
+   Ensured_Call c = { fn, cleanup, data };
+   rb_ensure(ensured_call_fn, (VALUE)&c, ensured_call_cleanup, (VALUE)&c); }
+
 OBJ_PTR String_New(char *src, long len) { return rb_str_new(src,len); }
 
 OBJ_PTR String_From_Cstring(char *src) { return rb_str_new2(src); }
@@ -210,6 +233,15 @@ OBJ_PTR Integer_Vector_New(long len, long *vals) {
 int do_flate_compress(unsigned char *new_ptr, unsigned long *new_len_ptr, unsigned char *ptr, long len) {
    return flate_compress(new_ptr, new_len_ptr, ptr, len); }
 
+struct flate_stream *do_flate_stream_open(FILE *out) {
+   return flate_stream_open(out); }
+
+int do_flate_stream_write(struct flate_stream *s, unsigned char *ptr, long len) {
+   return flate_stream_write(s, ptr, len); }
+
+int do_flate_stream_close(struct flate_stream *s, unsigned long *new_len_ptr) {
+   return flate_stream_close(s, new_len_ptr); }
+
 /* Hash-related functions: */
 
 OBJ_PTR Hash_New() 
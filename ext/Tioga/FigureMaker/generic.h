@@ -115,6 +115,10 @@ extern OBJ_PTR Integer_New(long val);
     // returns a new integer object with given val
 extern OBJ_PTR Float_New(double val);
     // returns a new float object with given val
+extern OBJ_PTR Pointer_New(void *ptr, void (*free_fn)(void *));
+    // returns a new object holding ptr; free_fn(ptr) is called when it is garbage collected
+extern void Call_Ensuring(void (*fn)(void *), void (*cleanup)(void *), void *data);
+    // calls fn(data), then cleanup(data), even when fn raised an error
 
 extern OBJ_PTR String_New(char *src, long len);
     // returns a new string object initialized with len chars from src
@@ -242,6 +246,18 @@ extern int do_flate_compress(unsigned char *new_ptr, unsigned long *new_len_ptr,
 // The minimal extra is 0.1% larger than the source plus 12 bytes.
 // My rule is to use (len * 11)/10 + 100 just to be sure.
 
+struct flate_stream;
+
+extern struct flate_stream *do_flate_stream_open(FILE *out);
+// returns a compression stream writing directly to out, or NULL on failure.
+extern int do_flate_stream_write(struct flate_stream *s, unsigned char *ptr, long len);
+// returns FLATE_OK if all okay.
+// compresses len bytes from ptr; output is written to the file as it comes.
+extern int do_flate_stream_close(struct flate_stream *s, unsigned long *new_len_ptr);
+// returns FLATE_OK if all okay.
+// finishes the stream, sets *new_len_ptr to the number of bytes written
+// to the file and frees s.
+
 #define FLATE_OK              0
 
 #endif   /* __generic_H__ */
@@ -28,6 +28,7 @@ long trace_lvl; // set to 0 to turn tracing off. higher values turn on more trac
 #define TRACE(fn) if (trace_lvl > 0) printf("%i %s\n",++trace_cnt,fn)
 
 static ID_PTR fm_data_ID;
+static ID_PTR pdf_document_ID;
 static ID_PTR save_dir_ID;
 static ID_PTR quiet_mode_ID;
 static ID_PTR tex_preview_documentclass_ID;
@@ -74,6 +75,7 @@ void Init_IDs(void)
 	initialized_ID = ID_Get("@@initialized");
 	// instance variables
    fm_data_ID = ID_Get("@fm_data");
+   pdf_document_ID = ID_Get("@pdf_document");
 	save_dir_ID = ID_Get("@save_dir");
 	quiet_mode_ID = ID_Get("@quiet_mode");    
 	tex_xoffset_ID = ID_Get("@tex_xoffset");
@@ -347,7 +349,6 @@ void c_private_make(OBJ_PTR fmkr, FM *p, OBJ_PTR name, OBJ_PTR cmd, int *ierr) {
    bool quiet = Get_quiet_mode(fmkr, ierr);
    if (*ierr != 0) return;
    if (!Get_initialized()) {
-      Init_pdf(ierr); if (*ierr != 0) return;
       Init_tex(ierr); if (*ierr != 0) return;
       Set_initialized();
    }
@@ -359,17 +360,18 @@ void c_private_make(OBJ_PTR fmkr, FM *p, OBJ_PTR name, OBJ_PTR cmd, int *ierr) {
    if (*ierr != 0) return;
    Open_tex(fmkr, full_name, quiet, ierr);
    if (*ierr != 0) return;
-   Write_gsave();
+   Write_gsave(p);
    p->root_figure = true;
    p->in_subplot = false;
    Call_Function(fmkr, make_page_ID, cmd, ierr);
    if (*ierr != 0) return;
-   Write_grestore();
+   Write_grestore(p);
    Close_pdf(fmkr, p, quiet, ierr);
    if (*ierr != 0) return;
    Close_tex(fmkr, quiet, ierr);
    if (*ierr != 0) return;
-   Create_wrapper(fmkr, full_name, quiet, ierr);
+   /* The pages of a document get a single wrapper at the end */
+   if (!p->pdf->multi_page) Create_wrapper(fmkr, full_name, quiet, ierr);
 }
    
       
@@ -385,6 +387,30 @@ OBJ_PTR c_private_make_portfolio(OBJ_PTR fmkr, FM *p, OBJ_PTR name, OBJ_PTR fign
 }
 
 
+void c_private_begin_pdf_document(OBJ_PTR fmkr, FM *p, OBJ_PTR name,
+                                  int *ierr) {
+   char full_name[STRLEN];
+   char *fn = (name == OBJ_NIL)? NULL : String_Ptr(name,ierr);
+   if (*ierr != 0) return;
+   Make_Save_Fname(fmkr, full_name, fn, true, true, ierr);
+   if (*ierr != 0) return;
+   Open_pdf_document(fmkr, p, full_name, ierr);
+}
+
+
+void c_private_end_pdf_document(OBJ_PTR fmkr, FM *p, OBJ_PTR name,
+                                OBJ_PTR fignames, int *ierr) {
+   char full_name[STRLEN];
+   char *fn = (name == OBJ_NIL)? NULL : String_Ptr(name,ierr);
+   if (*ierr != 0) return;
+   Make_Save_Fname(fmkr, full_name, fn, true, true, ierr);
+   if (*ierr != 0) return;
+   Close_pdf_document(fmkr, p, ierr);
+   if (*ierr != 0) return;
+   Create_document_wrapper(fmkr, full_name, fignames, ierr);
+}
+
+
 void c_set_device_pagesize(OBJ_PTR fmkr, FM *p, double width, double height, int *ierr) { 
    // sizes in units of 1/720 inch
    p->page_left = 0;
@@ -418,6 +444,13 @@ void c_set_frame_sides(OBJ_PTR fmkr, FM *p, double left, double right, double to
 
 
 void c_private_init_fm_data(OBJ_PTR fmkr, FM *p, double scale, int *ierr) {
+   /* Output files: the document is kept alive by @pdf_document */
+   if (p->pdf == NULL) {
+      p->pdf = New_PDF_Document();
+      Obj_Attr_Set(fmkr, pdf_document_ID,
+                   Pointer_New(p->pdf, Free_PDF_Document), ierr);
+      if (*ierr != 0) return;
+   }
    /* Page */
    p->scaling_factor = scale;
    p->root_figure = true;
@@ -599,6 +632,8 @@ void c_private_init_fm_data(OBJ_PTR fmkr, FM *p, double scale, int *ierr) {
    p->debug_verbosity_level = 0;
    /* emit a warning by default */
    p->croak_on_nonok_numbers = 1;
+   p->cull_points_threshold = 1000;
+   p->marker_xobject_threshold = 1000;
 }
 
 OBJ_PTR Get_line_type(OBJ_PTR fmkr, int *ierr) { 
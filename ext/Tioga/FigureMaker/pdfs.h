@@ -24,10 +24,7 @@
 
 #include <namespace.h>
 
-extern long *obj_offsets, capacity_obj_offsets, stream_start, stream_end, length_offset, xref_offset;
-extern long num_objects, next_available_object_number, next_available_gs_number, next_available_xo_number;
-extern long next_available_shade_number, next_available_font_number;
-extern void Record_Object_Offset(int obj_number);
+extern void Record_Object_Offset(FM *p, int obj_number);
 extern char *predefined_Fonts[];
 extern int num_pdf_standard_fonts, num_predefined_fonts;
 
@@ -37,7 +34,6 @@ typedef struct stroke_opacity_state {
    int obj_num;
    double stroke_opacity;
 } Stroke_Opacity_State;
-extern Stroke_Opacity_State *stroke_opacities;
 
 typedef struct fill_opacity_state {
    struct fill_opacity_state *next;
@@ -45,7 +41,6 @@ typedef struct fill_opacity_state {
    int obj_num;
    double fill_opacity;
 } Fill_Opacity_State;
-extern Fill_Opacity_State *fill_opacities;
 
 typedef struct xobj_info {
    struct xobj_info *next;
@@ -53,7 +48,6 @@ typedef struct xobj_info {
    int obj_num;
    int xobj_subtype;
 } XObject_Info;
-extern XObject_Info *xobj_list;
 
 typedef struct jpg_info {
    // start must match start of xobj_info
@@ -70,7 +64,7 @@ typedef struct jpg_info {
 
 /* Parses a JPEG file */
 JPG_Info * Parse_JPG(const char * file);
-extern void Write_JPG(JPG_Info *xo, int *ierr);
+extern void Write_JPG(FM *p, JPG_Info *xo, int *ierr);
 extern void Free_JPG(JPG_Info *xo);
 
 
@@ -97,11 +91,28 @@ typedef struct sampled_info {
   int components; /* number of bits per element (one color) */
   char * filters; /* PDF filters to be used "as-is" */
 } Sampled_Info;
-extern void Write_Sampled(Sampled_Info *xo, int *ierr);
+extern void Write_Sampled(FM *p, Sampled_Info *xo, int *ierr);
 extern void Free_Sampled(Sampled_Info *xo);
 
+typedef struct marker_info {
+   // start must match start of xobj_info
+   struct xobj_info *next;
+   int xo_num;
+   int obj_num;
+   int xobj_subtype;
+   // remainder is for this subtype of xobj
+   int font_num, font_obj_num, ft_height, mode;
+   double matrix[6]; // the text matrix, relative to the marker position
+   double bbox[4];
+   char *text; // already escaped for a PDF string
+   long text_len;
+} Marker_Info;
+extern void Write_Marker(FM *p, Marker_Info *xo, int *ierr);
+extern void Free_Marker(Marker_Info *xo);
+
 #define JPG_SUBTYPE 1
 #define SAMPLED_SUBTYPE 2
+#define MARKER_SUBTYPE 3
 
 #define RGB_IMAGE 0
 #define HLS_IMAGE 5
@@ -117,7 +128,6 @@ typedef struct function_info {
    int lookup_len;
    unsigned char *lookup;
 } Function_Info;
-extern Function_Info *functions_list;
 
 typedef struct shading_info {
    struct shading_info *next;
@@ -134,7 +144,6 @@ typedef struct shading_info {
    bool extend_start;
    bool extend_end;
 } Shading_Info;
-extern Shading_Info *shades_list;
 
 typedef struct { 
    int font_num; // for making font resource name such as /F7
@@ -153,14 +162,20 @@ extern Font_Afm_Info afm_array[];
 typedef struct font_dictionary { 
    struct font_dictionary *next;
    int font_num; // for making font resource name such as /F7
-   int obj_num;
-   bool in_use;
-   int widths_obj_num;
-   int descriptor_obj_num;
    Font_Afm_Info *afm;
 } Font_Dictionary;
 extern Font_Dictionary *font_dictionaries;
 
+typedef struct font_usage {
+   // a font of font_dictionaries that the document uses
+   struct font_usage *next;
+   Font_Dictionary *font;
+   int obj_num;
+   int widths_obj_num;
+   int descriptor_obj_num;
+} Font_Usage;
+extern Font_Usage *Get_Font_Usage(FM *p, Font_Dictionary *font_info);
+
 typedef struct old_font_dictionary { 
    struct old_font_dictionary *next;
    int font_num; // for making font resource name such as /F7
@@ -190,10 +205,57 @@ extern Old_Font_Dictionary *old_font_dictionaries;
 
 #define RADIANS_TO_DEGREES (180.0 / PI)
 
-extern bool have_current_point, constructing_path, writing_file;
+#define STREAM_BUFFER_SIZE 65536
+
+/* Everything about the figure being written.  Each FigureMaker has its
+   own (p->pdf), so that several of them can make figures at the same
+   time, in different threads. */
+typedef struct pdf_document {
+   FILE *OF; // for the PDF file
+   FILE *tex_file; // for the TeX file
+   long tex_picture_offset; // the \begin{picture} line, rewritten at the end
+   long *obj_offsets, capacity_obj_offsets, stream_start, stream_end;
+   long length_offset, xref_offset;
+   long num_objects, next_available_object_number, next_available_gs_number;
+   long next_available_xo_number;
+   long next_available_shade_number, next_available_font_number;
+   Stroke_Opacity_State *stroke_opacities;
+   Fill_Opacity_State *fill_opacities;
+   XObject_Info *xobj_list;
+   Function_Info *functions_list;
+   Shading_Info *shades_list;
+   Font_Usage *fonts_in_use;
+   bool have_current_point, constructing_path, writing_file;
+   double bbox_llx, bbox_lly, bbox_urx, bbox_ury;
+   /* The page content stream.  Operators are collected in a small buffer
+      that is flushed to OF (through a deflate stream when compressing)
+      each time it fills up, so memory use does not grow with the figure. */
+   char stream_buffer[STREAM_BUFFER_SIZE];
+   long stream_buffer_len;
+   bool stream_is_open, stream_failed;
+   struct flate_stream *stream_compressor;
+   /* The objects of the page being written */
+   int stream_obj_num, page_obj_num;
+   /* In a multi-page document (see Open_pdf_document), the figures are
+      pages of the same file, and share all the resources */
+   bool multi_page;
+   long *page_obj_nums;
+   int num_pages, capacity_pages;
+} PDF_Document;
+
+extern PDF_Document *New_PDF_Document(void);
+extern void Free_PDF_Document(void *doc);
+
+extern void Stream_Write(FM *p, const char *data, long len);
+extern void Stream_Puts(FM *p, const char *str);
 
-extern FILE *OF; // for the PDF file
-extern FILE *TF; // for the temp file holding the uncompressed stream
+/* Operands are followed by a space, so an operator can come right after:
+   Stream_Operand_Long(p, v) writes as "%ld " would, and
+   Stream_Operand_Double(p, v, prec) as "%0.<prec>f " would (prec <= 9). */
+extern void Stream_Operand_Long(FM *p, long v);
+extern void Stream_Operand_Double(FM *p, double v, int precision);
+extern void Stream_Matrix(FM *p, double a, double b, double c, double d,
+                          double e, double f, int precision);
 
 
 #endif   /* __pdfs_H__ */
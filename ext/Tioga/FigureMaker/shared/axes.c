@@ -975,7 +975,7 @@ static void c_show_side(OBJ_PTR fmkr, FM *p, PlotAxis *s, int *ierr) {
    draw_numeric_labels(fmkr, p, s->location, s, ierr);
    if (*ierr != 0) return;
  done:
-   End_Axis_Standard_State(); // grestore
+   End_Axis_Standard_State(p); // grestore
    free_allocated_memory(s);
 }
 
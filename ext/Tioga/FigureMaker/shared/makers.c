@@ -583,18 +583,36 @@ static int conrec(double **d,
 #include <stdio.h>
 #include <string.h>
 
-// globals to this file
-static int nx_1, ny_1, iGT, jGT, iLE, jLE;
+#define	NBITS 32
+#define INITIAL_CURVE_SIZE 100
 
-static void free_space_for_curve(void);
-static void get_space_for_curve(int *ierr);
-static void draw_the_contour(long *dest_len_ptr,
+// State of one gr_contour() call, shared by the routines below
+typedef struct {
+  int nx_1, ny_1, iGT, jGT, iLE, jLE;
+  // Space for curve
+  double *xcurve, *ycurve;
+  bool *legitcurve;
+  int num_in_curve, max_in_curve, num_in_path;
+  bool curve_storage_exists;
+  double xplot_last, yplot_last;
+  // Flags for FLAG()
+  bool flag_storage_exists;
+  unsigned long *flag, mask[NBITS];
+  int size;
+  int ni_max;	// x-dimension is saved
+} Gri_Contour;
+
+static void free_space_for_curve(Gri_Contour *gc);
+static void get_space_for_curve(Gri_Contour *gc, int *ierr);
+static void draw_the_contour(Gri_Contour *gc,
+                             long *dest_len_ptr,
                              double **dest_xs_ptr,
                              double **dest_ys_ptr,
                              long *dest_sz_ptr,
                              OBJ_PTR gaps,
                              int *ierr);
-static bool trace_contour(double z0,
+static bool trace_contour(Gri_Contour *gc,
+                          double z0,
                           double *x,
                           double *y,
                           double **z,
@@ -605,47 +623,41 @@ static bool trace_contour(double z0,
                           long *dest_sz_ptr,
                           OBJ_PTR gaps,
                           int *iterr);
-static int FLAG(int ni, int nj, int ind, int *ierr);
-static int append_segment(double xr, double yr, double zr, double OKr,
+static int FLAG(Gri_Contour *gc, int ni, int nj, int ind, int *ierr);
+static int append_segment(Gri_Contour *gc,
+                          double xr, double yr, double zr, double OKr,
                           double xs, double ys, double zs, double OKs,
                           double z0, int *ierr);
 
-// Space for curve, shared by several routines
-static double *xcurve, *ycurve;
-static bool *legitcurve;
-#define INITIAL_CURVE_SIZE 100
-static int num_in_curve, max_in_curve, num_in_path;
-static bool curve_storage_exists = false;
-
 
 static void
-free_space_for_curve(void)
+free_space_for_curve(Gri_Contour *gc)
 {
-  if (curve_storage_exists) {
-    free(xcurve);
-    free(ycurve);
-    free(legitcurve);
-    curve_storage_exists = false;
+  if (gc->curve_storage_exists) {
+    free(gc->xcurve);
+    free(gc->ycurve);
+    free(gc->legitcurve);
+    gc->curve_storage_exists = false;
   }
-  num_in_curve = 0;
-  num_in_path = 0;
+  gc->num_in_curve = 0;
+  gc->num_in_path = 0;
 }
 
 
 static void
-get_space_for_curve(int *ierr)
+get_space_for_curve(Gri_Contour *gc, int *ierr)
 {
-  max_in_curve = INITIAL_CURVE_SIZE;
-  if(curve_storage_exists) {
+  gc->max_in_curve = INITIAL_CURVE_SIZE;
+  if(gc->curve_storage_exists) {
     RAISE_ERROR("storage is messed up (internal error)", ierr);
     return;
   }
-  xcurve = ALLOC_N_double(max_in_curve);
-  ycurve = ALLOC_N_double(max_in_curve);
-  legitcurve = ALLOC_N_bool(max_in_curve);
-  curve_storage_exists = true;
-  num_in_curve = 0;
-  num_in_path = 0;
+  gc->xcurve = ALLOC_N_double(gc->max_in_curve);
+  gc->ycurve = ALLOC_N_double(gc->max_in_curve);
+  gc->legitcurve = ALLOC_N_bool(gc->max_in_curve);
+  gc->curve_storage_exists = true;
+  gc->num_in_curve = 0;
+  gc->num_in_path = 0;
 }
 
 
@@ -662,6 +674,52 @@ get_space_for_curve(int *ierr)
  * contour_space_later centimeters, starting with a space of
  * contour_space_first from the beginning of the trace.
  */
+static void
+search_for_contours(Gri_Contour *gc,
+                    double *x,
+                    double *y,
+                    double **z,
+                    double **legit,
+                    int nx,
+                    int ny, 
+                    double z0,
+                    long *dest_len_ptr,
+                    double **dest_xs_ptr,
+                    double **dest_ys_ptr,
+                    long *dest_sz_ptr,
+                    OBJ_PTR gaps,
+                    int *ierr);
+
+// The arguments of gr_contour(), for Call_Ensuring
+typedef struct {
+  double *x, *y, **z, **legit;
+  int nx, ny;
+  double z0;
+  long *dest_len_ptr;
+  double **dest_xs_ptr, **dest_ys_ptr;
+  long *dest_sz_ptr;
+  OBJ_PTR gaps;
+  int *ierr;
+  Gri_Contour gc;
+} Contour_Search;
+
+static void
+run_contour_search(void *data)
+{
+  Contour_Search *s = data;
+  search_for_contours(&s->gc, s->x, s->y, s->z, s->legit, s->nx, s->ny,
+                      s->z0, s->dest_len_ptr, s->dest_xs_ptr, s->dest_ys_ptr,
+                      s->dest_sz_ptr, s->gaps, s->ierr);
+}
+
+static void
+free_contour_search(void *data)
+{
+  Contour_Search *s = data;
+  free_space_for_curve(&s->gc);
+  if (s->gc.flag_storage_exists) free(s->gc.flag);
+}
+
 static void
 gr_contour(double *x,
            double *y,
@@ -676,23 +734,48 @@ gr_contour(double *x,
            long *dest_sz_ptr,
            OBJ_PTR gaps,
            int *ierr)
+{
+  Contour_Search s = { x, y, z, legit, nx, ny, z0, dest_len_ptr,
+                       dest_xs_ptr, dest_ys_ptr, dest_sz_ptr, gaps, ierr };
+  memset(&s.gc, 0, sizeof(s.gc));
+  // The errors are raised as exceptions, which skip the rest of the
+  // search: the space is freed in any case.
+  Call_Ensuring(run_contour_search, free_contour_search, &s);
+}
+
+
+static void
+search_for_contours(Gri_Contour *gc,
+                    double *x,
+                    double *y,
+                    double **z,
+                    double **legit,
+                    int nx,
+                    int ny, 
+                    double z0,
+                    long *dest_len_ptr,
+                    double **dest_xs_ptr,
+                    double **dest_ys_ptr,
+                    long *dest_sz_ptr,
+                    OBJ_PTR gaps,
+                    int *ierr)
 {
   register int    i, j;
   // Test for errors
   if (nx <= 0) { RAISE_ERROR("nx<=0 (internal error)", ierr); return; }
   if (ny <= 0) { RAISE_ERROR("ny<=0 (internal error)", ierr); return; }
-  // Save some globals
-  nx_1 = nx - 1;
-  ny_1 = ny - 1;
+  // Save some values for the other routines
+  gc->nx_1 = nx - 1;
+  gc->ny_1 = ny - 1;
   // Clear  all switches.
-  FLAG(nx, ny, -1, ierr);
+  FLAG(gc, nx, ny, -1, ierr);
   // Get space for the curve.
-  get_space_for_curve(ierr);
+  get_space_for_curve(gc, ierr);
   if (*ierr != 0) return;
     
   // Search for a contour intersecting various places on the grid. Whenever
   // a contour is found to be between two grid points, call trace_contour()
-  // after defining the global variables iLE,jLE,iGT,jGT so that
+  // after setting iLE,jLE,iGT,jGT in *gc so that
   // z[iLE]jLE] <= z0 < z[iGT][jGT], where legit[iLE][jLE] != 0
   // and legit[iGT][jGT] != 0.
   //
@@ -706,28 +789,28 @@ gr_contour(double *x,
   // Search bottom
   for (i = 1; i < nx; i++) {
     j = 0;
-    while (j < ny_1) {
+    while (j < gc->ny_1) {
       // move north to first legit point
-      while (j < ny_1 
+      while (j < gc->ny_1 
              && (legit == NULL || !(legit[i][j] != 0.0
                                     && legit[i - 1][j] != 0.0))
              ) {
         j++;
       }
       // trace a contour if it hits here
-      if (j < ny_1 && z[i][j] > z0 && z[i - 1][j] <= z0) {
-        iLE = i - 1;
-        jLE = j;
-        iGT = i;
-        jGT = j;
-        trace_contour(z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
+      if (j < gc->ny_1 && z[i][j] > z0 && z[i - 1][j] <= z0) {
+        gc->iLE = i - 1;
+        gc->jLE = j;
+        gc->iGT = i;
+        gc->jGT = j;
+        trace_contour(gc, z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
                       dest_ys_ptr, dest_sz_ptr, gaps, ierr);
         if (*ierr != 0) return;
       }
       // Space through legit points, that is, skipping through good
       // data looking for another island of bad data which will
       // thus be a new 'bottom edge'.
-      while (j < ny_1 && (legit == NULL || (legit[i][j] != 0.0
+      while (j < gc->ny_1 && (legit == NULL || (legit[i][j] != 0.0
                                             && legit[i - 1][j] != 0.0)))
         j++;
     }
@@ -735,7 +818,7 @@ gr_contour(double *x,
   
   // search right edge
   for (j = 1; j < ny; j++) {
-    i = nx_1;
+    i = gc->nx_1;
     while (i > 0) {
       // move west to first legit point
       while (i > 0 && (legit == NULL || !(legit[i][j] != 0.0
@@ -743,11 +826,11 @@ gr_contour(double *x,
         i--;
       // trace a contour if it hits here
       if (i > 0 && z[i][j] > z0 && z[i][j - 1] <= z0) {
-        iLE = i;
-        jLE = j - 1;
-        iGT = i;
-        jGT = j;
-        trace_contour(z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
+        gc->iLE = i;
+        gc->jLE = j - 1;
+        gc->iGT = i;
+        gc->jGT = j;
+        trace_contour(gc, z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
                       dest_ys_ptr, dest_sz_ptr, gaps, ierr);
         if (*ierr != 0) return;
       }
@@ -759,19 +842,19 @@ gr_contour(double *x,
   }
   
   // search top edge
-  for (i = nx_1 - 1; i > -1; i--) {
-    j = ny_1;
+  for (i = gc->nx_1 - 1; i > -1; i--) {
+    j = gc->ny_1;
     while (j > 0) {
       while (j > 0 && (legit == NULL || !(legit[i][j] != 0.0
                                           && legit[i + 1][ j] != 0.0)))
         j--;
       // trace a contour if it hits here
       if (j > 0 && z[i][j] > z0 && z[i + 1][ j] <= z0) {
-        iLE = i + 1;
-        jLE = j;
-        iGT = i;
-        jGT = j;
-        trace_contour(z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
+        gc->iLE = i + 1;
+        gc->jLE = j;
+        gc->iGT = i;
+        gc->jGT = j;
+        trace_contour(gc, z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
                       dest_ys_ptr, dest_sz_ptr, gaps, ierr);
         if (*ierr != 0) return;
       }
@@ -783,24 +866,24 @@ gr_contour(double *x,
   }
   
   // search left edge
-  for (j = ny_1 - 1; j > -1; j--) {
+  for (j = gc->ny_1 - 1; j > -1; j--) {
     i = 0;
-    while (i < nx_1) {
-      while (i < nx_1 && (legit == NULL || !(legit[i][j] != 0.0
+    while (i < gc->nx_1) {
+      while (i < gc->nx_1 && (legit == NULL || !(legit[i][j] != 0.0
                                              && legit[i][ j + 1] != 0.0)))
         i++;
       // trace a contour if it hits here
-      if (i < nx_1 && z[i][j] > z0 && z[i][j + 1] <= z0) {
-        iLE = i;
-        jLE = j + 1;
-        iGT = i;
-        jGT = j;
-        trace_contour(z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
+      if (i < gc->nx_1 && z[i][j] > z0 && z[i][j + 1] <= z0) {
+        gc->iLE = i;
+        gc->jLE = j + 1;
+        gc->iGT = i;
+        gc->jGT = j;
+        trace_contour(gc, z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
                       dest_ys_ptr, dest_sz_ptr, gaps, ierr);
         if (*ierr != 0) return;
       }
       // space through legit points
-      while (i < nx_1 && (legit == NULL || (legit[i][j] != 0.0
+      while (i < gc->nx_1 && (legit == NULL || (legit[i][j] != 0.0
                                             && legit[i][ j + 1] != 0.0)))
         i++;
     }
@@ -809,11 +892,11 @@ gr_contour(double *x,
   // Search interior. Pass up from bottom (starting at left), through all
   // interior points. Look for contours which enter, with high to right,
   // between iLE on left and iGT on right.
-  for (j = 1; j < ny_1; j++) {
+  for (j = 1; j < gc->ny_1; j++) {
     int             flag_is_set;
     for (i = 1; i < nx; i++) {
       // trace a contour if it hits here
-      flag_is_set = FLAG(i, j, 0, ierr);
+      flag_is_set = FLAG(gc, i, j, 0, ierr);
       if (*ierr != 0) return;
       if (flag_is_set < 0) {
         RAISE_ERROR("ran out of storage (internal error)", ierr);
@@ -824,19 +907,19 @@ gr_contour(double *x,
           && z[i][j] > z0
           && (legit == NULL || legit[i - 1][j] != 0.0)
           && z[i - 1][j] <= z0) {
-        iLE = i - 1;
-        jLE = j;
-        iGT = i;
-        jGT = j;
-        trace_contour(z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
+        gc->iLE = i - 1;
+        gc->jLE = j;
+        gc->iGT = i;
+        gc->jGT = j;
+        trace_contour(gc, z0, x, y, z, legit, dest_len_ptr, dest_xs_ptr,
                       dest_ys_ptr, dest_sz_ptr, gaps, ierr);
         if (*ierr != 0) return;
       }
     }
   }
   // Free up space.
-  free_space_for_curve();
-  FLAG(nx, ny, 2, ierr);
+  free_space_for_curve(gc);
+  FLAG(gc, nx, ny, 2, ierr);
 }
 
 /*
@@ -847,7 +930,8 @@ gr_contour(double *x,
  * work OK.
  */
 static bool
-trace_contour(double z0,
+trace_contour(Gri_Contour *gc,
+              double z0,
               double *x,
               double *y,
               double **z,
@@ -887,21 +971,21 @@ trace_contour(double z0,
   // *ycurve, *legitcurve.  When done, call draw_the_contour(), which draws
   // the contour stored in these arrays.
   while (true) {
-    append_segment(x[iLE], y[jLE], z[iLE][jLE],
-                   (legit == NULL)? 1.0: legit[iLE][jLE],
-                   x[iGT], y[jGT], z[iGT][jGT],
-                   (legit == NULL)? 1.0: legit[iGT][jGT],
+    append_segment(gc, x[gc->iLE], y[gc->jLE], z[gc->iLE][gc->jLE],
+                   (legit == NULL)? 1.0: legit[gc->iLE][gc->jLE],
+                   x[gc->iGT], y[gc->jGT], z[gc->iGT][gc->jGT],
+                   (legit == NULL)? 1.0: legit[gc->iGT][gc->jGT],
                    z0, ierr);
     if (*ierr != 0) return false;
     // Find the next point to check through a table lookup.
-    locate = 3 * (jGT - jLE) + (iGT - iLE) + 4;
-    i = iLE + i_test[locate];
-    j = jLE + j_test[locate];
+    locate = 3 * (gc->jGT - gc->jLE) + (gc->iGT - gc->iLE) + 4;
+    i = gc->iLE + i_test[locate];
+    j = gc->jLE + j_test[locate];
     
     // Did it hit an edge?
-    if (i > nx_1 || i < 0 || j > ny_1 || j < 0) {
-      draw_the_contour(dest_len_ptr, dest_xs_ptr, dest_ys_ptr, dest_sz_ptr,
-                       gaps, ierr);
+    if (i > gc->nx_1 || i < 0 || j > gc->ny_1 || j < 0) {
+      draw_the_contour(gc, dest_len_ptr, dest_xs_ptr, dest_ys_ptr,
+                       dest_sz_ptr, gaps, ierr);
       if (*ierr != 0) return false;
       return true; // all done
     }
@@ -909,15 +993,15 @@ trace_contour(double z0,
     // Test if retracing an existing contour.  See explanation
     // above, in grcntour(), just before search starts. 
     if (locate == 5) {
-      int already_set = FLAG(iGT, jGT, 1, ierr);
+      int already_set = FLAG(gc, gc->iGT, gc->jGT, 1, ierr);
       if (*ierr != 0) return false;
       if (already_set < 0) {
         RAISE_ERROR("ran out of storage (internal error)", ierr);
         return false;
       }
       if (already_set) {
-        draw_the_contour(dest_len_ptr, dest_xs_ptr, dest_ys_ptr, dest_sz_ptr,
-                         gaps, ierr);
+        draw_the_contour(gc, dest_len_ptr, dest_xs_ptr, dest_ys_ptr,
+                         dest_sz_ptr, gaps, ierr);
         if (*ierr != 0) return false;
         return true; // all done
       }
@@ -925,8 +1009,8 @@ trace_contour(double z0,
     
     // Following new for 2.1.13
     if (legit != NULL && legit[i][j] == 0.0) {
-      draw_the_contour(dest_len_ptr, dest_xs_ptr, dest_ys_ptr, dest_sz_ptr,
-                       gaps, ierr);
+      draw_the_contour(gc, dest_len_ptr, dest_xs_ptr, dest_ys_ptr,
+                       dest_sz_ptr, gaps, ierr);
       if (*ierr != 0) return false;
       return true; // all done
     }
@@ -934,78 +1018,79 @@ trace_contour(double z0,
     if (!dtest[locate]) {
       zp = z[i][j];
       if (zp > z0)
-        iGT = i, jGT = j;
+        gc->iGT = i, gc->jGT = j;
       else
-        iLE = i, jLE = j;
+        gc->iLE = i, gc->jLE = j;
       continue;
     }
-    vx = (x[iGT] + x[i]) * 0.5;
-    vy = (y[jGT] + y[j]) * 0.5;
-    locate = 3 * (jGT - j) + iGT - i + 4;
+    vx = (x[gc->iGT] + x[i]) * 0.5;
+    vy = (y[gc->jGT] + y[j]) * 0.5;
+    locate = 3 * (gc->jGT - j) + gc->iGT - i + 4;
     // Fourth point in rectangular boundary
     ii = i + i_test[locate];
     jj = j + j_test[locate];
     bool legit_diag = 
-      (legit == NULL || (legit[iLE][jLE] != 0.0
-			 && legit[iGT][jGT] != 0.0 
+      (legit == NULL || (legit[gc->iLE][gc->jLE] != 0.0
+			 && legit[gc->iGT][gc->jGT] != 0.0 
 			 && legit[i][j] != 0.0
 			 && legit[ii][jj] != 0.0)) ? true : false;
-    zcentre = 0.25 * (z[iLE][jLE] + z[iGT][jGT] + z[i][j] + z[ii][jj]);
+    zcentre = 0.25 * (z[gc->iLE][gc->jLE] + z[gc->iGT][gc->jGT]
+                      + z[i][j] + z[ii][jj]);
     
     if (zcentre <= z0) {
-      append_segment(x[iGT], y[jGT], z[iGT][jGT],
-                     (legit == NULL)? 1.0: legit[iGT][jGT],
+      append_segment(gc, x[gc->iGT], y[gc->jGT], z[gc->iGT][gc->jGT],
+                     (legit == NULL)? 1.0: legit[gc->iGT][gc->jGT],
                      vx, vy, zcentre, legit_diag,
                      z0, ierr);
       if (*ierr != 0) return false;
       if (z[ii][jj] <= z0) {
-        iLE = ii, jLE = jj;
+        gc->iLE = ii, gc->jLE = jj;
         continue;
       }
-      append_segment(x[ii], y[jj], z[ii][jj],
+      append_segment(gc, x[ii], y[jj], z[ii][jj],
                      (legit == NULL)? 1.0: legit[ii][jj],
                      vx, vy, zcentre, legit_diag,
                      z0, ierr);
       if (*ierr != 0) return false;
       if (z[i][j] <= z0) {
-        iGT = ii, jGT = jj;
-        iLE = i, jLE = j;
+        gc->iGT = ii, gc->jGT = jj;
+        gc->iLE = i, gc->jLE = j;
         continue;
       }
-      append_segment(x[i], y[j], z[i][j], (legit == NULL)? 1.0: legit[i][j],
+      append_segment(gc, x[i], y[j], z[i][j], (legit == NULL)? 1.0: legit[i][j],
                      vx, vy, zcentre, legit_diag,
                      z0, ierr);
       if (*ierr != 0) return false;
-      iGT = i, jGT = j;
+      gc->iGT = i, gc->jGT = j;
       continue;
     }
-    append_segment(vx, vy, zcentre, legit_diag,
-                   x[iLE], y[jLE], z[iLE][jLE],
-                   (legit == NULL)? 1.0: legit[iLE][jLE],
+    append_segment(gc, vx, vy, zcentre, legit_diag,
+                   x[gc->iLE], y[gc->jLE], z[gc->iLE][gc->jLE],
+                   (legit == NULL)? 1.0: legit[gc->iLE][gc->jLE],
                    z0, ierr);
     if (*ierr != 0) return false;
     if (z[i][j] > z0) {
-      iGT = i, jGT = j;
+      gc->iGT = i, gc->jGT = j;
       continue;
     }
-    append_segment(vx, vy, zcentre, legit_diag,
+    append_segment(gc, vx, vy, zcentre, legit_diag,
                    x[i], y[j], z[i][j], (legit == NULL)? 1.0: legit[i][j],
                    z0, ierr);
     if (*ierr != 0) return false;
     if (z[ii][jj] <= z0) {
-      append_segment(vx, vy, zcentre, legit_diag,
+      append_segment(gc, vx, vy, zcentre, legit_diag,
                      x[ii], y[jj], z[ii][jj],
                      (legit == NULL)? 1.0: legit[ii][jj],
                      z0, ierr);
       if (*ierr != 0) return false;
-      iLE = ii;
-      jLE = jj;
+      gc->iLE = ii;
+      gc->jLE = jj;
       continue;
     }
-    iLE = i;
-    jLE = j;
-    iGT = ii;
-    jGT = jj;
+    gc->iLE = i;
+    gc->jLE = j;
+    gc->iGT = ii;
+    gc->jGT = jj;
   }
 }
 
@@ -1013,9 +1098,9 @@ trace_contour(double z0,
 /*
  * append_segment() -- append a line segment on the contour
  */
-static double xplot_last, yplot_last;
 static int
-append_segment(double xr, double yr, double zr, double OKr,
+append_segment(Gri_Contour *gc,
+               double xr, double yr, double zr, double OKr,
                double xs, double ys, double zs, double OKs,
                double z0, int *ierr)
 {
@@ -1035,38 +1120,39 @@ append_segment(double xr, double yr, double zr, double OKr,
   double xplot = xr - frac * (xr - xs);
   double yplot = yr - frac * (yr - ys);
   // Avoid replot, which I suppose must be possible, given this code
-  if (num_in_curve > 0 && xplot == xplot_last && yplot == yplot_last)
+  if (gc->num_in_curve > 0 && xplot == gc->xplot_last
+      && yplot == gc->yplot_last)
     return 1;
-  if (num_in_curve > max_in_curve - 1) {
+  if (gc->num_in_curve > gc->max_in_curve - 1) {
     // Get new storage if running on empty.  Better to
     // do this with an STL vector class
-    max_in_curve *= 2;
+    gc->max_in_curve *= 2;
     int i;
-    double *tmp = ALLOC_N_double(num_in_curve);
-    for (i = 0; i < num_in_curve; i++) tmp[i] = xcurve[i];
-    free(xcurve); xcurve = ALLOC_N_double(max_in_curve);
-    for (i = 0; i < num_in_curve; i++) xcurve[i] = tmp[i];
-    for (i = 0; i < num_in_curve; i++) tmp[i] = ycurve[i];
-    free(ycurve); ycurve = ALLOC_N_double(max_in_curve);
-    for (i = 0; i < num_in_curve; i++) ycurve[i] = tmp[i];
+    double *tmp = ALLOC_N_double(gc->num_in_curve);
+    for (i = 0; i < gc->num_in_curve; i++) tmp[i] = gc->xcurve[i];
+    free(gc->xcurve); gc->xcurve = ALLOC_N_double(gc->max_in_curve);
+    for (i = 0; i < gc->num_in_curve; i++) gc->xcurve[i] = tmp[i];
+    for (i = 0; i < gc->num_in_curve; i++) tmp[i] = gc->ycurve[i];
+    free(gc->ycurve); gc->ycurve = ALLOC_N_double(gc->max_in_curve);
+    for (i = 0; i < gc->num_in_curve; i++) gc->ycurve[i] = tmp[i];
     free(tmp);
-    bool *tmpl = ALLOC_N_bool(num_in_curve);
-    for (i = 0; i < num_in_curve; i++)	tmpl[i] = legitcurve[i];
-    free(legitcurve); legitcurve = ALLOC_N_bool(max_in_curve);
-    for (i = 0; i < num_in_curve; i++)	legitcurve[i] = tmpl[i];
+    bool *tmpl = ALLOC_N_bool(gc->num_in_curve);
+    for (i = 0; i < gc->num_in_curve; i++)	tmpl[i] = gc->legitcurve[i];
+    free(gc->legitcurve); gc->legitcurve = ALLOC_N_bool(gc->max_in_curve);
+    for (i = 0; i < gc->num_in_curve; i++)	gc->legitcurve[i] = tmpl[i];
     free(tmpl);
   }
   // A segment is appended only if both the present point and the last
   // point came by interpolating between OK points.
-  xcurve[num_in_curve] = xplot;
-  ycurve[num_in_curve] = yplot;
+  gc->xcurve[gc->num_in_curve] = xplot;
+  gc->ycurve[gc->num_in_curve] = yplot;
   if (OKr != 0.0 && OKs != 0.0)
-    legitcurve[num_in_curve] = true;
+    gc->legitcurve[gc->num_in_curve] = true;
   else
-    legitcurve[num_in_curve] = false;
-  num_in_curve++;
-  xplot_last = xplot;
-  yplot_last = yplot;
+    gc->legitcurve[gc->num_in_curve] = false;
+  gc->num_in_curve++;
+  gc->xplot_last = xplot;
+  gc->yplot_last = yplot;
   return 1;
 }
 
@@ -1077,33 +1163,34 @@ append_segment(double xr, double yr, double zr, double OKr,
  */ 
 #define FACTOR 3.0 // contour must be FACTOR*len long to be labelled
 static void
-draw_the_contour(long *dest_len_ptr,
+draw_the_contour(Gri_Contour *gc,
+                 long *dest_len_ptr,
                  double **dest_xs_ptr,
                  double **dest_ys_ptr,
                  long *dest_sz_ptr,
                  OBJ_PTR gaps,
                  int *ierr)
 {
-  if (num_in_curve == 1) {
-    num_in_curve = 0;
+  if (gc->num_in_curve == 1) {
+    gc->num_in_curve = 0;
     return;
   }
   int i, k;
-  for (i = 0, k = 0; i < num_in_curve; i++) {
-    if (legitcurve[i] == true) {
+  for (i = 0, k = 0; i < gc->num_in_curve; i++) {
+    if (gc->legitcurve[i] == true) {
       // PUSH_POINT does num_in_path++
-      PUSH_POINT(xcurve[i],ycurve[i]); num_in_path++;
+      PUSH_POINT(gc->xcurve[i],gc->ycurve[i]); gc->num_in_path++;
     }
     else {
-      if (num_in_path > 0 && num_in_path != k) {
-        Array_Push(gaps, Integer_New(num_in_path), ierr);
+      if (gc->num_in_path > 0 && gc->num_in_path != k) {
+        Array_Push(gaps, Integer_New(gc->num_in_path), ierr);
         if (*ierr != 0) return;
       }
-      k = num_in_path;
+      k = gc->num_in_path;
     }
   }
-  Array_Push(gaps, Integer_New(num_in_path), ierr);
-  num_in_curve = 0;
+  Array_Push(gaps, Integer_New(gc->num_in_path), ierr);
+  gc->num_in_curve = 0;
 }
 
 
@@ -1118,43 +1205,38 @@ draw_the_contour(long *dest_len_ptr,
  * RETURN value: Normally, the flag value (0 or 1).  If the storage is
  * exhausted, return a number <0.
  */
-#define	NBITS 32
 static int
-FLAG(int ni, int nj, int ind, int *ierr)
+FLAG(Gri_Contour *gc, int ni, int nj, int ind, int *ierr)
 {
-  static bool flag_storage_exists = false;
-  static unsigned long *flag, mask[NBITS];
-  static int size;
-  static int ni_max;	// x-dimension is saved
   int i, ipos, iword, ibit, return_value;
   switch (ind) {
   case -1:
     // Allocate storage for flag array
-    if (flag_storage_exists) {
+    if (gc->flag_storage_exists) {
       RAISE_ERROR("storage is messed up (internal error)", ierr);
       return 0;
     }
-    size = 1 + ni * nj / NBITS;	// total storage array length
-    flag = ALLOC_N_unsigned_long(size);
+    gc->size = 1 + ni * nj / NBITS;	// total storage array length
+    gc->flag = ALLOC_N_unsigned_long(gc->size);
     // Create mask
-    mask[0] = 1;
+    gc->mask[0] = 1;
     for (i = 1; i < NBITS; i++)
-      mask[i] = 2 * mask[i - 1];
-    for (i = 0; i < size; i++)	// Zero out flag
-      flag[i] = 0;
-    ni_max = ni;		// Save for later
-    flag_storage_exists = true;
+      gc->mask[i] = 2 * gc->mask[i - 1];
+    for (i = 0; i < gc->size; i++)	// Zero out flag
+      gc->flag[i] = 0;
+    gc->ni_max = ni;		// Save for later
+    gc->flag_storage_exists = true;
     return 0;
   case 2:
-    if (!flag_storage_exists) {
+    if (!gc->flag_storage_exists) {
       RAISE_ERROR("No flag storage exists", ierr);
       return 0;
     }
-    free(flag);
-    flag_storage_exists = false;
+    free(gc->flag);
+    gc->flag_storage_exists = false;
     return 0;
   default:
-    if (!flag_storage_exists) {
+    if (!gc->flag_storage_exists) {
       RAISE_ERROR("No flag storage exists", ierr);
       return 0;
     }
@@ -1162,18 +1244,18 @@ FLAG(int ni, int nj, int ind, int *ierr)
   }
   // ind was not -1 or 2
   // Find location of bit.
-  ipos = nj * ni_max + ni;
+  ipos = nj * gc->ni_max + ni;
   iword = ipos / NBITS;
   ibit = ipos - iword * NBITS;
   // Check for something being broken here, causing to run out of space.
   // This should never happen, but may as well check.
-  if (iword >= size)
+  if (iword >= gc->size)
     return (-99);		// no space
   // Get flag.
-  return_value = (0 != (*(flag + iword) & mask[ibit]));
+  return_value = (0 != (*(gc->flag + iword) & gc->mask[ibit]));
   // If ind=1 and flag wasn't set, set the flag
   if (ind == 1 && !return_value)
-    flag[iword] |= mask[ibit];
+    gc->flag[iword] |= gc->mask[ibit];
   // Return the flag value
   return return_value;
 }
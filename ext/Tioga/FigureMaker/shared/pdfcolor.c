@@ -26,12 +26,12 @@
 /* functions */
 
 void
-Free_Functions()
+Free_Functions(PDF_Document *doc)
 {
    Function_Info *fo;
-   while (functions_list != NULL) {
-      fo = functions_list;
-      functions_list = fo->next;
+   while (doc->functions_list != NULL) {
+      fo = doc->functions_list;
+      doc->functions_list = fo->next;
       if (fo->lookup != NULL) free(fo->lookup);
       free(fo);
    }
@@ -39,45 +39,52 @@ Free_Functions()
 
 
 static void
-Write_Sampled_Function(Function_Info *fo, int *ierr)
-{
-   fprintf(OF, "%i 0 obj << /FunctionType 0\n", fo->obj_num);
-   fprintf(OF, "\t/Domain [0 1]\n");
-   fprintf(OF, "\t/Range [0 1 0 1 0 1]\n");
-   fprintf(OF, "\t/Size [%i]\n", fo->hival + 1);
-   fprintf(OF, "\t/BitsPerSample 8\n");
-   fprintf(OF, "\t/Order 1\n");
-   fprintf(OF, "\t/Length %i\n\t>>\nstream\n", fo->lookup_len);
-   if (fwrite(fo->lookup, 1, fo->lookup_len, OF) < fo->lookup_len) {
+Write_Sampled_Function(FM *p, Function_Info *fo, int *ierr)
+{
+   fprintf(p->pdf->OF, "%i 0 obj << /FunctionType 0\n", fo->obj_num);
+   fprintf(p->pdf->OF, "\t/Domain [0 1]\n");
+   fprintf(p->pdf->OF, "\t/Range [0 1 0 1 0 1]\n");
+   fprintf(p->pdf->OF, "\t/Size [%i]\n", fo->hival + 1);
+   fprintf(p->pdf->OF, "\t/BitsPerSample 8\n");
+   fprintf(p->pdf->OF, "\t/Order 1\n");
+   fprintf(p->pdf->OF, "\t/Length %i\n\t>>\nstream\n", fo->lookup_len);
+   if (fwrite(fo->lookup, 1, fo->lookup_len, p->pdf->OF) < fo->lookup_len) {
       RAISE_ERROR("Error writing function sample data", ierr);
       return;
    }
-   fprintf(OF, "\nendstream\nendobj\n");
+   fprintf(p->pdf->OF, "\nendstream\nendobj\n");
 }
 
 
 void
-Write_Functions(int *ierr)
+Write_Functions(FM *p, int *ierr)
 {
    Function_Info *fo;
-   for (fo = functions_list; fo != NULL; fo = fo->next) {
-      Record_Object_Offset(fo->obj_num);
-      Write_Sampled_Function(fo, ierr);
+   for (fo = p->pdf->functions_list; fo != NULL; fo = fo->next) {
+      Record_Object_Offset(p, fo->obj_num);
+      Write_Sampled_Function(p, fo, ierr);
    }
 }
 
 
+/* Returns the object number of a function for the given lookup table,
+   which is shared with the previous shadings using the same table. */
 static int
-create_function(int hival, int lookup_len, unsigned char *lookup)
+create_function(FM *p, int hival, int lookup_len, unsigned char *lookup)
 {
-   Function_Info *fo = (Function_Info *)calloc(1,sizeof(Function_Info));
-   fo->next = functions_list;
-   functions_list = fo;
+   Function_Info *fo;
+   for (fo = p->pdf->functions_list; fo != NULL; fo = fo->next) {
+      if (fo->hival == hival && fo->lookup_len == lookup_len &&
+          memcmp(fo->lookup, lookup, lookup_len) == 0) return fo->obj_num;
+   }
+   fo = (Function_Info *)calloc(1,sizeof(Function_Info));
+   fo->next = p->pdf->functions_list;
+   p->pdf->functions_list = fo;
    fo->lookup = ALLOC_N_unsigned_char(lookup_len);
    memcpy(fo->lookup, lookup, lookup_len);
    fo->lookup_len = lookup_len;
    fo->hival = hival;
-   fo->obj_num = next_available_object_number++;
+   fo->obj_num = p->pdf->next_available_object_number++;
    return fo->obj_num;
 }
 
@@ -85,113 +92,117 @@ create_function(int hival, int lookup_len, unsigned char *lookup)
 /* Opacity */
 
 void
-Free_Stroke_Opacities(void)
+Free_Stroke_Opacities(PDF_Document *doc)
 {
-   Stroke_Opacity_State *p;
-   while (stroke_opacities != NULL) {
-      p = stroke_opacities; 
-      stroke_opacities = p->next;
-      free(p);
+   Stroke_Opacity_State *ps;
+   while (doc->stroke_opacities != NULL) {
+      ps = doc->stroke_opacities; 
+      doc->stroke_opacities = ps->next;
+      free(ps);
    }
 }
 
 
 static int
-Get_Stroke_Opacity_XGS(double stroke_opacity)
+Get_Stroke_Opacity_XGS(FM *p, double stroke_opacity)
 {
-   Stroke_Opacity_State *p;
-   for (p = stroke_opacities; p != NULL; p = p->next) {
-      if (p->stroke_opacity == stroke_opacity) return p->gs_num;
+   Stroke_Opacity_State *ps;
+   for (ps = p->pdf->stroke_opacities; ps != NULL; ps = ps->next) {
+      if (ps->stroke_opacity == stroke_opacity) return ps->gs_num;
    }
-   p = (Stroke_Opacity_State *)calloc(1, sizeof(Stroke_Opacity_State));
-   p->stroke_opacity = stroke_opacity;
-   p->gs_num = next_available_gs_number++;
-   p->obj_num = next_available_object_number++;
-   p->next = stroke_opacities;
-   stroke_opacities = p;
-   return p->gs_num;
+   ps = (Stroke_Opacity_State *)calloc(1, sizeof(Stroke_Opacity_State));
+   ps->stroke_opacity = stroke_opacity;
+   ps->gs_num = p->pdf->next_available_gs_number++;
+   ps->obj_num = p->pdf->next_available_object_number++;
+   ps->next = p->pdf->stroke_opacities;
+   p->pdf->stroke_opacities = ps;
+   return ps->gs_num;
 }
 
 
 void
 c_stroke_opacity_set(OBJ_PTR fmkr, FM *p, double stroke_opacity, int *ierr)
 {  // /GSi gs for ExtGState obj with /CS set to stroke opacity val
-   if (constructing_path) {
+   if (p->pdf->constructing_path) {
       RAISE_ERROR("Sorry: must not be constructing a path when change stroke"
                   " opacity", ierr);
       return;
    }
    if (stroke_opacity == p->stroke_opacity) return;
-   int gs_num = Get_Stroke_Opacity_XGS(stroke_opacity);
-   fprintf(TF, "/GS%i gs\n", gs_num);
+   int gs_num = Get_Stroke_Opacity_XGS(p, stroke_opacity);
+   Stream_Puts(p, "/GS");
+   Stream_Operand_Long(p, gs_num);
+   Stream_Puts(p, "gs\n");
    p->stroke_opacity = stroke_opacity;
 }
 
 
 void
-Free_Fill_Opacities(void)
+Free_Fill_Opacities(PDF_Document *doc)
 {
-   Fill_Opacity_State *p;
-   while (fill_opacities != NULL) {
-      p = fill_opacities;
-      fill_opacities = p->next;
-      free(p);
+   Fill_Opacity_State *pf;
+   while (doc->fill_opacities != NULL) {
+      pf = doc->fill_opacities;
+      doc->fill_opacities = pf->next;
+      free(pf);
    }
 }
 
 
 static int
-Get_Fill_Opacity_XGS(double fill_opacity)
+Get_Fill_Opacity_XGS(FM *p, double fill_opacity)
 {
-   Fill_Opacity_State *p;
-   for (p = fill_opacities; p != NULL; p = p->next) {
-      if (p->fill_opacity == fill_opacity) return p->gs_num;
+   Fill_Opacity_State *pf;
+   for (pf = p->pdf->fill_opacities; pf != NULL; pf = pf->next) {
+      if (pf->fill_opacity == fill_opacity) return pf->gs_num;
    }
-   p = (Fill_Opacity_State *)calloc(1, sizeof(Fill_Opacity_State));
-   p->fill_opacity = fill_opacity;
-   p->gs_num = next_available_gs_number++;
-   p->obj_num = next_available_object_number++;
-   p->next = fill_opacities;
-   fill_opacities = p;
-   return p->gs_num;
+   pf = (Fill_Opacity_State *)calloc(1, sizeof(Fill_Opacity_State));
+   pf->fill_opacity = fill_opacity;
+   pf->gs_num = p->pdf->next_available_gs_number++;
+   pf->obj_num = p->pdf->next_available_object_number++;
+   pf->next = p->pdf->fill_opacities;
+   p->pdf->fill_opacities = pf;
+   return pf->gs_num;
 }
 
 
 void
 c_fill_opacity_set(OBJ_PTR fmkr, FM *p, double fill_opacity, int *ierr)
 {  // /GSi gs for ExtGState obj with /cs set to fill opacity val
-   if (constructing_path) {
+   if (p->pdf->constructing_path) {
       RAISE_ERROR("Sorry: must not be constructing a path when change fill "
                   "opacity", ierr);
       return;
    }
    if (fill_opacity == p->fill_opacity) return;
-   int gs_num = Get_Fill_Opacity_XGS(fill_opacity);
-   fprintf(TF, "/GS%i gs\n", gs_num);
+   int gs_num = Get_Fill_Opacity_XGS(p, fill_opacity);
+   Stream_Puts(p, "/GS");
+   Stream_Operand_Long(p, gs_num);
+   Stream_Puts(p, "gs\n");
    p->fill_opacity = fill_opacity;
 }
 
 
 void
-Write_Stroke_Opacity_Objects(void)
+Write_Stroke_Opacity_Objects(FM *p)
 {
-   Stroke_Opacity_State *p;
-   for (p = stroke_opacities; p != NULL; p = p->next) {
-      Record_Object_Offset(p->obj_num);
-      fprintf(OF, "%2i 0 obj << /Type /ExtGState /CA %g >> endobj\n",
-              p->obj_num, p->stroke_opacity);
+   Stroke_Opacity_State *ps;
+   for (ps = p->pdf->stroke_opacities; ps != NULL; ps = ps->next) {
+      Record_Object_Offset(p, ps->obj_num);
+      fprintf(p->pdf->OF, "%2i 0 obj << /Type /ExtGState /CA %g >> endobj\n",
+              ps->obj_num, ps->stroke_opacity);
    }
 }
 
 
 void
-Write_Fill_Opacity_Objects(void)
+Write_Fill_Opacity_Objects(FM *p)
 {
-   Fill_Opacity_State *p;
-   for (p = fill_opacities; p != NULL; p = p->next) {
-      Record_Object_Offset(p->obj_num);
-      fprintf(OF, "%2i 0 obj << /Type /ExtGState /ca %g >> endobj\n",
-              p->obj_num, p->fill_opacity);
+   Fill_Opacity_State *pf;
+   for (pf = p->pdf->fill_opacities; pf != NULL; pf = pf->next) {
+      Record_Object_Offset(p, pf->obj_num);
+      fprintf(p->pdf->OF, "%2i 0 obj << /Type /ExtGState /ca %g >> endobj\n",
+              pf->obj_num, pf->fill_opacity);
    }
 }
 
@@ -199,41 +210,66 @@ Write_Fill_Opacity_Objects(void)
 /* Shading */
 
 void
-Free_Shadings()
+Free_Shadings(PDF_Document *doc)
 {
    Shading_Info *so;
-   while (shades_list != NULL) {
-      so = shades_list;
-      shades_list = so->next;
+   while (doc->shades_list != NULL) {
+      so = doc->shades_list;
+      doc->shades_list = so->next;
       free(so);
    }
 }
 
 
 void
-Write_Shadings(void)
+Write_Shadings(FM *p)
 {
    Shading_Info *so;
-   for (so = shades_list; so != NULL; so = so->next) {
-      Record_Object_Offset(so->obj_num);
-      fprintf(OF, "%i 0 obj <<\n", so->obj_num);
+   for (so = p->pdf->shades_list; so != NULL; so = so->next) {
+      Record_Object_Offset(p, so->obj_num);
+      fprintf(p->pdf->OF, "%i 0 obj <<\n", so->obj_num);
       if (so->axial) {
-         fprintf(OF, "\t/ShadingType 2\n\t/Coords [%0.2f %0.2f %0.2f %0.2f]\n",
+         fprintf(p->pdf->OF, "\t/ShadingType 2\n\t/Coords [%0.2f %0.2f %0.2f %0.2f]\n",
                  so->x0, so->y0, so->x1, so->y1);
       }
       else {
-         fprintf(OF, "\t/ShadingType 3\n\t/Coords "
+         fprintf(p->pdf->OF, "\t/ShadingType 3\n\t/Coords "
                  "[%0.2f %0.2f %0.2f %0.2f %0.2f %0.2f]\n",
                  so->x0, so->y0, so->r0, so->x1, so->y1, so->r1);
       }
       if (so->extend_start || so->extend_end)
-         fprintf(OF, "\t/Extend [ %s %s ]\n",
+         fprintf(p->pdf->OF, "\t/Extend [ %s %s ]\n",
                  (so->extend_start)? "true" : "false",
                  (so->extend_end)? "true" : "false");
-      fprintf(OF, "\t/ColorSpace /DeviceRGB\n");
-      fprintf(OF, "\t/Function %i 0 R\n", so->function);
-      fprintf(OF, ">> endobj\n");
+      fprintf(p->pdf->OF, "\t/ColorSpace /DeviceRGB\n");
+      fprintf(p->pdf->OF, "\t/Function %i 0 R\n", so->function);
+      fprintf(p->pdf->OF, ">> endobj\n");
+   }
+}
+
+
+/* Looks for a shading identical to _so_ among the previous ones.  If
+   there is one, _so_ is freed and the other one is returned; otherwise,
+   _so_ is added to the list. */
+static Shading_Info *
+Record_Shading(FM *p, Shading_Info *so)
+{
+   Shading_Info *old;
+   for (old = p->pdf->shades_list; old != NULL; old = old->next) {
+      if (old->axial == so->axial && old->function == so->function &&
+          old->x0 == so->x0 && old->y0 == so->y0 && old->r0 == so->r0 &&
+          old->x1 == so->x1 && old->y1 == so->y1 && old->r1 == so->r1 &&
+          old->extend_start == so->extend_start &&
+          old->extend_end == so->extend_end) {
+         free(so);
+         return old;
+      }
    }
+   so->next = p->pdf->shades_list;
+   p->pdf->shades_list = so;
+   so->shade_num = p->pdf->next_available_shade_number++;
+   so->obj_num = p->pdf->next_available_object_number++;
+   return so;
 }
 
 
@@ -243,11 +279,7 @@ c_axial_shading(FM *p, double x0, double y0, double x1, double y1,
                 bool extend_start, bool extend_end)
 {
    Shading_Info *so = (Shading_Info *)calloc(1, sizeof(Shading_Info));
-   so->next = shades_list;
-   shades_list = so;
-   so->shade_num = next_available_shade_number++;
-   so->obj_num = next_available_object_number++;
-   so->function = create_function(hival, lookup_len, lookup);
+   so->function = create_function(p, hival, lookup_len, lookup);
    so->axial = true;
    so->x0 = x0;
    so->y0 = y0;
@@ -255,7 +287,10 @@ c_axial_shading(FM *p, double x0, double y0, double x1, double y1,
    so->y1 = y1;
    so->extend_start = extend_start;
    so->extend_end = extend_end;
-   fprintf(TF, "/Shade%i sh\n", so->shade_num);
+   so = Record_Shading(p, so);
+   Stream_Puts(p, "/Shade");
+   Stream_Operand_Long(p, so->shade_num);
+   Stream_Puts(p, "sh\n");
 }
 
       
@@ -291,11 +326,7 @@ c_radial_shading(FM *p, double x0, double y0, double r0, double x1, double y1,
                  bool extend_start, bool extend_end)
 {
    Shading_Info *so = (Shading_Info *)calloc(1, sizeof(Shading_Info));
-   so->next = shades_list;
-   shades_list = so;
-   so->shade_num = next_available_shade_number++;
-   so->obj_num = next_available_object_number++;
-   so->function = create_function(hival, lookup_len, lookup);
+   so->function = create_function(p, hival, lookup_len, lookup);
    so->axial = false;
    so->x0 = x0;
    so->y0 = y0;
@@ -305,12 +336,18 @@ c_radial_shading(FM *p, double x0, double y0, double r0, double x1, double y1,
    so->r1 = r1;
    so->extend_start = extend_start;
    so->extend_end = extend_end;
+   so = Record_Shading(p, so);
    if (a != 1.0 || b != 0.0 || c != 0.0 || d != 1.0 || e != 0 || f != 0) {
-      fprintf(TF, "q %0.2f %0.2f %0.2f %0.2f %0.2f %0.2f cm /Shade%i sh Q\n",
-              a, b, c, d, e, f, so->shade_num);
+      Stream_Puts(p, "q ");
+      Stream_Matrix(p, a, b, c, d, e, f, 2);
+      Stream_Puts(p, "cm /Shade");
+      Stream_Operand_Long(p, so->shade_num);
+      Stream_Puts(p, "sh Q\n");
    }
    else {
-      fprintf(TF, "/Shade%i sh\n", so->shade_num);
+      Stream_Puts(p, "/Shade");
+      Stream_Operand_Long(p, so->shade_num);
+      Stream_Puts(p, "sh\n");
    }
 }
 
@@ -58,7 +58,7 @@ void
 c_private_set_bounds(OBJ_PTR fmkr, FM *p, double left, double right,
                      double top, double bottom, int *ierr)
 {
-   if (constructing_path) {
+   if (p->pdf->constructing_path) {
       RAISE_ERROR("Sorry: must finish with current path before calling "
                   "set_bounds", ierr);
       return;
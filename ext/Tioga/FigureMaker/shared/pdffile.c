@@ -20,11 +20,16 @@
 */
 
 #include <time.h>
+#include <float.h>
 #include "figures.h"
 #include "pdfs.h"
 
 #define FLATE_ENCODE 1
 
+/* ruby.h substitutes its own snprintf, which does not round %f exactly
+   like the C library's printf; we want the same output as printf. */
+#undef snprintf
+
 #define Get_pdf_xoffset()  5.0
 #define Get_pdf_yoffset()  5.0
 
@@ -50,31 +55,19 @@ char *predefined_Fonts[] = {
 int num_predefined_fonts = 14;
 int num_pdf_standard_fonts = 14;
 
-long *obj_offsets, capacity_obj_offsets, stream_start, stream_end;
-long length_offset, xref_offset;
-long num_objects, next_available_object_number, next_available_gs_number;
-long next_available_xo_number;
-long next_available_shade_number, next_available_font_number;
-Stroke_Opacity_State *stroke_opacities = NULL;
-Fill_Opacity_State *fill_opacities = NULL;
-XObject_Info *xobj_list = NULL;
-Function_Info *functions_list;
-Shading_Info *shades_list = NULL;
 Font_Dictionary *font_dictionaries = NULL;
 Old_Font_Dictionary *old_font_dictionaries = NULL;
-FILE *OF = NULL; // for the PDF file
-FILE *TF = NULL; // for the temp file
 
 
 /* PDF File Management */
 
 static void
-Free_XObjects(int *ierr)
+Free_XObjects(PDF_Document *doc, int *ierr)
 {
    XObject_Info *xo;
-   while (xobj_list != NULL) {
-      xo = xobj_list;
-      xobj_list = xo->next;
+   while (doc->xobj_list != NULL) {
+      xo = doc->xobj_list;
+      doc->xobj_list = xo->next;
       switch (xo->xobj_subtype) {
       case JPG_SUBTYPE:
          Free_JPG((JPG_Info *)xo);
@@ -82,6 +75,9 @@ Free_XObjects(int *ierr)
       case SAMPLED_SUBTYPE:
          Free_Sampled((Sampled_Info *)xo);
          break;
+      case MARKER_SUBTYPE:
+         Free_Marker((Marker_Info *)xo);
+         break;
       default:
          RAISE_ERROR_i("Invalid XObject subtype (%i)",
                        xo->xobj_subtype, ierr);
@@ -92,52 +88,58 @@ Free_XObjects(int *ierr)
 }
 
 
-void
-Init_pdf(int *ierr)
+PDF_Document *
+New_PDF_Document(void)
 {
    int i;
-   writing_file = false;
-   capacity_obj_offsets = 1000;
-   num_objects = 0;
-   obj_offsets = ALLOC_N_long(capacity_obj_offsets);
-   for (i=0; i < capacity_obj_offsets; i++) obj_offsets[i] = 0;
+   PDF_Document *doc = (PDF_Document *)calloc(1, sizeof(PDF_Document));
+   doc->writing_file = false;
+   doc->capacity_obj_offsets = 1000;
+   doc->num_objects = 0;
+   doc->obj_offsets = ALLOC_N_long(doc->capacity_obj_offsets);
+   for (i=0; i < doc->capacity_obj_offsets; i++) doc->obj_offsets[i] = 0;
+   return doc;
 }
 
 
 void
-Record_Object_Offset(int obj_number)
+Record_Object_Offset(FM *p, int obj_number)
 {
-   long int offset = ftell(OF);
-   if (obj_number >= capacity_obj_offsets) {
+   long int offset = ftell(p->pdf->OF);
+   if (obj_number >= p->pdf->capacity_obj_offsets) {
       int size_increment = 50, i;
-      REALLOC_long(&obj_offsets, obj_number + size_increment);
-      capacity_obj_offsets = obj_number + size_increment;
-      for (i=num_objects; i < capacity_obj_offsets; i++) obj_offsets[i] = 0;
+      REALLOC_long(&p->pdf->obj_offsets, obj_number + size_increment);
+      p->pdf->capacity_obj_offsets = obj_number + size_increment;
+      for (i=p->pdf->num_objects; i < p->pdf->capacity_obj_offsets; i++)
+         p->pdf->obj_offsets[i] = 0;
    }
-   obj_offsets[obj_number] = offset;
-   if (obj_number >= num_objects) num_objects = obj_number + 1;
+   p->pdf->obj_offsets[obj_number] = offset;
+   if (obj_number >= p->pdf->num_objects) p->pdf->num_objects = obj_number + 1;
 }
 
 
 static void
-Write_XObjects(int *ierr)
+Write_XObjects(FM *p, int *ierr)
 {
    XObject_Info *xo;
-   for (xo = xobj_list; xo != NULL; xo = xo->next) {
-      Record_Object_Offset(xo->obj_num);
-      fprintf(OF, "%i 0 obj << /Type /XObject ", xo->obj_num);
+   for (xo = p->pdf->xobj_list; xo != NULL; xo = xo->next) {
+      Record_Object_Offset(p, xo->obj_num);
+      fprintf(p->pdf->OF, "%i 0 obj << /Type /XObject ", xo->obj_num);
       switch (xo->xobj_subtype) {
       case JPG_SUBTYPE:
-         Write_JPG((JPG_Info *)xo, ierr);
+         Write_JPG(p, (JPG_Info *)xo, ierr);
          break;
       case SAMPLED_SUBTYPE:
-         Write_Sampled((Sampled_Info *)xo, ierr);
+         Write_Sampled(p, (Sampled_Info *)xo, ierr);
+         break;
+      case MARKER_SUBTYPE:
+         Write_Marker(p, (Marker_Info *)xo, ierr);
          break;
       default:
          RAISE_ERROR_i("Invalid XObject subtype (%i)", xo->xobj_subtype, ierr);
       }
       if (*ierr != 0) return;
-      fprintf(OF, ">> endobj\n");
+      fprintf(p->pdf->OF, ">> endobj\n");
    }
 }
 
@@ -151,13 +153,35 @@ Write_XObjects(int *ierr)
 
 
 static void
-Free_Records(int *ierr)
+Free_Records(PDF_Document *doc, int *ierr)
+{
+   Free_Stroke_Opacities(doc);
+   Free_Fill_Opacities(doc);
+   Free_XObjects(doc, ierr);
+   Free_Shadings(doc);
+   Free_Functions(doc);
+}
+
+
+/* Called when the FigureMaker that owns the document is garbage
+   collected.  The files are only still open if the figure was
+   abandoned because of an error. */
+void
+Free_PDF_Document(void *ptr)
 {
-   Free_Stroke_Opacities();
-   Free_Fill_Opacities();
-   Free_XObjects(ierr);
-   Free_Shadings();
-   Free_Functions();
+   PDF_Document *doc = (PDF_Document *)ptr;
+   int ierr = 0;
+   if (doc->stream_compressor != NULL) {
+      unsigned long new_len;
+      do_flate_stream_close(doc->stream_compressor, &new_len);
+   }
+   if (doc->OF != NULL) fclose(doc->OF);
+   if (doc->tex_file != NULL) fclose(doc->tex_file);
+   Free_Fonts_In_Use(doc);
+   Free_Records(doc, &ierr);
+   free(doc->obj_offsets);
+   free(doc->page_obj_nums);
+   free(doc);
 }
 
 
@@ -172,61 +196,106 @@ Get_pdf_name(char *ofile, char *filename, int maxlen)
 }
 
 
-void
-Open_pdf(OBJ_PTR fmkr, FM *p, char *filename, bool quiet_mode, int *ierr)
+/* Forgets all the resources of the previous file */
+static void
+Reset_Records(FM *p, int *ierr)
 {
-   int i;
-   if (writing_file) {
-      RAISE_ERROR("Sorry: cannot start a new output file until finish "
-                  "current one.", ierr);
-      return;
-   }
-   Clear_Fonts_In_Use_Flags();
-   Free_Records(ierr);
+   Free_Fonts_In_Use(p->pdf);
+   Free_Records(p->pdf, ierr);
    if (*ierr != 0) return;
-   next_available_object_number = FIRST_OTHER_OBJ;
-   next_available_font_number = num_predefined_fonts + 1;
-   next_available_gs_number = 1;
-   next_available_xo_number = 1;
-   next_available_shade_number = 1;
-   writing_file = true;
+   p->pdf->next_available_object_number = FIRST_OTHER_OBJ;
+   p->pdf->next_available_font_number = num_predefined_fonts + 1;
+   p->pdf->next_available_gs_number = 1;
+   p->pdf->next_available_xo_number = 1;
+   p->pdf->next_available_shade_number = 1;
+}
+
+
+/* Opens the PDF file for _filename_ and writes the header and the Info
+   object */
+static void
+Open_pdf_file(FM *p, char *filename, int *ierr)
+{
+   int i;
    time_t now = time(NULL);
    char ofile[300], timestring[100];
    Get_pdf_name(ofile, filename, 300);
-   if ((OF = fopen(ofile, "wb")) == NULL) { /* Write binary file ! */
+   if ((p->pdf->OF = fopen(ofile, "wb")) == NULL) { /* Write binary file ! */
       RAISE_ERROR_s("Sorry: can't open %s.\n", filename, ierr);
       return;
    }
-   if ((TF = tmpfile()) == NULL) {
-      RAISE_ERROR_s("Sorry: can't create temp file for writing PDF file %s.\n",
-                    filename, ierr);
-      return;
-   }
    /* open PDF file and write header */
-   fprintf(OF, "%%PDF-1.4\n");
+   fprintf(p->pdf->OF, "%%PDF-1.4\n");
    strcpy(timestring, ctime(&now));
    i = strlen(timestring);
    if (i > 0) timestring[i-1] = '\0';
-   Record_Object_Offset(INFO_OBJ);
-   fprintf(OF,
+   Record_Object_Offset(p, INFO_OBJ);
+   fprintf(p->pdf->OF,
            "%i 0 obj <<\n/Creator (Tioga)\n/CreationDate (%s)\n>>\nendobj\n",
            INFO_OBJ, timestring);
-   Record_Object_Offset(PAGES_OBJ);
-   fprintf(OF,
-           "%i 0 obj <<\n/Type /Pages\n/Kids [%i 0 R]\n/Count 1\n>> endobj\n",
-           PAGES_OBJ, PAGE_OBJ);
-   Record_Object_Offset(STREAM_OBJ);
+}
+
+
+void
+Open_pdf(OBJ_PTR fmkr, FM *p, char *filename, bool quiet_mode, int *ierr)
+{
+   if (p->pdf->writing_file) {
+      RAISE_ERROR("Sorry: cannot start a new output file until finish "
+                  "current one.", ierr);
+      return;
+   }
+   if (p->pdf->multi_page) {
+      /* A new page of the document: the first one gets the objects that
+         are reserved for the page of a single figure. */
+      if (p->pdf->num_pages == 0) {
+         p->pdf->stream_obj_num = STREAM_OBJ;
+         p->pdf->page_obj_num = PAGE_OBJ;
+      }
+      else {
+         p->pdf->stream_obj_num = p->pdf->next_available_object_number++;
+         p->pdf->page_obj_num = p->pdf->next_available_object_number++;
+      }
+      p->pdf->writing_file = true;
+   }
+   else {
+      Reset_Records(p, ierr);
+      if (*ierr != 0) return;
+      p->pdf->writing_file = true;
+      p->pdf->stream_obj_num = STREAM_OBJ;
+      p->pdf->page_obj_num = PAGE_OBJ;
+      Open_pdf_file(p, filename, ierr);
+      if (*ierr != 0) return;
+      Record_Object_Offset(p, PAGES_OBJ);
+      fprintf(p->pdf->OF,
+              "%i 0 obj <<\n/Type /Pages\n/Kids [%i 0 R]\n/Count 1\n>> endobj\n",
+              PAGES_OBJ, PAGE_OBJ);
+   }
+   Record_Object_Offset(p, p->pdf->stream_obj_num);
    if (FLATE_ENCODE)
-      fprintf(OF, "%i 0 obj <<\t/Filter /FlateDecode   /Length ", STREAM_OBJ);
+      fprintf(p->pdf->OF, "%i 0 obj <<\t/Filter /FlateDecode   /Length ",
+              p->pdf->stream_obj_num);
    else
-      fprintf(OF, "%i 0 obj <<\t/Length ", STREAM_OBJ);
-   length_offset = ftell(OF);
-   fprintf(OF, "             \n>>\nstream\n");
-   stream_start = ftell(OF);
-   fprintf(TF, "%.2f 0 0 %.2f %.2f %.2f cm\n", 1.0/ENLARGE, 1.0/ENLARGE,
-           Get_pdf_xoffset(), Get_pdf_yoffset());
+      fprintf(p->pdf->OF, "%i 0 obj <<\t/Length ", p->pdf->stream_obj_num);
+   p->pdf->length_offset = ftell(p->pdf->OF);
+   fprintf(p->pdf->OF, "             \n>>\nstream\n");
+   p->pdf->stream_start = ftell(p->pdf->OF);
+   p->pdf->stream_buffer_len = 0;
+   p->pdf->stream_failed = false;
+   if (FLATE_ENCODE && (p->pdf->stream_compressor =
+                        do_flate_stream_open(p->pdf->OF)) == NULL) {
+      RAISE_ERROR_s("Sorry: can't start compressing the PDF stream for %s.\n",
+                    filename, ierr);
+      return;
+   }
+   p->pdf->stream_is_open = true;
+   Stream_Operand_Double(p, 1.0/ENLARGE, 2);
+   Stream_Puts(p, "0 0 ");
+   Stream_Operand_Double(p, 1.0/ENLARGE, 2);
+   Stream_Operand_Double(p, Get_pdf_xoffset(), 2);
+   Stream_Operand_Double(p, Get_pdf_yoffset(), 2);
+   Stream_Puts(p, "cm\n");
    /* set stroke and fill colors to black */
-   have_current_point = constructing_path = false;
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
    c_line_width_set(fmkr, p, p->line_width, ierr);
    c_line_cap_set(fmkr, p, p->line_cap, ierr);
    c_line_join_set(fmkr, p, p->line_join, ierr);
@@ -237,8 +306,8 @@ Open_pdf(OBJ_PTR fmkr, FM *p, char *filename, bool quiet_mode, int *ierr)
    c_fill_color_set_RGB(fmkr, p, p->fill_color_R, p->fill_color_G,
                         p->fill_color_B, ierr);
    // initialize clip region
-   bbox_llx = bbox_lly = 1e5;
-   bbox_urx = bbox_ury = -1e5;
+   p->pdf->bbox_llx = p->pdf->bbox_lly = 1e5;
+   p->pdf->bbox_urx = p->pdf->bbox_ury = -1e5;
 }
 
 
@@ -246,7 +315,7 @@ void
 Start_Axis_Standard_State(OBJ_PTR fmkr, FM *p, double r, double g, double b,
                           double line_width, int *ierr)
 {
-   fprintf(TF, "q 2 J [] 0 d\n");
+   Stream_Puts(p, "q 2 J [] 0 d\n");
    c_line_width_set(fmkr, p, line_width, ierr);
    c_stroke_color_set_RGB(fmkr, p, r, g, b, ierr);
    /* 2 J sets the line cap style to square cap */
@@ -255,188 +324,404 @@ Start_Axis_Standard_State(OBJ_PTR fmkr, FM *p, double r, double g, double b,
 
 
 void
-End_Axis_Standard_State(void)
+End_Axis_Standard_State(FM *p)
 {
-   Write_grestore();
+   Write_grestore(p);
 }
 
 
 void
-Write_gsave(void)
+Write_gsave(FM *p)
 {
-   fprintf(TF, "q\n");
+   Stream_Puts(p, "q\n");
 }
 
 
 void
-Write_grestore(void)
+Write_grestore(FM *p)
 {
-   fprintf(TF, "Q\n");
+   Stream_Puts(p, "Q\n");
 }
 
 
 void
 c_pdf_gsave(OBJ_PTR fmkr, FM *p, int *ierr)
 {
-   Write_gsave();
+   Write_gsave(p);
 }
 
 
 void
 c_pdf_grestore(OBJ_PTR fmkr, FM *p, int *ierr)
 {
-   Write_grestore();
+   Write_grestore(p);
 }
 
 
 static void
-Print_Xref(long int offset)
+Print_Xref(FM *p, long int offset)
 {
    char line[80];
    int i, len;
    snprintf(line,sizeof(line), "%li", offset);
    len = strlen(line);
-   for (i=0; i < 10-len; i++) fputc('0', OF);
-   fprintf(OF, "%s 00000 n \n", line);
+   for (i=0; i < 10-len; i++) fputc('0', p->pdf->OF);
+   fprintf(p->pdf->OF, "%s 00000 n \n", line);
 }
 
 
+/* Sends raw bytes to the content stream of the PDF file */
 static void
-Write_Stream(int *ierr)
-{
-   long int len = ftell(TF);
-   unsigned long int new_len = (len * 11) / 10 + 100;
-   unsigned char *buffer, *dest_buffer;
-   rewind(TF);
-   buffer = ALLOC_N_unsigned_char(len+1);
-   dest_buffer = ALLOC_N_unsigned_char(new_len+1);
-   fread(buffer, 1, len, TF);
-   fclose(TF);
+Write_Stream_Bytes(FM *p, const char *data, long len)
+{
+   if (p->pdf->stream_failed) return;
    if (FLATE_ENCODE) {
-      if (do_flate_compress(dest_buffer, &new_len, buffer, len) != FLATE_OK) {
-         free(buffer); free(dest_buffer);
-         RAISE_ERROR("Error compressing PDF stream data", ierr); 
+      if (do_flate_stream_write(p->pdf->stream_compressor,
+                                (unsigned char *)data, len) != FLATE_OK)
+         p->pdf->stream_failed = true;
+   }
+   else if (fwrite(data, 1, len, p->pdf->OF) < (size_t) len)
+      p->pdf->stream_failed = true;
+}
+
+
+static void
+Flush_Stream_Buffer(FM *p)
+{
+   if (p->pdf->stream_buffer_len > 0)
+      Write_Stream_Bytes(p, p->pdf->stream_buffer, p->pdf->stream_buffer_len);
+   p->pdf->stream_buffer_len = 0;
+}
+
+
+void
+Stream_Write(FM *p, const char *data, long len)
+{
+   if (!p->pdf->stream_is_open) return;
+   if (p->pdf->stream_buffer_len + len > STREAM_BUFFER_SIZE) {
+      Flush_Stream_Buffer(p);
+      if (len > STREAM_BUFFER_SIZE) {
+         Write_Stream_Bytes(p, data, len);
          return;
       }
-      fwrite(dest_buffer, 1, new_len, OF);
    }
-   else {
-      fwrite(buffer, 1, len, OF);
+   memcpy(p->pdf->stream_buffer + p->pdf->stream_buffer_len, data, len);
+   p->pdf->stream_buffer_len += len;
+}
+
+
+void
+Stream_Puts(FM *p, const char *str)
+{
+   Stream_Write(p, str, strlen(str));
+}
+
+
+/* Number formatting for the content stream.  This is where most of the
+   time goes for large plots, so we avoid the printf machinery: the
+   results are the same as with "%ld " and "%0.<precision>f ". */
+
+#define MAX_OPERAND_LEN 40
+
+static const double powers_of_ten[] = {
+   1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+/* Makes sure there is room for len more bytes in the buffer */
+static char *
+Reserve_Stream_Buffer(FM *p, long len)
+{
+   if (p->pdf->stream_buffer_len + len > STREAM_BUFFER_SIZE)
+      Flush_Stream_Buffer(p);
+   return p->pdf->stream_buffer + p->pdf->stream_buffer_len;
+}
+
+
+static int
+Format_Unsigned(char *buf, unsigned long long u, int min_digits)
+{
+   char tmp[24];
+   int n = 0, len = 0;
+   do {
+      tmp[n++] = '0' + (u % 10);
+      u /= 10;
+   } while (u != 0 || n < min_digits);
+   while (n > 0) buf[len++] = tmp[--n];
+   return len;
+}
+
+
+void
+Stream_Operand_Long(FM *p, long v)
+{
+   char *buf;
+   int len = 0;
+   if (!p->pdf->stream_is_open) return;
+   buf = Reserve_Stream_Buffer(p, MAX_OPERAND_LEN);
+   if (v < 0) {
+      buf[len++] = '-';
+      len += Format_Unsigned(buf + len, - (unsigned long long) v, 1);
    }
-   free(buffer);
-   free(dest_buffer);
+   else len += Format_Unsigned(buf + len, v, 1);
+   buf[len++] = ' ';
+   p->pdf->stream_buffer_len += len;
 }
 
 
 void
-Close_pdf(OBJ_PTR fmkr, FM *p, bool quiet_mode, int *ierr)
+Stream_Operand_Double(FM *p, double v, int precision)
+{
+   char *buf;
+   int len = 0;
+   double scaled, whole, frac;
+   unsigned long long digits, unit;
+   if (!p->pdf->stream_is_open) return;
+   scaled = fabs(v) * powers_of_ten[precision];
+   whole = floor(scaled);
+   frac = scaled - whole;
+   /* scaled carries a relative error of one rounding: when that is enough
+      to put it on the other side of the half, or for numbers too large
+      for the fast path, we let snprintf do the exact decimal rounding. */
+   if (!(scaled < 1e15) || fabs(frac - 0.5) <= scaled * 4e-16) {
+      char str[DBL_MAX_10_EXP + 20];
+      len = snprintf(str, sizeof(str), "%0.*f ", precision, v);
+      if (len > 0) Stream_Write(p, str, len);
+      return;
+   }
+   buf = Reserve_Stream_Buffer(p, MAX_OPERAND_LEN);
+   digits = (unsigned long long) whole + (frac > 0.5 ? 1 : 0);
+   unit = (unsigned long long) powers_of_ten[precision];
+   if (signbit(v)) buf[len++] = '-';
+   len += Format_Unsigned(buf + len, digits / unit, 1);
+   if (precision > 0) {
+      buf[len++] = '.';
+      len += Format_Unsigned(buf + len, digits % unit, precision);
+   }
+   buf[len++] = ' ';
+   p->pdf->stream_buffer_len += len;
+}
+
+
+void
+Stream_Matrix(FM *p, double a, double b, double c, double d, double e,
+              double f, int precision)
+{
+   Stream_Operand_Double(p, a, precision);
+   Stream_Operand_Double(p, b, precision);
+   Stream_Operand_Double(p, c, precision);
+   Stream_Operand_Double(p, d, precision);
+   Stream_Operand_Double(p, e, precision);
+   Stream_Operand_Double(p, f, precision);
+}
+
+
+static void
+Write_Stream(FM *p, int *ierr)
+{
+   unsigned long new_len;
+   Flush_Stream_Buffer(p);
+   p->pdf->stream_is_open = false;
+   if (FLATE_ENCODE) {
+      if (do_flate_stream_close(p->pdf->stream_compressor, &new_len)
+          != FLATE_OK)
+         p->pdf->stream_failed = true;
+      p->pdf->stream_compressor = NULL;
+   }
+   if (p->pdf->stream_failed) {
+      RAISE_ERROR("Error compressing PDF stream data", ierr); 
+      return;
+   }
+}
+
+
+/* Writes the Catalog, the objects for the resources, the xref table and
+   the trailer, and closes the file */
+static void
+Close_pdf_file(FM *p, int *ierr)
 {
    int i;
+   Record_Object_Offset(p, CATALOG_OBJ);
+   fprintf(p->pdf->OF,
+           "%i 0 obj <<\n/Type /Catalog\n/Pages %i 0 R\n>> endobj\n",
+           CATALOG_OBJ, PAGES_OBJ);
+   Write_Font_Dictionaries(p);
+   Write_Font_Descriptors(p);
+   Write_Font_Widths(p);
+   Write_Stroke_Opacity_Objects(p);
+   Write_Fill_Opacity_Objects(p);
+   Write_XObjects(p, ierr);
+   if (*ierr != 0) return;
+   Write_Functions(p, ierr);
+   if (*ierr != 0) return;
+   Write_Shadings(p);
+   p->pdf->xref_offset = ftell(p->pdf->OF);
+   fprintf(p->pdf->OF, "xref\n0 %li\n0000000000 65535 f \n",
+           p->pdf->num_objects);
+   for (i = 1; i < p->pdf->num_objects; i++)
+      Print_Xref(p, p->pdf->obj_offsets[i]); // NB: DONT USE OBJECT 0
+   fprintf(p->pdf->OF, "trailer\n<<\n/Size %li\n/Root %i 0 R\n/Info %i 0 "
+           "R\n>>\nstartxref\n%li\n%%%%EOF\n",
+           p->pdf->num_objects, CATALOG_OBJ, INFO_OBJ, p->pdf->xref_offset);
+   fclose(p->pdf->OF);
+   p->pdf->OF = NULL;
+   Free_Records(p->pdf, ierr);
+}
+
+
+void
+Close_pdf(OBJ_PTR fmkr, FM *p, bool quiet_mode, int *ierr)
+{
    double llx, lly, urx, ury, xoff, yoff;
-   if (!writing_file) {
+   if (!p->pdf->writing_file) {
       RAISE_ERROR("Sorry: cannot End_Output if not writing file.", ierr);
       return;
    }
-   writing_file = false;
-   if (constructing_path) {
+   p->pdf->writing_file = false;
+   if (p->pdf->constructing_path) {
       RAISE_ERROR("Sorry: must finish with current path before ending file",
                   ierr);
       return;
    }
-   Write_Stream(ierr);
+   Write_Stream(p, ierr);
    if (*ierr != 0) return;
-   stream_end = ftell(OF);
-   fprintf(OF, "endstream\nendobj\n");
-   Record_Object_Offset(PAGE_OBJ);
-   fprintf(OF, "%i 0 obj <<\n/Type /Page\n/Parent %i 0 R\n/MediaBox [ ",
-           PAGE_OBJ, PAGES_OBJ);
-   if (bbox_llx < p->page_left) bbox_llx = p->page_left;
-   if (bbox_lly < p->page_bottom) bbox_lly = p->page_bottom;
-   if (bbox_urx > p->page_left + p->page_width)
-      bbox_urx = p->page_left + p->page_width;
-   if (bbox_ury > p->page_bottom + p->page_height)
-      bbox_ury = p->page_bottom + p->page_height;
+   p->pdf->stream_end = ftell(p->pdf->OF);
+   fprintf(p->pdf->OF, "endstream\nendobj\n");
+   /* Now that the length of the stream is known */
+   fseek(p->pdf->OF, p->pdf->length_offset, SEEK_SET);
+   fprintf(p->pdf->OF, "%li", p->pdf->stream_end - p->pdf->stream_start);
+   fseek(p->pdf->OF, 0, SEEK_END);
+   Record_Object_Offset(p, p->pdf->page_obj_num);
+   fprintf(p->pdf->OF, "%i 0 obj <<\n/Type /Page\n/Parent %i 0 R\n/MediaBox [ ",
+           p->pdf->page_obj_num, PAGES_OBJ);
+   if (p->pdf->bbox_llx < p->page_left) p->pdf->bbox_llx = p->page_left;
+   if (p->pdf->bbox_lly < p->page_bottom) p->pdf->bbox_lly = p->page_bottom;
+   if (p->pdf->bbox_urx > p->page_left + p->page_width)
+      p->pdf->bbox_urx = p->page_left + p->page_width;
+   if (p->pdf->bbox_ury > p->page_bottom + p->page_height)
+      p->pdf->bbox_ury = p->page_bottom + p->page_height;
 //#define MARGIN 3
 #define MARGIN 0
    xoff = Get_pdf_xoffset();
    yoff = Get_pdf_yoffset();
-   llx = bbox_llx / ENLARGE + xoff - MARGIN;  // convert back to points
-   lly = bbox_lly / ENLARGE + yoff - MARGIN;
-   urx = bbox_urx / ENLARGE + xoff + MARGIN;
-   ury = bbox_ury / ENLARGE + yoff + MARGIN;
+   llx = p->pdf->bbox_llx / ENLARGE + xoff - MARGIN;  // convert back to points
+   lly = p->pdf->bbox_lly / ENLARGE + yoff - MARGIN;
+   urx = p->pdf->bbox_urx / ENLARGE + xoff + MARGIN;
+   ury = p->pdf->bbox_ury / ENLARGE + yoff + MARGIN;
    if (urx < llx || ury < lly) {
       RAISE_ERROR("Sorry: Empty plot!", ierr);
       return;
    }
-   fprintf(OF, "%d %d %d %d", ROUND(llx), ROUND(lly), ROUND(urx), ROUND(ury));
-   fprintf(OF, " ]\n/Contents %i 0 R\n/Resources << "
-           "/ProcSet [/PDF /Text /ImageB /ImageC /ImageI]\n", STREAM_OBJ);
-   if (Used_Any_Fonts()) {
-      Font_Dictionary *f;      
-      fprintf(OF, "    /Font <<\n     ");
+   fprintf(p->pdf->OF, "%d %d %d %d", ROUND(llx), ROUND(lly), ROUND(urx),
+           ROUND(ury));
+   fprintf(p->pdf->OF, " ]\n/Contents %i 0 R\n/Resources << "
+           "/ProcSet [/PDF /Text /ImageB /ImageC /ImageI]\n",
+           p->pdf->stream_obj_num);
+   /* In a multi-page document, the resources of the previous pages are
+      listed as well, which does no harm */
+   if (Used_Any_Fonts(p)) {
+      Font_Dictionary *f;
+      Font_Usage *fu;
+      fprintf(p->pdf->OF, "    /Font <<\n     ");
       for (f = font_dictionaries; f != NULL; f = f->next) {
-         if (!f->in_use) continue;
-         fprintf(OF, "      /F%i %i 0 R\n", f->font_num, f->obj_num);
+         if ((fu = Get_Font_Usage(p, f)) == NULL) continue;
+         fprintf(p->pdf->OF, "      /F%i %i 0 R\n", f->font_num, fu->obj_num);
       }
-      fprintf(OF, "    >>\n"); // end of /Font
+      fprintf(p->pdf->OF, "    >>\n"); // end of /Font
    }
-   if (fill_opacities != NULL || stroke_opacities != NULL) {
+   if (p->pdf->fill_opacities != NULL || p->pdf->stroke_opacities != NULL) {
       // ExtGstate objects go here
       Fill_Opacity_State *pf;
       Stroke_Opacity_State *ps;
-      fprintf(OF, "    /ExtGState <<\n");
-      for (ps = stroke_opacities; ps != NULL; ps = ps->next) {
-         fprintf(OF, "      /GS%i %i 0 R\n", ps->gs_num, ps->obj_num);
+      fprintf(p->pdf->OF, "    /ExtGState <<\n");
+      for (ps = p->pdf->stroke_opacities; ps != NULL; ps = ps->next) {
+         fprintf(p->pdf->OF, "      /GS%i %i 0 R\n", ps->gs_num, ps->obj_num);
       }
-      for (pf = fill_opacities; pf != NULL; pf = pf->next) {
-         fprintf(OF, "      /GS%i %i 0 R\n", pf->gs_num, pf->obj_num);
+      for (pf = p->pdf->fill_opacities; pf != NULL; pf = pf->next) {
+         fprintf(p->pdf->OF, "      /GS%i %i 0 R\n", pf->gs_num, pf->obj_num);
       }
-      fprintf(OF, "    >>\n"); // end of /ExtGState
+      fprintf(p->pdf->OF, "    >>\n"); // end of /ExtGState
    }
-   if (xobj_list != NULL) {
+   if (p->pdf->xobj_list != NULL) {
       // Xobjects go here
       XObject_Info *xo;
-      fprintf(OF, "    /XObject <<\n");
-      for (xo = xobj_list; xo != NULL; xo = xo->next) {
-         fprintf(OF, "      /XObj%i %i 0 R\n", xo->xo_num, xo->obj_num);
+      fprintf(p->pdf->OF, "    /XObject <<\n");
+      for (xo = p->pdf->xobj_list; xo != NULL; xo = xo->next) {
+         fprintf(p->pdf->OF, "      /XObj%i %i 0 R\n", xo->xo_num, xo->obj_num);
       }
-      fprintf(OF, "    >>\n"); // end of /XObject
+      fprintf(p->pdf->OF, "    >>\n"); // end of /XObject
    }
-   if (shades_list != NULL) {
+   if (p->pdf->shades_list != NULL) {
       // Shadings go here
       Shading_Info *so;
-      fprintf(OF, "    /Shading <<\n");
-      for (so = shades_list; so != NULL; so = so->next) {
-         fprintf(OF, "      /Shade%i %i 0 R\n", so->shade_num, so->obj_num);
+      fprintf(p->pdf->OF, "    /Shading <<\n");
+      for (so = p->pdf->shades_list; so != NULL; so = so->next) {
+         fprintf(p->pdf->OF, "      /Shade%i %i 0 R\n", so->shade_num,
+                 so->obj_num);
       }
-      fprintf(OF, "    >>\n"); // end of /Shading
+      fprintf(p->pdf->OF, "    >>\n"); // end of /Shading
    }
-   fprintf(OF, "  >>\n"); // end of /Resources
-   fprintf(OF, ">> endobj\n");
-   Record_Object_Offset(CATALOG_OBJ);
-   fprintf(OF, "%i 0 obj <<\n/Type /Catalog\n/Pages %i 0 R\n>> endobj\n",
-           CATALOG_OBJ, PAGES_OBJ);
-   Write_Font_Dictionaries();
-   Write_Font_Descriptors();
-   Write_Font_Widths();
-   Write_Stroke_Opacity_Objects();
-   Write_Fill_Opacity_Objects();
-   Write_XObjects(ierr);
+   fprintf(p->pdf->OF, "  >>\n"); // end of /Resources
+   fprintf(p->pdf->OF, ">> endobj\n");
+   if (p->pdf->multi_page) {
+      if (p->pdf->num_pages >= p->pdf->capacity_pages) {
+         p->pdf->capacity_pages = 2 * p->pdf->capacity_pages + 16;
+         REALLOC_long(&p->pdf->page_obj_nums, p->pdf->capacity_pages);
+      }
+      p->pdf->page_obj_nums[p->pdf->num_pages++] = p->pdf->page_obj_num;
+      return;
+   }
+   Close_pdf_file(p, ierr);
+}
+
+
+/* Starts a multi-page document: until Close_pdf_document, the figures
+   made with Open_pdf/Close_pdf become the pages of a single PDF file for
+   _filename_, in which the fonts, opacities, images and shadings are
+   written only once for all the pages. */
+void
+Open_pdf_document(OBJ_PTR fmkr, FM *p, char *filename, int *ierr)
+{
+   if (p->pdf->writing_file || p->pdf->multi_page) {
+      RAISE_ERROR("Sorry: cannot start a new output file until finish "
+                  "current one.", ierr);
+      return;
+   }
+   Reset_Records(p, ierr);
    if (*ierr != 0) return;
-   Write_Functions(ierr);
+   Open_pdf_file(p, filename, ierr);
    if (*ierr != 0) return;
-   Write_Shadings();
-   xref_offset = ftell(OF);
-   fprintf(OF, "xref\n0 %li\n0000000000 65535 f \n", num_objects);
-   for (i = 1; i < num_objects; i++)
-      Print_Xref(obj_offsets[i]); // NB: DONT USE OBJECT 0
-   fprintf(OF, "trailer\n<<\n/Size %li\n/Root %i 0 R\n/Info %i 0 "
-           "R\n>>\nstartxref\n%li\n%%%%EOF\n",
-           num_objects, CATALOG_OBJ, INFO_OBJ, xref_offset);
-   fseek(OF, length_offset, SEEK_SET);
-   fprintf(OF, "%li", stream_end - stream_start);
-   fclose(OF);
-   Free_Records(ierr);
+   p->pdf->multi_page = true;
+   p->pdf->num_pages = 0;
+}
+
+
+void
+Close_pdf_document(OBJ_PTR fmkr, FM *p, int *ierr)
+{
+   int i;
+   if (!p->pdf->multi_page) {
+      RAISE_ERROR("Sorry: not writing a multi-page document.", ierr);
+      return;
+   }
+   if (p->pdf->writing_file) {
+      RAISE_ERROR("Sorry: must finish the current page before ending the "
+                  "document", ierr);
+      return;
+   }
+   p->pdf->multi_page = false;
+   if (p->pdf->num_pages == 0) {
+      /* Nothing to keep */
+      fclose(p->pdf->OF);
+      p->pdf->OF = NULL;
+      RAISE_ERROR("Sorry: the document has no pages.", ierr);
+      return;
+   }
+   Record_Object_Offset(p, PAGES_OBJ);
+   fprintf(p->pdf->OF, "%i 0 obj <<\n/Type /Pages\n/Kids [", PAGES_OBJ);
+   for (i = 0; i < p->pdf->num_pages; i++)
+      fprintf(p->pdf->OF, "%s%li 0 R", (i == 0) ? "" : " ",
+              p->pdf->page_obj_nums[i]);
+   fprintf(p->pdf->OF, "]\n/Count %i\n>> endobj\n", p->pdf->num_pages);
+   Close_pdf_file(p, ierr);
 }
 
 
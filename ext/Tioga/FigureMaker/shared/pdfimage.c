@@ -208,13 +208,13 @@ Free_Sampled(Sampled_Info *xo)
 
 
 static bool
-Is_monochrome(int obj_num)
+Is_monochrome(FM *p, int obj_num)
 {
    XObject_Info *xo;
-   for (xo = xobj_list; xo != NULL; xo = xo->next) {
+   for (xo = p->pdf->xobj_list; xo != NULL; xo = xo->next) {
       if (xo->xobj_subtype == SAMPLED_SUBTYPE && xo->obj_num == obj_num) {
-         Sampled_Info *p = (Sampled_Info *)xo;
-         return (p->image_type == MONO_IMAGE);
+         Sampled_Info *si = (Sampled_Info *)xo;
+         return (si->image_type == MONO_IMAGE);
       }
    }
    return false;
@@ -222,8 +222,8 @@ Is_monochrome(int obj_num)
 
 
 static void
-Write_Image_From_File(char *filename, int width, int height, char *out_info,
-                      int mask_obj_num, int *ierr)
+Write_Image_From_File(FM *p, char *filename, int width, int height,
+                      char *out_info, int mask_obj_num, int *ierr)
 {
    FILE *jpg = fopen(filename, "rb"); /* We read binary files ! */
    if (jpg == NULL) {
@@ -240,34 +240,34 @@ Write_Image_From_File(char *filename, int width, int height, char *out_info,
       len += buff_len;
    }
    len += rd_len;
-   fprintf(OF, "\t/Subtype /Image\n");
+   fprintf(p->pdf->OF, "\t/Subtype /Image\n");
    if (mask_obj_num > 0) {
-      if (!Is_monochrome(mask_obj_num))
-         fprintf(OF, "\t/SMask %i 0 R\n", mask_obj_num);
+      if (!Is_monochrome(p, mask_obj_num))
+         fprintf(p->pdf->OF, "\t/SMask %i 0 R\n", mask_obj_num);
       else
-         fprintf(OF, "\t/Mask %i 0 R\n", mask_obj_num);
+         fprintf(p->pdf->OF, "\t/Mask %i 0 R\n", mask_obj_num);
    }
-   fprintf(OF, "\t/Width %i\n", width);
-   fprintf(OF, "\t/Height %i\n", height);
-   fprintf(OF, "%s", out_info);
-   fprintf(OF, "\t/Length %i\n\t>>\nstream\n", len);
-   if (len < buff_len) fwrite(buff, 1, len, OF);
+   fprintf(p->pdf->OF, "\t/Width %i\n", width);
+   fprintf(p->pdf->OF, "\t/Height %i\n", height);
+   fprintf(p->pdf->OF, "%s", out_info);
+   fprintf(p->pdf->OF, "\t/Length %i\n\t>>\nstream\n", len);
+   if (len < buff_len) fwrite(buff, 1, len, p->pdf->OF);
    else {
       rewind(jpg);
       while ((rd_len = fread(buff, 1, buff_len, jpg)) == buff_len) {
-         fwrite(buff, 1, buff_len, OF);
+         fwrite(buff, 1, buff_len, p->pdf->OF);
       }
-      fwrite(buff, 1, rd_len, OF);
+      fwrite(buff, 1, rd_len, p->pdf->OF);
    }
-   fprintf(OF, "\nendstream\n");
+   fprintf(p->pdf->OF, "\nendstream\n");
    fclose(jpg);
 }
 
 
 void
-Write_JPG(JPG_Info *xo, int *ierr)
+Write_JPG(FM *p, JPG_Info *xo, int *ierr)
 {
-   Write_Image_From_File(xo->filename, xo->width, xo->height, 
+   Write_Image_From_File(p, xo->filename, xo->width, xo->height, 
                          "\t/Filter /DCTDecode\n\t/ColorSpace "
                          "/DeviceRGB\n\t/BitsPerComponent 8\n",
                          xo->mask_obj_num, ierr);
@@ -277,13 +277,13 @@ extern void
 str_hls_to_rgb_bang(unsigned char* str, long len);
    
 void
-Write_Sampled(Sampled_Info *xo, int *ierr)
+Write_Sampled(FM *p, Sampled_Info *xo, int *ierr)
 {
-   fprintf(OF, "\n\t/Subtype /Image\n");
-   fprintf(OF, "\t/Interpolate %s\n",
+   fprintf(p->pdf->OF, "\n\t/Subtype /Image\n");
+   fprintf(p->pdf->OF, "\t/Interpolate %s\n",
            (xo->interpolate)? "true":"false");
-   fprintf(OF, "\t/Height %i\n", xo->height);
-   fprintf(OF, "\t/Width %i\n", xo->width);
+   fprintf(p->pdf->OF, "\t/Height %i\n", xo->height);
+   fprintf(p->pdf->OF, "\t/Width %i\n", xo->width);
    int i, len;
    unsigned long new_len;
    unsigned char *image_data;
@@ -292,49 +292,49 @@ Write_Sampled(Sampled_Info *xo, int *ierr)
    switch (xo->image_type) {
       case RGB_IMAGE:
       case HLS_IMAGE:
-         fprintf(OF, "\t/ColorSpace /DeviceRGB\n");
-         fprintf(OF, "\t/BitsPerComponent %d\n", xo->components);
+         fprintf(p->pdf->OF, "\t/ColorSpace /DeviceRGB\n");
+         fprintf(p->pdf->OF, "\t/BitsPerComponent %d\n", xo->components);
          break;
       case CMYK_IMAGE:
-         fprintf(OF, "\t/ColorSpace /DeviceCMYK\n");
-         fprintf(OF, "\t/BitsPerComponent %d\n", xo->components);
+         fprintf(p->pdf->OF, "\t/ColorSpace /DeviceCMYK\n");
+         fprintf(p->pdf->OF, "\t/BitsPerComponent %d\n", xo->components);
          break;
       case GRAY_IMAGE:
-         fprintf(OF, "\t/ColorSpace /DeviceGray\n");
-         fprintf(OF, "\t/BitsPerComponent %d\n", xo->components);
+         fprintf(p->pdf->OF, "\t/ColorSpace /DeviceGray\n");
+         fprintf(p->pdf->OF, "\t/BitsPerComponent %d\n", xo->components);
          break;
       case MONO_IMAGE:
-         fprintf(OF, "\t/ImageMask true\n");
-         fprintf(OF, "\t/BitsPerComponent 1\n");
-         if (!xo->reversed) fprintf(OF, "\t/Decode [0 1]\n");
-         else fprintf(OF, "\t/Decode [1 0]\n");
+         fprintf(p->pdf->OF, "\t/ImageMask true\n");
+         fprintf(p->pdf->OF, "\t/BitsPerComponent 1\n");
+         if (!xo->reversed) fprintf(p->pdf->OF, "\t/Decode [0 1]\n");
+         else fprintf(p->pdf->OF, "\t/Decode [1 0]\n");
          break;
       default:
          len = xo->lookup_len;
-         fprintf(OF, "\t/ColorSpace [ /Indexed /DeviceRGB %i <", xo->hival);
+         fprintf(p->pdf->OF, "\t/ColorSpace [ /Indexed /DeviceRGB %i <", xo->hival);
          for (i = 0; i < len; i++) {
             unsigned char c = xo->lookup[i];
-            if (c == 0) fprintf(OF, "00");
-            else if (c < 16) fprintf(OF, "0%x", c);
-            else fprintf(OF, "%x", c);
+            if (c == 0) fprintf(p->pdf->OF, "00");
+            else if (c < 16) fprintf(p->pdf->OF, "0%x", c);
+            else fprintf(p->pdf->OF, "%x", c);
          }
-         fprintf(OF, "> ]\n");
-         fprintf(OF, "\t/BitsPerComponent %d\n", xo->components);
+         fprintf(p->pdf->OF, "> ]\n");
+         fprintf(p->pdf->OF, "\t/BitsPerComponent %d\n", xo->components);
    }
    if (xo->mask_obj_num > 0) {
       if (xo->image_type == MONO_IMAGE) {
          RAISE_ERROR("Sorry: monochrome images must not have masks", ierr);
          return;
       }
-      if (!Is_monochrome(xo->mask_obj_num))
-         fprintf(OF, "\t/SMask %i 0 R\n", xo->mask_obj_num);
+      if (!Is_monochrome(p, xo->mask_obj_num))
+         fprintf(p->pdf->OF, "\t/SMask %i 0 R\n", xo->mask_obj_num);
       else
-         fprintf(OF, "\t/Mask %i 0 R\n", xo->mask_obj_num);
+         fprintf(p->pdf->OF, "\t/Mask %i 0 R\n", xo->mask_obj_num);
    }
    if (xo->value_mask_min >= 0 && xo->value_mask_max >= 0
        && xo->value_mask_min <= 255 && xo->value_mask_max <= 255
        && xo->value_mask_min <= xo->value_mask_max)
-      fprintf(OF, "\t/Mask [%i %i]\n", xo->value_mask_min, xo->value_mask_max);
+      fprintf(p->pdf->OF, "\t/Mask [%i %i]\n", xo->value_mask_min, xo->value_mask_max);
    
    if (xo->image_type == HLS_IMAGE) {
       image_data = ALLOC_N_unsigned_char(xo->length);
@@ -349,10 +349,10 @@ Write_Sampled(Sampled_Info *xo, int *ierr)
    
    if(xo->filters) {
      new_len = xo->length;
-     fprintf(OF, "%s", xo->filters);
+     fprintf(p->pdf->OF, "%s", xo->filters);
    }
    else {
-     fprintf(OF, "\t/Filter /FlateDecode\n");
+     fprintf(p->pdf->OF, "\t/Filter /FlateDecode\n");
    
      new_len = (xo->length * 11)/10 + 100;
      buffer = ALLOC_N_unsigned_char(new_len);
@@ -364,16 +364,16 @@ Write_Sampled(Sampled_Info *xo, int *ierr)
      }
      wd = buffer;
    }
-   fprintf(OF, "\t/Length %li\n", new_len);
-   fprintf(OF, "\t>>\nstream\n");
-   if (fwrite(wd, 1, new_len, OF) < new_len) {
+   fprintf(p->pdf->OF, "\t/Length %li\n", new_len);
+   fprintf(p->pdf->OF, "\t>>\nstream\n");
+   if (fwrite(wd, 1, new_len, p->pdf->OF) < new_len) {
       RAISE_ERROR("Error writing image data", ierr);
       return;
    }
    if(buffer)
      free(buffer);
    if (xo->image_type == HLS_IMAGE) free(image_data);
-   fprintf(OF, "\nendstream\nendobj\n");
+   fprintf(p->pdf->OF, "\nendstream\nendobj\n");
 }
 
 
@@ -394,12 +394,20 @@ c_private_register_jpg(OBJ_PTR fmkr, FM *p, char *filename,
                        int width, int height,
                        int mask_obj_num, int *ierr)
 {
+  XObject_Info *old;
+  /* The same file is only written once */
+  for (old = p->pdf->xobj_list; old != NULL; old = old->next) {
+     JPG_Info *jo = (JPG_Info *)old;
+     if (old->xobj_subtype == JPG_SUBTYPE && jo->width == width &&
+         jo->height == height && jo->mask_obj_num == mask_obj_num &&
+         strcmp(jo->filename, filename) == 0) return old->obj_num;
+  }
   JPG_Info *xo = (JPG_Info *)calloc(1,sizeof(JPG_Info));
   xo->xobj_subtype = JPG_SUBTYPE;
-  xo->next = xobj_list;
-  xobj_list = (XObject_Info *)xo;
-  xo->xo_num = next_available_xo_number++;
-  xo->obj_num = next_available_object_number++;
+  xo->next = p->pdf->xobj_list;
+  p->pdf->xobj_list = (XObject_Info *)xo;
+  xo->xo_num = p->pdf->next_available_xo_number++;
+  xo->obj_num = p->pdf->next_available_object_number++;
   xo->filename = ALLOC_N_char(strlen(filename)+1);
   strcpy(xo->filename, filename);
   xo->width = width;
@@ -435,7 +443,7 @@ c_private_show_jpg(OBJ_PTR fmkr, FM *p, char *filename,
 {
    double dest[6];
    int ref;
-   if (constructing_path) {
+   if (p->pdf->constructing_path) {
       RAISE_ERROR("Sorry: must finish with current path before "
                   "calling show_jpg", ierr);
       return;
@@ -604,6 +612,38 @@ c_private_show_image(OBJ_PTR fmkr, FM *p, int image_type, double llx,
   return Integer_New(ref);
 }
 
+/* Returns the object number of a previous image identical to _xo_, or
+   -1 if there is none. */
+static int
+Find_Same_Sampled(FM *p, Sampled_Info *xo)
+{
+   XObject_Info *old;
+   for (old = p->pdf->xobj_list; old != NULL; old = old->next) {
+      Sampled_Info *so = (Sampled_Info *)old;
+      if (old->xobj_subtype != SAMPLED_SUBTYPE) continue;
+      if (so->width != xo->width || so->height != xo->height ||
+          so->length != xo->length || so->image_type != xo->image_type ||
+          so->interpolate != xo->interpolate ||
+          so->reversed != xo->reversed ||
+          so->components != xo->components ||
+          so->mask_obj_num != xo->mask_obj_num ||
+          so->value_mask_min != xo->value_mask_min ||
+          so->value_mask_max != xo->value_mask_max ||
+          so->hival != xo->hival || so->lookup_len != xo->lookup_len)
+         continue;
+      if ((so->filters == NULL) != (xo->filters == NULL) ||
+          (so->filters != NULL && strcmp(so->filters, xo->filters) != 0))
+         continue;
+      if (so->lookup_len > 0 &&
+          memcmp(so->lookup, xo->lookup, so->lookup_len) != 0)
+         continue;
+      if (memcmp(so->image_data, xo->image_data, xo->length) == 0)
+         return old->obj_num;
+   }
+   return -1;
+}
+
+
 int
 c_private_register_image(OBJ_PTR fmkr, FM *p, int image_type,
                          bool interpolate, bool reversed,
@@ -615,7 +655,7 @@ c_private_register_image(OBJ_PTR fmkr, FM *p, int image_type,
 {
    unsigned char *lookup = NULL;
    int value_mask_min = 256, value_mask_max = 256, lookup_len = 0, hival = 0;
-   if (constructing_path) {
+   if (p->pdf->constructing_path) {
       RAISE_ERROR("Sorry: must finish with current path before calling "
                   "show_image", ierr);
       RETURN_NIL;
@@ -631,13 +671,8 @@ c_private_register_image(OBJ_PTR fmkr, FM *p, int image_type,
    
 
    Sampled_Info *xo = (Sampled_Info *)calloc(1, sizeof(Sampled_Info));
+   int same_obj_num;
    xo->xobj_subtype = SAMPLED_SUBTYPE;
-   double a, b, c, d, e, f; // the transform to position the image
-   //int ir, ic, id;
-   xo->next = xobj_list;
-   xobj_list = (XObject_Info *)xo;
-   xo->xo_num = next_available_xo_number++;
-   xo->obj_num = next_available_object_number++;
    xo->image_data = ALLOC_N_unsigned_char(len);
    xo->length = len;
    xo->interpolate = interpolate;
@@ -658,6 +693,8 @@ c_private_register_image(OBJ_PTR fmkr, FM *p, int image_type,
          RAISE_ERROR_ii("Sorry: color space hival (%i) is too large for "
                         "length of lookup table (%i)", hival, lookup_len,
                         ierr);
+         Free_Sampled(xo);
+         free(xo);
          RETURN_NIL;
       }
       xo->hival = hival;
@@ -671,6 +708,16 @@ c_private_register_image(OBJ_PTR fmkr, FM *p, int image_type,
    xo->value_mask_min = value_mask_min;
    xo->value_mask_max = value_mask_max;
    xo->mask_obj_num = mask_obj_num;
+   /* Identical images are only written once */
+   if ((same_obj_num = Find_Same_Sampled(p, xo)) >= 0) {
+      Free_Sampled(xo);
+      free(xo);
+      return same_obj_num;
+   }
+   xo->next = p->pdf->xobj_list;
+   p->pdf->xobj_list = (XObject_Info *)xo;
+   xo->xo_num = p->pdf->next_available_xo_number++;
+   xo->obj_num = p->pdf->next_available_object_number++;
    return xo->obj_num;
 }
 
@@ -678,9 +725,9 @@ c_private_register_image(OBJ_PTR fmkr, FM *p, int image_type,
    matches the one given, and returns the Xobject number. -1 if not
    found. */
 
-int Find_XObjRef(int ref)
+int Find_XObjRef(FM *p, int ref)
 {
-  XObject_Info * info = xobj_list;
+  XObject_Info * info = p->pdf->xobj_list;
   while(1) {
     if(info->obj_num == ref)
       return info->xo_num;
@@ -697,14 +744,14 @@ c_private_show_image_from_ref(OBJ_PTR fmkr, FM *p, int ref, double llx,
                               double uly,
                               int *ierr)
 {
-   if (constructing_path) {
+   if (p->pdf->constructing_path) {
       RAISE_ERROR("Sorry: must finish with current path before calling "
                   "show_image", ierr);
       return;
    }
 
    double a, b, c, d, e, f; // the transform to position the image
-   int xo_num = Find_XObjRef(ref);
+   int xo_num = Find_XObjRef(p, ref);
    if(xo_num < 0) {
      RAISE_ERROR_i("Could not find image PDF object %d", ref,
                     ierr);
@@ -720,8 +767,11 @@ c_private_show_image_from_ref(OBJ_PTR fmkr, FM *p, int ref, double llx,
 
    Create_Transform_from_Points(llx, lly, lrx, lry, ulx, uly,
                                 &a, &b, &c, &d, &e, &f);
-   fprintf(TF, "q %0.2f %0.2f %0.2f %0.2f %0.2f %0.2f cm /XObj%i Do Q\n",
-           a, b, c, d, e, f, xo_num);
+   Stream_Puts(p, "q ");
+   Stream_Matrix(p, a, b, c, d, e, f, 2);
+   Stream_Puts(p, "cm /XObj");
+   Stream_Operand_Long(p, xo_num);
+   Stream_Puts(p, "Do Q\n");
    update_bbox(p, llx, lly);
    update_bbox(p, lrx, lry);
    update_bbox(p, ulx, uly);
@@ -22,8 +22,6 @@
 #include "figures.h"
 #include "pdfs.h"
 
-bool have_current_point, constructing_path, writing_file;
-double bbox_llx, bbox_lly, bbox_urx, bbox_ury;
 
 /* emits a warning on nonok numbers if croak_on_nonok_numbers is true */
 static void croak_on_nonok(FM *p, const char * function)
@@ -64,7 +62,12 @@ void Unpack_RGB(OBJ_PTR rgb, double *rp, double *gp, double *bp, int *ierr)
 }
 
 void c_stroke_color_set_RGB(OBJ_PTR fmkr, FM *p, double r, double g, double b, int *ierr) {
-   if (writing_file) fprintf(TF, "%0.3f %0.3f %0.3f RG\n", r, g, b);
+   if (p->pdf->writing_file) {
+      Stream_Operand_Double(p, r, 3);
+      Stream_Operand_Double(p, g, 3);
+      Stream_Operand_Double(p, b, 3);
+      Stream_Puts(p, "RG\n");
+   }
    p->stroke_color_R = r;
    p->stroke_color_G = g;
    p->stroke_color_B = b;
@@ -92,7 +95,12 @@ OBJ_PTR c_stroke_color_get(OBJ_PTR fmkr, FM *p, int *ierr) { // OBJ_PTR is array
 
 
 void c_fill_color_set_RGB(OBJ_PTR fmkr, FM *p, double r, double g, double b, int *ierr) {
-   if (writing_file) fprintf(TF, "%0.3f %0.3f %0.3f rg\n", r, g, b);
+   if (p->pdf->writing_file) {
+      Stream_Operand_Double(p, r, 3);
+      Stream_Operand_Double(p, g, 3);
+      Stream_Operand_Double(p, b, 3);
+      Stream_Puts(p, "rg\n");
+   }
    p->fill_color_R = r;
    p->fill_color_G = g;
    p->fill_color_B = b;
@@ -122,7 +130,10 @@ OBJ_PTR c_fill_color_get(OBJ_PTR fmkr, FM *p, int *ierr) { // OBJ_PTR is array o
 void c_line_width_set(OBJ_PTR fmkr, FM *p, double line_width, int *ierr) {
    if (line_width < 0.0) { RAISE_ERROR_g("Sorry: invalid line width (%g points): must be positive", line_width, ierr); return; }
    if (line_width > 1e3) { RAISE_ERROR_g("Sorry: too large line width (%g points)", line_width, ierr); return; }
-   if (writing_file) fprintf(TF, "%0.3f w\n", line_width * ENLARGE * p->default_line_scale);
+   if (p->pdf->writing_file) {
+      Stream_Operand_Double(p, line_width * ENLARGE * p->default_line_scale, 3);
+      Stream_Puts(p, "w\n");
+   }
    p->line_width = line_width;
 }
 
@@ -137,39 +148,48 @@ void c_rescale_lines(OBJ_PTR fmkr, FM *p, double scaling_factor, int *ierr) {
 
 void c_line_cap_set(OBJ_PTR fmkr, FM *p, int line_cap, int *ierr) {
    if (line_cap < 0 || line_cap > 3) { RAISE_ERROR_i("Sorry: invalid arg for setting line_cap (%i)", line_cap, ierr); return; }
-   if (writing_file) fprintf(TF, "%d J\n", line_cap);
+   if (p->pdf->writing_file) {
+      Stream_Operand_Long(p, line_cap);
+      Stream_Puts(p, "J\n");
+   }
    p->line_cap = line_cap;
 }
 
 
 void c_line_join_set(OBJ_PTR fmkr, FM *p, int line_join, int *ierr) {
    if (line_join < 0 || line_join > 3) { RAISE_ERROR_i("Sorry: invalid arg for setting line_join (%i)", line_join, ierr); return; }
-   if (writing_file) fprintf(TF, "%d j\n", line_join);
+   if (p->pdf->writing_file) {
+      Stream_Operand_Long(p, line_join);
+      Stream_Puts(p, "j\n");
+   }
    p->line_join = line_join;
 }
 
 
 void c_miter_limit_set(OBJ_PTR fmkr, FM *p, double miter_limit, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must not be constructing a path when change miter limit", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must not be constructing a path when change miter limit", ierr); return; }
    if (miter_limit < 0.0) {
       RAISE_ERROR_g(
          "Sorry: invalid miter limit (%g): must be positive ratio for max miter length to line width", miter_limit, ierr); 
       return; }
-   if (writing_file) fprintf(TF, "%0.3f M\n", miter_limit);
+   if (p->pdf->writing_file) {
+      Stream_Operand_Double(p, miter_limit, 3);
+      Stream_Puts(p, "M\n");
+   }
    p->miter_limit = miter_limit;
 }
 
 
 void c_line_type_set(OBJ_PTR fmkr, FM *p, OBJ_PTR line_type, int *ierr) { // array phase d  (distances given in points)
    double sz;
-   if (constructing_path) {
+   if (p->pdf->constructing_path) {
       RAISE_ERROR("Sorry: must not be constructing a path when change line_type", ierr);
       return;
    }
    if (line_type == OBJ_NIL) {
-      fprintf(TF, "[] 0 d\n");
+      Stream_Puts(p, "[] 0 d\n");
    } else {
-      if (writing_file) {
+      if (p->pdf->writing_file) {
          int len = Array_Len(line_type, ierr);
          if (*ierr != 0) return;
          if (len != 2) {
@@ -180,7 +200,7 @@ void c_line_type_set(OBJ_PTR fmkr, FM *p, OBJ_PTR line_type, int *ierr) { // arr
          if (*ierr != 0) return;
          OBJ_PTR dashPhase = Array_Entry(line_type, 1, ierr);
          if (*ierr != 0) return;
-         fprintf(TF, "[ ");
+         Stream_Puts(p, "[ ");
          if (dashArray != OBJ_NIL) {
             long i, len = Array_Len(dashArray, ierr);
             if (*ierr != 0) return;
@@ -193,7 +213,7 @@ void c_line_type_set(OBJ_PTR fmkr, FM *p, OBJ_PTR line_type, int *ierr) { // arr
                   RAISE_ERROR_g("Sorry: invalid dash array entry (%g): must be positive", sz, ierr);
                   return;
                }
-               fprintf(TF, "%0.3f ", sz * ENLARGE);
+               Stream_Operand_Double(p, sz * ENLARGE, 3);
             }
          }
          sz = Number_to_double(dashPhase, ierr);
@@ -202,7 +222,9 @@ void c_line_type_set(OBJ_PTR fmkr, FM *p, OBJ_PTR line_type, int *ierr) { // arr
             RAISE_ERROR_g("Sorry: invalid dash phase (%g): must be positive", sz, ierr);
             return;
          }
-         fprintf(TF, "] %0.3f d\n", sz * ENLARGE);
+         Stream_Puts(p, "] ");
+         Stream_Operand_Double(p, sz * ENLARGE, 3);
+         Stream_Puts(p, "d\n");
       }
    }
    Set_line_type(fmkr, line_type, ierr);
@@ -227,10 +249,10 @@ static long c_round_dev(FM *p, double v) { // make sure that we don't get too fa
 
 void update_bbox(FM *p, double x, double y)
 {
-   if (x >= p->clip_left && x < bbox_llx) bbox_llx = x;
-   if (y >= p->clip_bottom && y < bbox_lly) bbox_lly = y;
-   if (x <= p->clip_right && x > bbox_urx) bbox_urx = x;
-   if (y <= p->clip_top && y > bbox_ury) bbox_ury = y;
+   if (x >= p->clip_left && x < p->pdf->bbox_llx) p->pdf->bbox_llx = x;
+   if (y >= p->clip_bottom && y < p->pdf->bbox_lly) p->pdf->bbox_lly = y;
+   if (x <= p->clip_right && x > p->pdf->bbox_urx) p->pdf->bbox_urx = x;
+   if (y <= p->clip_top && y > p->pdf->bbox_ury) p->pdf->bbox_ury = y;
 }
 
 void c_update_bbox(OBJ_PTR fmkr, FM *p, double x, double y, int *ierr) {
@@ -238,13 +260,13 @@ void c_update_bbox(OBJ_PTR fmkr, FM *p, double x, double y, int *ierr) {
 }
 
 
-OBJ_PTR c_bbox_left(OBJ_PTR fmkr, FM *p, int *ierr) { return Float_New(bbox_llx); }
+OBJ_PTR c_bbox_left(OBJ_PTR fmkr, FM *p, int *ierr) { return Float_New(p->pdf->bbox_llx); }
 
-OBJ_PTR c_bbox_right(OBJ_PTR fmkr, FM *p, int *ierr) { return Float_New(bbox_urx); }
+OBJ_PTR c_bbox_right(OBJ_PTR fmkr, FM *p, int *ierr) { return Float_New(p->pdf->bbox_urx); }
 
-OBJ_PTR c_bbox_top(OBJ_PTR fmkr, FM *p, int *ierr) { return Float_New(bbox_ury); }
+OBJ_PTR c_bbox_top(OBJ_PTR fmkr, FM *p, int *ierr) { return Float_New(p->pdf->bbox_ury); }
 
-OBJ_PTR c_bbox_bottom(OBJ_PTR fmkr, FM *p, int *ierr) { return Float_New(bbox_lly); }
+OBJ_PTR c_bbox_bottom(OBJ_PTR fmkr, FM *p, int *ierr) { return Float_New(p->pdf->bbox_lly); }
 
 
 void c_move_to_point(OBJ_PTR fmkr, FM *p, double x, double y, int *ierr) {
@@ -254,9 +276,13 @@ void c_move_to_point(OBJ_PTR fmkr, FM *p, double x, double y, int *ierr) {
 }
 void c_moveto(OBJ_PTR fmkr, FM *p, double x, double y, int *ierr) {
    ARE_OK_NUMBERS(x,y);
-   if (writing_file) fprintf(TF, "%ld %ld m\n", c_round_dev(p,x), c_round_dev(p,y));
+   if (p->pdf->writing_file) {
+      Stream_Operand_Long(p, c_round_dev(p,x));
+      Stream_Operand_Long(p, c_round_dev(p,y));
+      Stream_Puts(p, "m\n");
+   }
    update_bbox(p, x, y);
-   have_current_point = constructing_path = true;
+   p->pdf->have_current_point = p->pdf->constructing_path = true;
 }
 
 
@@ -267,8 +293,12 @@ void c_append_point_to_path(OBJ_PTR fmkr, FM *p, double x, double y, int *ierr)
 }
 void c_lineto(OBJ_PTR fmkr, FM *p, double x, double y, int *ierr) {
    ARE_OK_NUMBERS(x,y);
-   if (!constructing_path) { RAISE_ERROR("Sorry: must start path with moveto before call lineto", ierr); return; }
-   if (writing_file) fprintf(TF, "%ld %ld l\n", c_round_dev(p,x), c_round_dev(p,y));
+   if (!p->pdf->constructing_path) { RAISE_ERROR("Sorry: must start path with moveto before call lineto", ierr); return; }
+   if (p->pdf->writing_file) {
+      Stream_Operand_Long(p, c_round_dev(p,x));
+      Stream_Operand_Long(p, c_round_dev(p,y));
+      Stream_Puts(p, "l\n");
+   }
    update_bbox(p, x, y);
 }
 
@@ -300,9 +330,16 @@ void c_curveto(OBJ_PTR fmkr, FM *p,
    ARE_OK_NUMBERS(x1,y1);
    ARE_OK_NUMBERS(x2,y2);
    ARE_OK_NUMBERS(x3,y3);
-   if (!constructing_path) { RAISE_ERROR("Sorry: must start path with moveto before call curveto", ierr); return; }
-   if (writing_file) fprintf(TF, "%ld %ld %ld %ld %ld %ld c\n", 
-            c_round_dev(p,x1), c_round_dev(p,y1), c_round_dev(p,x2), c_round_dev(p,y2), c_round_dev(p,x3), c_round_dev(p,y3));
+   if (!p->pdf->constructing_path) { RAISE_ERROR("Sorry: must start path with moveto before call curveto", ierr); return; }
+   if (p->pdf->writing_file) {
+      Stream_Operand_Long(p, c_round_dev(p,x1));
+      Stream_Operand_Long(p, c_round_dev(p,y1));
+      Stream_Operand_Long(p, c_round_dev(p,x2));
+      Stream_Operand_Long(p, c_round_dev(p,y2));
+      Stream_Operand_Long(p, c_round_dev(p,x3));
+      Stream_Operand_Long(p, c_round_dev(p,y3));
+      Stream_Puts(p, "c\n");
+   }
    update_bbox(p, x1, y1);
    update_bbox(p, x2, y2);
    update_bbox(p, x3, y3);
@@ -310,9 +347,9 @@ void c_curveto(OBJ_PTR fmkr, FM *p,
 
 
 void c_close_path(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) { RAISE_ERROR("Sorry: must be constructing path when call closepath", ierr); return; }
-   if (writing_file) fprintf(TF, "h\n");
-   have_current_point = false;
+   if (!p->pdf->constructing_path) { RAISE_ERROR("Sorry: must be constructing path when call closepath", ierr); return; }
+   if (p->pdf->writing_file) Stream_Puts(p, "h\n");
+   p->pdf->have_current_point = false;
 }
 
 
@@ -377,7 +414,7 @@ void c_append_arc(OBJ_PTR fmkr, FM *p, double x_start, double y_start, double x_
    x1 += x_center; y1 += y_center;
    x2 += x_center; y2 += y_center;
    x3 += x_center; y3 += y_center;
-   if (have_current_point) c_lineto(fmkr,p,x0,y0,ierr);
+   if (p->pdf->have_current_point) c_lineto(fmkr,p,x0,y0,ierr);
    else c_moveto(fmkr,p,x0,y0, ierr);
    c_curveto(fmkr,p,x1,y1,x2,y2,x3,y3,ierr);
 }
@@ -467,165 +504,321 @@ void c_append_circle_to_path(OBJ_PTR fmkr, FM *p, double x, double y, double dx,
    c_append_oval(fmkr, p, convert_figure_to_output_x(p,x), convert_figure_to_output_y(p,y), s, s, 0.0, ierr);
 }
 
-void c_append_points_to_path(OBJ_PTR fmkr, FM *p, OBJ_PTR x_vec, OBJ_PTR y_vec, int *ierr) {
-   long xlen, ylen, i;
-   double *xs = Vector_Data_for_Read(x_vec, &xlen, ierr);
-   if (*ierr != 0) return;
-   double *ys = Vector_Data_for_Read(y_vec, &ylen, ierr);
-   if (*ierr != 0) return;
-   if (xlen != ylen) { RAISE_ERROR("Sorry: must have same number xs and ys for append_points", ierr); return; }
-   if (xlen <= 0) return;
-   if (have_current_point) c_append_point_to_path(fmkr,p,xs[0],ys[0], ierr);
-   else c_move_to_point(fmkr,p,xs[0],ys[0], ierr);
-   for (i=1; i<xlen; i++) c_append_point_to_path(fmkr,p,xs[i],ys[i], ierr);
+/* Point culling for long vectors of points (see cull_points_threshold).
+   Points are appended in device coordinates, and a point is only written
+   out once we know it can't be left out: that is when it neither rounds
+   to the same device position as the previous one, nor lies on the
+   straight segment going on from the previous one in the same direction.
+   Either way, the rendered path is the same. */
+
+typedef struct {
+   bool active;
+   bool has_last; // (last_x, last_y) is the current point of the stream
+   bool has_pending; // (pending_x, pending_y) is not written out yet
+   long last_x, last_y;
+   long pending_x, pending_y;
+} Point_Culler;
+
+static void culler_init(FM *p, Point_Culler *c, long num_points)
+{
+   c->active = p->pdf->writing_file && p->cull_points_threshold >= 0 &&
+      num_points >= p->cull_points_threshold;
+   c->has_last = c->has_pending = false;
 }
 
-void c_private_append_points_with_gaps_to_path(OBJ_PTR fmkr, FM *p,
-      OBJ_PTR x_vec, OBJ_PTR y_vec, OBJ_PTR gaps, bool do_close, int *ierr) {
+static void culler_flush(FM *p, Point_Culler *c)
+{
+   if (!c->has_pending) return;
+   Stream_Operand_Long(p, c->pending_x);
+   Stream_Operand_Long(p, c->pending_y);
+   Stream_Puts(p, "l\n");
+   c->last_x = c->pending_x;
+   c->last_y = c->pending_y;
+   c->has_pending = false;
+}
+
+static void culler_move_to_point(OBJ_PTR fmkr, FM *p, Point_Culler *c,
+      double x, double y, int *ierr)
+{
+   x = convert_figure_to_output_x(p,x);
+   y = convert_figure_to_output_y(p,y);
+   culler_flush(p, c);
+   c_moveto(fmkr, p, x, y, ierr);
+   if (!c->active || *ierr != 0) return;
+   c->has_last = is_okay_number(x) && is_okay_number(y);
+   if (c->has_last) {
+      c->last_x = c_round_dev(p,x);
+      c->last_y = c_round_dev(p,y);
+   }
+}
+
+static void culler_append_point_to_path(OBJ_PTR fmkr, FM *p, Point_Culler *c,
+      double x, double y, int *ierr)
+{
+   long ix, iy;
+   x = convert_figure_to_output_x(p,x);
+   y = convert_figure_to_output_y(p,y);
+   if (!c->active || !c->has_last || !is_okay_number(x) ||
+       !is_okay_number(y)) {
+      // c_lineto does the complaining
+      culler_flush(p, c);
+      c_lineto(fmkr, p, x, y, ierr);
+      if (!c->active || *ierr != 0 || !p->pdf->constructing_path ||
+          !is_okay_number(x) || !is_okay_number(y)) return;
+      c->has_last = true;
+      c->last_x = c_round_dev(p,x);
+      c->last_y = c_round_dev(p,y);
+      return;
+   }
+   update_bbox(p, x, y);
+   ix = c_round_dev(p,x);
+   iy = c_round_dev(p,y);
+   if (c->has_pending) {
+      // long long, as the products can overflow a 32 bits long
+      long long dx1 = c->pending_x - c->last_x, dy1 = c->pending_y - c->last_y;
+      long long dx2 = ix - c->pending_x, dy2 = iy - c->pending_y;
+      if (dx2 == 0 && dy2 == 0) return;
+      if (dx1 * dy2 == dy1 * dx2 && dx1 * dx2 + dy1 * dy2 > 0) {
+         // collinear, going on in the same direction
+         c->pending_x = ix;
+         c->pending_y = iy;
+         return;
+      }
+      culler_flush(p, c);
+   }
+   else if (ix == c->last_x && iy == c->last_y) return;
+   c->pending_x = ix;
+   c->pending_y = iy;
+   c->has_pending = true;
+}
+
+/* Min/max decimation: in a run of consecutive points that fall in the
+   same device column, only the first, the last, the lowest and the
+   highest can make a difference to the output, as the path never leaves
+   the vertical segment between the lowest and the highest. They are
+   appended in their original order. */
+static void append_decimated_points(OBJ_PTR fmkr, FM *p, Point_Culler *c,
+      double *xs, double *ys, long start, long end, int *ierr)
+{
+   long i = start, j, column, keep[4];
+   int k, num_keep;
+   double y, y_min, y_max;
+   while (i < end && *ierr == 0) {
+      double x = convert_figure_to_output_x(p,xs[i]);
+      y = convert_figure_to_output_y(p,ys[i]);
+      if (!is_okay_number(x) || !is_okay_number(y)) {
+         // let culler_append_point_to_path deal with that one
+         culler_append_point_to_path(fmkr,p,c,xs[i],ys[i], ierr);
+         i++;
+         continue;
+      }
+      column = c_round_dev(p,x);
+      long i_min = i, i_max = i;
+      y_min = y_max = y;
+      for (j = i + 1; j < end; j++) {
+         x = convert_figure_to_output_x(p,xs[j]);
+         y = convert_figure_to_output_y(p,ys[j]);
+         if (!is_okay_number(x) || !is_okay_number(y) ||
+             c_round_dev(p,x) != column) break;
+         if (y < y_min) { y_min = y; i_min = j; }
+         if (y > y_max) { y_max = y; i_max = j; }
+      }
+      // j is now the first point of the next run
+      keep[0] = i;
+      keep[1] = (i_min < i_max) ? i_min : i_max;
+      keep[2] = (i_min < i_max) ? i_max : i_min;
+      keep[3] = j - 1;
+      for (k = 0, num_keep = 0; k < 4; k++) {
+         if (num_keep > 0 && keep[k] == keep[num_keep-1]) continue;
+         keep[num_keep++] = keep[k];
+      }
+      for (k = 0; k < num_keep; k++)
+         culler_append_point_to_path(fmkr,p,c,xs[keep[k]],ys[keep[k]], ierr);
+      i = j;
+   }
+}
+
+static void append_points_range(OBJ_PTR fmkr, FM *p, Point_Culler *c,
+      double *xs, double *ys, long start, long end, bool decimate, int *ierr)
+{
+   long i;
+   if (decimate) {
+      append_decimated_points(fmkr, p, c, xs, ys, start, end, ierr);
+      return;
+   }
+   for (i = start; i < end; i++)
+      culler_append_point_to_path(fmkr,p,c,xs[i],ys[i], ierr);
+}
+
+static void append_points_with_gaps(OBJ_PTR fmkr, FM *p,
+      OBJ_PTR x_vec, OBJ_PTR y_vec, OBJ_PTR gaps, bool do_close,
+      bool decimate, int *ierr) {
     // where there's a gap, do a moveto instead of a lineto
-   if (gaps == OBJ_NIL) return c_append_points_to_path(fmkr, p, x_vec, y_vec, ierr);
-   long xlen, ylen, glen, i, j;
+   long xlen, ylen, glen = 0, i, j;
+   Point_Culler culler;
+   double *gs = NULL;
    double *xs = Vector_Data_for_Read(x_vec, &xlen, ierr);
    if (*ierr != 0) return;
    double *ys = Vector_Data_for_Read(y_vec, &ylen, ierr);
    if (*ierr != 0) return;
-   double *gs = Vector_Data_for_Read(gaps, &glen, ierr);
-   if (*ierr != 0) return;
-   if (xlen != ylen) { RAISE_ERROR("Sorry: must have same number xs and ys for append_points_with_gaps", ierr); return; }
+   if (gaps != OBJ_NIL) {
+      gs = Vector_Data_for_Read(gaps, &glen, ierr);
+      if (*ierr != 0) return;
+   }
+   if (xlen != ylen) {
+      if (gaps == OBJ_NIL) RAISE_ERROR("Sorry: must have same number xs and ys for append_points", ierr);
+      else RAISE_ERROR("Sorry: must have same number xs and ys for append_points_with_gaps", ierr);
+      return;
+   }
    if (xlen <= 0) return;
-   if (have_current_point) c_append_point_to_path(fmkr,p,xs[0],ys[0], ierr);
-   else c_move_to_point(fmkr,p,xs[0],ys[0], ierr);
+   culler_init(p, &culler, xlen);
+   if (p->pdf->have_current_point) culler_append_point_to_path(fmkr,p,&culler,xs[0],ys[0], ierr);
+   else culler_move_to_point(fmkr,p,&culler,xs[0],ys[0], ierr);
    for (i = 1, j = 0; j < glen; j++) {
       int gap_start = ROUND(gs[j]);
       if (gap_start == xlen) break;
       if (gap_start > xlen) {
+         culler_flush(p, &culler);
          RAISE_ERROR_ii("Sorry: gap value (%i) too large for vectors of length (%i)", gap_start, xlen, ierr); 
          return; }
-      while (i < gap_start) {
-         c_append_point_to_path(fmkr,p,xs[i],ys[i], ierr);
-         i++;
+      if (i < gap_start) {
+         append_points_range(fmkr,p,&culler,xs,ys,i,gap_start,decimate, ierr);
+         i = gap_start;
       }
+      culler_flush(p, &culler);
       if (do_close) c_close_path(fmkr,p, ierr);
-      c_move_to_point(fmkr,p,xs[i],ys[i], ierr);
+      culler_move_to_point(fmkr,p,&culler,xs[i],ys[i], ierr);
       i++;
    }
-   while (i < xlen) {
-      c_append_point_to_path(fmkr,p,xs[i],ys[i], ierr);
-      i++;
-   }
-   if (do_close) c_close_path(fmkr,p, ierr);
+   append_points_range(fmkr,p,&culler,xs,ys,i,xlen,decimate, ierr);
+   culler_flush(p, &culler);
+   if (do_close && gaps != OBJ_NIL) c_close_path(fmkr,p, ierr);
+}
+
+void c_append_points_to_path(OBJ_PTR fmkr, FM *p, OBJ_PTR x_vec, OBJ_PTR y_vec, int *ierr) {
+   append_points_with_gaps(fmkr, p, x_vec, y_vec, OBJ_NIL, false, false, ierr);
+}
+
+void c_private_append_points_with_gaps_to_path(OBJ_PTR fmkr, FM *p,
+      OBJ_PTR x_vec, OBJ_PTR y_vec, OBJ_PTR gaps, bool do_close, int *ierr) {
+   append_points_with_gaps(fmkr, p, x_vec, y_vec, gaps, do_close, false, ierr);
+}
+
+void c_private_append_decimated_points_to_path(OBJ_PTR fmkr, FM *p,
+      OBJ_PTR x_vec, OBJ_PTR y_vec, OBJ_PTR gaps, bool do_close, int *ierr) {
+   append_points_with_gaps(fmkr, p, x_vec, y_vec, gaps, do_close, true, ierr);
 }
 
 /* Path painting operators */
 
 void c_stroke(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "S\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "S\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
 }
 
 void c_close_and_stroke(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "s\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "s\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
 }
 
 void c_fill(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "f\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "f\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
 }
 
 void c_discard_path(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "n\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "n\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
    }
 
 void c_eofill(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "f*\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "f*\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
    }
 
 void c_fill_and_stroke(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "B\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "B\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
    }
 
 void c_eofill_and_stroke(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "B*\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "B*\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
    }
 
 void c_close_fill_and_stroke(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "b\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "b\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
    }
 
 void c_close_eofill_and_stroke(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "b*\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "b*\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
    }
 
 void c_clip(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "W n\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "W n\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
    }
 
 
 void c_eoclip(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "W* n\n");
-   have_current_point = constructing_path = false;
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "W* n\n");
+   p->pdf->have_current_point = p->pdf->constructing_path = false;
    }
 
 void c_fill_and_clip(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "q f Q\n");
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "q f Q\n");
    c_clip(fmkr,p, ierr);
    }
 
 void c_stroke_and_clip(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "q S Q\n");
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "q S Q\n");
    c_clip(fmkr,p, ierr);
    }
 
 void c_fill_stroke_and_clip(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (!constructing_path) return;
-   if (writing_file) fprintf(TF, "q B Q\n");
+   if (!p->pdf->constructing_path) return;
+   if (p->pdf->writing_file) Stream_Puts(p, "q B Q\n");
    c_clip(fmkr,p, ierr);
    }
 
 /* Combination Path Constructing and Using */
 
 void c_stroke_line(OBJ_PTR fmkr, FM *p, double x1, double y1, double x2, double y2, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_line", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_line", ierr); return; }
    c_move_to_point(fmkr, p, x1, y1, ierr);
    c_append_point_to_path(fmkr, p, x2, y2, ierr);
    c_stroke(fmkr, p, ierr);
    }
 
 void c_fill_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, double height, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_rect", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_rect", ierr); return; }
    c_append_rect_to_path(fmkr, p, x, y, width, height, ierr);
    c_fill(fmkr,p, ierr);
    }
 
 void c_stroke_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, double height, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_rect", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_rect", ierr); return; }
    c_append_rect_to_path(fmkr, p, x, y, width, height, ierr);
    c_stroke(fmkr,p, ierr);
    }
 
 void c_fill_and_stroke_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, double height, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_rect", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_rect", ierr); return; }
    c_append_rect_to_path(fmkr, p, x, y, width, height, ierr);
    c_fill_and_stroke(fmkr,p, ierr);
    }
@@ -635,7 +828,7 @@ void c_clip_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, double h
       convert_figure_to_output_x(p,x), convert_figure_to_output_y(p,y),
       convert_figure_to_output_dx(p,width), convert_figure_to_output_dy(p,height), ierr); }
 void c_clip_dev_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, double height, int *ierr) { // in output coords
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_rect", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_rect", ierr); return; }
    double clip_left=x, clip_right, clip_top, clip_bottom=y, clip_width=width, clip_height=height;
    if (clip_width < 0.0) { clip_right = clip_left; clip_width = -clip_width; clip_left -= clip_width; }
    else clip_right = clip_left + clip_width;
@@ -651,73 +844,73 @@ void c_clip_dev_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, doub
 
 
 void c_clip_oval(OBJ_PTR fmkr, FM *p, double x, double y, double dx, double dy, double angle, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_oval", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_oval", ierr); return; }
    c_append_oval_to_path(fmkr, p, x, y, dx, dy, angle, ierr);
    c_clip(fmkr,p, ierr);
    }
 
 void c_fill_oval(OBJ_PTR fmkr, FM *p, double x, double y, double dx, double dy, double angle, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_oval", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_oval", ierr); return; }
    c_append_oval_to_path(fmkr, p, x, y, dx, dy, angle, ierr);
    c_fill(fmkr,p, ierr);
    }
 
 void c_stroke_oval(OBJ_PTR fmkr, FM *p, double x, double y, double dx, double dy, double angle, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_oval", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_oval", ierr); return; }
    c_append_oval_to_path(fmkr, p, x, y, dx, dy, angle, ierr);
    c_stroke(fmkr,p, ierr);
    }
 
 void c_fill_and_stroke_oval(OBJ_PTR fmkr, FM *p, double x, double y, double dx, double dy, double angle, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_oval", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_oval", ierr); return; }
    c_append_oval_to_path(fmkr, p, x, y, dx, dy, angle, ierr);
    c_fill_and_stroke(fmkr,p, ierr);
    }
 
 void c_clip_rounded_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, double height, double dx, double dy, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_rounded_rect", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_rounded_rect", ierr); return; }
    c_append_rounded_rect_to_path(fmkr, p, x, y, width, height, dx, dy, ierr);
    c_clip(fmkr,p, ierr);
    }
 
 void c_fill_rounded_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, double height, double dx, double dy, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_rounded_rect", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_rounded_rect", ierr); return; }
    c_append_rounded_rect_to_path(fmkr, p, x, y, width, height, dx, dy, ierr);
    c_fill(fmkr,p, ierr);
    }
 
 void c_stroke_rounded_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, double height, double dx, double dy, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_rounded_rect", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_rounded_rect", ierr); return; }
    c_append_rounded_rect_to_path(fmkr, p, x, y, width, height, dx, dy, ierr);
    c_stroke(fmkr,p, ierr);
    }
 
 void c_fill_and_stroke_rounded_rect(OBJ_PTR fmkr, FM *p, double x, double y, double width, double height, double dx, double dy, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_rounded_rect", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_rounded_rect", ierr); return; }
    c_append_rounded_rect_to_path(fmkr, p, x, y, width, height, dx, dy, ierr);
    c_fill_and_stroke(fmkr,p, ierr);
    }
 
 void c_clip_circle(OBJ_PTR fmkr, FM *p, double x, double y, double dx, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_circle", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_circle", ierr); return; }
    c_append_circle_to_path(fmkr, p, x, y, dx, ierr);
    c_clip(fmkr, p, ierr);
    }
 
 void c_fill_circle(OBJ_PTR fmkr, FM *p, double x, double y, double dx, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_circle", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_circle", ierr); return; }
    c_append_circle_to_path(fmkr, p, x, y, dx, ierr);
    c_fill(fmkr, p, ierr);
    }
 
 void c_stroke_circle(OBJ_PTR fmkr, FM *p, double x, double y, double dx, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_circle", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_circle", ierr); return; }
    c_append_circle_to_path(fmkr, p, x, y, dx, ierr);
    c_stroke(fmkr, p, ierr);
    }
 
 void c_fill_and_stroke_circle(OBJ_PTR fmkr, FM *p, double x, double y, double dx, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_circle", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_circle", ierr); return; }
    c_append_circle_to_path(fmkr, p, x, y, dx, ierr);
    c_fill_and_stroke(fmkr, p, ierr);
    }
@@ -742,25 +935,25 @@ void c_append_frame_to_path(OBJ_PTR fmkr, FM *p, int *ierr) {
 }
 
 void c_fill_frame(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_frame", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_frame", ierr); return; }
    c_append_frame(fmkr, p, false, ierr);
    c_fill(fmkr ,p, ierr);
    }
 
 void c_stroke_frame(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_frame", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling stroke_frame", ierr); return; }
    c_append_frame(fmkr, p, false, ierr);
    c_stroke(fmkr, p, ierr);
    }
 
 void c_fill_and_stroke_frame(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_frame", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling fill_and_stroke_frame", ierr); return; }
    c_append_frame(fmkr, p, false, ierr);
    c_fill_and_stroke(fmkr, p, ierr);
    }
 
 void c_clip_to_frame(OBJ_PTR fmkr, FM *p, int *ierr) {
-   if (constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_to_frame", ierr); return; }
+   if (p->pdf->constructing_path) { RAISE_ERROR("Sorry: must finish with current path before calling clip_to_frame", ierr); return; }
    c_append_frame(fmkr, p, true, ierr); 
    c_clip(fmkr, p, ierr);
    }
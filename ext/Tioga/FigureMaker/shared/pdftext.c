@@ -32,7 +32,6 @@ Init_Font_Dictionary(void)
       font_info = (Font_Dictionary *)calloc(1, sizeof(Font_Dictionary));
       font_info->afm = &afm_array[i];
       font_info->font_num = font_info->afm->font_num;
-      font_info->in_use = false;
       font_info->next = font_dictionaries;
       font_dictionaries = font_info;
    }
@@ -103,17 +102,32 @@ WriteFontDictsToFile(void)
 }
 
 
+Font_Usage *
+Get_Font_Usage(FM *p, Font_Dictionary *font_info)
+{
+   Font_Usage *fu;
+   for (fu = p->pdf->fonts_in_use; fu != NULL; fu = fu->next) {
+      if (fu->font == font_info) return fu;
+   }
+   return NULL;
+}
+
+
 static void
-Record_Font_In_Use(Font_Dictionary *font_info, int font_number)
+Record_Font_In_Use(FM *p, Font_Dictionary *font_info, int font_number)
 {
-   if (font_info->in_use) return;
+   Font_Usage *fu;
+   if (Get_Font_Usage(p, font_info) != NULL) return;
    font_info->afm->font_num = font_number;
-   font_info->obj_num = next_available_object_number++;
-   font_info->in_use = true;
+   fu = (Font_Usage *)calloc(1, sizeof(Font_Usage));
+   fu->font = font_info;
+   fu->obj_num = p->pdf->next_available_object_number++;
    if (font_number > num_pdf_standard_fonts) {
-      font_info->widths_obj_num = next_available_object_number++;
-      font_info->descriptor_obj_num = next_available_object_number++;
+      fu->widths_obj_num = p->pdf->next_available_object_number++;
+      fu->descriptor_obj_num = p->pdf->next_available_object_number++;
    }
+   fu->next = p->pdf->fonts_in_use;
+   p->pdf->fonts_in_use = fu;
 }
 
 
@@ -121,13 +135,13 @@ Record_Font_In_Use(Font_Dictionary *font_info, int font_number)
 #define MAXSTR 100
 
 static Font_Dictionary *
-GetFontDict(char *font_name, int font_number, int *ierr)
+GetFontDict(FM *p, char *font_name, int font_number, int *ierr)
 {
    Font_Dictionary *font_info;
    for (font_info = font_dictionaries; font_info != NULL;
         font_info = font_info->next) {
       if (strcmp(font_name, font_info->afm->font_name) == 0) {
-         Record_Font_In_Use(font_info, font_number);
+         Record_Font_In_Use(p, font_info, font_number);
          return font_info;
       }
    }
@@ -137,17 +151,17 @@ GetFontDict(char *font_name, int font_number, int *ierr)
 
 
 static Font_Dictionary *
-GetFontInfo(int font_number, int *ierr)
+GetFontInfo(FM *p, int font_number, int *ierr)
 {
    Font_Dictionary *f;
    for (f = font_dictionaries; f != NULL; f = f->next) {
       if (f->font_num == font_number) {
-         Record_Font_In_Use(f, font_number);
+         Record_Font_In_Use(p, f, font_number);
          return f;
       }
    }
    if (font_number > 0 && font_number <= num_predefined_fonts)
-      return GetFontDict(predefined_Fonts[font_number], font_number, ierr);
+      return GetFontDict(p, predefined_Fonts[font_number], font_number, ierr);
    return NULL;
 }
 
@@ -163,100 +177,106 @@ c_register_font(OBJ_PTR fmkr, FM *p, char *font_name, int *ierr)
    }
    for (i = 1; i <= num_predefined_fonts; i++) {
       if (strcmp(predefined_Fonts[i], font_name)==0) {
-         f = GetFontDict(font_name, i, ierr);
+         f = GetFontDict(p, font_name, i, ierr);
          if (f == NULL)
             RAISE_ERROR_s("Error in reading font metrics for %s", font_name,
                           ierr);
          return Integer_New(i);
       }
    }
-   f = GetFontDict(font_name, next_available_font_number, ierr);
+   f = GetFontDict(p, font_name, p->pdf->next_available_font_number, ierr);
    if (f == NULL) RAISE_ERROR_s("Error in reading font metrics for %s",
                                 font_name, ierr);
-   next_available_font_number++;
-   return Integer_New(next_available_font_number); 
+   p->pdf->next_available_font_number++;
+   return Integer_New(p->pdf->next_available_font_number); 
 }
 
 
 bool
-Used_Any_Fonts(void)
+Used_Any_Fonts(FM *p)
 {
-   Font_Dictionary *f;
-   for (f = font_dictionaries; f != NULL; f = f->next) {
-      if (f->in_use) return true;
-   }
-   return false;
+   return p->pdf->fonts_in_use != NULL;
 }
 
 
 void
-Clear_Fonts_In_Use_Flags(void)
+Free_Fonts_In_Use(PDF_Document *doc)
 {
-   Font_Dictionary *f;
-   for (f = font_dictionaries; f != NULL; f = f->next) {
-      f->in_use = false;
+   Font_Usage *fu;
+   while (doc->fonts_in_use != NULL) {
+      fu = doc->fonts_in_use;
+      doc->fonts_in_use = fu->next;
+      free(fu);
    }
 }
 
 
+/* The font objects are written in the order of font_dictionaries, which
+   does not depend on the order in which the figure uses the fonts. */
+
 void
-Write_Font_Descriptors(void)
+Write_Font_Descriptors(FM *p)
 {
    Font_Dictionary *f;
+   Font_Usage *fu;
    for (f = font_dictionaries; f != NULL; f = f->next) {
-      if (!f->in_use || f->font_num <= num_pdf_standard_fonts) continue;
-      Record_Object_Offset(f->descriptor_obj_num);
-      fprintf(OF, "%i 0 obj << /Type /FontDescriptor /FontName /%s\n",
-              f->descriptor_obj_num, f->afm->font_name);
-      fprintf(OF, "           /Flags %i /FontBBox [ %i %i %i %i ]\n",
+      if (f->font_num <= num_pdf_standard_fonts) continue;
+      if ((fu = Get_Font_Usage(p, f)) == NULL) continue;
+      Record_Object_Offset(p, fu->descriptor_obj_num);
+      fprintf(p->pdf->OF, "%i 0 obj << /Type /FontDescriptor /FontName /%s\n",
+              fu->descriptor_obj_num, f->afm->font_name);
+      fprintf(p->pdf->OF, "           /Flags %i /FontBBox [ %i %i %i %i ]\n",
               f->afm->flags, f->afm->fnt_llx, f->afm->fnt_lly, f->afm->fnt_urx,
               f->afm->fnt_ury);
-      fprintf(OF, "           /ItalicAngle %i /Ascent %i /Descent %i "
+      fprintf(p->pdf->OF, "           /ItalicAngle %i /Ascent %i /Descent %i "
               "/CapHeight %i /StemV %i\n", f->afm->italicAngle, f->afm->ascent,
               f->afm->descent, f->afm->capHeight, f->afm->stemV);
-      fprintf(OF, ">> endobj\n");
+      fprintf(p->pdf->OF, ">> endobj\n");
    }
 }
 
 
 void
-Write_Font_Widths(void)
+Write_Font_Widths(FM *p)
 {
    Font_Dictionary *f;
+   Font_Usage *fu;
    int i, cnt = 0;
    for (f = font_dictionaries; f != NULL; f = f->next) {
-      if (!f->in_use || f->font_num <= num_pdf_standard_fonts) continue;
-      Record_Object_Offset(f->widths_obj_num);
-      fprintf(OF, "%i 0 obj [\n    ", f->widths_obj_num);
+      if (f->font_num <= num_pdf_standard_fonts) continue;
+      if ((fu = Get_Font_Usage(p, f)) == NULL) continue;
+      Record_Object_Offset(p, fu->widths_obj_num);
+      fprintf(p->pdf->OF, "%i 0 obj [\n    ", fu->widths_obj_num);
       for (i = f->afm->firstChar; i <= f->afm->lastChar; i++) {
-         fprintf(OF, "%i ", f->afm->char_width[i]);
-         if (++cnt % 16 == 0) fprintf(OF, "\n    ");
+         fprintf(p->pdf->OF, "%i ", f->afm->char_width[i]);
+         if (++cnt % 16 == 0) fprintf(p->pdf->OF, "\n    ");
       }
-      fprintf(OF, "\n] endobj\n");
+      fprintf(p->pdf->OF, "\n] endobj\n");
    }
 }
 
 
 void
-Write_Font_Dictionaries(void)
+Write_Font_Dictionaries(FM *p)
 {
    if (0) WriteFontDictsToFile(); // creates pdf_font_dicts.c 
    Font_Dictionary *f;
+   Font_Usage *fu;
    for (f = font_dictionaries; f != NULL; f = f->next) {
-      if (!f->in_use) continue;
-      Record_Object_Offset(f->obj_num);
-      fprintf(OF, "%i 0 obj << /Type /Font /Subtype /Type1 /BaseFont /%s",
-              f->obj_num, f->afm->font_name);
+      if ((fu = Get_Font_Usage(p, f)) == NULL) continue;
+      Record_Object_Offset(p, fu->obj_num);
+      fprintf(p->pdf->OF, "%i 0 obj << /Type /Font /Subtype /Type1 /BaseFont /%s",
+              fu->obj_num, f->afm->font_name);
       if (strcmp(f->afm->font_name,"Symbol") != 0
           && strcmp(f->afm->font_name,"ZapfDingbats") != 0)
-         fprintf(OF, " /Encoding /MacRomanEncoding\n");
+         fprintf(p->pdf->OF, " /Encoding /MacRomanEncoding\n");
       else
-         fprintf(OF, "\n");
+         fprintf(p->pdf->OF, "\n");
       if (f->font_num > num_pdf_standard_fonts)
-         fprintf(OF, "           /FirstChar %i /LastChar %i /Widths %i 0 R "
+         fprintf(p->pdf->OF, "           /FirstChar %i /LastChar %i /Widths %i 0 R "
                  "/FontDescriptor %i 0 R\n", f->afm->firstChar,
-                 f->afm->lastChar, f->widths_obj_num, f->descriptor_obj_num);
-      fprintf(OF, ">> endobj\n");
+                 f->afm->lastChar, fu->widths_obj_num, fu->descriptor_obj_num);
+      fprintf(p->pdf->OF, ">> endobj\n");
    }
 }
 
@@ -266,7 +286,7 @@ GetStringInfo(FM *p, int font_number, unsigned char *text, double ft_ht,
               double *llx_ptr, double *lly_ptr, double *urx_ptr,
               double *ury_ptr, double *width_ptr, int *ierr)
 {
-   Font_Dictionary *fontinfo = GetFontInfo(font_number, ierr);
+   Font_Dictionary *fontinfo = GetFontInfo(p, font_number, ierr);
    if (*ierr != 0) return;
    if (fontinfo == NULL) {
       RAISE_ERROR_i("Sorry: invalid font number (%i): "
@@ -324,6 +344,127 @@ c_marker_string_info(OBJ_PTR fmkr, FM *p, int fnt, unsigned char *text,
 }
 
 
+/* Markers as Form XObjects.
+
+   When show_marker has a lot of points to mark (see
+   marker_xobject_threshold), the marker is written only once, as a Form
+   XObject holding the string with its font, scale and rotation, and each
+   point just moves the origin and invokes it.  Without a rotation or
+   scaling, the Td ... Tj sequence for each point is already about as short
+   as it gets, so the XObject is only used when the text matrix is needed.
+   The colors and line width are inherited from the page; the clipping
+   modes can't be used this way, as the clipping path would not survive
+   the XObject. */
+
+void
+Write_Marker(FM *p, Marker_Info *xo, int *ierr)
+{
+   char head[200];
+   int head_len = snprintf(head, sizeof(head),
+                           "BT /F%i %i Tf %i Tr %0.6f %0.6f %0.6f %0.6f "
+                           "%0.6f %0.6f Tm (", xo->font_num, xo->ft_height,
+                           xo->mode, xo->matrix[0], xo->matrix[1],
+                           xo->matrix[2], xo->matrix[3], xo->matrix[4],
+                           xo->matrix[5]);
+   fprintf(p->pdf->OF, "\n\t/Subtype /Form\n");
+   // leave some room around the glyphs for the strokes
+   fprintf(p->pdf->OF, "\t/BBox [ %0.2f %0.2f %0.2f %0.2f ]\n",
+           xo->bbox[0] - xo->ft_height, xo->bbox[1] - xo->ft_height,
+           xo->bbox[2] + xo->ft_height, xo->bbox[3] + xo->ft_height);
+   fprintf(p->pdf->OF, "\t/Resources << /Font << /F%i %i 0 R >> >>\n",
+           xo->font_num, xo->font_obj_num);
+   fprintf(p->pdf->OF, "\t/Length %li\n\t>>\nstream\n",
+           head_len + xo->text_len + 7);
+   if (fwrite(head, 1, head_len, p->pdf->OF) < (size_t)head_len ||
+       fwrite(xo->text, 1, xo->text_len, p->pdf->OF) < (size_t)xo->text_len) {
+      RAISE_ERROR("Error writing marker", ierr);
+      return;
+   }
+   fprintf(p->pdf->OF, ") Tj ET\nendstream\n");
+}
+
+
+void
+Free_Marker(Marker_Info *xo)
+{
+   if (xo->text != NULL) free(xo->text);
+}
+
+
+/* Finds the marker XObject for the given string and text matrix, or
+   makes a new one; the bbox corners are relative to the shifted origin */
+static Marker_Info *
+Get_Marker(FM *p, int font_number, int ft_height, int mode, double a,
+           double b, double c, double d, double shiftx, double shifty,
+           double llx, double lly, double urx, double ury, double llx2,
+           double lly2, double urx2, double ury2, char *text, long text_len,
+           int *ierr)
+{
+   double matrix[6] = { a, b, c, d, shiftx, shifty };
+   XObject_Info *old;
+   Marker_Info *mo;
+   for (old = p->pdf->xobj_list; old != NULL; old = old->next) {
+      if (old->xobj_subtype != MARKER_SUBTYPE) continue;
+      mo = (Marker_Info *)old;
+      if (mo->font_num == font_number && mo->ft_height == ft_height &&
+          mo->mode == mode && mo->text_len == text_len &&
+          memcmp(mo->matrix, matrix, sizeof(matrix)) == 0 &&
+          memcmp(mo->text, text, text_len) == 0)
+         return mo;
+   }
+   Font_Dictionary *font_info = GetFontInfo(p, font_number, ierr);
+   if (*ierr != 0) return NULL;
+   mo = (Marker_Info *)calloc(1, sizeof(Marker_Info));
+   mo->xobj_subtype = MARKER_SUBTYPE;
+   mo->font_num = font_number;
+   mo->font_obj_num = Get_Font_Usage(p, font_info)->obj_num;
+   mo->ft_height = ft_height;
+   mo->mode = mode;
+   memcpy(mo->matrix, matrix, sizeof(matrix));
+   mo->bbox[0] = MIN(MIN(llx, urx), MIN(llx2, urx2)) + shiftx;
+   mo->bbox[1] = MIN(MIN(lly, ury), MIN(lly2, ury2)) + shifty;
+   mo->bbox[2] = MAX(MAX(llx, urx), MAX(llx2, urx2)) + shiftx;
+   mo->bbox[3] = MAX(MAX(lly, ury), MAX(lly2, ury2)) + shifty;
+   mo->text = ALLOC_N_char(text_len);
+   memcpy(mo->text, text, text_len);
+   mo->text_len = text_len;
+   mo->xo_num = p->pdf->next_available_xo_number++;
+   mo->obj_num = p->pdf->next_available_object_number++;
+   mo->next = p->pdf->xobj_list;
+   p->pdf->xobj_list = (XObject_Info *)mo;
+   return mo;
+}
+
+
+/* Each point gets a translation relative to the previous one; the
+   offsets are rounded to what gets written, so that they don't drift */
+static void
+Stamp_Marker(FM *p, Marker_Info *mo, int n, double *xs, double *ys)
+{
+   double x, y, dx, dy, prev_x = 0, prev_y = 0;
+   char name[30];
+   int i;
+   snprintf(name, sizeof(name), "cm /XObj%i Do\n", mo->xo_num);
+   Stream_Puts(p, "q\n");
+   for (i = 0; i < n; i++) {
+      x = convert_figure_to_output_x(p, xs[i]);
+      y = convert_figure_to_output_y(p, ys[i]);
+      if(!is_okay_number(x) || !is_okay_number(y))
+         continue;
+      update_bbox(p, x + mo->bbox[0], y + mo->bbox[1]);
+      update_bbox(p, x + mo->bbox[2], y + mo->bbox[3]);
+      dx = round((x - prev_x) * 1e6) * 1e-6;
+      dy = round((y - prev_y) * 1e6) * 1e-6;
+      prev_x += dx; prev_y += dy;
+      Stream_Puts(p, "1 0 0 1 ");
+      Stream_Operand_Double(p, dx, 6);
+      Stream_Operand_Double(p, dy, 6);
+      Stream_Puts(p, name);
+   }
+   Stream_Puts(p, "Q\n");
+}
+
+
 #define TRANSFORM_VEC(dx,dy) tmp = dx; dx = (dx) * a + (dy) * c; dy = tmp * b + (dy) * d;
 
 
@@ -333,13 +474,13 @@ c_rotated_string_at_points(OBJ_PTR fmkr, FM *p, double rotation,
                            int n, double *xs, double *ys, int alignment,
                            int just, double horizontal_scaling,
                            double vertical_scaling, double italic_angle,
-                           double ascent_angle, int *ierr)
+                           double ascent_angle, int mode, int *ierr)
 {
    double ft_ht = (p->default_text_scale * scale * p->default_font_size
                    * ENLARGE);
    int i, ft_height = ROUND(ft_ht), justification = just - 1;
    ft_ht = ft_height;
-   if (constructing_path) {
+   if (p->pdf->constructing_path) {
       RAISE_ERROR("Sorry: must not be constructing a path when show marker",
                   ierr);
       return;
@@ -415,14 +556,38 @@ c_rotated_string_at_points(OBJ_PTR fmkr, FM *p, double rotation,
    TRANSFORM_VEC(llx2, ury2)
    TRANSFORM_VEC(urx2, lly2)
    TRANSFORM_VEC(shiftx, shifty)
-   fprintf(TF, "BT /F%i %i Tf\n", font_number, ft_height);
+   // the string is the same for every marker, so escape it only once
+   long text_len = strlen((char *)text), escaped_len = 0;
+   char *escaped = ALLOC_N_char(2 * text_len + 1);
+   unsigned char *cp, char_code;
+   for (cp = text; (char_code = *cp) != '\0'; cp++) {
+      if (char_code == '\\' || char_code == '(' || char_code == ')')
+         escaped[escaped_len++] = '\\';
+      escaped[escaped_len++] = char_code;
+   }
+   if (mode < FILL_AND_CLIP && p->marker_xobject_threshold >= 0 &&
+       n >= p->marker_xobject_threshold &&
+       !(b == 0 && c == 0 && a == 1 && d == 1)) {
+      Marker_Info *mo = Get_Marker(p, font_number, ft_height, mode,
+                                   a, b, c, d, shiftx, shifty,
+                                   llx, lly, urx, ury, llx2, lly2, urx2, ury2,
+                                   escaped, escaped_len, ierr);
+      free(escaped);
+      if (*ierr != 0) return;
+      Stamp_Marker(p, mo, n, xs, ys);
+      return;
+   }
+   Stream_Puts(p, "BT /F");
+   Stream_Operand_Long(p, font_number);
+   Stream_Operand_Long(p, ft_height);
+   Stream_Puts(p, "Tf\n");
    if (0 && horizontal_scaling != 1.0) {
-      fprintf(TF, "%d Tz\n", ROUND(100 * ABS(horizontal_scaling)));
+      Stream_Operand_Long(p, ROUND(100 * ABS(horizontal_scaling)));
+      Stream_Puts(p, "Tz\n");
    }
    double x, y, prev_x = 0, prev_y = 0, dx, dy;
    //int idx, idy;
    for (i = 0; i < n; i++) {
-      unsigned char *cp = text, char_code;
       x = convert_figure_to_output_x(p, xs[i]) + shiftx;
       y = convert_figure_to_output_y(p, ys[i]) + shifty;
       if(!is_okay_number(x) || !is_okay_number(y))
@@ -437,24 +602,19 @@ c_rotated_string_at_points(OBJ_PTR fmkr, FM *p, double rotation,
       //prev_x = prev_x + idx; prev_y = prev_y + idy;
       prev_x = prev_x + dx; prev_y = prev_y + dy;
       if (b == 0 && c == 0 && a == 1 && d == 1) {
-         //fprintf(TF, "%i %i Td (", idx, idy);
-         fprintf(TF, "%0.6f %0.6f Td (", dx, dy);
+         Stream_Operand_Double(p, dx, 6);
+         Stream_Operand_Double(p, dy, 6);
+         Stream_Puts(p, "Td (");
       } 
       else { // need high precision when doing rotations
-         fprintf(TF, "%0.6f %0.6f %0.6f %0.6f %0.6f %0.6f Tm (",
-                 a, b, c, d, x, y);
-      }
-      while ((char_code = *cp++) != '\0') {
-         if (char_code == '\\')
-            fprintf(TF, "\\\\");
-         else if (char_code == '(' || char_code == ')')
-            fprintf(TF, "\\%c", char_code);
-         else
-            fprintf(TF, "%c", char_code);
+         Stream_Matrix(p, a, b, c, d, x, y, 6);
+         Stream_Puts(p, "Tm (");
       }
-      fprintf(TF, ") Tj\n");
+      Stream_Write(p, escaped, escaped_len);
+      Stream_Puts(p, ") Tj\n");
    }
-   fprintf(TF, "ET\n");
+   Stream_Puts(p, "ET\n");
+   free(escaped);
 }
 
 
@@ -631,7 +791,8 @@ c_private_show_marker(OBJ_PTR fmkr, FM *p, OBJ_PTR args, int *ierr)
                   OBJ_PTR s = Array_Entry(marker, 2, ierr); if (*ierr != 0) return;
                   double width = Number_to_double(s,ierr); if (*ierr != 0) return;
                   if (*ierr != 0) return;
-                  fprintf(TF, "%0.6f w\n", width * ENLARGE);
+                  Stream_Operand_Double(p, width * ENLARGE, 6);
+                  Stream_Puts(p, "w\n");
                }
             }
          }
@@ -651,14 +812,16 @@ c_private_show_marker(OBJ_PTR fmkr, FM *p, OBJ_PTR args, int *ierr)
       if (stroke_width_obj != OBJ_NIL) {
          double width = get1_dbl(stroke_width_is_list, stroke_width_obj, i, ierr); if (*ierr != 0) return;
          if (*ierr != 0) return;
-         fprintf(TF, "%0.6f w\n", width * ENLARGE);
+         Stream_Operand_Double(p, width * ENLARGE, 6);
+         Stream_Puts(p, "w\n");
       }
       
       if (mode_obj != OBJ_NIL) {
          mode = get1_int(mode_is_list, mode_obj, i, ierr); if (*ierr != 0) return;
       }
       
-      fprintf(TF, "%d Tr\n", mode);
+      Stream_Operand_Long(p, mode);
+      Stream_Puts(p, "Tr\n");
       
       if (stroke_color != OBJ_NIL &&
           (mode == STROKE || mode == FILL_AND_STROKE
@@ -691,7 +854,7 @@ c_private_show_marker(OBJ_PTR fmkr, FM *p, OBJ_PTR args, int *ierr)
       }
 
       c_rotated_string_at_points(fmkr, p, angle, fnt_num, text, scale, num_per_call, xs+i, ys+i,
-                        alignment, justification, h_scale, v_scale, it_angle, ascent_angle, ierr);
+                        alignment, justification, h_scale, v_scale, it_angle, ascent_angle, mode, ierr);
                               
       if (prev_line_width != p->line_width) c_line_width_set(fmkr, p, prev_line_width, ierr);
       if (prev_fill_color_R != p->fill_color_R
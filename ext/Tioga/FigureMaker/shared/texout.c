@@ -20,11 +20,10 @@
 */
 
 #include "figures.h"
+#include "pdfs.h"
 
 #define RADIANS_TO_DEGREES (180.0 / PI)
 
-static FILE *fp; // for the TeX file
-
 /* TeX text */
 
 void c_rescale_text(OBJ_PTR fmkr, FM *p, double scaling_factor, int *ierr) {
@@ -83,27 +82,27 @@ static void tex_show_rotated_text(OBJ_PTR fmkr, FM *p, char *text,
    if (justification == 0) jst = 'c';
    else if (justification > 0) jst = 'r';
    else jst = 'l';
-   bbox_llx = MIN(bbox_llx, x - sz);
-   bbox_lly = MIN(bbox_lly, y - sz);
-   bbox_urx = MAX(bbox_urx, x + sz);
-   bbox_ury = MAX(bbox_ury, y + sz);
+   p->pdf->bbox_llx = MIN(p->pdf->bbox_llx, x - sz);
+   p->pdf->bbox_lly = MIN(p->pdf->bbox_lly, y - sz);
+   p->pdf->bbox_urx = MAX(p->pdf->bbox_urx, x + sz);
+   p->pdf->bbox_ury = MAX(p->pdf->bbox_ury, y + sz);
    if (angle != 0.0)
-      fprintf(fp,"\\put(%d,%d){\\rotatebox{%.1f}{\\scalebox{%.2f}{\\makebox(0,0)[%c%c]{",
+      fprintf(p->pdf->tex_file,"\\put(%d,%d){\\rotatebox{%.1f}{\\scalebox{%.2f}{\\makebox(0,0)[%c%c]{",
             ROUND(x), ROUND(y), angle, scale, jst, ref);
    else
-      fprintf(fp,"\\put(%d,%d){\\scalebox{%.2f}{\\makebox(0,0)[%c%c]{",
+      fprintf(p->pdf->tex_file,"\\put(%d,%d){\\scalebox{%.2f}{\\makebox(0,0)[%c%c]{",
             ROUND(x), ROUND(y), scale, jst, ref);
    if(measure_name != OBJ_NIL)
-     fprintf(fp, "{\\tiogameasure{%s}{\\tiogasetfont{}", 
+     fprintf(p->pdf->tex_file, "{\\tiogameasure{%s}{\\tiogasetfont{}", 
 	     CString_Ptr(measure_name,&dummy));
    else
-     fprintf(fp, "{{\\tiogasetfont{}");
+     fprintf(p->pdf->tex_file, "{{\\tiogasetfont{}");
 
    /* Moving the \BS out of the potential \tiogameasure input, so it does
       not disturb the measure.
    */
-   fprintf(fp, (alignment == ALIGNED_AT_BASELINE)? "%s}\\BS" : "%s}", text);
-   fprintf(fp, angle != 0? "}}}}}\n" : "}}}}\n");
+   fprintf(p->pdf->tex_file, (alignment == ALIGNED_AT_BASELINE)? "%s}\\BS" : "%s}", text);
+   fprintf(p->pdf->tex_file, angle != 0? "}}}}}\n" : "}}}}\n");
 
    /* Now, we save measures informations if applicable*/
    if(measures != OBJ_NIL) {
@@ -200,8 +199,6 @@ OBJ_PTR c_check_label_clip(OBJ_PTR fmkr, FM *p, double x, double y, int *ierr) {
 
 /* TeX File Management */
 
-static long cur_pos;
-
 static void Get_tex_name(char *ofile, char *filename, int maxlen)
 {
    char *dot;
@@ -216,11 +213,11 @@ void Open_tex(OBJ_PTR fmkr, char *filename, bool quiet_mode, int *ierr)
    char ofile[300];
    Get_tex_name(ofile, filename, 300);
    FM *p = Get_FM(fmkr,ierr);
-   fp = fopen(ofile, "w");
-   fprintf(fp,"\\setlength{\\unitlength}{%fbp}%%\n", 1.0/ENLARGE);
-   cur_pos = ftell(fp);
-   fprintf(fp,"\\begin{picture}(xxxxxx,xxxxxx)            %% (width,height)(xoffset,yoffset) -- Adjust the 2nd pair for registration adjustments\n"); /* this line is rewritten at the end */
-   fprintf(fp,"\\def\\BS{\\phantom{\\Huge\\scalebox{0}[2]{\\hbox{\\rotatebox{180}{O}O}}}}\n"); 
+   p->pdf->tex_file = fopen(ofile, "w");
+   fprintf(p->pdf->tex_file,"\\setlength{\\unitlength}{%fbp}%%\n", 1.0/ENLARGE);
+   p->pdf->tex_picture_offset = ftell(p->pdf->tex_file);
+   fprintf(p->pdf->tex_file,"\\begin{picture}(xxxxxx,xxxxxx)            %% (width,height)(xoffset,yoffset) -- Adjust the 2nd pair for registration adjustments\n"); /* this line is rewritten at the end */
+   fprintf(p->pdf->tex_file,"\\def\\BS{\\phantom{\\Huge\\scalebox{0}[2]{\\hbox{\\rotatebox{180}{O}O}}}}\n"); 
       // graphicx seems to vertically align baseline (B) like center (c), 
       // so we add BS (Big Strut) to make them look the same
 }
@@ -229,14 +226,15 @@ void Close_tex(OBJ_PTR fmkr, bool quiet_mode, int *ierr)
 {
    double x, y, xoff, yoff;
    FM *p = Get_FM(fmkr,ierr);
-   x = bbox_urx - bbox_llx; if (x < 0) x = bbox_urx = bbox_llx = 0;
-   y = bbox_ury - bbox_lly; if (y < 0) y = bbox_ury = bbox_lly = 0;
-   xoff = bbox_llx + Get_tex_xoffset(fmkr,ierr)*ENLARGE;
-   yoff = bbox_lly + Get_tex_yoffset(fmkr,ierr)*ENLARGE;
-   fprintf(fp,"\\end{picture}");
-   fseek(fp, cur_pos, SEEK_SET);
-   fprintf(fp,"\\begin{picture}(%03d,%03d)(%02d,%d)", ROUND(x), ROUND(y), ROUND(xoff), ROUND(yoff));
-   fclose(fp);
+   x = p->pdf->bbox_urx - p->pdf->bbox_llx; if (x < 0) x = p->pdf->bbox_urx = p->pdf->bbox_llx = 0;
+   y = p->pdf->bbox_ury - p->pdf->bbox_lly; if (y < 0) y = p->pdf->bbox_ury = p->pdf->bbox_lly = 0;
+   xoff = p->pdf->bbox_llx + Get_tex_xoffset(fmkr,ierr)*ENLARGE;
+   yoff = p->pdf->bbox_lly + Get_tex_yoffset(fmkr,ierr)*ENLARGE;
+   fprintf(p->pdf->tex_file,"\\end{picture}");
+   fseek(p->pdf->tex_file, p->pdf->tex_picture_offset, SEEK_SET);
+   fprintf(p->pdf->tex_file,"\\begin{picture}(%03d,%03d)(%02d,%d)", ROUND(x), ROUND(y), ROUND(xoff), ROUND(yoff));
+   fclose(p->pdf->tex_file);
+   p->pdf->tex_file = NULL;
 }   
 
 
@@ -300,18 +298,19 @@ static void Write_figure_command(OBJ_PTR fmkr, char *simple_name, FILE *file, in
 }
 
    
-void Create_wrapper(OBJ_PTR fmkr, char *fname, bool quiet_mode, int *ierr)
-{  // create the wrapper TeX file to combine the text and graphics to make a figure
+/* The names of the wrapper TeX file for fname, of fname without its
+   extension and of fname without its extension and its directory. */
+static void Get_wrapper_names(char *fname, char *tex_fname, char *base_name,
+                              char *simple_name)
+{
    char *dot;
-   char tex_fname[100], base_name[100], simple_name[100];
-   FILE *file;
    if ((dot=strrchr(fname,'.')) != NULL) {
       strncpy(base_name, fname, dot-fname); base_name[dot-fname] = '\0';
-      snprintf(tex_fname, sizeof(tex_fname), "%s.tex", base_name);
+      snprintf(tex_fname, 100, "%s.tex", base_name);
       }
    else {
       strcpy(base_name, fname);
-      snprintf(tex_fname, sizeof(tex_fname), "%s.tex", fname);
+      snprintf(tex_fname, 100, "%s.tex", fname);
       }
    if ((dot=strrchr(base_name,'/')) != NULL) {
       strcpy(simple_name, dot+1);
@@ -319,6 +318,13 @@ void Create_wrapper(OBJ_PTR fmkr, char *fname, bool quiet_mode, int *ierr)
    else {
       strcpy(simple_name, base_name);
       }
+}
+
+void Create_wrapper(OBJ_PTR fmkr, char *fname, bool quiet_mode, int *ierr)
+{  // create the wrapper TeX file to combine the text and graphics to make a figure
+   char tex_fname[100], base_name[100], simple_name[100];
+   FILE *file;
+   Get_wrapper_names(fname, tex_fname, base_name, simple_name);
    file = fopen(tex_fname, "w");
    fprintf(file, "%% Tioga preview LaTeX file for %s_figure.pdf and %s_figure.txt\n\n", base_name, base_name);
 
@@ -334,6 +340,40 @@ void Create_wrapper(OBJ_PTR fmkr, char *fname, bool quiet_mode, int *ierr)
    fclose(file);
 }
 
+void Create_document_wrapper(OBJ_PTR fmkr, char *fname, OBJ_PTR fignames,
+                             int *ierr)
+{  // the wrapper for a multi-page document: one page per figure, with
+   // the graphics from the pages of a single PDF file
+   char tex_fname[100], base_name[100], simple_name[100];
+   FILE *file;
+   int i, len;
+   Get_wrapper_names(fname, tex_fname, base_name, simple_name);
+   len = Array_Len(fignames, ierr);
+   if (*ierr != 0) return;
+   file = fopen(tex_fname, "w");
+   if (file == NULL) {
+      RAISE_ERROR_s("Sorry: can't open %s.\n", tex_fname, ierr); return; }
+   fprintf(file, "%% Tioga LaTeX file for the pages of %s_figure.pdf\n\n",
+           base_name);
+
+   Write_preview_header(fmkr, file, ierr);
+
+   fprintf(file, "\n%% Here are the pages with the figures.\n");
+   fprintf(file, "\\begin{document}\n");
+   fprintf(file, "\\pagestyle{%s}\n", Get_tex_preview_pagestyle(fmkr,ierr));
+   for (i = 0; i < len; i++) {
+      char *figname = Get_String(fignames, i, ierr);
+      if (*ierr != 0) { fclose(file); return; }
+      if (i > 0) fprintf(file, "\\clearpage\n");
+      fprintf(file, "\\tiogasetfigurepage{%s}{%i}\n", simple_name, i + 1);
+      /* necessary to get the position right */
+      fprintf(file, "\\noindent");
+      Write_figure_command(fmkr, figname, file, ierr);
+   }
+   fprintf(file, "\\end{document}\n");
+   fclose(file);
+}
+
 void Init_tex(int *ierr)
 {
 }
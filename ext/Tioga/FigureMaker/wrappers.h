@@ -56,6 +56,8 @@ extern OBJ_PTR FM_set_device_pagesize(OBJ_PTR fmkr, OBJ_PTR width, OBJ_PTR heigh
 extern OBJ_PTR FM_get_save_filename(OBJ_PTR fmkr, OBJ_PTR name);
 extern OBJ_PTR FM_private_make(OBJ_PTR fmkr, OBJ_PTR name, OBJ_PTR cmd);
 extern OBJ_PTR FM_private_make_portfolio(OBJ_PTR fmkr, OBJ_PTR name, OBJ_PTR fignums, OBJ_PTR fignames);
+extern OBJ_PTR FM_private_begin_pdf_document(OBJ_PTR fmkr, OBJ_PTR name);
+extern OBJ_PTR FM_private_end_pdf_document(OBJ_PTR fmkr, OBJ_PTR name, OBJ_PTR fignames);
 
 /*======================================================================*/
 // makers.c
@@ -213,6 +215,7 @@ extern OBJ_PTR FM_append_oval_to_path(OBJ_PTR fmkr, OBJ_PTR x, OBJ_PTR y, OBJ_PT
 extern OBJ_PTR FM_append_circle_to_path(OBJ_PTR fmkr, OBJ_PTR x, OBJ_PTR y, OBJ_PTR dx);
 extern OBJ_PTR FM_append_points_to_path(OBJ_PTR fmkr, OBJ_PTR x_vec, OBJ_PTR y_vec);
 extern OBJ_PTR FM_private_append_points_with_gaps_to_path(OBJ_PTR fmkr, OBJ_PTR x_vec, OBJ_PTR y_vec, OBJ_PTR gaps, OBJ_PTR close_gaps);
+extern OBJ_PTR FM_private_append_decimated_points_to_path(OBJ_PTR fmkr, OBJ_PTR x_vec, OBJ_PTR y_vec, OBJ_PTR gaps, OBJ_PTR close_gaps);
 extern OBJ_PTR FM_stroke(OBJ_PTR fmkr);  // S
 extern OBJ_PTR FM_close_and_stroke(OBJ_PTR fmkr);  // s
 extern OBJ_PTR FM_fill(OBJ_PTR fmkr); // f
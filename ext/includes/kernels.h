@@ -0,0 +1,103 @@
+/**********************************************************************
+
+   kernels.h:
+   specialized loops for the simple element-wise operations of Dvector
+   and Dtable.
+
+   The generic loops of Dvector and Dtable call a double (*op)(double)
+   for each element, which the compiler can't vectorize. The operations
+   for which it matters the most (arithmetic, sqrt, floor/ceil and the
+   clamps of trim and the safe_* functions) get their own loops here,
+   which it vectorizes. With GCC on x86_64, each loop is compiled for
+   AVX-512, AVX2 and plain SSE2, and the best one for the processor is
+   picked when the library is loaded (using CPUID). Contraction of
+   a*b+c into fused multiply-adds is turned off, so that all the
+   variants give exactly the same results as the generic loops, which
+   remain the reference. The sqrt loops are only vectorized with
+   -fno-math-errno (see extconf.rb).
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Library Public License as published
+   by the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Library General Public License for more details.
+
+   You should have received a copy of the GNU Library General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+
+**********************************************************************/
+
+#ifndef __kernels_H__
+#define __kernels_H__
+
+#include <math.h>
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 6 \
+  && defined(__x86_64__) && defined(__linux__)
+#define KERNEL_ATTRIBUTES \
+  __attribute__((unused, target_clones("avx512f", "avx2", "default"), \
+                 optimize("fp-contract=off", "no-trapping-math")))
+#else
+#define KERNEL_ATTRIBUTES __attribute__((unused))
+#endif
+
+/* p[i] = f(p[i]) */
+#define UNARY_KERNEL(name, expr)                                \
+  KERNEL_ATTRIBUTES static void name(double *p, long len) {     \
+    long i;                                                     \
+    for(i = 0; i < len; i++) {                                  \
+      double x = p[i];                                          \
+      p[i] = (expr);                                            \
+    }                                                           \
+  }
+
+/* p[i] = f(p[i], y) */
+#define SCALAR_KERNEL(name, expr)                                       \
+  KERNEL_ATTRIBUTES static void name(double *p, long len, double y) {   \
+    long i;                                                             \
+    for(i = 0; i < len; i++) {                                          \
+      double x = p[i];                                                  \
+      p[i] = (expr);                                                    \
+    }                                                                   \
+  }
+
+/* p[i] = f(p[i], q[i]) */
+#define VECTOR_KERNEL(name, expr)                                       \
+  KERNEL_ATTRIBUTES static void name(double *p, const double *q,        \
+                                     long len) {                        \
+    long i;                                                             \
+    for(i = 0; i < len; i++) {                                          \
+      double x = p[i], y = q[i];                                        \
+      p[i] = (expr);                                                    \
+    }                                                                   \
+  }
+
+UNARY_KERNEL(kernel_neg, -x)
+UNARY_KERNEL(kernel_abs, fabs(x))
+UNARY_KERNEL(kernel_inv, 1.0/x)
+UNARY_KERNEL(kernel_sqrt, sqrt(x))
+UNARY_KERNEL(kernel_safe_sqrt, sqrt(x > 0.0 ? x : 0.0))
+UNARY_KERNEL(kernel_floor, floor(x))
+UNARY_KERNEL(kernel_ceil, ceil(x))
+
+SCALAR_KERNEL(kernel_add_scalar, x + y)
+SCALAR_KERNEL(kernel_sub_scalar, x - y)
+SCALAR_KERNEL(kernel_mul_scalar, x * y)
+SCALAR_KERNEL(kernel_div_scalar, x / y)
+SCALAR_KERNEL(kernel_mod_scalar, x - y * floor(x/y))
+SCALAR_KERNEL(kernel_trim, (fabs(x) < y) ? 0.0 : x)
+SCALAR_KERNEL(kernel_safe_inv,
+              (fabs(x) >= y) ? 1.0/x : (x > 0.0) ? 1.0/y : -1.0/y)
+
+VECTOR_KERNEL(kernel_add, x + y)
+VECTOR_KERNEL(kernel_sub, x - y)
+VECTOR_KERNEL(kernel_mul, x * y)
+VECTOR_KERNEL(kernel_div, x / y)
+VECTOR_KERNEL(kernel_mod, x - y * floor(x/y))
+
+#endif
@@ -101,4 +101,61 @@ static inline double get_double(const unsigned char * p)
 
 #endif /* HAVE_IEEE754_H */
 
+/* Copies of whole arrays of doubles to and from the same little-endian
+   form, which is just a memcpy on most machines. */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ \
+  && defined(__FLOAT_WORD_ORDER__) \
+  && __FLOAT_WORD_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <string.h>
+#define DOUBLES_ARE_LITTLE_ENDIAN
+#endif
+
+static inline void store_doubles(const double * a, long nb, 
+				 unsigned char * p)
+{
+#ifdef DOUBLES_ARE_LITTLE_ENDIAN
+  memcpy(p, a, nb * 8);
+#else
+  while(nb-- > 0)
+    {
+      store_double(*(a++), p);
+      p += 8;
+    }
+#endif
+}
+
+static inline void get_doubles(double * a, long nb, 
+			       const unsigned char * p)
+{
+#ifdef DOUBLES_ARE_LITTLE_ENDIAN
+  memcpy(a, p, nb * 8);
+#else
+  while(nb-- > 0)
+    {
+      *(a++) = get_double(p);
+      p += 8;
+    }
+#endif
+}
+
+/* Lengths as 8 bytes, lower bytes first, whatever the size of long */
+static inline void store_length(unsigned long long a, unsigned char * p)
+{
+  int i;
+  for(i = 0; i < 8; i++)
+    STORE_LOWER_BYTE(a, p);
+}
+
+static inline unsigned long long get_length(const unsigned char * p)
+{
+  unsigned long long a = 0;
+  int i;
+  for(i = 0; i < 8; i++)
+    a |= ((unsigned long long) *(p++)) << (i * 8);
+  return a;
+}
+
+/* The tag of the dumps whose doubles are stored by store_doubles */
+#define DOUBLES_LITTLE_ENDIAN_TAG 'l'
+
 #endif /* _DOUBLE_H */
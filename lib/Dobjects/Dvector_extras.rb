@@ -58,6 +58,17 @@ module Dobjects
       return @block.call(*args)
     end
 
+    # The absolute value of _x_, as Dvector#abs.
+    def fabs(x)
+      x.abs
+    end
+
+    # <tt>x - y * floor(x/y)</tt>, as Dvector#modulo, which isn't quite
+    # Float#% when _x_/_y_ is large.
+    def floor_mod(x, y)
+      x - y * (x/y).floor
+    end
+
   end
 
   class Dvector
@@ -91,6 +102,7 @@ module Dobjects
       'remove_space' => true ,# removes spaces at the beginning of the lines
       'last_col' => -1,       # Read all columns
       'text_columns' => [],   # Not a single column is text
+      'parallel' => false,    # Files are read by one thread
     }
 
     # This function is a wrapper for #fast_fancy_read that reflects the
@@ -121,6 +133,77 @@ module Dobjects
       end
     end
 
+    # Reads _stream_ (an IO object or a file name) like #fancy_read,
+    # but by chunks of at most 'rows' lines (100000 by default), and
+    # yields the columns of each chunk, so that files much larger than
+    # the memory can be processed:
+    #
+    #   sum = 0.0
+    #   Dvector.each_chunk("data.dat", 'rows' => 10000) do |x, y|
+    #     sum += y.sum
+    #   end
+    #
+    # The options are those of #fancy_read (symbols can be used as
+    # keys). The same Array and the same Dvectors are yielded for all
+    # the chunks; use +dup+ to keep them from one chunk to the next.
+    # With the formats handled by the C tokenizer (see
+    # #fast_fancy_read), the memory used doesn't depend on the size of
+    # the file and no new object is created for each chunk.
+    def Dvector.each_chunk(stream, opts = {}, &block)
+      o = FANCY_READ_DEFAULTS.merge('rows' => 100000)
+      opts.each { |k, v| o[k.to_s] = v }
+      if stream.is_a?(String)
+        return File.open(stream) { |f| Dvector.each_chunk(f, o, &block) }
+      end
+      raise ArgumentError.new("'stream' should have a gets method") unless
+        stream.respond_to? :gets
+      o['sep'] = Regexp.new(o['sep']) unless o['sep'].is_a? Regexp
+      rows = o['rows']
+
+      if o['index_col']
+        ramp = Dvector.new(rows) { |i| i }
+        index = Dvector.new
+        offset = 0
+        inner = block
+        block = proc do |cols|
+          index.replace(ramp).resize(cols[0].size).add!(offset)
+          offset += cols[0].size
+          cols.unshift(index)
+          inner.call(cols)
+        end
+      end
+
+      return nil if Dvector.fast_each_chunk(stream, rows, o, &block)
+
+      # The general case: the lines are read by groups of rows, which
+      # are parsed by #fast_fancy_read
+      require 'stringio'
+      o['skip_first'].times { stream.gets }
+      o['skip_first'] = 0
+      o['initial_size'] = rows + 1
+      columns = []
+      # the Array yielded, which the block (or index_col) may modify
+      yielded = []
+      chunk = []
+      while true
+        chunk.clear
+        while chunk.size < rows and line = stream.gets
+          chunk << line
+        end
+        break if chunk.empty?
+        cols = Dvector.fast_fancy_read(StringIO.new(chunk.join), o)
+        next if cols.empty?
+        size = cols[0].size
+        columns.size.times do |i|
+          cols[i] ||= Dvector.new(size, o['default'])
+          columns[i].replace(cols[i])
+        end
+        columns.concat(cols[columns.size..-1])
+        block.call(yielded.replace(columns))
+      end
+      return nil
+    end
+
     # This function reads in +stream+ (can an IO object or a String,
     # in which case it represents the name of a file to be opened)
     # the columns specified by +cols+ and returns them. column 0 is the
@@ -217,8 +300,11 @@ module Dobjects
     # column[n]:: represents the current element of the n th
     #             Dvector of the array
     #
-    # This is just a try, and should be implemented in C rather than in
-    # Ruby. But if you're looking for simplicity, here you go ;-) !
+    # Formulas using only numbers, the arithmetic operators, the
+    # functions of Math and the constants PI and E are compiled and
+    # evaluated in C by #fast_compute_formula, which is a lot faster
+    # for large Dvectors. Other formulas are evaluated by Ruby for
+    # each element.
     #
     # _modules_ are the modules you would wish the evaluator to +include+. 
     # This feature enables one to make sure custom functions are included
@@ -252,6 +338,12 @@ module Dobjects
         end
       }
       
+      # the modules could redefine the functions of Math
+      if modules.empty?
+        res = Dvector.fast_compute_formula(formula, target)
+        return res if res
+      end
+
       res = Dvector.new
       
       last.each_index { |i|
@@ -279,19 +371,393 @@ module Dobjects
       'write_mode' => "a",
     }
 
-    # Writes an array of Dvectors into a text _file_ 
+    # Writes an array of Dvectors into a text _file_, one column per
+    # Dvector. When _file_ is a file name, the file is opened with the
+    # 'write_mode' option (appending by default). Columns of Dvectors
+    # are written by Dvector.fast_write.
     def Dvector.write(file, cols, options = {})
-      ops = WRITE_DEFAULTS.update(options)
+      ops = WRITE_DEFAULTS.merge(options)
       if file.is_a?(String)
-        file = File.open(file, ops["write_mode"])
+        File.open(file, ops["write_mode"]) do |f|
+          Dvector.write(f, cols, options)
+        end
+        return
       end 
+      if cols.all? { |d| d.is_a?(Dvector) }
+        Dvector.fast_write(file, cols, ops["sep"].to_s)
+        return
+      end
       nb = cols.map {|d| d.size}.max # The number of lines
       nb.times do |i|
         file.puts(cols.map {|d| d[i].to_s }.join(ops["sep"]))
       end
     end
+
+    # The first bytes of the files of Dvector.write_binary
+    BINARY_MAGIC = "DOBJECTS"
+
+    # The version of the format of Dvector.write_binary
+    BINARY_VERSION = 1
+
+    # Dvector.write_binary writes _columns_, a Hash of names (strings)
+    # and Dvectors or Dtables, into _file_ in a binary form that can be
+    # read back, in full or in part, by Dvector.read_binary. _columns_
+    # can also be an Array of Dvectors, which are then named "0", "1"...
+    #
+    # If the _compress_ option is true, all the columns are
+    # compressed with Flate; it can also be an array holding the names
+    # of the ones to compress. Columns larger than 2GB are never
+    # compressed.
+    #
+    #  Dvector.write_binary("run.dob", {"t" => t, "x" => x, "map" => table},
+    #                       :compress => ["map"])
+    #
+    # The file starts with a header, in which all numbers are
+    # little-endian:
+    # 
+    # * the 8 bytes "DOBJECTS";
+    # * the version of the format (1) and the number of columns, as
+    #   32-bit integers;
+    # * the size of the whole header, as a 64-bit integer;
+    # * for each column:
+    #   * the length of its name, as a 16-bit integer, followed by the
+    #     name itself (in UTF-8);
+    #   * three bytes: the kind of column (0 for a Dvector, 1 for a
+    #     Dtable), the type of the data (0, for 8-byte doubles) and the
+    #     compression (0 for none, 1 for Flate), then a zero byte;
+    #   * the number of rows (the length of a Dvector), the number of
+    #     columns (1 for a Dvector), the position of the data from the
+    #     start of the file and the number of bytes it takes, as 64-bit
+    #     integers.
+    #
+    # The data of each column follows, starting at a multiple of 64
+    # bytes: little-endian doubles, row after row for a Dtable, possibly
+    # compressed. Uncompressed Dvectors can therefore also be read with
+    # Dvector.mmap at the given position.
+    def Dvector.write_binary(file, columns, options = {})
+      if columns.is_a?(Array)
+        hash = {}
+        columns.each_with_index { |c, i| hash[i.to_s] = c }
+        columns = hash
+      end
+      compress = options[:compress] || options['compress']
+      compress = compress.map { |n| n.to_s } if compress.is_a?(Array)
+
+      entries = []
+      columns.each do |name, col|
+        name = name.to_s
+        if defined?(Dtable) && col.is_a?(Dtable)
+          kind, rows, cols = 1, col.num_rows, col.num_cols
+        else
+          col = col.to_dvector
+          kind, rows, cols = 0, col.size, 1
+        end
+        data = col.to_binary
+        method = 0
+        if (compress == true || 
+            (compress.is_a?(Array) && compress.include?(name))) && 
+            data.size < 2**31
+          require 'Flate'
+          data = Flate.compress(data)
+          method = 1
+        end
+        entries << [name, kind, method, rows, cols, data]
+      end
+
+      header_size = 24 + entries.inject(0) do |sum, e|
+        sum + 2 + e[0].bytesize + 4 + 32
+      end
+      header = [BINARY_MAGIC, BINARY_VERSION, entries.size, 
+                header_size].pack("a8VVQ<")
+      pos = header_size
+      offsets = entries.map do |e|
+        pos += (-pos) % 64
+        offset = pos
+        pos += e[5].bytesize
+        offset
+      end
+      entries.each_with_index do |e, i|
+        name = e[0].dup.force_encoding("BINARY")
+        header << [name.bytesize].pack("v") << name
+        header << [e[1], 0, e[2], 0, e[3], e[4], 
+                   offsets[i], e[5].bytesize].pack("C4Q<4")
+      end
+
+      io = file.is_a?(String) ? File.open(file, "wb") : file
+      begin
+        io.write(header)
+        pos = header_size
+        entries.each_with_index do |e, i|
+          io.write("\0" * (offsets[i] - pos))
+          io.write(e[5])
+          pos = offsets[i] + e[5].bytesize
+        end
+      ensure
+        io.close if file.is_a?(String)
+      end
+    end
+
+    # Returns the description of the columns of a _file_ written by
+    # Dvector.write_binary, as an Array of Hashes with the keys
+    # 'name', 'kind' (:dvector or :dtable), 'rows', 'cols', 'offset',
+    # 'size' and 'compressed'.
+    def Dvector.read_binary_header(file)
+      if file.is_a?(String)
+        return File.open(file, "rb") { |f| Dvector.read_binary_header(f) }
+      end
+      magic, version, nb, size = (file.read(24) || "").unpack("a8VVQ<")
+      if magic != BINARY_MAGIC
+        raise ArgumentError, "#{file.inspect} was not written by " +
+          "Dvector.write_binary"
+      end
+      if version != BINARY_VERSION
+        raise ArgumentError, "unsupported version #{version} of the " +
+          "binary format"
+      end
+      header = file.read(size - 24)
+      pos = 0
+      entries = []
+      nb.times do
+        len = header[pos, 2].unpack("v").first
+        name = header[pos + 2, len].force_encoding("UTF-8")
+        pos += 2 + len
+        kind, type, method, pad, rows, cols, offset, bytes = 
+          header[pos, 36].unpack("C4Q<4")
+        pos += 36
+        if type != 0
+          raise ArgumentError, "unsupported data type #{type} for #{name}"
+        end
+        entries << {
+          'name' => name, 'kind' => (kind == 1 ? :dtable : :dvector),
+          'rows' => rows, 'cols' => cols, 'offset' => offset, 
+          'size' => bytes, 'compressed' => (method == 1)
+        }
+      end
+      return entries
+    end
+
+    # Reads the columns of a _file_ written by Dvector.write_binary,
+    # and returns them as a Hash of names and Dvectors or Dtables, in
+    # the order of the file. With the _cols_ option, only the columns
+    # given by their names or their indices are read, in that order;
+    # the others are skipped altogether. Each column is read with a
+    # single read.
+    #
+    # With the _mmap_ option, the uncompressed Dvectors are not read, but
+    # mapped with Dvector.mmap.
+    #
+    #  cols = Dvector.read_binary("run.dob", :cols => ["t", "x"])
+    #  t, x = cols["t"], cols["x"]
+    def Dvector.read_binary(file, options = {})
+      wanted = options[:cols] || options['cols']
+      mmap = options[:mmap] || options['mmap']
+      File.open(file, "rb") do |f|
+        entries = Dvector.read_binary_header(f)
+        if wanted
+          wanted = [wanted] unless wanted.is_a?(Array)
+          entries = wanted.map do |c|
+            e = c.is_a?(Integer) ? entries[c] : 
+              entries.find { |e| e['name'] == c.to_s }
+            raise ArgumentError, "no column #{c.inspect} in #{file}" unless e
+            e
+          end
+        end
+        ret = {}
+        for e in entries
+          raw = e['rows'] * e['cols'] * 8
+          if mmap && e['kind'] == :dvector && ! e['compressed']
+            ret[e['name']] = Dvector.mmap(file, :offset => e['offset'], 
+                                          :length => e['rows'])
+            next
+          end
+          f.seek(e['offset'])
+          data = f.read(e['size']) || ""
+          if e['compressed']
+            require 'Flate'
+            data = Flate.expand(data, raw)
+          end
+          if data.bytesize != raw
+            raise ArgumentError, "#{file} is truncated"
+          end
+          ret[e['name']] = if e['kind'] == :dtable
+                             require 'Dobjects/Dtable'
+                             Dtable.from_binary(data, e['cols'], e['rows'])
+                           else
+                             Dvector.from_binary(data)
+                           end
+        end
+        return ret
+      end
+    end
+
+    # Returns a LazyDvector standing for this Dvector: arithmetic on it
+    # is only recorded, and done in a single pass, without temporary
+    # Dvectors, when the result is needed.
+    #
+    #  log_xhe0 = (xhe.lazy - xhe1 - xhe2).log10.to_dvector
+    def lazy
+      LazyDvector.new("column[0]", [self])
+    end
     
   end
+
+  # A LazyDvector is an expression on Dvectors that is not computed
+  # yet, as returned by Dvector#lazy. The arithmetic operators and the
+  # usual math functions of Dvector applied to it just make a bigger
+  # expression, in the form of a formula for Dvector.compute_formula.
+  # The whole expression is then computed in a single pass over the
+  # Dvectors, without temporary Dvectors for the intermediate results,
+  # by #to_dvector, or when it is used as a Dvector.
+  #
+  # The expression is computed again each time it is used, with the
+  # current contents of the Dvectors.
+  class LazyDvector
+
+    # The formula, with column[n] standing for the n-th element of
+    # #vectors
+    attr_reader :formula
+
+    # The Dvectors the formula uses
+    attr_reader :vectors
+
+    def initialize(formula, vectors)
+      @formula = formula
+      @vectors = vectors
+    end
+
+    # The operators and their aliases
+    BINARY_OPERATORS = {
+      '+' => [:+, :add], '-' => [:-, :sub], '*' => [:*, :mul],
+      '/' => [:/, :div], '**' => [:**, :pow]
+    }
+
+    BINARY_OPERATORS.each do |op, names|
+      for name in names
+        define_method(name) do |other|
+          combine(other) { |a, b| "(#{a} #{op} #{b})" }
+        end
+      end
+    end
+
+    MATH_FUNCTIONS = %w(sin cos tan asin acos atan sinh cosh tanh
+                        asinh acosh atanh exp log log10 sqrt)
+
+    for func in MATH_FUNCTIONS
+      class_eval "def #{func}; unary { |a| \"#{func}(\#{a})\" }; end"
+    end
+
+    # Computed as Dvector#modulo, not as Float#%
+    def %(other)
+      combine(other) { |a, b| "floor_mod(#{a}, #{b})" }
+    end
+    alias :modulo :%
+    alias :mod :%
+
+    def atan2(other)
+      combine(other) { |a, b| "atan2(#{a}, #{b})" }
+    end
+
+    def as_exponent_of(other)
+      combine(other) { |a, b| "(#{b} ** #{a})" }
+    end
+
+    def -@
+      unary { |a| "(-#{a})" }
+    end
+    alias :neg :-@
+
+    def +@
+      self
+    end
+
+    def abs
+      unary { |a| "fabs(#{a})" }
+    end
+
+    def exp10
+      unary { |a| "(10.0 ** #{a})" }
+    end
+
+    def inv
+      unary { |a| "(1.0 / #{a})" }
+    end
+
+    # Computes the expression, and returns the result as a new Dvector.
+    def to_dvector
+      Dvector.compute_formula(@formula, @vectors)
+    end
+    alias :force :to_dvector
+
+    def to_a
+      to_dvector.to_a
+    end
+
+    # So that numbers can come first, as in 2 * x.lazy
+    def coerce(number)
+      return [LazyDvector.new(LazyDvector.literal(number), @vectors), self]
+    end
+
+    # Anything else is done on the computed Dvector
+    def method_missing(name, *args, &block)
+      if Dvector.method_defined?(name)
+        return to_dvector.send(name, *args, &block)
+      end
+      super
+    end
+
+    def respond_to_missing?(name, include_private = false)
+      Dvector.method_defined?(name) || super
+    end
+
+    # A number as it should be written in a formula
+    def LazyDvector.literal(x)
+      x = x.to_f
+      if x.nan?
+        return "(0.0 / 0.0)"
+      elsif x.infinite?
+        return x > 0 ? "(1.0 / 0.0)" : "(-1.0 / 0.0)"
+      end
+      return "(#{x})"
+    end
+
+    protected
+
+    def unary
+      LazyDvector.new(yield(@formula), @vectors)
+    end
+
+    # Yields the formulas of self and _other_ and makes a new
+    # LazyDvector from the formula returned by the block.
+    def combine(other)
+      vectors = @vectors.dup
+      case other
+      when LazyDvector
+        # renumber the columns of the other formula
+        other_formula = other.formula.gsub(/column\[(\d+)\]/) do
+          v = other.vectors[$1.to_i]
+          idx = vectors.index { |w| w.equal?(v) }
+          unless idx
+            vectors << v
+            idx = vectors.size - 1
+          end
+          "column[#{idx}]"
+        end
+      when Dvector
+        idx = vectors.index { |w| w.equal?(other) }
+        unless idx
+          vectors << other
+          idx = vectors.size - 1
+        end
+        other_formula = "column[#{idx}]"
+      when Numeric
+        other_formula = LazyDvector.literal(other)
+      else
+        return combine(Dvector.new.replace(other.to_dvector))
+      end
+      return LazyDvector.new(yield(@formula, other_formula), vectors)
+    end
+
+  end
 end
 
 # Modified by Vincent Fourmond to have a nice Dvector module
@@ -72,6 +72,17 @@ class Creating_Paths < Doc < FigureMaker
    def append_points_with_gaps_to_path(x_vec, y_vec, gaps, close_subpaths)
    end
 
+# Like append_points_with_gaps_to_path, but for very long series of
+# points: of the consecutive points that fall in the same device column
+# (using the current mapping to output coordinates), only the first, the
+# last, the lowest and the highest are kept.  The result looks the same at
+# the output resolution, but the number of points appended is of the order
+# of the width of the frame.  The _gaps_ can be +nil+.
+#
+# See also #decimate_polylines.
+   def append_decimated_points_to_path(x_vec, y_vec, gaps = nil, close_subpaths = false)
+   end
+
 # :call-seq:
 #               discard_path                         
 #                   
@@ -99,6 +110,21 @@ class Creating_Paths < Doc < FigureMaker
    def croak_on_nonok_numbers=(bool)
    end
 
+   # When append_points_to_path or append_points_with_gaps_to_path (and
+   # hence show_polyline) get vectors with at least #cull_points_threshold
+   # points, the points that can't make any difference to the output are
+   # left out of the path: those that round to the same device position as
+   # the previous one, and the middle points of exactly collinear runs.
+   # This makes the PDF files for heavily oversampled data a lot smaller
+   # and faster to display, without changing what they look like.
+   def cull_points_threshold
+   end
+
+   # Sets the #cull_points_threshold. Defaults to 1000; use 0 to cull
+   # points in all paths, or a negative number to never do it.
+   def cull_points_threshold=(int)
+   end
+
 
 end # class
 end # module Tioga
@@ -92,6 +92,21 @@ class Executive < Doc < FigureMaker
     def make_portfolio_pdf(name,fignums=nil,report=false)
     end
 
+# :call-seq:
+#   make_multipage_pdf(name,fignums=nil,report=false)
+#
+# Creates a multipage pdf file containing the figures listed in _fignums_, like make_portfolio.
+# Does all the defined figures if _fignums_ is +nil+. 
+# Writes pdf information to terminal as it goes if _report_ is true.
+#
+# Instead of making a pdf for each figure and then combining them, make_multipage_pdf writes the
+# graphics of all the figures as the pages of a single file, in which the fonts, transparency
+# states, images and shadings are written only once.  The text of all the figures is then
+# added by a single pdflatex run.
+#
+    def make_multipage_pdf(name,fignums=nil,report=false)
+    end
+
 
 # :call-seq:
 #   figure_index(name)
@@ -443,10 +458,43 @@ class Executive < Doc < FigureMaker
 #               multithreads_okay_for_tioga = a_boolean
 #
 # Whether or not to use multithreading wherever possible (default is true).  Currently, this only is used when making
-# a batch of pdfs -- if multithreads_okay_for_tioga is true, then we launch all the pdflatex shells in parallel.
+# a batch of pdfs -- if multithreads_okay_for_tioga is true, then we launch the pdflatex shells in parallel,
+# at most +max_parallel_pdflatex+ at a time.
    def multithreads_okay_for_tioga
    end
 
+# :call-seq:
+#               max_parallel_pdflatex                                     
+#               max_parallel_pdflatex = an_integer
+#
+# The maximum number of pdflatex shells run at the same time when making a batch of pdfs (default is the number
+# of processors).  The reports and error messages still come out in the order of the figures.  Only used if
+# +multithreads_okay_for_tioga+ is true.
+   def max_parallel_pdflatex
+   end
+
+# :call-seq:
+#               cache_pdfs                                     
+#               cache_pdfs = a_boolean
+#
+# Whether or not to keep the PDFs made by pdflatex in a cache (the .tioga_cache directory in +save_dir+), indexed by
+# the contents of the files given to pdflatex (default is false).  When a figure comes out exactly as in a previous run,
+# its PDF is taken from the cache without running pdflatex.  Files that the figure's TeX code reads on its own are not
+# taken into account.  The cache directory can be removed at any time.
+   def cache_pdfs
+   end
+
+# :call-seq:
+#               cache_measures                                     
+#               cache_measures = a_boolean
+#
+# Whether or not to keep the sizes of the texts measured by pdflatex (see the 'measure' entry of #show_text) in
+# the .tioga_cache directory of +save_dir+ (default is false).  The sizes are indexed by the text, its scale and the
+# font settings.  On the next run, the texts found there get their sizes as soon as they are shown, so that a
+# figure using them doesn't need to be made twice.
+   def cache_measures
+   end
+
 # :call-seq:
 #               pdflatex                                     
 #               pdflatex = a_string
@@ -25,6 +25,8 @@ require 'Tioga/Utils'
 
 require "tmpdir"
 require "fileutils"
+require "etc"
+require "digest/sha1"
 
 module Tioga
 class FigureMaker
@@ -166,6 +168,20 @@ class FigureMaker
     # Whether or not do do multithreading for parallel pdflatex calls
     attr_accessor :multithreads_okay_for_tioga
 
+    # The maximum number of pdflatex processes run at the same time
+    # when making several PDFs (only if multithreads_okay_for_tioga)
+    attr_accessor :max_parallel_pdflatex
+
+    # Whether or not to keep the PDFs made by pdflatex in a cache
+    # directory in _save_dir_, so that a figure whose files didn't
+    # change since a previous run doesn't go through pdflatex again
+    attr_accessor :cache_pdfs
+
+    # Whether or not to keep the sizes measured by pdflatex in a file
+    # in _save_dir_, so that the measured texts of a figure get their
+    # sizes right away on the next run
+    attr_accessor :cache_measures
+
     # An accessor for @measures_info:
     attr_accessor :measures_info
 
@@ -180,6 +196,11 @@ class FigureMaker
     # as it causes a systematic second run of pdflatex.
     attr_accessor :measure_legends
 
+    # Whether show_polyline uses append_decimated_points_to_path to
+    # keep only the min and max points of each device column. Off by
+    # default.
+    attr_accessor :decimate_polylines
+
     # Stores the errors recorded in the last run of pdflatex.
     attr_accessor :pdflatex_errors
 
@@ -315,6 +336,20 @@ class FigureMaker
         # multithreads by default
         @multithreads_okay_for_tioga = true
 
+        # As many pdflatex processes as there are processors
+        @max_parallel_pdflatex = Etc.nprocessors
+
+        # No cache of the PDFs by default
+        @cache_pdfs = false
+
+        # No cache of the measures either
+        @cache_measures = false
+        @measures_cache = nil
+        @measures_cache_file = nil
+        # The keys of the measures shown, by [figure, measure name]
+        @measures_cache_keys = {}
+        @measures_figure = nil
+
 
         # The values of the sizes measured during the pdflatex run
         # we need to keep track of them so we can decide how many times
@@ -327,6 +362,9 @@ class FigureMaker
         # We don't measure legends by default.
         @measure_legends = false
 
+        # Nor do we decimate polylines
+        @decimate_polylines = false
+
         # Max number of pdflatex runs
         @max_nested_pdflatex_calls = 3
 
@@ -1306,11 +1344,19 @@ class FigureMaker
         private_append_points_with_gaps_to_path(xs, ys, gaps, close_subpaths)
     end
 
+    def append_decimated_points_to_path(xs, ys, gaps = nil, close_subpaths = false)
+        private_append_decimated_points_to_path(xs, ys, gaps, close_subpaths)
+    end
+
     def show_polyline(xs, ys, color = nil, legend = nil, type = nil, gaps = nil, close_subpaths = nil)
         context do
             self.line_type = type if type != nil
             self.stroke_color = color if color != nil
-            append_points_with_gaps_to_path(xs, ys, gaps, close_subpaths)
+            if @decimate_polylines
+                append_decimated_points_to_path(xs, ys, gaps, close_subpaths)
+            else
+                append_points_with_gaps_to_path(xs, ys, gaps, close_subpaths)
+            end
             stroke
             save_legend_info(legend) if legend != nil
         end
@@ -2030,6 +2076,7 @@ EOD
             end
             show_rotated_label(text, xloc, yloc, scale, angle, just, align, 
                                dict['measure'] || nil)
+            preload_measure(dict['measure'], text)
             return
         end
         position = alt_names(dict, 'position', 'pos')
@@ -2059,10 +2106,12 @@ EOD
             end
             show_rotated_label(text, xloc, yloc, scale, angle + angle_add, just, align,
                                dict['measure'])
+            preload_measure(dict['measure'], text)
             return
         end
         show_rotated_text(text, loc, shift, position, scale, angle, just, 
                           align, dict['measure'])
+        preload_measure(dict['measure'], text)
     end
     
     
@@ -2246,23 +2295,27 @@ EOD
     def make_pdf(num,&cmd) # returns pdf name if successful, false if failed.
         def_figure(num,&cmd) if Kernel.block_given?
         old_measure_keys = @measures.keys
-        num = get_num_for_pdf(num)
-        result = start_making_pdf(num)
-        return unless result
-
         if ! @current_pdflatex_call
           # Clear the measures at the first call
           @measures.clear
           @current_pdflatex_call = 0
         end
+        num = get_num_for_pdf(num)
+        result = start_making_pdf(num)
+        return unless result
+
+        # The measures found in the measures cache while making the
+        # figure are known as well
+        old_measure_keys |= @measures.keys
         begin
-          @figure_pdfs[num] = finish_making_pdf(@figure_names[num])
+          name = @figure_names[num]
+          @figure_pdfs[num] = finish_making_pdf(name, run_figure_pdflatex(name))
         rescue Exception => e
           p e, e.backtrace
         end
 
         # If the keys have changed, we run that again.
-        if @measures.keys != old_measure_keys
+        if @measures.keys.sort != old_measure_keys.sort
           @current_pdflatex_call += 1
 
           # We limit
@@ -2317,6 +2370,42 @@ EOD
         private_make_portfolio(name, fignums, @figure_names)
         finish_making_pdf(name)
     end
+
+    
+    # Same as make_portfolio, but the graphics of all the figures are
+    # written as the pages of a single PDF file, in which fonts,
+    # opacities, images and shadings are shared. A single pdflatex
+    # run then makes the whole document.
+    def make_multipage_pdf(name, fignums=nil, report=false)
+        fignums = Array.new(@figure_names.length) {|i| i} if fignums == nil
+        ensure_safe_save_dir
+        pages = []
+        private_begin_pdf_document(name)
+        begin
+          fignums.each do |num|
+            num = get_num_for_pdf(num)
+            next unless num
+            if create_figure_temp_files(num)
+              report_number_and_name(num,@figure_names[num]) if report
+              pages << @figure_names[num]
+            else
+              puts 'ERROR: Failed to make pdf for ' + @figure_names[num]
+            end
+          end
+        ensure
+          private_end_pdf_document(name, pages)
+        end
+        pdfname = finish_making_pdf(name)
+        if pdfname && @autocleanup
+          pages.each do |figname|
+            begin
+              File.delete(File.join(@save_dir || ".", figname + "_figure.txt"))
+            rescue
+            end
+          end
+        end
+        return pdfname
+    end
     
     
 
@@ -2336,6 +2425,7 @@ EOD
         begin
             reset_plot_attrs(self.scaling_factor)
             reset_legend_info
+            @measures_figure = name
             private_make(name, cmd)
             return true
         rescue Exception => er
@@ -2393,26 +2483,67 @@ EOD
     end
     
       
+    # The outcome of a pdflatex run: see run_pdflatex.
+    # _digest_ is the key of the figure in the PDF cache, and _cached_
+    # is true if the PDF comes from there.
+    PdflatexRun = Struct.new(:status, :popen_error, :logname,
+                             :measures, :errors, :digest, :cached)
+
     def finish_making_pdfs(fignums,report)
-      if false # Process.respond_to? :fork
-        threads = []
-        
-        fignums.each do |num|
-          treads << Process.fork { finish_1_pdf(num,report) }
+      workers_count = 1
+      if @multithreads_okay_for_tioga && @max_parallel_pdflatex
+        workers_count = [@max_parallel_pdflatex.to_i, fignums.size].min
+      end
+      if workers_count <= 1
+        fignums.each {|num| finish_1_pdf(num, nil, report)}
+        return true
+      end
+
+      # The pdflatex runs don't depend on each other, so up to
+      # max_parallel_pdflatex of them are run at the same time by
+      # worker threads. Their results are then handled here, one at a
+      # time and in the order of fignums, as in the serial case.
+      jobs = Queue.new
+      results = fignums.map do |num|
+        result = Queue.new
+        jobs << [@figure_names[num], result]
+        result
+      end
+      jobs.close
+      workers = Array.new(workers_count) do
+        Thread.new do
+          while job = jobs.pop
+            name, result = job
+            begin
+              # Each run needs its own log file
+              result << run_figure_pdflatex(name, "#{name}_pdflatex.log")
+            rescue Exception => e
+              result << e
+            end
+          end
         end
-        threads.each {|thr| Process.wait(thr)}
-      else
-        
-        # Less fast, but will create real problems with Dir.chdir block...
-        fignums.each {|num| finish_1_pdf(num,report)}
       end
+      made = false
+      begin
+        fignums.each_with_index do |num, i|
+          run = results[i].pop
+          raise run if run.kind_of?(Exception)
+          # The other runs may still need the shared aux files
+          made |= finish_1_pdf(num, run, report, true)
+        end
+      ensure
+        jobs.clear
+        workers.each {|thr| thr.join}
+      end
+      delete_shared_aux_files if made && @autocleanup
       return true
     end
     
     
-    def finish_1_pdf(num,report)
-      old_measure_keys = @measures.keys
-      pdfname = finish_making_pdf(@figure_names[num])
+    def finish_1_pdf(num,run,report,keep_shared_aux = false)
+      name = @figure_names[num]
+      pdfname = finish_making_pdf(name, run || run_figure_pdflatex(name),
+                                  keep_shared_aux)
 
       if pdfname != false
         @figure_pdfs[num] = pdfname
@@ -2420,37 +2551,48 @@ EOD
       else
         puts 'ERROR: pdflatex failed to make pdf for ' + @figure_names[num]
       end
+      return pdfname != false
     end
-   
-    
-    def finish_making_pdf(name) # returns pdfname if succeeds, false if fails.
-      pdflatex = FigureMaker.pdflatex
-      quiet = @quiet_mode
-      run_directory = @run_dir
-      
-      logname = "pdflatex.log"
 
-      new_dir = @save_dir || "."
-      syscmd = "#{pdflatex} -interaction nonstopmode #{name}.tex"
 
-      popen_error = nil
-      @pdflatex_errors = []
-      Dir.chdir(new_dir) do 
-        # Now fun begins:
-        # We use IO::popen for three reasons:
-        # * first, we want to be able to read back information from
-        #   pdflatex (see \tiogameasure)
-        # * second, this way of doing should be portable to win, while
-        #   the > trick might not be that much...
-        # * third, closing the standard input of pdflatex will remove
-        #   painful bugs, when pdflatex gets interrupted but waits
-        #   for an input for which it didn't prompt.
-        
-        @measures = {}
+    # The aux files that pdflatex writes for the files the TeX
+    # preamble includes, whatever the figure.
+    SharedAuxFiles = %w(color_names.aux)
+
+    def delete_shared_aux_files
+      for f in SharedAuxFiles
         begin
-          IO::popen(syscmd, "r+") do |f|
-            f.close_write           # We don't need that.
-            log = File.open(logname, "w")
+          File.delete(File.join(@save_dir || ".", f))
+        rescue
+        end
+      end
+    end
+   
+
+    # Runs pdflatex on the TeX file of _name_ in the save directory,
+    # and returns a PdflatexRun. It doesn't change the state of the
+    # FigureMaker, so several runs can go on at the same time.
+    def run_pdflatex(name, logname = "pdflatex.log")
+      pdflatex = FigureMaker.pdflatex
+      run_dir = @save_dir || "."
+      syscmd = "#{pdflatex} -interaction nonstopmode #{name}.tex"
+      run = PdflatexRun.new(nil, nil, logname, {}, [])
+
+      # Now fun begins:
+      # We use IO::popen for three reasons:
+      # * first, we want to be able to read back information from
+      #   pdflatex (see \tiogameasure)
+      # * second, this way of doing should be portable to win, while
+      #   the > trick might not be that much...
+      # * third, closing the standard input of pdflatex will remove
+      #   painful bugs, when pdflatex gets interrupted but waits
+      #   for an input for which it didn't prompt.
+      # pdflatex is started in the save directory rather than using
+      # Dir.chdir, which changes the directory of the whole process.
+      begin
+        IO::popen(syscmd, "r+", :chdir => run_dir) do |f|
+          f.close_write           # We don't need that.
+          File.open(File.join(run_dir, logname), "w") do |log|
             error_pending = false
             for line in f
               log.print line
@@ -2458,24 +2600,176 @@ EOD
                 n = $1
                 num = $2.to_i
                 dim = Utils::tex_dimension_to_bp($3)
-                @measures[n] ||= []
-                @measures[n][num] = dim
+                run.measures[n] ||= []
+                run.measures[n][num] = dim
               elsif line =~ /^!/
                 error_pending = true
               elsif line =~ /^\s*$/ # errors seem to stop at blank lines
                 error_pending = false
               end
               if error_pending
-                @pdflatex_errors << line
+                run.errors << line
               end
             end
           end
-        rescue SystemCallError => e
-          popen_error = e
         end
+        run.status = $?
+      rescue SystemCallError => e
+        run.popen_error = e
+      end
+      return run
+    end
+
+    
+    # Same as run_pdflatex for the files of a figure, but if
+    # cache_pdfs is on and the PDF cache has the result of a run on
+    # the very same files, the PDF is taken from there instead.
+    def run_figure_pdflatex(name, logname = "pdflatex.log")
+      digest = @cache_pdfs && pdf_cache_digest(name)
+      run = digest && cached_pdflatex_run(name, digest, logname)
+      if ! run
+        run = run_pdflatex(name, logname)
+        run.digest = digest
       end
+      return run
+    end
+
+    
+    # The directory of the PDF and measures caches.
+    def pdf_cache_dir
+      return File.join(@save_dir || ".", ".tioga_cache")
+    end
+
+
+    # The key of the figure _name_ in the PDF cache: a hash of the
+    # files pdflatex reads, or nil if one of them is missing.
+    def pdf_cache_digest(name)
+      dir = @save_dir || "."
+      digest = Digest::SHA1.new
+      digest << FigureMaker.pdflatex << "\0"
+      for suffix in %w(.tex _figure.txt _figure.pdf)
+        file = File.join(dir, name + suffix)
+        return nil unless File.exist?(file)
+        data = File.open(file, "rb") {|f| f.read}
+        if suffix == "_figure.pdf"
+          # The only thing that changes from one run to the other
+          data = data.sub(/\/CreationDate \([^)]*\)/, "")
+        end
+        digest << data << "\0"
+      end
+      return digest.hexdigest
+    end
+
+
+    # Returns a PdflatexRun for the PDF cache entry _digest_, after
+    # copying the PDF in place, or nil if there is no such entry.
+    def cached_pdflatex_run(name, digest, logname)
+      base = File.join(pdf_cache_dir, digest)
+      return nil unless File.exist?("#{base}.pdf") &&
+        File.exist?("#{base}.measures")
+      measures = File.open("#{base}.measures", "rb") {|f| Marshal.load(f)}
+      FileUtils.cp("#{base}.pdf", File.join(@save_dir || ".", name + ".pdf"))
+      return PdflatexRun.new(nil, nil, logname, measures, [], digest, true)
+    rescue SystemCallError, TypeError, ArgumentError
+      # A broken entry, that will be written again
+      return nil
+    end
+
+
+    # Saves the PDF made by the pdflatex _run_ for figure _name_ in
+    # the PDF cache.
+    def save_in_pdf_cache(name, run)
+      pdf = File.join(@save_dir || ".", name + ".pdf")
+      return unless run.status.success? && File.exist?(pdf)
+      base = File.join(pdf_cache_dir, run.digest)
+      FileUtils.mkdir_p(pdf_cache_dir)
+      FileUtils.cp(pdf, "#{base}.pdf")
+      File.open("#{base}.measures", "wb") {|f| Marshal.dump(run.measures, f)}
+    rescue SystemCallError => e
+      $stderr.puts "Warning: could not save #{name} in the PDF cache: #{e}"
+    end
+
+    
+    # The measures cache, read from its file if needed. It maps keys
+    # made by measures_cache_key to the sizes pdflatex measured.
+    def measures_cache
+      file = File.join(pdf_cache_dir, "measures")
+      if @measures_cache_file != file
+        @measures_cache_file = file
+        @measures_cache = {}
+        begin
+          if File.exist?(file)
+            @measures_cache = File.open(file, "rb") {|f| Marshal.load(f)}
+          end
+        rescue SystemCallError, TypeError, ArgumentError
+          # A broken cache, that will be written again
+        end
+      end
+      return @measures_cache
+    end
+
+
+    # The key of a text in the measures cache: what the size of the
+    # text depends on.
+    def measures_cache_key(text, scale)
+      return [text, scale, @tex_preamble, @tex_fontsize, @tex_fontfamily,
+              @tex_fontseries, @tex_fontshape]
+    end
+
+
+    # Called when the text of the measure _name_ has been shown: if
+    # the measures cache knows the size of _text_, it is used right
+    # away, as if pdflatex had already measured it.
+    def preload_measure(name, text)
+      return unless name && @cache_measures
+      info = @measures_info[name]
+      # No measure for blank texts
+      return unless info && info.key?('scale')
+      key = measures_cache_key(text, info['scale'])
+      @measures_cache_keys[[@measures_figure, name]] = key
+      if val = measures_cache[key]
+        @measures[name] = val
+        private_save_measure(name, *val)
+      end
+    end
+
+
+    # Saves the new measures of the last pdflatex run, for the figure
+    # _figure_, in the measures cache file.
+    def save_in_measures_cache(figure)
+      return unless @cache_measures
+      cache = measures_cache
+      changed = false
+      for name, val in @measures
+        key = @measures_cache_keys[[figure, name]]
+        if key && cache[key] != val
+          cache[key] = val
+          changed = true
+        end
+      end
+      return unless changed
+      FileUtils.mkdir_p(pdf_cache_dir)
+      File.open("#{@measures_cache_file}.tmp", "wb") {|f| Marshal.dump(cache, f)}
+      File.rename("#{@measures_cache_file}.tmp", @measures_cache_file)
+    rescue SystemCallError => e
+      $stderr.puts "Warning: could not save the measures cache: #{e}"
+    end
+
+    
+    # Makes the PDF file for _name_ out of the results of
+    # run_pdflatex, which is called if _run_ is not given. The
+    # SharedAuxFiles are left alone if _keep_shared_aux_ is true, as
+    # other runs may be using them.
+    def finish_making_pdf(name, run = nil, keep_shared_aux = false) # returns pdfname if succeeds, false if fails.
+      run ||= run_pdflatex(name)
+      pdflatex = FigureMaker.pdflatex
+      run_directory = @run_dir
+      logname = File.join(@save_dir || ".", run.logname)
+      @measures = run.measures
+      @pdflatex_errors = run.errors
         
-      if !$? or ($?.exitstatus == 127) or popen_error
+      if !run.cached and (!run.status or (run.status.exitstatus == 127) or
+                          run.popen_error)
         $stderr.puts <<"EOE"
 ERROR: Tioga doesn't seem to find pdflatex (as '#{pdflatex}').
 
@@ -2496,8 +2790,8 @@ export TIOGA_PDFLATEX=/path/to/pdflatex
 in your ~/.bashrc.
 EOE
 
-        if popen_error
-          $stderr.puts "Error: #{popen_error.inspect}"
+        if run.popen_error
+          $stderr.puts "Error: #{run.popen_error.inspect}"
         end
       end
         
@@ -2507,19 +2801,21 @@ EOE
         private_save_measure(key, *val)
       end
 
+      save_in_measures_cache(name)
+
       # Delete all keys in @
       extra = @measures_info.keys - @measures.keys
       for e in extra
         @measures_info.delete(e)
       end
         
-      result = $?
+      result = run.cached || run.status
         if !result
-            $stderr.puts "ERROR: #{pdflatex} failed with error code #{$? ? $?.exitstatus : 'no command run'}"
-            file = File.open(logname)
-            if file == nil
+            $stderr.puts "ERROR: #{pdflatex} failed with error code #{result ? result.exitstatus : 'no command run'}"
+            if ! File.exist?(logname)
                 puts "cannot open #{logname}"
             else
+                file = File.open(logname)
                 reporting = false; linecount = 0
                 file.each_line do |line|
                     reporting = true if line =~ /^!/
@@ -2533,13 +2829,13 @@ EOE
             end
         end
         if result
+            save_in_pdf_cache(name, run) if run.digest && ! run.cached
             pdfname = name
-            logname = "pdflatex.log"
             files = %w(.tex .out .aux .log _figure.pdf _figure.txt).map do |suffix|
               pdfname + suffix
             end
-            files << logname
-            files << "color_names.aux"
+            files << run.logname
+            files += SharedAuxFiles unless keep_shared_aux
             if @save_dir # prepend directory specification
               files.map! do |f|
                 "#{@save_dir}/#{f}"
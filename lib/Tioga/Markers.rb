@@ -131,6 +131,18 @@ link:images/Marker_Shadow_Effect.png
    def marker_defaults
    end
 
+# When show_marker gets at least #marker_xobject_threshold points and the marker is rotated, scaled
+# or skewed, the marker is written only once, as a Form XObject, and each point just places a
+# copy of it.  This makes the PDF files for large scatter plots several times smaller and faster
+# to write and to display.  The clipping rendering modes never use this.
+   def marker_xobject_threshold
+   end
+
+# Sets the #marker_xobject_threshold. Defaults to 1000; use a negative number to never
+# use a Form XObject for markers.
+   def marker_xobject_threshold=(int)
+   end
+
 
 
 end # class
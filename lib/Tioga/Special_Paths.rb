@@ -210,7 +210,8 @@ link:images/Splines.png
 
 # Calls #context, then, inside the new context, changes line_type and stroke_color (if those arguments are not +nil+),
 # calls append_points_with_gaps_to_path, calls #stroke, and then saves the legend information (if _legend_
-# is not +nil+).
+# is not +nil+).  If #decimate_polylines is set, append_decimated_points_to_path is used
+# instead of append_points_with_gaps_to_path.
     def show_polyline(xs, ys, color = nil, legend = nil, type = nil, gaps = nil, close_subpaths = nil)
     end
 
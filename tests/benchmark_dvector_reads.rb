@@ -42,6 +42,19 @@ Benchmark.bm do |x|
     Dobjects::Dvector.fancy_read(stream, nil, 'default'=> 0.0, 
                                  'initial_size' => 100000).size
   end
+  x.report("fancy_read(100 000), 4 threads:") do 
+    Dobjects.with_num_threads(4) do
+      stream = File.open(f.path)
+      Dobjects::Dvector.fancy_read(stream, nil, 'default'=> 0.0, 
+                                   'parallel' => true).size
+    end
+  end
+  x.report("each_chunk(100 000), 10 000 rows:") do 
+    sum = 0.0
+    Dobjects::Dvector.each_chunk(f.path, 'rows' => 10000) do |cols|
+      sum += cols[1].sum
+    end
+  end
 
   # We create a smaller file:
   f = Tempfile.new("data")
@@ -0,0 +1,45 @@
+# A small benchmarking file for the PDF output of large plots: it measures
+# how many points per second end up in the figure content stream for
+# polylines and markers.
+#
+# The figures only go through create_figure_temp_files, so pdflatex
+# is not needed.
+
+require 'Tioga/FigureMaker'
+require 'benchmark'
+require 'tmpdir'
+
+include Tioga
+include FigureConstants
+
+n = (ARGV[0] || 1_000_000).to_i
+xs = Dobjects::Dvector.new(n) { |i| i.to_f / n }
+ys = xs.map { |x| Math.sin(x * 400) }
+
+t = FigureMaker.default
+t.def_figure("polyline") do
+  t.show_plot([0, 1, 1, -1]) { t.show_polyline(xs, ys) }
+end
+t.def_figure("markers") do
+  t.show_plot([0, 1, 1, -1]) do
+    t.show_marker('Xs' => xs, 'Ys' => ys, 'marker' => Bullet,
+                  'scale' => 0.1)
+  end
+end
+
+Dir.mktmpdir do |dir|
+  t.save_dir = dir
+  rates = {}
+  Benchmark.bm(20) do |x|
+    for name in ["polyline", "markers"]
+      tms = x.report("#{name}(#{n}):") do
+        t.create_figure_temp_files(t.figure_index(name))
+      end
+      rates[name] = n / tms.real
+    end
+  end
+  puts
+  rates.each do |name, rate|
+    puts "%-20s %12.0f points/s" % [name, rate]
+  end
+end
@@ -2,6 +2,7 @@
 
 require 'Dobjects/Dtable'
 require 'test/unit'
+require 'tmpdir'
 
 class TestDtable < Test::Unit::TestCase
 
@@ -22,6 +23,22 @@ class TestDtable < Test::Unit::TestCase
         assert_equal(@num_rows, @arr.num_rows)
     end
     
+    def test_read_fortran_exponents
+      Dir.mktmpdir do |dir|
+        name = File.join(dir, "fortran.dat")
+        File.open(name, "w") do |f|
+          f.puts "0.501-129 1.5D3"
+          f.puts "-2.5d-2 1.25E+2"
+        end
+        t = Dtable.new(2, 2)
+        t.read(name)
+        assert_equal(0.501e-129, t[0, 0])
+        assert_equal(1500.0, t[0, 1])
+        assert_equal(-0.025, t[1, 0])
+        assert_equal(125.0, t[1, 1])
+      end
+    end
+
     def test_at
         read_data
         assert_equal(7, @arr.at(1,2))
@@ -184,6 +201,104 @@ class TestDtable < Test::Unit::TestCase
         end
     end
 
+    # The simple operations go through the vectorized loops one row at
+    # a time
+    def test_kernels
+      row = Dvector.new(37) { |i| (i - 18) * 0.37 }
+      other = row.reverse
+      t = Dtable.new(row.size, 3)
+      u = Dtable.new(row.size, 3)
+      3.times do |i|
+        t.set_row(i, row)
+        u.set_row(i, other)
+      end
+      3.times do |i|
+        assert_equal(row.inv, t.inv.row(i))
+        assert_equal(row.trim(0.5), t.trim(0.5).row(i))
+        assert_equal(row % 0.7, (t % 0.7).row(i))
+        assert_equal(row + other, (t + u).row(i))
+        assert_equal(row * other, (t * u).row(i))
+      end
+    end
+
+    def test_num_threads
+      threshold = Dobjects.parallel_threshold
+      Dobjects.parallel_threshold = 10
+      t = Dtable.new(7, 13)
+      13.times { |i| t.set_row(i, Dvector.new(7) { |j| i * 7 + j + 0.5 }) }
+      one = Dobjects.with_num_threads(1) { [t.log, t * t, t - 0.25] }
+      four = Dobjects.with_num_threads(4) { [t.log, t * t, t - 0.25] }
+      one.zip(four) do |a, b|
+        13.times { |i| assert_equal(a.row(i), b.row(i)) }
+      end
+    ensure
+      Dobjects.parallel_threshold = threshold
+    end
+
+    def test_interpolate
+      xs = Dvector[0, 0.5, 2, 3, 4.5, 7]
+      ys = Dvector[-1, 0, 0.25, 1, 3]
+      f = proc { |x, y| 2 + 0.5 * x - 3 * y + 0.25 * x * y }
+      t = Dtable.new(xs.size, ys.size)
+      ys.each_index do |i|
+        t.set_row(i, Dvector.new(xs.size) { |j| f.call(xs[j], ys[i]) })
+      end
+      threshold = Dobjects.parallel_threshold
+      Dobjects.parallel_threshold = 10
+      for mode in [nil, "cubic", :nearest]
+        args = [xs, ys, 29, 17, 0, 7, -1, 3]
+        args << mode if mode
+        r = t.interpolate(*args)
+        assert_equal([29, 17], [r.num_cols, r.num_rows])
+        r4 = Dobjects.with_num_threads(4) { t.interpolate(*args) }
+        17.times do |i|
+          y = -1 + i * 0.25
+          assert_equal(r.row(i), r4.row(i))
+          29.times do |j|
+            x = j * 0.25
+            if mode == :nearest
+              jj = (0...xs.size).min_by { |k| (xs[k] - x).abs }
+              ii = (0...ys.size).min_by { |k| (ys[k] - y).abs }
+              assert_equal(t[ii, jj], r[i, j])
+            else
+              # Both reproduce bilinear functions on the cells
+              assert_in_delta(f.call(x, y), r[i, j], 1e-12) if ! mode
+              # The cubic one is exact along the grid lines
+              if mode && (xs.include?(x) || ys.include?(y))
+                assert_in_delta(f.call(x, y), r[i, j], 1e-12)
+              end
+            end
+          end
+        end
+      end
+      # The end points
+      r = t.interpolate(xs, ys, 2, 2, 0, 7, -1, 3)
+      assert_equal(t[-1, -1], r[1, 1])
+      assert_equal(t[0, -1], r[0, 1])
+      assert_raise(ArgumentError) do
+        t.interpolate(xs, ys, 2, 2, 0, 7, -1, 3, "spline")
+      end
+      assert_raise(ArgumentError) { t.interpolate(xs, ys, 2, 2, 0, 7.5, -1, 3) }
+    ensure
+      Dobjects.parallel_threshold = threshold
+    end
+
+    def test_binary
+      t = Dtable.new(3, 4)
+      4.times { |i| t.set_row(i, Dvector[i, i + 0.5, -i]) }
+      u = Dtable.from_binary(t.to_binary, 3, 4)
+      4.times { |i| assert_equal(t.row(i), u.row(i)) }
+      assert_raise(ArgumentError) { Dtable.from_binary(t.to_binary, 3, 5) }
+      Dir.mktmpdir do |dir|
+        file = File.join(dir, "data.dob")
+        Dvector.write_binary(file, {"t" => t, "x" => Dvector[1, 2]},
+                             :compress => true)
+        u = Dvector.read_binary(file, :cols => ["t"])["t"]
+        assert_equal([3, 4], [u.num_cols, u.num_rows])
+        4.times { |i| assert_equal(t.row(i), u.row(i)) }
+      end
+    end
+
     def test_marshal
       t = Dtable.new(3,4)
       t[1,1] = 1.2
@@ -197,6 +312,92 @@ class TestDtable < Test::Unit::TestCase
         assert_equal(t.row(i), tbis.row(i))
         i += 1
       end
+      assert_raise(RuntimeError) { Dtable._load(t._dump(-1)[0..-2]) }
+      assert_raise(RuntimeError) { Dtable._load(t._dump(-1) + "\0") }
+      # the version 1 dumps, with 4-byte dimensions
+      v1 = [1, 4, 3].pack("CVV") + t.to_binary
+      u = Dtable._load(v1)
+      assert_equal([3, 4], [u.num_cols, u.num_rows])
+      4.times { |i| assert_equal(t.row(i), u.row(i)) }
+      assert_equal([2, "l".ord, 4, 3].pack("CCQ<Q<") + t.to_binary,
+                   t._dump(-1))
+    end
+
+    def test_copies
+      t = Dtable.new(5, 3)
+      3.times { |i| t.set_row(i, Dvector[1, 2, 3, 4, 5] * (i + 1)) }
+      u = t.dup
+      u[0, 0] = -1
+      assert_equal(1, t[0, 0])
+      assert_equal(Dvector[3, 6, 9, 12, 15], u.row(2))
+      v = t.reverse_rows
+      3.times { |i| assert_equal(t.row(2 - i), v.row(i)) }
+      u.set(t)
+      assert_equal(t.row(0), u.row(0))
+      u.set(u)
+      assert_equal(t.row(1), u.row(1))
+      u.clear
+      assert_equal(Dvector.new(5), u.row(2))
+    end
+
+    def test_row_views
+      t = Dtable.new(4, 3)
+      3.times { |i| t.set_row(i, Dvector[1, 2, 3, 4] * (i + 1)) }
+      r = t.row_view(1)
+      assert_equal(t.row(1), r)
+      t[1, 2] = -1
+      assert_equal(-1, r[2])
+      r[0] = 10
+      assert_equal(2, t[1, 0])
+      t[1, 1] = 0
+      assert_equal(4, r[1])
+      assert_equal(Dvector[6, 9, 12], t.row_view(2)[1..3])
+
+      # the views keep the table alive
+      views = Array.new(3) { |i| Dtable.new(100, 100).row_view(99) }
+      GC.start
+      views.each { |v| assert_equal(Dvector.new(100), v) }
+
+      rows = []
+      t.each_row { |row| rows << row.dup; row.mul!(0) }
+      assert_equal([t.row(0), Dvector[2, 0, -1, 8], t.row(2)], rows)
+      assert_equal(Dvector[3, 6, 9, 12], t.row(2))
+      assert_raise(RuntimeError) { t.send(:initialize, 2, 2) }
+
+      cols = []
+      t.each_column { |col| cols << col.dup; col.resize(1) }
+      assert_equal([Dvector[1, 2, 3], Dvector[2, 0, 6], Dvector[3, -1, 9],
+                    Dvector[4, 8, 12]], cols)
+      assert_equal(Dvector[4, 8, 12], t.column(3))
+    end
+
+    def test_transpose_and_rotations
+      for cols, rows in [[1, 1], [3, 3], [70, 70], [5, 3], [45, 70], [1, 9]]
+        t = Dtable.new(cols, rows)
+        rows.times { |i| t.set_row(i, Dvector.new(cols) { |j| i * 1000 + j }) }
+        tr = t.transpose
+        cw = t.rotate_cw90
+        ccw = t.rotate_ccw90
+        assert_equal([rows, cols], [tr.num_cols, tr.num_rows])
+        rows.times do |i|
+          cols.times do |j|
+            assert_equal(t[i, j], tr[j, i])
+            assert_equal(t[i, j], cw[j, rows - 1 - i])
+            assert_equal(t[i, j], ccw[cols - 1 - j, i])
+          end
+        end
+        { :transpose! => tr, :rotate_cw90! => cw, :rotate_ccw90! => ccw,
+          :reverse_rows! => t.reverse_rows,
+          :reverse_cols! => t.reverse_cols }.each do |meth, expected|
+          u = t.dup
+          assert_same(u, u.send(meth))
+          assert_equal([expected.num_cols, expected.num_rows],
+                       [u.num_cols, u.num_rows])
+          expected.num_rows.times do |i|
+            assert_equal(expected.row(i), u.row(i))
+          end
+        end
+      end
     end
 
 end
@@ -2,6 +2,7 @@
 
 require 'Dobjects/Dvector'
 require 'stringio'
+require 'tmpdir'
 require 'test/unit'
 
 class TestDvector < Test::Unit::TestCase
@@ -30,6 +31,56 @@ class TestDvector < Test::Unit::TestCase
         assert_equal(1.0, row[-1])
     end
     
+    def test_read_fortran_exponents
+      Dir.mktmpdir do |dir|
+        name = File.join(dir, "fortran.dat")
+        File.open(name, "w") do |f|
+          f.puts "0.501-129 1.5D3 -2.5d-2 1e5"
+          f.puts "1.25E+2 3.0+003 -7 0.1"
+        end
+        cols = Dvector.read(name)
+        assert_equal(Dvector[0.501e-129, 125.0], cols[0])
+        assert_equal(Dvector[1500.0, 3000.0], cols[1])
+        assert_equal(Dvector[-0.025, -7.0], cols[2])
+        assert_equal(Dvector[1e5, 0.1], cols[3])
+        assert_equal(Dvector[0.501e-129, 1500.0, -0.025, 1e5], 
+                     Dvector.read_row(name))
+        File.open(name, "w") { |f| f.puts "1.5 2.5x" }
+        assert_raise(ArgumentError) { Dvector.read(name) }
+      end
+    end
+
+    def test_write
+      values = [0.0, -0.0, 1.0, 0.1 + 0.2, 1e15, 1e16, 123456789.125,
+                0.0001, 0.00001, 5e-324, 2.2250738585072014e-308,
+                1.7976931348623157e308, -1.0/3, 1.0/0.0, -1.0/0.0]
+      r = Random.new(4)
+      1000.times do
+        values << [r.bytes(8)].pack("a8").unpack("E").first
+      end
+      v = Dvector[*values]
+      w = Dvector[1, 2, 3]
+      io = StringIO.new
+      Dvector.write(io, [v, w])
+      lines = io.string.split("\n")
+      assert_equal(v.size, lines.size)
+      lines.each_with_index do |l, i|
+        expected = values[i].to_s + "\t" + (i < 3 ? w[i].to_s : "")
+        assert_equal(expected, l)
+      end
+      # Everything reads back exactly
+      cols = Dvector.fancy_read(StringIO.new(io.string))
+      assert_same_values(v, cols[0])
+
+      Dir.mktmpdir do |dir|
+        name = File.join(dir, "out.dat")
+        Dvector.write(name, [w, w * 2], 'sep' => ', ')
+        Dvector.write(name, [w, [0.5]])
+        assert_equal("1.0, 2.0\n2.0, 4.0\n3.0, 6.0\n" +
+                     "1.0\t0.5\n2.0\t\n3.0\t\n", File.read(name))
+      end
+    end
+
     def test_vector_length
         a = Dvector[3.0, 4.0]
         assert_equal(a.vector_length, 5.0)
@@ -377,6 +428,10 @@ class TestDvector < Test::Unit::TestCase
         assert_equal(Dvector[44, 55], a.replace([44, 55]))
         a = Dvector.new(0)
         assert_equal(Dvector[44, 55], a.replace([44, 55]))
+        b = Dvector[1, 2, 3, 4, 5]
+        assert_equal(Dvector[2, 3], a.replace(b[1, 2]))
+        a[0] = 7
+        assert_equal(Dvector[1, 2, 3, 4, 5], b)
     end
     
     def test_push
@@ -888,6 +943,168 @@ EOT
       end
     end
 
+    # A stream with only a gets method, which fast_fancy_read can't
+    # read by blocks
+    class GetsOnly
+      def initialize(text)
+        @stream = StringIO.new(text)
+      end
+
+      def gets
+        @stream.gets
+      end
+    end
+
+    def test_fancy_read_tokenizer
+      text = "skipped 1 2\r\n" + 
+        "1.5 2,5\t3 \r\n" +
+        "  # indented comment\n" +
+        "#comment\n" +
+        "\t \n" +
+        "4e2,,6;7 \n" +
+        "-1 nan 1 2, 3\r\n" +
+        "8,9\t10,"
+      for opts in [{}, { 'sep' => /,/ }, { 'sep' => /\t/ },
+                   { 'sep' => ',' }, { 'sep' => /;/, 'remove_space' => false },
+                   { 'comments' => /^\#/ }, { 'comments' => nil },
+                   { 'skip_first' => 1, 'default' => -1.0 }]
+        comments = []
+        expected_comments = []
+        cols = Dvector.fancy_read(StringIO.new(text), nil, 
+                                  opts.merge('comment_out' => comments))
+        expected = Dvector.fancy_read(GetsOnly.new(text), nil, 
+                                      opts.merge('comment_out' => 
+                                                 expected_comments))
+        assert_equal(expected.size, cols.size, opts.inspect)
+        expected.each_index do |i|
+          assert_same_values(expected[i], cols[i])
+        end
+        assert_equal(expected_comments, comments, opts.inspect)
+      end
+
+      # Lines that span several blocks
+      text = (1..100000).map { |i| "#{i} #{i * 0.5}\n" }.join
+      cols = Dvector.fancy_read(StringIO.new(text))
+      assert_equal(100000, cols[0].size)
+      assert_equal(Dvector.new(100000) { |i| i + 1 }, cols[0])
+      assert_equal(cols[0] * 0.5, cols[1])
+
+      Dir.mktmpdir do |dir|
+        name = File.join(dir, "data.dat")
+        File.open(name, "w") { |f| f.write(text) }
+        cols = Dvector.fancy_read(name)
+        assert_equal(cols[0] * 0.5, cols[1])
+      end
+    end
+
+    def test_fancy_read_parallel
+      threshold = Dobjects.parallel_threshold
+      Dobjects.parallel_threshold = 10
+      text = "# header\n" + (1..200).map do |i|
+        line = (["#{i}"] + ["#{i * 0.5}"] * (i % 7)).join(i % 3 == 0 ? 
+                                                           "\t" : "  ")
+        line = "# comment #{i}" if i % 17 == 0
+        line = "   " if i % 19 == 0
+        line += " " * (i % 5) * 30 if i % 11 == 0
+        line + (i % 2 == 0 ? "\r\n" : "\n")
+      end.join + "201 1"
+      Dir.mktmpdir do |dir|
+        name = File.join(dir, "data.dat")
+        File.open(name, "w") { |f| f.write(text) }
+        for opts in [{}, { 'skip_first' => 3 }, { 'skip_first' => 500 },
+                     { 'comments' => nil, 'default' => -1.0 }]
+          expected_comments = []
+          expected = Dvector.fancy_read(StringIO.new(text), nil, 
+                                        opts.merge('comment_out' => 
+                                                   expected_comments))
+          for threads in [1, 3, 8]
+            comments = []
+            cols = Dobjects.with_num_threads(threads) do
+              File.open(name) do |f|
+                Dvector.fancy_read(f, nil, opts.merge('parallel' => true, 
+                                                      'comment_out' => 
+                                                      comments))
+              end
+            end
+            assert_equal(expected.size, cols.size)
+            expected.each_index do |i|
+              assert_same_values(expected[i], cols[i])
+            end
+            assert_equal(expected_comments, comments)
+          end
+        end
+
+        # Starting from the current position of the stream
+        File.open(name) do |f|
+          f.gets
+          f.gets
+          cols = Dobjects.with_num_threads(4) do
+            Dvector.fancy_read(f, nil, 'parallel' => true)
+          end
+          expected = Dvector.fancy_read(StringIO.new(text), nil, 
+                                        'skip_first' => 2)
+          expected.each_index do |i|
+            assert_same_values(expected[i], cols[i])
+          end
+          assert(f.eof?)
+        end
+      end
+    ensure
+      Dobjects.parallel_threshold = threshold
+    end
+
+    def test_each_chunk
+      text = "# header\n" + (1..250).map do |i|
+        line = (["#{i}"] + ["#{i * 0.5}"] * (i / 40)).join(" ")
+        line = "# comment #{i}" if i % 17 == 0
+        line = "" if i % 23 == 0
+        line + "\n"
+      end.join
+      for opts in [{}, { 'skip_first' => 5, 'index_col' => true },
+                   { 'sep' => / +/ }]
+        for rows in [1, 7, 100, 1000]
+          expected_comments = []
+          expected = Dvector.fancy_read(StringIO.new(text), nil,
+                                        opts.merge('comment_out' =>
+                                                   expected_comments))
+          comments = []
+          got = []
+          arrays = []
+          nb = 0
+          Dvector.each_chunk(StringIO.new(text),
+                             opts.merge(:rows => rows,
+                                        'comment_out' => comments)) do |cols|
+            assert(cols[0].size <= rows)
+            arrays << cols
+            cols.each_index do |i|
+              got[i] ||= Dvector.new(nb, 0.0/0.0)
+              got[i].concat(cols[i])
+            end
+            nb += cols[0].size
+          end
+          # The same Array is yielded for all chunks
+          assert_equal(1, arrays.map { |a| a.object_id }.uniq.size)
+          assert_equal(expected.size, got.size)
+          expected.each_index do |i|
+            # Columns that appear later start with NaN in both cases
+            assert_same_values(expected[i], got[i])
+          end
+          assert_equal(expected_comments, comments)
+        end
+      end
+
+      # Breaking out of the block
+      seen = 0
+      Dvector.each_chunk(StringIO.new(text), 'rows' => 10) do |cols|
+        seen += 1
+        break
+      end
+      assert_equal(1, seen)
+      assert_raise(ArgumentError) do
+        Dvector.each_chunk(StringIO.new(text), 'rows' => 0) { }
+      end
+    end
+
     def test_compute_formula
       v = Dvector[1,2,3]
       w = Dvector[3,2,1]
@@ -901,6 +1118,248 @@ EOT
       # not perfectly precise.
     end
 
+    def test_fast_compute_formula
+      v = Dvector[1.5, -2, 3, 0.25]
+      w = Dvector[3, 2, -1, 4]
+      for f in ["-column[0] ** 2 + column[1] % 2.5",
+                "atan2(column[0], column[1]) * PI / E",
+                "log(column[0], 2) + sqrt(column[1]) - 2 ** column[1]",
+                "(column[0] - 1) * (1_0.5e-1 + column[ 1 ]) / 3"]
+        fast = Dvector.fast_compute_formula(f, [v, w])
+        slow = Dvector.compute_formula(f, [v, w], [Math])
+        fast.each_index do |i|
+          if slow[i].nan?
+            assert(fast[i].nan?)
+          else
+            assert_in_delta(slow[i], fast[i], 1e-12)
+          end
+        end
+      end
+      # These can't be compiled, but still work
+      for f in ["1/2 + column[0]", "column[0].abs", "3 ** 2 * column[0]"]
+        assert_nil(Dvector.fast_compute_formula(f, [v, w]))
+      end
+      assert_equal(Dvector[1.5, -2, 3, 0.25],
+                   Dvector.compute_formula("1/2 + column[0]", [v, w]))
+      assert_equal(Dvector[1.5, 2, 3, 0.25],
+                   Dvector.compute_formula("column[0].abs", [v, w]))
+    end
+
+    def test_lazy
+      x = Dvector[10, 20, 30]
+      y = Dvector[1, 2, 3]
+      z = Dvector[0.5, 0.5, 0.5]
+      l = (x.lazy - y - z).log10
+      assert_kind_of(LazyDvector, l)
+      assert_equal((x - y - z).log10, l.to_dvector)
+      assert_equal(x * 2 + 1, (2 * x.lazy + 1).to_dvector)
+      assert_equal(x ** 2 - y * x, (x.lazy ** 2 - y.lazy * x).to_dvector)
+      assert_equal(y.neg.abs.inv.exp10, (-y.lazy).abs.inv.exp10.to_dvector)
+      assert_equal(x.atan2(y), x.lazy.atan2(y).force)
+      # the same modulo as Dvector's, including for large quotients
+      a = Dvector[1e17 + 3, 1e300, 5.5, -5.5, -7.25, 0.3]
+      b = Dvector[0.7, 3.3, -2, 2, -0.5, 0.1]
+      assert_equal(a % b, (a.lazy % b).to_dvector)
+      assert_equal(a.modulo(b).abs, a.lazy.mod(b).abs.to_dvector)
+      assert_equal(a % b, Dvector.compute_formula(
+                     "floor_mod(column[0], column[1])", [a, b], [Comparable]))
+      assert_equal(a.abs, Dvector.compute_formula("fabs(column[0])", [a],
+                                                  [Comparable]))
+      # the columns are shared
+      assert_equal(2, (x.lazy * y + y.lazy * x).vectors.size)
+      # used as a Dvector
+      assert_equal(60, (x.lazy * 2).max)
+      assert_equal(Dvector[11, 22, 33], y + x.lazy)
+      # computed with the current values
+      x[0] = 0
+      assert_equal(Dvector[-1, 18, 27], (l = x.lazy - y).to_dvector)
+      x[0] = 10
+      assert_equal(Dvector[9, 18, 27], l.to_dvector)
+    end
+
+    # The simple operations have their own vectorized loops, which must
+    # agree element by element with the plain arithmetic (and handle
+    # lengths that are not a multiple of the vector size)
+    def assert_same_values(expected, got)
+      assert_equal(expected.size, got.size)
+      expected.each_index do |i|
+        if expected[i].nan?
+          assert(got[i].nan?, "element #{i}: #{got[i]} instead of NaN")
+        else
+          assert_equal(expected[i], got[i], "element #{i}")
+        end
+      end
+    end
+
+    def test_kernels
+      inf = 1.0/0.0
+      a = [0.0, -0.0, 1e-300, -1e-300, 3.7, -3.7, 1e300, inf, -inf, 0.0/0.0]
+      37.times { |i| a << (i - 18) * 0.37 }
+      x = Dvector[*a]
+      y = Dvector[*a.reverse]
+      assert_same_values(a.map { |v| -v }, x.neg.to_a)
+      assert_same_values(a.map { |v| v.abs }, x.abs.to_a)
+      assert_same_values(a.map { |v| 1.0/v }, x.inv.to_a)
+      assert_same_values(a.map { |v| v.floor.to_f rescue v }, x.floor.to_a)
+      assert_same_values(a.map { |v| v.ceil.to_f rescue v }, x.ceil.to_a)
+      assert_same_values(a.map { |v| Math.sqrt(v > 0 ? v : 0.0) }, 
+                         x.safe_sqrt.to_a)
+      assert_same_values(a.map { |v| v < 0 ? 0.0/0.0 : Math.sqrt(v) }, 
+                         x.sqrt.to_a)
+      assert_same_values(a.map { |v| v + 2.5 }, (x + 2.5).to_a)
+      assert_same_values(a.map { |v| v * 2.5 }, (x * 2.5).to_a)
+      assert_same_values(a.map { |v| v / 2.5 }, (x / 2.5).to_a)
+      assert_same_values(a.map { |v| v - 2.5 * (v/2.5).floor rescue 0.0/0.0 },
+                         (x % 2.5).to_a)
+      assert_same_values(a.map { |v| v.abs < 0.5 ? 0.0 : v }, 
+                         x.trim(0.5).to_a)
+      assert_same_values(a.map { |v| v.abs >= 1e-2 ? 1/v : 
+                           (v > 0 ? 1e2 : -1e2) }, x.safe_inv(1e-2).to_a)
+      b = a.reverse
+      assert_same_values(a.zip(b).map { |u, v| u - v }, (x - y).to_a)
+      assert_same_values(a.zip(b).map { |u, v| u * v }, (x * y).to_a)
+      assert_same_values(a.zip(b).map { |u, v| u / v }, (x / y).to_a)
+    end
+
+    def test_num_threads
+      threshold = Dobjects.parallel_threshold
+      Dobjects.parallel_threshold = 100
+      x = Dvector.new(1001) { |i| Math.sin(i) * 10 }
+      x[3] = 0.0/0.0
+      y = x.reverse
+      w = Dvector.new(1001) { |i| 1.0/(i + 1) }
+      one = Dobjects.with_num_threads(1) do
+        [x.log10, x.exp, x * y, x % 0.3, x.safe_inv(0.1), w.dot(w), 
+         x.min, x.max, x.bounds, Dvector.min_of_many([x, y])]
+      end
+      Dobjects.num_threads = 4
+      assert_equal(4, Dobjects.num_threads)
+      assert_equal(1, Dobjects.with_num_threads(1) { Dobjects.num_threads })
+      assert_equal(4, Dobjects.num_threads)
+      four = [x.log10, x.exp, x * y, x % 0.3, x.safe_inv(0.1), w.dot(w), 
+              x.min, x.max, x.bounds, Dvector.min_of_many([x, y])]
+      # bitwise-identical element-wise operations
+      0.upto(4) do |i|
+        assert_equal(one[i].to_a.pack("G*"), four[i].to_a.pack("G*"))
+      end
+      assert_in_delta(one[5], four[5], 1e-10)
+      assert_equal(one[6..-1], four[6..-1])
+      # the first NaN wins, like in the plain loop
+      x[0] = 0.0/0.0
+      assert(x.max.nan?)
+      assert_raise(ArgumentError) { Dobjects.num_threads = 0 }
+    ensure
+      Dobjects.num_threads = 1
+      Dobjects.parallel_threshold = threshold
+    end
+
+    def test_mmap
+      Dir.mktmpdir do |dir|
+        file = File.join(dir, "data.bin")
+        File.open(file, "wb") do |f|
+          f.write("header!!")
+          f.write((0...1000).map { |i| i * 0.5 }.pack("E*"))
+        end
+        v = Dvector.mmap(file, :offset => 8)
+        assert_equal(1000, v.size)
+        assert_equal(Dvector[0, 0.5, 1], v[0..2])
+        assert_equal(499.5, v.max)
+        assert_equal(Dvector[1, 1.5], Dvector.mmap(file, :offset => 24, 
+                                                   :length => 2))
+        # copy on write
+        v.mul!(2)
+        assert_equal(1.0, v[1])
+        assert_equal(0.5, File.open(file, "rb") { |f| 
+                       f.seek(16); f.read(8).unpack("E").first })
+        # writing to the file
+        w = Dvector.mmap(file, :offset => 8, :writable => true)
+        w[1] = 42
+        w[2..3].add!(1)
+        w << 1                  # detaches w from the file
+        w[0] = 12
+        assert_equal([0, 42, 2, 2.5], 
+                     File.open(file, "rb") { |f| 
+                       f.seek(8); f.read(32).unpack("E*") })
+        # the copies and the Dvectors that changed length don't write to
+        # the file
+        w = Dvector.mmap(file, :offset => 8, :length => 3, :writable => true)
+        c = Dvector.new(w)
+        c.mul!(10)
+        w.dup.add!(1)
+        Dvector.new.replace(w[1..2]).add!(1)
+        assert_equal(Dvector[0, 42, 2], w)
+        w.shift
+        w.push(99)
+        w[0] = 7
+        w = Dvector.mmap(file, :offset => 8, :length => 3, :writable => true)
+        w.pop
+        w.push(99)
+        w.resize(1)
+        w.push(98)
+        assert_equal([0, 42, 2, 2.5],
+                     File.open(file, "rb") { |f|
+                       f.seek(8); f.read(32).unpack("E*") })
+        assert_equal(Dvector[0, 98], w)
+        # neither do the methods that remove entries
+        File.open(file, "wb") { |f| f.write([1, 2, 3, 4].pack("E*")) }
+        { lambda { |x| x.delete_at(0) } => [2, 3, 4],
+          lambda { |x| x.slice!(0, 2) } => [3, 4],
+          lambda { |x| x.slice!(1..2).add!(10) } => [1, 4],
+          lambda { |x| x.delete(2.0) } => [1, 3, 4],
+          lambda { |x| x.reject! { |y| y == 1 } } => [2, 3, 4],
+          lambda { |x| x.delete_if { |y| y > 2 } } => [1, 2],
+          lambda { |x| x.prune!([1]) } => [1, 3, 4],
+          lambda { |x| x.uniq! } => [1, 2, 3, 4],
+          lambda { |x| x.pop; x.push(7) } => [1, 2, 3, 7],
+          lambda { |x| x.clear } => [] }.each do |meth, expected|
+          w = Dvector.mmap(file, :writable => true)
+          meth.call(w)
+          assert_equal(Dvector[*expected], w)
+          assert_equal([1, 2, 3, 4], 
+                       File.open(file, "rb") { |f| f.read.unpack("E*") })
+        end
+        assert_raise(ArgumentError) { Dvector.mmap(file, :offset => 3) }
+        assert_raise(ArgumentError) { Dvector.mmap(file, :length => 1002) }
+        v = w = nil
+        GC.start
+      end
+    end
+
+    def test_binary
+      x = Dvector.new(1000) { |i| i * 0.25 }
+      y = x.sin
+      y[3] = 0.0/0.0
+      assert_equal(x, Dvector.from_binary(x.to_binary))
+      assert_equal(x.to_a.pack("E*"), x.to_binary)
+      Dir.mktmpdir do |dir|
+        file = File.join(dir, "data.dob")
+        Dvector.write_binary(file, {"x" => x, "y" => y, :z => [1, 2]}, 
+                             :compress => ["y"])
+        header = Dvector.read_binary_header(file)
+        assert_equal(["x", "y", "z"], header.map { |e| e['name'] })
+        assert_equal([false, true, false], 
+                     header.map { |e| e['compressed'] })
+        assert_equal([0, 0, 0], header.map { |e| e['offset'] % 64 })
+        cols = Dvector.read_binary(file)
+        assert_equal(["x", "y", "z"], cols.keys)
+        assert_equal(x, cols["x"])
+        assert_equal(y.to_binary, cols["y"].to_binary)
+        assert_equal(Dvector[1, 2], cols["z"])
+        # only some columns
+        cols = Dvector.read_binary(file, :cols => ["z", 0], :mmap => true)
+        assert_equal(["z", "x"], cols.keys)
+        assert_equal(x, cols["x"])
+        assert_equal(x, Dvector.mmap(file, :offset => header[0]['offset'], 
+                                     :length => 1000))
+        assert_raise(ArgumentError) { Dvector.read_binary(file, 
+                                                          :cols => ["w"]) }
+        # plain arrays of Dvectors
+        Dvector.write_binary(file, [y, x], :compress => true)
+        assert_equal(["0", "1"], Dvector.read_binary(file).keys)
+        assert_equal(x, Dvector.read_binary(file, :cols => 1)["1"])
+      end
+    end
+
     def test_dirtyness
       v = Dvector.new(10)
       assert(! v.dirty?)
@@ -916,6 +1375,13 @@ EOT
       s = Marshal.dump(v)
       v_bis = Marshal.restore(s)
       assert_equal(v, v_bis)
+      assert_equal([2, "l".ord, 3].pack("CCQ<") + v.to_binary, v._dump(-1))
+      # the version 1 dumps, with a 4-byte length
+      assert_equal(v, Dvector._load([1, 3].pack("CV") + v.to_binary))
+      assert_equal(Dvector[], Dvector._load([2, "l".ord, 0].pack("CCQ<")))
+      assert_raise(RuntimeError) { Dvector._load(v._dump(-1)[0..-2]) }
+      assert_raise(RuntimeError) { Dvector._load([1, 4].pack("CV") + 
+                                                 v.to_binary) }
     end
 
     NB_NUMBERS = 10000
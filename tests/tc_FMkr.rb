@@ -3,6 +3,8 @@
 require 'Tioga/tioga'
 
 require 'test/unit'
+require 'tmpdir'
+require 'zlib'
 
 class MyPlots
   
@@ -140,6 +142,389 @@ class TestFMkr < Test::Unit::TestCase
       assert_equal(b['biniou'], 0)
     end
 
+    # Returns the uncompressed content stream of a PDF file
+    def content_stream(file)
+      pdf = File.open(file, "rb") { |f| f.read }
+      Zlib::Inflate.inflate(pdf[/stream\r?\n(.*?)endstream/m, 1])
+    end
+
+    # Returns the path construction operators of the content stream of
+    # a figure made with the given cull_points_threshold.
+    def path_operators(xs, ys, threshold, decimate = false)
+      t = Tioga::FigureMaker.new
+      t.decimate_polylines = decimate
+      t.def_figure("cull") do
+        t.cull_points_threshold = threshold
+        t.show_plot([0, 1, 1, -1]) { t.show_polyline(xs, ys) }
+      end
+      Dir.mktmpdir do |dir|
+        t.save_dir = dir
+        t.create_figure_temp_files(0)
+        stream = content_stream("#{dir}/cull_figure.pdf")
+        return stream.split("\n").grep(/ [ml]$/)
+      end
+    end
+
+    def test_cull_points
+      n = 50000
+      xs = Dobjects::Dvector.new(n) { |i| i.to_f / n }
+      ys = xs.map { |x| Math.sin(x * 10) }
+      full = path_operators(xs, ys, -1)
+      culled = path_operators(xs, ys, 1000)
+      # the frame, then the polyline
+      assert(full.size > n)
+      assert(culled.size < full.size / 5)
+      assert_equal(full.first, culled.first)
+      assert_equal(full.last, culled.last)
+      # culled points are a subset of the original ones
+      assert_equal([], culled - full)
+      # below the threshold, nothing changes
+      assert_equal(full, path_operators(xs, ys, n + 1))
+    end
+
+    def test_decimate_polylines
+      n = 50000
+      xs = Dobjects::Dvector.new(n) { |i| i.to_f / n }
+      ys = xs.map { |x| Math.sin(x * 1000) }
+      full = path_operators(xs, ys, -1)
+      decimated = path_operators(xs, ys, -1, true)
+      columns = full.map { |op| op.split.first }.uniq.size
+      assert(decimated.size <= 4 * columns + 5)
+      assert_equal(full.first, decimated.first)
+      assert_equal(full.last, decimated.last)
+      # decimated points are a subset of the original ones
+      assert_equal([], decimated - full)
+    end
+
+    # Returns the PDF file of a figure with rotated markers at the given
+    # points, made with the given marker_xobject_threshold and rendering
+    # mode.
+    def rotated_markers_pdf(xs, ys, threshold,
+                            mode = Tioga::FigureConstants::FILL)
+      t = Tioga::FigureMaker.new
+      t.def_figure("markers") do
+        t.marker_xobject_threshold = threshold
+        t.show_plot([0, 1, 1, -1]) do
+          t.show_marker('Xs' => xs, 'Ys' => ys, 'angle' => 30, 'mode' => mode,
+                        'marker' => Tioga::FigureConstants::Bullet)
+        end
+      end
+      Dir.mktmpdir do |dir|
+        t.save_dir = dir
+        t.create_figure_temp_files(0)
+        return File.open("#{dir}/markers_figure.pdf", "rb") { |f| f.read }
+      end
+    end
+
+    def test_marker_xobjects
+      n = 5000
+      xs = Dobjects::Dvector.new(n) { |i| i.to_f / n }
+      ys = xs.map { |x| Math.sin(x * 10) }
+      plain = rotated_markers_pdf(xs, ys, -1)
+      stamped = rotated_markers_pdf(xs, ys, 1000)
+      assert(stamped.size < plain.size / 2)
+      assert_equal(1, stamped.scan(/\/Subtype \/Form\b/).size)
+      form = stamped[/\/Subtype \/Form.*?endstream/m]
+      e, f = form[/(\S+ \S+) Tm/, 1].split.map { |v| v.to_f }
+      # the markers end up at the same place
+      tms = Zlib::Inflate.inflate(plain[/stream\r?\n(.*?)endstream/m, 1]).
+        scan(/(\S+) (\S+) Tm/)
+      x = y = 0.0
+      Zlib::Inflate.inflate(stamped[/stream\r?\n(.*?)endstream/m, 1]).
+        scan(/^1 0 0 1 (\S+) (\S+) cm \/XObj\d+ Do$/).each_with_index do |d, i|
+        x += d[0].to_f; y += d[1].to_f
+        assert_in_delta(tms[i][0].to_f, x + e, 1e-4)
+        assert_in_delta(tms[i][1].to_f, y + f, 1e-4)
+      end
+      assert_equal(n, tms.size)
+      # below the threshold, nothing changes
+      assert_equal(plain.sub(/\/CreationDate.*/, ''),
+                   rotated_markers_pdf(xs, ys, n + 1).sub(/\/CreationDate.*/, ''))
+      # the clipping modes are always written inline, as the clipping path
+      # would not survive the XObject
+      clipped = rotated_markers_pdf(xs, ys, 1000,
+                                    Tioga::FigureConstants::FILL_AND_CLIP)
+      assert_equal(0, clipped.scan(/\/Subtype \/Form\b/).size)
+      assert_equal(n, Zlib::Inflate.inflate(clipped[/stream\r?\n(.*?)endstream/m, 1]).
+                   scan(/ Tm/).size)
+    end
+
+    def test_independent_figure_makers
+      bullet = Tioga::FigureConstants::Bullet
+      xs = Dobjects::Dvector.new(100) { |i| i.to_f / 100 }
+      t1, t2 = Tioga::FigureMaker.new, Tioga::FigureMaker.new
+      [[t1, 1.0], [t2, 2.0]].each do |t, phase|
+        t.def_figure("fig") do
+          t.show_plot([0, 1, 1, -1]) do
+            t.show_polyline(xs, xs.map { |x| Math.sin(x * 10 + phase) })
+            t.show_marker('Xs' => xs, 'Ys' => xs, 'marker' => bullet)
+          end
+        end
+      end
+      Dir.mktmpdir do |dir|
+        separate = [t1, t2].map do |t|
+          t.save_dir = dir
+          t.create_figure_temp_files(0)
+          content_stream("#{dir}/fig_figure.pdf")
+        end
+        # makes the second figure while the first one is being written
+        t1.def_figure("outer") do
+          t1.show_plot([0, 1, 1, -1]) do
+            t1.show_polyline(xs, xs.map { |x| Math.sin(x * 10 + 1.0) })
+            t2.create_figure_temp_files(0)
+            t1.show_marker('Xs' => xs, 'Ys' => xs, 'marker' => bullet)
+          end
+        end
+        t1.create_figure_temp_files(t1.figure_index("outer"))
+        assert_equal(separate[0], content_stream("#{dir}/outer_figure.pdf"))
+        assert_equal(separate[1], content_stream("#{dir}/fig_figure.pdf"))
+      end
+    end
+
+    def test_concurrent_figure_makers
+      bullet = Tioga::FigureConstants::Bullet
+      xs = Dobjects::Dvector.new(100) { |i| i.to_f / 100 }
+      # Each figure gives way to the other threads in the middle
+      make = lambda do |dir, phase|
+        Dir.mkdir(dir)
+        t = Tioga::FigureMaker.new
+        t.save_dir = dir
+        t.def_figure("fig") do
+          t.show_plot([0, 1, 1, -1]) do
+            t.show_polyline(xs, xs.map { |x| Math.sin(x * 10 + phase) })
+            Thread.pass
+            t.show_text('text' => "phase #{phase}", 'at' => [0.5, 0.5])
+            Thread.pass
+            t.show_marker('Xs' => xs, 'Ys' => xs.map { |x| x * phase },
+                          'marker' => bullet)
+          end
+        end
+        t.create_figure_temp_files(0)
+        [content_stream("#{dir}/fig_figure.pdf"),
+         File.read("#{dir}/fig_figure.txt")]
+      end
+      Dir.mktmpdir do |dir|
+        phases = [1.0, 2.0, 3.0, 4.0]
+        serial = phases.map { |phase| make.call("#{dir}/#{phase}", phase) }
+        3.times do |round|
+          threads = phases.map do |phase|
+            Thread.new { make.call("#{dir}/#{round}-#{phase}", phase) }
+          end
+          assert_equal(serial, threads.map { |thr| thr.value })
+        end
+      end
+    end
+
+    # Runs the block with a fake pdflatex in _dir_ that makes an empty
+    # PDF after running the given shell commands, and logs the names
+    # of the figures in pdflatex.runs.
+    def with_fake_pdflatex(dir, commands = [])
+      fake = "#{dir}/fake_pdflatex"
+      File.open(fake, "w") do |f|
+        f.puts "#!/bin/sh"
+        f.puts "name=`basename $3 .tex`"
+        f.puts commands
+        f.puts "echo $name >> pdflatex.runs"
+        f.puts "touch $name.pdf"
+      end
+      File.chmod(0755, fake)
+      old_pdflatex = Tioga::FigureMaker.pdflatex
+      begin
+        Tioga::FigureMaker.pdflatex = fake
+        yield
+      ensure
+        Tioga::FigureMaker.pdflatex = old_pdflatex
+      end
+    end
+
+    # Returns the figures that went through the fake pdflatex since
+    # the last call
+    def pdflatex_runs(dir)
+      file = "#{dir}/pdflatex.runs"
+      return [] unless File.exist?(file)
+      runs = File.readlines(file).map {|l| l.chomp}
+      File.delete(file)
+      return runs.sort
+    end
+
+    def test_parallel_pdflatex
+      Dir.mktmpdir do |dir|
+        # Slower for the first figures. The runs share color_names.aux,
+        # which must stay until all of them are done.
+        with_fake_pdflatex(dir, ["touch color_names.aux",
+                                 "sleep `expr 3 - ${name#fig} / 2`",
+                                 "test -f color_names.aux || " +
+                                 "echo $name >> aux.missing"]) do
+          cwd = Dir.pwd
+          t = Tioga::FigureMaker.new
+          t.save_dir = dir
+          t.max_parallel_pdflatex = 3
+          6.times do |i|
+            t.def_figure("fig#{i}") { t.show_plot([0, 1, 1, 0]) { } }
+          end
+          start = Time.now
+          t.make_all
+          # 2 rounds of at most 3 seconds instead of 12 seconds
+          assert(Time.now - start < 8)
+          assert_equal(cwd, Dir.pwd)
+          6.times do |i|
+            assert_equal("#{dir}/fig#{i}.pdf", t.figure_pdfs[i])
+            assert(File.exist?("#{dir}/fig#{i}.pdf"))
+            assert(! File.exist?("#{dir}/fig#{i}_pdflatex.log"))
+          end
+          assert(! File.exist?("#{dir}/aux.missing"))
+          assert(! File.exist?("#{dir}/color_names.aux"))
+        end
+      end
+    end
+
+    def test_cache_pdfs
+      Dir.mktmpdir do |dir|
+        with_fake_pdflatex(dir) do
+          y = 0.5
+          make = lambda do
+            t = Tioga::FigureMaker.new
+            t.save_dir = dir
+            t.cache_pdfs = true
+            t.def_figure("a") { t.show_plot([0, 1, 1, 0]) { } }
+            t.def_figure("b") do
+              t.show_plot([0, 1, 1, 0]) { t.show_polyline([0, 1], [y, y]) }
+            end
+            t.make_all
+            assert_equal("#{dir}/b.pdf", t.figure_pdfs[1])
+            assert(File.exist?("#{dir}/b.pdf"))
+          end
+          make.call
+          assert_equal(["a", "b"], pdflatex_runs(dir))
+          make.call
+          assert_equal([], pdflatex_runs(dir))
+          y = 0.7
+          make.call
+          assert_equal(["b"], pdflatex_runs(dir))
+        end
+      end
+    end
+
+    def test_multipage_pdf
+      Dir.mktmpdir do |dir|
+        with_fake_pdflatex(dir) do
+          t = Tioga::FigureMaker.new
+          t.save_dir = dir
+          t.autocleanup = false
+          bullet = Tioga::FigureConstants::Bullet
+          3.times do |i|
+            t.def_figure("f#{i}") do
+              t.show_plot([0, 1, 1, 0]) do
+                t.show_marker('x' => 0.5, 'y' => 0.5, 'marker' => bullet)
+                t.axial_shading('start_point' => [0, 0], 'end_point' => [1, 1],
+                                'colormap' => t.mellow_colormap)
+              end
+            end
+          end
+          assert_equal("#{dir}/doc.pdf", t.make_multipage_pdf("doc"))
+          assert_equal(["doc"], pdflatex_runs(dir))
+          pdf = File.open("#{dir}/doc_figure.pdf", "rb") { |f| f.read }
+          assert_equal(3, pdf.scan(/\/Type \/Page\n/).size)
+          assert_match(/\/Count 3\b/, pdf)
+          assert_equal(1, pdf.scan(/\/Type \/Font\b/).size)
+          assert_equal(1, pdf.scan(/\/ShadingType 2\b/).size)
+          # The cross-reference table points at the right objects
+          xref = pdf[pdf.rindex("\nxref\n") + 1..-1].split("\n")
+          count = xref[1].split[1].to_i
+          (1...count).each do |i|
+            offset = xref[2 + i].split[0].to_i
+            assert_match(/\A#{i} 0 obj/, pdf[offset, 20]) if offset > 0
+          end
+          tex = File.read("#{dir}/doc.tex")
+          assert_equal(3, tex.scan(/\\tiogasetfigurepage\{doc\}/).size)
+        end
+      end
+    end
+
+    def test_cache_measures
+      Dir.mktmpdir do |dir|
+        # Measures all the texts as 10pt x 5pt
+        measure = ["for m in `sed -n 's/.*tiogameasure{\\([^}]*\\)}.*/\\1/p' " +
+                   "${name}_figure.txt`; do",
+                   "  echo \"$m[0]=10.0pt\"; echo \"$m[1]=5.0pt\"",
+                   "  echo \"$m[2]=0.0pt\"",
+                   "done"]
+        with_fake_pdflatex(dir, measure) do
+          widths = []
+          make = lambda do
+            t = Tioga::FigureMaker.new
+            t.save_dir = dir
+            t.cache_measures = true
+            t.def_figure("m") do
+              t.show_plot([0, 1, 1, 0]) do
+                t.show_text('text' => 'label', 'at' => [0.5, 0.5],
+                            'measure' => 'label')
+                widths << t.get_text_size('label')['width']
+              end
+            end
+            t.make_pdf("m")
+          end
+          make.call
+          assert_equal(["m", "m"], pdflatex_runs(dir))
+          assert_equal(nil, widths[0])
+          assert(widths[1] > 9)
+          width = widths.last
+          widths.clear
+          # The size is known from the start on the next run
+          make.call
+          assert_equal(["m"], pdflatex_runs(dir))
+          assert_equal([width], widths)
+
+          # Two figures with the same measure name but different texts
+          known = []
+          two = lambda do
+            t = Tioga::FigureMaker.new
+            t.save_dir = dir
+            t.cache_measures = true
+            ["a", "b"].each do |name|
+              t.def_figure(name) do
+                t.show_plot([0, 1, 1, 0]) do
+                  t.show_text('text' => "label #{name}", 'at' => [0.5, 0.5],
+                              'measure' => 'label')
+                  known << name if t.get_text_size('label')['width']
+                end
+              end
+            end
+            t.make_all
+          end
+          two.call
+          pdflatex_runs(dir)
+          known.clear
+          # Both sizes are known from the start
+          two.call
+          assert_equal(["a", "b"], known)
+        end
+      end
+    end
+
+    def test_measures_without_cache
+      Dir.mktmpdir do |dir|
+        measure = ["for m in `sed -n 's/.*tiogameasure{\\([^}]*\\)}.*/\\1/p' " +
+                   "${name}_figure.txt`; do",
+                   "  echo \"$m[0]=10.0pt\"; echo \"$m[1]=5.0pt\"",
+                   "  echo \"$m[2]=0.0pt\"",
+                   "done"]
+        with_fake_pdflatex(dir, measure) do
+          t = Tioga::FigureMaker.new
+          t.save_dir = dir
+          t.def_figure("m") do
+            t.show_plot([0, 1, 1, 0]) do
+              t.show_text('text' => 'label', 'at' => [0.5, 0.5],
+                          'measure' => 'label')
+            end
+          end
+          # The measures of the previous run are already known
+          runs = Array.new(3) { t.make_pdf("m"); pdflatex_runs(dir).size }
+          assert_equal([2, 1, 1], runs)
+        end
+      end
+    end
+
     def test_hls_to_rgb
       t = Tioga::FigureMaker.default
       rgb_old = [0.1, 0.1, 1.0]